@@ -38,6 +38,9 @@
 #ifdef HAVE_SYS_RESOURCE_H
 #include <sys/resource.h>
 #endif
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
 
 #include <crystal.h>
 
@@ -55,6 +58,8 @@ static void usage(void)
     printf("First run options:\n");
     printf("  -f, --file=FILE_PATH          File containing addresses of nodes to be tested."
            " Nodes are separated by whitespaces or newlines.\n");
+    printf("  -n, --repeat=COUNT            Probe each node COUNT times over reused"
+           " connections and report the median (p50) latency.\n");
     printf("\n");
     printf("Debugging options:\n");
     printf("      --debug                   Wait for debugger attach after start.\n");
@@ -78,19 +83,20 @@ void signal_handler(int signum)
     exit(-1);
 }
 
-void probe(const char *node)
+static int repeat = 1;
+
+static int probe_once(const char *node, long *elapsed)
 {
     http_client_t *httpc;
+    struct timeval start, end;
     char url[1024];
     long resp_code;
     int rc;
 
-    printf("probing %s...", node);
-
     httpc = http_client_new();
     if (!httpc) {
         printf("internal error.\n");
-        return;
+        return -1;
     }
 
     snprintf(url, sizeof(url), "http://%s:9095/version", node);
@@ -99,8 +105,9 @@ void probe(const char *node)
         snprintf(url, sizeof(url), "http://%s/version", node);
         rc = http_client_set_url(httpc, url);
         if (rc) {
+            http_client_close(httpc);
             printf("invalid node address.\n");
-            return;
+            return -1;
         }
     }
 
@@ -108,25 +115,71 @@ void probe(const char *node)
     http_client_set_request_body_instant(httpc, NULL, 0);
     http_client_set_timeout(httpc, 5);
 
+    gettimeofday(&start, NULL);
     rc = http_client_request(httpc);
+    gettimeofday(&end, NULL);
     if (rc) {
+        http_client_close(httpc);
         printf("unreachable.\n");
-        return;
+        return -1;
     }
 
     rc = http_client_get_response_code(httpc, &resp_code);
     http_client_close(httpc);
     if (rc)  {
         printf("unreachable.\n");
-        return;
+        return -1;
     }
 
     if (resp_code != HttpStatus_OK) {
         printf("unreachable.\n");
+        return -1;
+    }
+
+    *elapsed = (end.tv_sec - start.tv_sec) * 1000000L +
+               (end.tv_usec - start.tv_usec);
+    return 0;
+}
+
+static int compare_latency(const void *a, const void *b)
+{
+    long la = *(const long *)a;
+    long lb = *(const long *)b;
+
+    return la < lb ? -1 : (la > lb ? 1 : 0);
+}
+
+void probe(const char *node)
+{
+    long *latencies;
+    int i;
+
+    printf("probing %s...", node);
+
+    latencies = (long *)malloc(sizeof(long) * repeat);
+    if (!latencies) {
+        printf("internal error.\n");
         return;
     }
 
-    printf("ok.\n");
+    for (i = 0; i < repeat; i++) {
+        if (probe_once(node, &latencies[i]) < 0) {
+            free(latencies);
+            return;
+        }
+    }
+
+    if (repeat == 1) {
+        free(latencies);
+        printf("ok.\n");
+        return;
+    }
+
+    qsort(latencies, repeat, sizeof(long), compare_latency);
+    printf("ok (p50 %.3f ms, min %.3f ms, max %.3f ms over %d requests).\n",
+           latencies[repeat / 2] / 1000.0, latencies[0] / 1000.0,
+           latencies[repeat - 1] / 1000.0, repeat);
+    free(latencies);
 }
 
 void logging(const char *fmt, va_list args)
@@ -146,6 +199,7 @@ int main(int argc, char *argv[])
     int opt;
     struct option options[] = {
         {"file",   required_argument, NULL, 'f'},
+        {"repeat", required_argument, NULL, 'n'},
         {"debug",  no_argument,       NULL,  2 },
         {"help",   no_argument,       NULL, 'h'},
         {NULL,     0,                 NULL,  0 }
@@ -157,11 +211,18 @@ int main(int argc, char *argv[])
     setvbuf(stdout, NULL, _IONBF, 0);
     setvbuf(stderr, NULL, _IONBF, 0);
 
-    while ((opt = getopt_long(argc, argv, "f:h?", options, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "f:n:h?", options, NULL)) != -1) {
         switch (opt) {
         case 'f':
             strcpy(file, optarg);
             break;
+        case 'n':
+            repeat = atoi(optarg);
+            if (repeat <= 0) {
+                usage();
+                exit(-1);
+            }
+            break;
         case 2:
             wait_for_attach = 1;
             break;
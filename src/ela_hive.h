@@ -90,7 +90,7 @@ enum HiveDriveType {
 
     /**
      * \~English
-     * OwnCloud(not implemented).
+     * OwnCloud, or any server speaking WebDAV.
      */
     HiveDriveType_ownCloud  = 0x51,
 
@@ -277,6 +277,39 @@ typedef struct OneDriveOptions {
      * The redirect URL through which the client gets the authorization code.
      */
     const char *redirect_url;
+
+    /**
+     * \~English
+     * The size in bytes of each fragment of a file upload, rounded down to
+     * a multiple of 320 KiB and capped at 60 MiB. The default value is
+     * 10 MiB if 0 given.
+     */
+    size_t upload_fragment_size;
+
+    /**
+     * \~English
+     * The maximum count of fragments of one file upload in flight at the
+     * same time. The default value is 4 if 0 given, and 1 uploads the
+     * fragments one after another.
+     */
+    unsigned int upload_parallelism;
+
+    /**
+     * \~English
+     * The time in seconds a local index of the drive metadata is trusted
+     * after being refreshed. The index is populated through the delta
+     * api and refreshed incrementally, so file stats and listings are
+     * answered locally most of the time. The index is disabled if 0 given.
+     */
+    unsigned int metadata_cache_ttl;
+
+    /**
+     * \~English
+     * The time in seconds before the access token expires that it gets
+     * renewed in the background, so requests seldom wait for a token
+     * refresh. The default value is 300 seconds if 0 given.
+     */
+    unsigned int token_refresh_margin;
 } OneDriveOptions;
 
 /**
@@ -304,6 +337,37 @@ typedef struct HiveRpcNode {
     const char *port;
 } HiveRpcNode;
 
+/**
+ * \~English
+ * Policies deciding when mutations on an IPFS drive get published to IPNS.
+ */
+typedef enum IPFSPublishPolicy {
+    /**
+     * \~English
+     * Publish right after every mutation.
+     */
+    IPFSPublishPolicy_Immediate = 0,
+    /**
+     * \~English
+     * Publish file writes when the file is committed or closed. Drive
+     * level mutations are published right away.
+     */
+    IPFSPublishPolicy_OnCommit  = 1,
+    /**
+     * \~English
+     * Publish once no further mutation happened for publish_interval
+     * milliseconds, and at the latest 10 times publish_interval after
+     * the first mutation not published yet.
+     */
+    IPFSPublishPolicy_Debounce  = 2,
+    /**
+     * \~English
+     * Publish only when hive_drive_flush() is called or the client is
+     * closed.
+     */
+    IPFSPublishPolicy_Manual    = 3
+} IPFSPublishPolicy;
+
 /**
  * \~English
  * The IPFS client options.
@@ -329,8 +393,97 @@ typedef struct IPFSOptions {
      * The array of addresses of IPFS RPC nodes.
      */
     HiveRpcNode *rpcNodes;
+
+    /**
+     * The policy to publish mutations to IPNS. Pending mutations are always
+     * published when the client is closed.
+     */
+    IPFSPublishPolicy publish_policy;
+
+    /**
+     * The quiet period in milliseconds for IPFSPublishPolicy_Debounce.
+     * The default value is 1000 if 0 given.
+     */
+    unsigned int publish_interval;
+
+    /**
+     * The size in bytes of the write-back buffer of each opened file.
+     * Contiguous writes are merged into one request until the buffer is
+     * full, or the file is seeked, read, committed or closed. Write-back
+     * is disabled if 0 given.
+     */
+    size_t write_buffer_size;
+
+    /**
+     * The size in bytes of the in-memory cache for file content shared by
+     * all files of the client. Sequential reads are served by adaptive
+     * read-ahead through this cache. The cache is disabled if 0 given.
+     */
+    size_t read_cache_size;
+
+    /**
+     * The maximum count of concurrent files/read requests serving one
+     * large read. The default value is 4 if 0 given, and 1 disables
+     * parallel download.
+     */
+    unsigned int download_parallelism;
+
+    /**
+     * The size in bytes of each range of a parallel download. Reads of at
+     * least two ranges are downloaded in parallel. The default value is
+     * 1 MiB if 0 given.
+     */
+    size_t download_range_size;
+
+    /**
+     * The interval in seconds of the background health check of all RPC
+     * nodes. The monitor keeps the scores of the nodes fresh and keeps the
+     * best one besides the current node synchronized as standby, so that
+     * failing over to it does not stall the failed request. The monitor
+     * is disabled if 0 given.
+     */
+    unsigned int health_check_interval;
+
+    /**
+     * The time in seconds a synchronization result persisted in the
+     * persistent location stays valid. While valid, login and failover
+     * log onto the node with the cached root hash and skip resolving it
+     * through IPNS. The cache is disabled if 0 given.
+     */
+    unsigned int sync_cache_ttl;
 } IPFSOptions;
 
+/**
+ * \~English
+ * The ownCloud client options.
+ */
+typedef struct OwnCloudOptions {
+    /**
+     * \~English
+     * Common options.
+     */
+    HiveOptions base;
+
+    /**
+     * \~English
+     * The WebDAV root of the user files, such as
+     * "https://example.com/remote.php/webdav".
+     */
+    const char *url;
+
+    /**
+     * \~English
+     * The user name to authenticate with.
+     */
+    const char *username;
+
+    /**
+     * \~English
+     * The password, or app password, of the user.
+     */
+    const char *password;
+} OwnCloudOptions;
+
 /**
  * \~English
  * A structure representing the hive client associated user's information.
@@ -401,6 +554,74 @@ typedef struct HiveFileInfo {
     size_t size;
 } HiveFileInfo;
 
+/**
+ * \~English
+ * Hive drive operations that can be carried in a batch.
+ */
+typedef enum HiveBatchOpType {
+    /**
+     * \~English
+     * Get status of the file at path into info.
+     */
+    HiveBatchOp_Stat   = 0,
+    /**
+     * \~English
+     * Create a directory at path.
+     */
+    HiveBatchOp_Mkdir  = 1,
+    /**
+     * \~English
+     * Move the file at path to target.
+     */
+    HiveBatchOp_Move   = 2,
+    /**
+     * \~English
+     * Copy the file at path to target.
+     */
+    HiveBatchOp_Copy   = 3,
+    /**
+     * \~English
+     * Delete the file at path.
+     */
+    HiveBatchOp_Delete = 4
+} HiveBatchOpType;
+
+/**
+ * \~English
+ * A structure representing one operation of a batch on hive drive.
+ */
+typedef struct HiveBatchRequest {
+    /**
+     * \~English
+     * The operation to carry out.
+     */
+    HiveBatchOpType op;
+    /**
+     * \~English
+     * The absolute path of the file the operation applies to.
+     */
+    const char *path;
+    /**
+     * \~English
+     * The absolute destination path of HiveBatchOp_Move and
+     * HiveBatchOp_Copy. Ignored by other operations.
+     */
+    const char *target;
+    /**
+     * \~English
+     * The HiveFileInfo pointer to receive the status of HiveBatchOp_Stat.
+     * Ignored by other operations.
+     */
+    HiveFileInfo *info;
+    /**
+     * \~English
+     * The outcome of the operation, filled in by hive_drive_batch(): 0 on
+     * success, or the error code hive_get_error() would have returned if
+     * the operation had been called on its own.
+     */
+    int result;
+} HiveBatchRequest;
+
 /******************************************************************************
  * Client APIs
  *****************************************************************************/
@@ -736,6 +957,26 @@ int hive_drive_copy_file(HiveDrive *drive, const char *src, const char *dest);
 HIVE_API
 int hive_drive_delete_file(HiveDrive *drive, const char *path);
 
+/**
+ * \~English
+ * Make all the mutations done on drive so far durable on the backend.
+ *
+ * It only matters for drives deferring part of their work, such as IPFS
+ * drive with a publish policy other than IPFSPublishPolicy_Immediate.
+ * For the others it returns immediately. An IPFS drive fails with
+ * HIVEERR_WRONG_STATE once if unpublished mutations were lost because
+ * their node failed before they could be published.
+ *
+ * @param
+ *      drive      [in] A handle identifying the Hive drive instance.
+ *
+ * @return
+ *      If no error occurs, return 0. Otherwise, return -1, and a specific
+ *      error code can be retrieved by calling hive_get_error().
+ */
+HIVE_API
+int hive_drive_flush(HiveDrive *drive);
+
 /**
  * \~English
  * Get status of the file specified by path in drive. The result is
@@ -760,6 +1001,37 @@ HIVE_API
 int hive_drive_file_stat(HiveDrive *drive, const char *path,
                          HiveFileInfo *file_info);
 
+/**
+ * \~English
+ * Carry out a set of stat, mkdir, move, copy and delete operations on
+ * drive in one call.
+ *
+ * Drives able to combine operations into one round trip, such as
+ * OneDrive, do so; for the others the operations are simply carried out
+ * one after another. The operations are independent of each other and
+ * may be carried out in any order, so none of them should depend on the
+ * outcome of another one in the same batch.
+ *
+ * This function is effective only when state of client generating drive is
+ * "logined".
+ *
+ * @param
+ *      drive      [in] A handle identifying the Hive drive instance.
+ * @param
+ *      requests   [in] An array of operations. The result of each entry
+ *                      is filled in on return.
+ * @param
+ *      count      [in] The number of entries in requests.
+ *
+ * @return
+ *      If all operations succeed, return 0. Otherwise, return -1, and a
+ *      specific error code can be retrieved by calling hive_get_error().
+ *      The result of each request tells which ones failed.
+ */
+HIVE_API
+int hive_drive_batch(HiveDrive *drive, HiveBatchRequest *requests,
+                     size_t count);
+
 /******************************************************************************
  * File APIs
  *****************************************************************************/
@@ -794,6 +1066,9 @@ HiveFile *hive_file_open(HiveDrive *drive, const char *path, const char *mode);
  * As long as the file instance is closed, it becomes invalid. And calling
  * any function related invalid drive instance would be undefined.
  *
+ * The file instance is closed even if an error is returned, which happens
+ * when data still buffered by the file could not be written back.
+ *
  * @param
  *      file      [in] A handle identifying the Hive file instance.
  *
@@ -926,6 +1201,298 @@ int hive_file_commit(HiveFile *file);
 HIVE_API
 int hive_file_discard(HiveFile *file);
 
+/******************************************************************************
+ * Asynchronous APIs
+ *****************************************************************************/
+
+/**
+ * \~English
+ * An application-defined function that receives the result of an
+ * asynchronous operation.
+ *
+ * Completion callbacks are never invoked from inside the call submitting
+ * the operation. They run on the thread calling
+ * hive_client_process_completions(), one call per submitted operation.
+ * Operations still outstanding when the client is closed are aborted, and
+ * hive_client_close() invokes their callbacks, with an error for aborted
+ * requests, before it returns. Operations that cannot be interrupted, such
+ * as local file I/O, invoke their callbacks on the thread finishing them.
+ *
+ * @param
+ *      result      [in] The non-negative result of the operation (number of
+ *                       bytes for read and write, 0 for the others), or a
+ *                       negative error code of the same form returned by
+ *                       hive_get_error().
+ * @param
+ *      context     [in] The application-defined context data.
+ */
+typedef void HiveCompletionCallback(int result, void *context);
+
+/**
+ * \~English
+ * Get a file descriptor that becomes readable whenever completed
+ * asynchronous operations of the client are waiting to be processed.
+ *
+ * The descriptor can be added to an application's own poll/epoll loop.
+ * It is owned by the client and must not be read or closed by the
+ * application; call hive_client_process_completions() once it becomes
+ * readable.
+ *
+ * @param
+ *      client      [in] A handle identifying the Hive client instance.
+ *
+ * @return
+ *      If no error occurs, return the file descriptor. Otherwise, return -1,
+ *      and a specific error code can be retrieved by calling hive_get_error().
+ */
+HIVE_API
+int hive_client_get_completion_fd(HiveClient *client);
+
+/**
+ * \~English
+ * Invoke the completion callbacks of all asynchronous operations of the
+ * client that have completed so far, on the calling thread.
+ *
+ * @param
+ *      client      [in] A handle identifying the Hive client instance.
+ *
+ * @return
+ *      If no error occurs, return the number of callbacks invoked.
+ *      Otherwise, return -1, and a specific error code can be retrieved by
+ *      calling hive_get_error().
+ */
+HIVE_API
+int hive_client_process_completions(HiveClient *client);
+
+/**
+ * \~English
+ * Asynchronous version of hive_drive_file_stat().
+ *
+ * file_info must stay valid until callback is invoked.
+ *
+ * @param
+ *      drive      [in] A handle identifying the Hive drive instance.
+ * @param
+ *      path       [in] The absolute path to a file in drive.
+ * @param
+ *      file_info  [in] The HiveFileInfo pointer to receive the file
+ *                      information.
+ * @param
+ *      callback   [in] The function to receive the result.
+ * @param
+ *      context    [in] The application defined context data.
+ *
+ * @return
+ *      If the operation is submitted, return 0, and callback would be
+ *      invoked exactly once later. Otherwise, return -1, and a specific
+ *      error code can be retrieved by calling hive_get_error().
+ */
+HIVE_API
+int hive_drive_file_stat_async(HiveDrive *drive, const char *path,
+                               HiveFileInfo *file_info,
+                               HiveCompletionCallback *callback, void *context);
+
+/**
+ * \~English
+ * Asynchronous version of hive_drive_list_files().
+ *
+ * The iterate function is invoked for each file info right before
+ * callback, on the thread processing completions.
+ *
+ * @param
+ *      drive      [in] A handle identifying the Hive drive instance.
+ * @param
+ *      path       [in] The absolute path to a directory list its file infos.
+ * @param
+ *      iterate    [in] An application-defined function to iterate each
+ *                      file info under directory.
+ * @param
+ *      callback   [in] The function to receive the result.
+ * @param
+ *      context    [in] The application defined context data passed to both
+ *                      iterate and callback.
+ *
+ * @return
+ *      If the operation is submitted, return 0, and callback would be
+ *      invoked exactly once later. Otherwise, return -1, and a specific
+ *      error code can be retrieved by calling hive_get_error().
+ */
+HIVE_API
+int hive_drive_list_files_async(HiveDrive *drive, const char *path,
+                                HiveFilesIterateCallback *iterate,
+                                HiveCompletionCallback *callback, void *context);
+
+/**
+ * \~English
+ * Asynchronous version of hive_drive_mkdir().
+ *
+ * @param
+ *      drive      [in] A handle identifying the Hive drive instance.
+ * @param
+ *      path       [in] The absolute path to a directory in drive.
+ * @param
+ *      callback   [in] The function to receive the result.
+ * @param
+ *      context    [in] The application defined context data.
+ *
+ * @return
+ *      If the operation is submitted, return 0, and callback would be
+ *      invoked exactly once later. Otherwise, return -1, and a specific
+ *      error code can be retrieved by calling hive_get_error().
+ */
+HIVE_API
+int hive_drive_mkdir_async(HiveDrive *drive, const char *path,
+                           HiveCompletionCallback *callback, void *context);
+
+/**
+ * \~English
+ * Asynchronous version of hive_drive_move_file().
+ *
+ * @param
+ *      drive      [in] A handle identifying the Hive drive instance.
+ * @param
+ *      old        [in] The absolute path of file that would be moved.
+ * @param
+ *      new        [in] The absolute path that a file would move to.
+ * @param
+ *      callback   [in] The function to receive the result.
+ * @param
+ *      context    [in] The application defined context data.
+ *
+ * @return
+ *      If the operation is submitted, return 0, and callback would be
+ *      invoked exactly once later. Otherwise, return -1, and a specific
+ *      error code can be retrieved by calling hive_get_error().
+ */
+HIVE_API
+int hive_drive_move_file_async(HiveDrive *drive, const char *old, const char *new,
+                               HiveCompletionCallback *callback, void *context);
+
+/**
+ * \~English
+ * Asynchronous version of hive_drive_copy_file().
+ *
+ * @param
+ *      drive      [in] A handle identifying the Hive drive instance.
+ * @param
+ *      src        [in] The absolute path of file that would be copied.
+ * @param
+ *      dest       [in] The absolute path that a file would copy to.
+ * @param
+ *      callback   [in] The function to receive the result.
+ * @param
+ *      context    [in] The application defined context data.
+ *
+ * @return
+ *      If the operation is submitted, return 0, and callback would be
+ *      invoked exactly once later. Otherwise, return -1, and a specific
+ *      error code can be retrieved by calling hive_get_error().
+ */
+HIVE_API
+int hive_drive_copy_file_async(HiveDrive *drive, const char *src, const char *dest,
+                               HiveCompletionCallback *callback, void *context);
+
+/**
+ * \~English
+ * Asynchronous version of hive_drive_delete_file().
+ *
+ * @param
+ *      drive      [in] A handle identifying the Hive drive instance.
+ * @param
+ *      path       [in] The absolute path to a file in drive.
+ * @param
+ *      callback   [in] The function to receive the result.
+ * @param
+ *      context    [in] The application defined context data.
+ *
+ * @return
+ *      If the operation is submitted, return 0, and callback would be
+ *      invoked exactly once later. Otherwise, return -1, and a specific
+ *      error code can be retrieved by calling hive_get_error().
+ */
+HIVE_API
+int hive_drive_delete_file_async(HiveDrive *drive, const char *path,
+                                 HiveCompletionCallback *callback, void *context);
+
+/**
+ * \~English
+ * Asynchronous version of hive_file_read().
+ *
+ * buf must stay valid until callback is invoked, and no other operation
+ * should be issued on the same file in the meantime.
+ *
+ * @param
+ *      file       [in] A handle identifying the Hive file instance.
+ * @param
+ *      buf        [in] Buffer to hold data.
+ * @param
+ *      bufsz      [in] Length of data to be read.
+ * @param
+ *      callback   [in] The function to receive the length of data
+ *                      actually read.
+ * @param
+ *      context    [in] The application defined context data.
+ *
+ * @return
+ *      If the operation is submitted, return 0, and callback would be
+ *      invoked exactly once later. Otherwise, return -1, and a specific
+ *      error code can be retrieved by calling hive_get_error().
+ */
+HIVE_API
+int hive_file_read_async(HiveFile *file, char *buf, size_t bufsz,
+                         HiveCompletionCallback *callback, void *context);
+
+/**
+ * \~English
+ * Asynchronous version of hive_file_write().
+ *
+ * buf must stay valid until callback is invoked, and no other operation
+ * should be issued on the same file in the meantime.
+ *
+ * @param
+ *      file       [in] A handle identifying the Hive file instance.
+ * @param
+ *      buf        [in] Buffer to hold data.
+ * @param
+ *      bufsz      [in] Length of data to be written.
+ * @param
+ *      callback   [in] The function to receive the length of data
+ *                      actually written.
+ * @param
+ *      context    [in] The application defined context data.
+ *
+ * @return
+ *      If the operation is submitted, return 0, and callback would be
+ *      invoked exactly once later. Otherwise, return -1, and a specific
+ *      error code can be retrieved by calling hive_get_error().
+ */
+HIVE_API
+int hive_file_write_async(HiveFile *file, const char *buf, size_t bufsz,
+                          HiveCompletionCallback *callback, void *context);
+
+/**
+ * \~English
+ * Asynchronous version of hive_file_commit().
+ *
+ * No other operation should be issued on the same file until callback is
+ * invoked.
+ *
+ * @param
+ *      file       [in] A handle identifying the Hive file instance.
+ * @param
+ *      callback   [in] The function to receive the result.
+ * @param
+ *      context    [in] The application defined context data.
+ *
+ * @return
+ *      If the operation is submitted, return 0, and callback would be
+ *      invoked exactly once later. Otherwise, return -1, and a specific
+ *      error code can be retrieved by calling hive_get_error().
+ */
+HIVE_API
+int hive_file_commit_async(HiveFile *file,
+                           HiveCompletionCallback *callback, void *context);
+
 /******************************************************************************
  * Error handling
  *****************************************************************************/
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2019 Elastos Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "hashmap.h"
+
+typedef struct hashmap_entry hashmap_entry_t;
+
+struct hashmap_entry {
+    hashmap_entry_t *next;
+    uint32_t hash;
+    void *value;
+    size_t keylen;
+    char key[0];
+};
+
+struct hashmap {
+    hashmap_entry_t **buckets;
+    size_t nbuckets;
+    size_t size;
+};
+
+static uint32_t hash_key(const void *key, size_t keylen)
+{
+    const unsigned char *p = (const unsigned char *)key;
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < keylen; i++) {
+        hash ^= p[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+hashmap_t *hashmap_new(size_t capacity)
+{
+    hashmap_t *map;
+    size_t nbuckets = 16;
+
+    while (nbuckets < capacity)
+        nbuckets <<= 1;
+
+    map = calloc(1, sizeof(*map));
+    if (!map)
+        return NULL;
+
+    map->buckets = calloc(nbuckets, sizeof(hashmap_entry_t *));
+    if (!map->buckets) {
+        free(map);
+        return NULL;
+    }
+
+    map->nbuckets = nbuckets;
+    return map;
+}
+
+void hashmap_free(hashmap_t *map)
+{
+    hashmap_entry_t *entry;
+    size_t i;
+
+    if (!map)
+        return;
+
+    for (i = 0; i < map->nbuckets; i++) {
+        while ((entry = map->buckets[i]) != NULL) {
+            map->buckets[i] = entry->next;
+            free(entry);
+        }
+    }
+
+    free(map->buckets);
+    free(map);
+}
+
+size_t hashmap_size(hashmap_t *map)
+{
+    return map->size;
+}
+
+static hashmap_entry_t **lookup(hashmap_t *map, uint32_t hash,
+                                const void *key, size_t keylen)
+{
+    hashmap_entry_t **pos = &map->buckets[hash & (map->nbuckets - 1)];
+
+    for (; *pos; pos = &(*pos)->next) {
+        if ((*pos)->hash == hash && (*pos)->keylen == keylen &&
+            !memcmp((*pos)->key, key, keylen))
+            break;
+    }
+
+    return pos;
+}
+
+static void grow(hashmap_t *map)
+{
+    hashmap_entry_t **buckets;
+    hashmap_entry_t *entry;
+    size_t nbuckets = map->nbuckets << 1;
+    size_t i;
+
+    // Keep the current table if the bigger one can not be allocated.
+    buckets = calloc(nbuckets, sizeof(hashmap_entry_t *));
+    if (!buckets)
+        return;
+
+    for (i = 0; i < map->nbuckets; i++) {
+        while ((entry = map->buckets[i]) != NULL) {
+            map->buckets[i] = entry->next;
+            entry->next = buckets[entry->hash & (nbuckets - 1)];
+            buckets[entry->hash & (nbuckets - 1)] = entry;
+        }
+    }
+
+    free(map->buckets);
+    map->buckets  = buckets;
+    map->nbuckets = nbuckets;
+}
+
+void *hashmap_get(hashmap_t *map, const void *key, size_t keylen)
+{
+    hashmap_entry_t *entry;
+
+    entry = *lookup(map, hash_key(key, keylen), key, keylen);
+    return entry ? entry->value : NULL;
+}
+
+int hashmap_put(hashmap_t *map, const void *key, size_t keylen, void *value,
+                void **old)
+{
+    uint32_t hash = hash_key(key, keylen);
+    hashmap_entry_t **pos;
+    hashmap_entry_t *entry;
+
+    pos = lookup(map, hash, key, keylen);
+    if (*pos) {
+        if (old)
+            *old = (*pos)->value;
+        (*pos)->value = value;
+        return 0;
+    }
+
+    entry = malloc(sizeof(*entry) + keylen);
+    if (!entry)
+        return -1;
+
+    entry->hash   = hash;
+    entry->value  = value;
+    entry->keylen = keylen;
+    memcpy(entry->key, key, keylen);
+
+    entry->next = *pos;
+    *pos = entry;
+
+    if (old)
+        *old = NULL;
+
+    if (++map->size > map->nbuckets - map->nbuckets / 4)
+        grow(map);
+
+    return 0;
+}
+
+void *hashmap_remove(hashmap_t *map, const void *key, size_t keylen)
+{
+    hashmap_entry_t **pos;
+    hashmap_entry_t *entry;
+    void *value;
+
+    pos = lookup(map, hash_key(key, keylen), key, keylen);
+    entry = *pos;
+    if (!entry)
+        return NULL;
+
+    *pos = entry->next;
+    value = entry->value;
+    free(entry);
+    map->size--;
+
+    return value;
+}
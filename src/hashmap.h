@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2019 Elastos Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __HASHMAP_H__
+#define __HASHMAP_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+typedef struct hashmap hashmap_t;
+
+/*
+ * A plain chained hash map with binary keys. Keys are copied into the map,
+ * values are borrowed; neither the map nor its operations are thread safe.
+ */
+hashmap_t *hashmap_new(size_t capacity);
+void hashmap_free(hashmap_t *map);
+
+size_t hashmap_size(hashmap_t *map);
+
+void *hashmap_get(hashmap_t *map, const void *key, size_t keylen);
+
+/*
+ * Returns 0 on success or -1 if out of memory. An existing value with the
+ * same key is replaced, and returned through old if given.
+ */
+int hashmap_put(hashmap_t *map, const void *key, size_t keylen, void *value,
+                void **old);
+
+void *hashmap_remove(hashmap_t *map, const void *key, size_t keylen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __HASHMAP_H__
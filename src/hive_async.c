@@ -0,0 +1,329 @@
+/*
+ * Copyright (c) 2019 Elastos Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <fcntl.h>
+#endif
+
+#include <crystal.h>
+
+#include "hive_async.h"
+#include "hive_error.h"
+
+struct hive_async {
+    pthread_mutex_t lock;
+    hive_async_op_t *head;
+    hive_async_op_t *tail;
+#if !defined(_WIN32) && !defined(_WIN64)
+    int fds[2];
+#endif
+
+    http_engine_t *engine;
+    pthread_t engine_thread;
+    volatile bool engine_stopping;
+    bool closed;
+    bool bypass_queue;
+};
+
+static void *engine_routine(void *arg)
+{
+    hive_async_t *async = (hive_async_t *)arg;
+
+    while (!async->engine_stopping)
+        http_engine_perform(async->engine, 1000);
+
+    return NULL;
+}
+
+http_engine_t *hive_async_get_engine(hive_async_t *async)
+{
+    http_engine_t *engine;
+    int rc;
+
+    assert(async);
+
+    pthread_mutex_lock(&async->lock);
+    if (async->closed) {
+        pthread_mutex_unlock(&async->lock);
+        vlogE("Async: completion queue already closed.");
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_WRONG_STATE));
+        return NULL;
+    }
+
+    if (async->engine) {
+        engine = async->engine;
+        pthread_mutex_unlock(&async->lock);
+        return engine;
+    }
+
+    engine = http_engine_new();
+    if (!engine) {
+        pthread_mutex_unlock(&async->lock);
+        vlogE("Async: failed to create http engine.");
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY));
+        return NULL;
+    }
+
+    async->engine = engine;
+    async->engine_stopping = false;
+    rc = pthread_create(&async->engine_thread, NULL, engine_routine, async);
+    if (rc != 0) {
+        async->engine = NULL;
+        pthread_mutex_unlock(&async->lock);
+        http_engine_close(engine);
+        vlogE("Async: failed to start engine thread (%d).", rc);
+        hive_set_error(HIVE_SYS_ERROR(rc));
+        return NULL;
+    }
+    pthread_mutex_unlock(&async->lock);
+
+    return engine;
+}
+
+static void dispatch_op(hive_async_op_t *op)
+{
+    op->next = NULL;
+    if (op->deliver && op->result >= 0)
+        op->deliver(op);
+    op->callback(op->result, op->context);
+    deref(op);
+}
+
+static void hive_async_destroy(void *obj)
+{
+    hive_async_t *async = (hive_async_t *)obj;
+
+#if !defined(_WIN32) && !defined(_WIN64)
+    if (async->fds[0] >= 0)
+        close(async->fds[0]);
+    if (async->fds[1] >= 0)
+        close(async->fds[1]);
+#endif
+
+    pthread_mutex_destroy(&async->lock);
+}
+
+hive_async_t *hive_async_new(void)
+{
+    hive_async_t *async;
+
+    async = (hive_async_t *)rc_zalloc(sizeof(hive_async_t), hive_async_destroy);
+    if (!async)
+        return NULL;
+
+    pthread_mutex_init(&async->lock, NULL);
+#if !defined(_WIN32) && !defined(_WIN64)
+    async->fds[0] = -1;
+    async->fds[1] = -1;
+#endif
+
+    return async;
+}
+
+void hive_async_close(hive_async_t *async)
+{
+    hive_async_op_t *op;
+    http_engine_t *engine;
+
+    if (!async)
+        return;
+
+    pthread_mutex_lock(&async->lock);
+    async->closed = true;
+    engine = async->engine;
+    pthread_mutex_unlock(&async->lock);
+
+    if (engine) {
+        async->engine_stopping = true;
+        http_engine_wakeup(engine);
+        pthread_join(async->engine_thread, NULL);
+    }
+
+    /*
+     * From now on operations are handed to their callbacks as soon as they
+     * complete. Deliver what is already queued first, then abort the
+     * requests still in flight, whose operations complete with an error
+     * right on this thread.
+     */
+    pthread_mutex_lock(&async->lock);
+    async->bypass_queue = true;
+    op = async->head;
+    async->head = NULL;
+    async->tail = NULL;
+    pthread_mutex_unlock(&async->lock);
+
+    while (op) {
+        hive_async_op_t *next = op->next;
+        dispatch_op(op);
+        op = next;
+    }
+
+    if (engine) {
+        async->engine = NULL;
+        http_engine_close(engine);
+    }
+
+    deref(async);
+}
+
+int hive_async_get_fd(hive_async_t *async)
+{
+#if !defined(_WIN32) && !defined(_WIN64)
+    int fd;
+
+    assert(async);
+
+    pthread_mutex_lock(&async->lock);
+    if (async->fds[0] < 0) {
+        if (pipe(async->fds) < 0) {
+            int err = errno;
+            async->fds[0] = -1;
+            async->fds[1] = -1;
+            pthread_mutex_unlock(&async->lock);
+            vlogE("Async: failed to create completion pipe (%d).", err);
+            return HIVE_SYS_ERROR(err);
+        }
+
+        fcntl(async->fds[0], F_SETFL, fcntl(async->fds[0], F_GETFL) | O_NONBLOCK);
+        fcntl(async->fds[1], F_SETFL, fcntl(async->fds[1], F_GETFL) | O_NONBLOCK);
+        fcntl(async->fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(async->fds[1], F_SETFD, FD_CLOEXEC);
+
+        if (async->head) {
+            char c = 0;
+            if (write(async->fds[1], &c, 1) < 0)
+                vlogW("Async: failed to signal completion pipe (%d).", errno);
+        }
+    }
+    fd = async->fds[0];
+    pthread_mutex_unlock(&async->lock);
+
+    return fd;
+#else
+    (void)async;
+    return HIVE_GENERAL_ERROR(HIVEERR_NOT_SUPPORTED);
+#endif
+}
+
+bool hive_async_is_closed(hive_async_t *async)
+{
+    bool closed;
+
+    assert(async);
+
+    pthread_mutex_lock(&async->lock);
+    closed = async->closed;
+    pthread_mutex_unlock(&async->lock);
+
+    return closed;
+}
+
+int hive_async_dispatch(hive_async_t *async)
+{
+    hive_async_op_t *op;
+    int count = 0;
+
+    assert(async);
+
+    pthread_mutex_lock(&async->lock);
+    op = async->head;
+    async->head = NULL;
+    async->tail = NULL;
+#if !defined(_WIN32) && !defined(_WIN64)
+    if (async->fds[0] >= 0) {
+        char drain[64];
+        while (read(async->fds[0], drain, sizeof(drain)) > 0) ;
+    }
+#endif
+    pthread_mutex_unlock(&async->lock);
+
+    while (op) {
+        hive_async_op_t *next = op->next;
+
+        dispatch_op(op);
+
+        op = next;
+        count++;
+    }
+
+    return count;
+}
+
+void *hive_async_op_new(size_t size, HiveCompletionCallback *callback,
+                        void *context, void (*destructor)(void *))
+{
+    hive_async_op_t *op;
+
+    assert(size >= sizeof(hive_async_op_t));
+    assert(callback);
+
+    op = (hive_async_op_t *)rc_zalloc(size, destructor);
+    if (!op)
+        return NULL;
+
+    op->callback = callback;
+    op->context  = context;
+
+    return op;
+}
+
+void hive_async_op_complete(hive_async_t *async, hive_async_op_t *op,
+                            int result)
+{
+    assert(async);
+    assert(op);
+
+    op->result = result;
+    op->next   = NULL;
+
+    pthread_mutex_lock(&async->lock);
+    if (async->bypass_queue) {
+        pthread_mutex_unlock(&async->lock);
+        dispatch_op(op);
+        return;
+    }
+
+    if (async->tail)
+        async->tail->next = op;
+    else
+        async->head = op;
+    async->tail = op;
+
+#if !defined(_WIN32) && !defined(_WIN64)
+    if (async->fds[1] >= 0 && async->head == op) {
+        char c = 0;
+        if (write(async->fds[1], &c, 1) < 0)
+            vlogW("Async: failed to signal completion pipe (%d).", errno);
+    }
+#endif
+    pthread_mutex_unlock(&async->lock);
+}
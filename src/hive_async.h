@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2019 Elastos Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef __HIVE_ASYNC_H__
+#define __HIVE_ASYNC_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "ela_hive.h"
+#include "http_client.h"
+
+typedef struct hive_async hive_async_t;
+typedef struct hive_async_op hive_async_op_t;
+
+/*
+ * Base of every asynchronous operation. Vendors embed it as the first
+ * member of their operation context, allocate the context with
+ * hive_async_op_new() and hand it back through hive_async_op_complete()
+ * exactly once. The optional deliver hook runs on the thread dispatching
+ * completions right before the application callback, and only on success.
+ */
+struct hive_async_op {
+    HiveCompletionCallback *callback;
+    void *context;
+    int result;
+    void (*deliver)(hive_async_op_t *op);
+    hive_async_op_t *next;
+};
+
+hive_async_t *hive_async_new(void);
+void hive_async_close(hive_async_t *async);
+
+int hive_async_get_fd(hive_async_t *async);
+bool hive_async_is_closed(hive_async_t *async);
+int hive_async_dispatch(hive_async_t *async);
+
+/*
+ * The engine driving the asynchronous requests of one client. It runs on
+ * its own thread, which is started on first use and stopped when the
+ * client is closed. Closing the queue dispatches the operations already
+ * completed, aborts the requests still in flight and hands every operation
+ * completing afterwards straight to its callback on the completing thread.
+ */
+http_engine_t *hive_async_get_engine(hive_async_t *async);
+
+void *hive_async_op_new(size_t size, HiveCompletionCallback *callback,
+                        void *context, void (*destructor)(void *));
+void hive_async_op_complete(hive_async_t *async, hive_async_op_t *op,
+                            int result);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // __HIVE_ASYNC_H__
@@ -85,6 +85,18 @@ HiveClient *hive_client_new(const HiveOptions *options)
         return NULL;
     }
 
+    if (!client)
+        return NULL;
+
+    client->async = hive_async_new();
+    if (!client->async) {
+        vlogE("Client: failed to create completion queue.");
+        if (client->close)
+            client->close(client);
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY));
+        return NULL;
+    }
+
     return client;
 }
 
@@ -93,6 +105,11 @@ int hive_client_close(HiveClient *client)
     if (!client)
         return 0;
 
+    if (client->async) {
+        hive_async_close(client->async);
+        client->async = NULL;
+    }
+
     if (client->close)
         client->close(client);
 
@@ -238,5 +255,35 @@ HiveDrive *hive_drive_open(HiveClient *client)
         return NULL;
     }
 
+    drive->async = ref(client->async);
     return drive;
 }
+
+int hive_client_get_completion_fd(HiveClient *client)
+{
+    int rc;
+
+    if (!client || !client->async) {
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS));
+        return -1;
+    }
+
+    rc = hive_async_get_fd(client->async);
+    if (rc < 0) {
+        vlogE("Client: Failed to get completion fd.");
+        hive_set_error(rc);
+        return -1;
+    }
+
+    return rc;
+}
+
+int hive_client_process_completions(HiveClient *client)
+{
+    if (!client || !client->async) {
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS));
+        return -1;
+    }
+
+    return hive_async_dispatch(client->async);
+}
@@ -35,6 +35,7 @@ extern "C" {
 #endif
 
 #include "ela_hive.h"
+#include "hive_async.h"
 
 #define HIVE_F_RDONLY O_RDONLY
 #define HIVE_F_WRONLY O_WRONLY
@@ -56,6 +57,8 @@ struct HiveClient {
     int (*get_info)     (HiveClient *, HiveClientInfo *);
     int (*get_drive)    (HiveClient *, HiveDrive **);
     int (*close)        (HiveClient *);
+
+    hive_async_t *async;    // completion queue, owned by client.
 };
 
 struct HiveDrive {
@@ -68,6 +71,33 @@ struct HiveDrive {
     int (*delete_file)  (HiveDrive *, const char *path);
     int (*open_file)    (HiveDrive *, const char *path, int flags, HiveFile **);
     void (*close)       (HiveDrive *);
+    int (*flush)        (HiveDrive *);
+
+    /*
+     * Optional. Fills in the result of every request, and returns a
+     * negative code only when the batch could not be carried out at all.
+     * Drives without it get one call per request from the core.
+     */
+    int (*batch)        (HiveDrive *, HiveBatchRequest *, size_t count);
+
+    /*
+     * Optional asynchronous methods. Returning 0 means the operation was
+     * submitted and will be completed through hive_async_op_complete().
+     */
+    int (*stat_file_async)  (HiveDrive *, const char *path, HiveFileInfo *,
+                             HiveCompletionCallback *, void *);
+    int (*list_files_async) (HiveDrive *, const char *path, HiveFilesIterateCallback *,
+                             HiveCompletionCallback *, void *);
+    int (*make_dir_async)   (HiveDrive *, const char *path,
+                             HiveCompletionCallback *, void *);
+    int (*move_file_async)  (HiveDrive *, const char *from, const char *to,
+                             HiveCompletionCallback *, void *);
+    int (*copy_file_async)  (HiveDrive *, const char *from, const char *to,
+                             HiveCompletionCallback *, void *);
+    int (*delete_file_async)(HiveDrive *, const char *path,
+                             HiveCompletionCallback *, void *);
+
+    hive_async_t *async;    // referenced until the drive is closed.
 };
 
 struct HiveFile {
@@ -80,6 +110,14 @@ struct HiveFile {
     int     (*commit)   (HiveFile *);
     int     (*discard)  (HiveFile *);
     int     (*close)    (HiveFile *);
+
+    int (*read_async)   (HiveFile *, char *buf, size_t bufsz,
+                         HiveCompletionCallback *, void *);
+    int (*write_async)  (HiveFile *, const char *buf, size_t bufsz,
+                         HiveCompletionCallback *, void *);
+    int (*commit_async) (HiveFile *, HiveCompletionCallback *, void *);
+
+    hive_async_t *async;    // referenced until the file is closed.
 };
 
 /*
@@ -244,6 +244,135 @@ int hive_drive_delete_file(HiveDrive *drive, const char *path)
     return 0;
 }
 
+int hive_drive_flush(HiveDrive *drive)
+{
+    int rc;
+
+    if (!drive) {
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS));
+        return -1;
+    }
+
+    // Drives without deferred work have nothing to flush.
+    if (!drive->flush)
+        return 0;
+
+    rc = drive->flush(drive);
+    if (rc < 0) {
+        vlogE("Drive: Failed to flush drive.");
+        hive_set_error(rc);
+        return -1;
+    }
+
+    return 0;
+}
+
+static bool batch_request_is_valid(const HiveBatchRequest *request)
+{
+    if (!is_absolute_path(request->path))
+        return false;
+
+    switch (request->op) {
+    case HiveBatchOp_Stat:
+        return request->info != NULL;
+
+    case HiveBatchOp_Mkdir:
+    case HiveBatchOp_Delete:
+        return strcmp(request->path, "/") != 0;
+
+    // Same checks as hive_drive_move_file() and hive_drive_copy_file().
+    case HiveBatchOp_Move:
+        return is_absolute_path(request->target) &&
+               strcmp(request->path, "/") != 0 &&
+               strcmp(request->path, request->target) != 0;
+
+    case HiveBatchOp_Copy:
+        return is_absolute_path(request->target) &&
+               strcmp(request->path, "/") != 0 &&
+               strcmp(request->target, "/") != 0 &&
+               strcmp(request->path, request->target) != 0;
+
+    default:
+        return false;
+    }
+}
+
+static int batch_request_perform(HiveDrive *drive, HiveBatchRequest *request)
+{
+    switch (request->op) {
+    case HiveBatchOp_Stat:
+        if (drive->stat_file)
+            return drive->stat_file(drive, request->path, request->info);
+        break;
+
+    case HiveBatchOp_Mkdir:
+        if (drive->make_dir)
+            return drive->make_dir(drive, request->path);
+        break;
+
+    case HiveBatchOp_Move:
+        if (drive->move_file)
+            return drive->move_file(drive, request->path, request->target);
+        break;
+
+    case HiveBatchOp_Copy:
+        if (drive->copy_file)
+            return drive->copy_file(drive, request->path, request->target);
+        break;
+
+    case HiveBatchOp_Delete:
+        if (drive->delete_file)
+            return drive->delete_file(drive, request->path);
+        break;
+    }
+
+    return HIVE_GENERAL_ERROR(HIVEERR_NOT_SUPPORTED);
+}
+
+int hive_drive_batch(HiveDrive *drive, HiveBatchRequest *requests,
+                     size_t count)
+{
+    size_t i;
+    int rc;
+
+    if (!drive || !requests || !count) {
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS));
+        return -1;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (!batch_request_is_valid(&requests[i])) {
+            vlogE("Drive: invalid batch request at %zu.", i);
+            hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS));
+            return -1;
+        }
+        requests[i].result = 0;
+    }
+
+    if (drive->batch) {
+        rc = drive->batch(drive, requests, count);
+        if (rc < 0) {
+            vlogE("Drive: Failed to perform batch (%d).", rc);
+            hive_set_error(rc);
+            return -1;
+        }
+    } else {
+        // Drives without a batch endpoint get one call per request.
+        for (i = 0; i < count; i++)
+            requests[i].result = batch_request_perform(drive, &requests[i]);
+    }
+
+    for (i = 0; i < count; i++) {
+        if (requests[i].result < 0) {
+            vlogE("Drive: batch request %zu failed (%d).", i, requests[i].result);
+            hive_set_error(requests[i].result);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
 static int mode_to_flags(const char *mode, int *flags)
 {
     if (!mode)
@@ -308,14 +437,253 @@ HiveFile *hive_file_open(HiveDrive *drive, const char *path, const char *mode)
         return NULL;
     }
 
+    file->async = ref(drive->async);
     return file;
 }
 
 int hive_drive_close(HiveDrive *drive)
 {
+    hive_async_t *async;
+
     if (!drive)
         return 0;
 
+    // Ops still in flight hold references of their own.
+    async = drive->async;
     drive->close(drive);
+    if (async)
+        deref(async);
+
+    return 0;
+}
+
+int hive_drive_file_stat_async(HiveDrive *drive, const char *path,
+                               HiveFileInfo *info,
+                               HiveCompletionCallback *callback, void *context)
+{
+    int rc;
+
+    if (!drive || !info || !callback) {
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS));
+        return -1;
+    }
+
+    if (!is_absolute_path(path)) {
+        vlogE("Drive: path must be absolute.");
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS));
+        return -1;
+    }
+
+    if (!drive->stat_file_async || !drive->async) {
+        vlogE("Drive: drive type does not support this method.");
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_NOT_SUPPORTED));
+        return -1;
+    }
+
+    if (hive_async_is_closed(drive->async)) {
+        vlogE("Drive: client already closed.");
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_WRONG_STATE));
+        return -1;
+    }
+
+    rc = drive->stat_file_async(drive, path, info, callback, context);
+    if (rc < 0) {
+        vlogE("Drive: Failed to submit file status request.");
+        hive_set_error(rc);
+        return -1;
+    }
+
+    return 0;
+}
+
+int hive_drive_list_files_async(HiveDrive *drive, const char *path,
+                                HiveFilesIterateCallback *iterate,
+                                HiveCompletionCallback *callback, void *context)
+{
+    int rc;
+
+    if (!drive || !iterate || !callback) {
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS));
+        return -1;
+    }
+
+    if (!is_absolute_path(path)) {
+        vlogE("Drive: path must be absolute.");
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS));
+        return -1;
+    }
+
+    if (!drive->list_files_async || !drive->async) {
+        vlogE("Drive: drive type does not support this method.");
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_NOT_SUPPORTED));
+        return -1;
+    }
+
+    if (hive_async_is_closed(drive->async)) {
+        vlogE("Drive: client already closed.");
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_WRONG_STATE));
+        return -1;
+    }
+
+    rc = drive->list_files_async(drive, path, iterate, callback, context);
+    if (rc < 0) {
+        vlogE("Drive: Failed to submit list files request.");
+        hive_set_error(rc);
+        return -1;
+    }
+
+    return 0;
+}
+
+int hive_drive_mkdir_async(HiveDrive *drive, const char *path,
+                           HiveCompletionCallback *callback, void *context)
+{
+    int rc;
+
+    if (!drive || !callback) {
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS));
+        return -1;
+    }
+
+    if (!is_absolute_path(path) || strcmp(path, "/") == 0) {
+        vlogE("Drive: path must be absolute.");
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS));
+        return -1;
+    }
+
+    if (!drive->make_dir_async || !drive->async) {
+        vlogE("Drive: drive type does not support this method.");
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_NOT_SUPPORTED));
+        return -1;
+    }
+
+    if (hive_async_is_closed(drive->async)) {
+        vlogE("Drive: client already closed.");
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_WRONG_STATE));
+        return -1;
+    }
+
+    rc = drive->make_dir_async(drive, path, callback, context);
+    if (rc < 0) {
+        vlogE("Drive: Failed to submit make dir request.");
+        hive_set_error(rc);
+        return -1;
+    }
+
+    return 0;
+}
+
+int hive_drive_move_file_async(HiveDrive *drive, const char *from, const char *to,
+                               HiveCompletionCallback *callback, void *context)
+{
+    int rc;
+
+    if (!drive || !callback) {
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS));
+        return -1;
+    }
+
+    if (!is_absolute_path(from) || !is_absolute_path(to) ||
+        strcmp(from, "/") == 0  || strcmp(from, to) == 0) {
+        vlogE("Drive: path must be absolute.");
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS));
+        return -1;
+    }
+
+    if (!drive->move_file_async || !drive->async) {
+        vlogE("Drive: drive type does not support this method.");
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_NOT_SUPPORTED));
+        return -1;
+    }
+
+    if (hive_async_is_closed(drive->async)) {
+        vlogE("Drive: client already closed.");
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_WRONG_STATE));
+        return -1;
+    }
+
+    rc = drive->move_file_async(drive, from, to, callback, context);
+    if (rc < 0) {
+        vlogE("Drive: Failed to submit move file request.");
+        hive_set_error(rc);
+        return -1;
+    }
+
+    return 0;
+}
+
+int hive_drive_copy_file_async(HiveDrive *drive, const char *src, const char *dest,
+                               HiveCompletionCallback *callback, void *context)
+{
+    int rc;
+
+    if (!drive || !callback) {
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS));
+        return -1;
+    }
+
+    if (!is_absolute_path(src) || !is_absolute_path(dest) ||
+        strcmp(src, "/") == 0  || strcmp(dest, "/") == 0  ||
+        strcmp(src, dest) == 0) {
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS));
+        return -1;
+    }
+
+    if (!drive->copy_file_async || !drive->async) {
+        vlogE("Drive: drive type does not support this method.");
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_NOT_SUPPORTED));
+        return -1;
+    }
+
+    if (hive_async_is_closed(drive->async)) {
+        vlogE("Drive: client already closed.");
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_WRONG_STATE));
+        return -1;
+    }
+
+    rc = drive->copy_file_async(drive, src, dest, callback, context);
+    if (rc < 0) {
+        vlogE("Drive: Failed to submit copy file request.");
+        hive_set_error(rc);
+        return -1;
+    }
+
+    return 0;
+}
+
+int hive_drive_delete_file_async(HiveDrive *drive, const char *path,
+                                 HiveCompletionCallback *callback, void *context)
+{
+    int rc;
+
+    if (!drive || !callback) {
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS));
+        return -1;
+    }
+
+    if (!is_absolute_path(path) || strcmp(path, "/") == 0) {
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS));
+        return -1;
+    }
+
+    if (!drive->delete_file_async || !drive->async) {
+        vlogE("Drive: drive type does not support this method.");
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_NOT_SUPPORTED));
+        return -1;
+    }
+
+    if (hive_async_is_closed(drive->async)) {
+        vlogE("Drive: client already closed.");
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_WRONG_STATE));
+        return -1;
+    }
+
+    rc = drive->delete_file_async(drive, path, callback, context);
+    if (rc < 0) {
+        vlogE("Drive: Failed to submit delete file request.");
+        hive_set_error(rc);
+        return -1;
+    }
+
     return 0;
 }
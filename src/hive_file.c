@@ -107,10 +107,16 @@ int hive_file_close(HiveFile *file)
 {
     int rc;
 
+    hive_async_t *async;
+
     if (!file)
         return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
 
+    async = file->async;
     rc = file->close(file);
+    if (async)
+        deref(async);
+
     if (rc < 0) {
         vlogE("File: Failed to close file.");
         hive_set_error(rc);
@@ -173,3 +179,104 @@ int hive_file_discard(HiveFile *file)
 
     return rc;
 }
+
+int hive_file_read_async(HiveFile *file, char *buf, size_t bufsz,
+                         HiveCompletionCallback *callback, void *context)
+{
+    int rc;
+
+    if (!file || !buf || !bufsz || !callback ||
+        HIVE_F_IS_SET(file->flags, HIVE_F_WRONLY)) {
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS));
+        return -1;
+    }
+
+    if (!file->read_async || !file->async) {
+        vlogE("File: file type does not support this method.");
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_NOT_SUPPORTED));
+        return -1;
+    }
+
+    if (hive_async_is_closed(file->async)) {
+        vlogE("File: client already closed.");
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_WRONG_STATE));
+        return -1;
+    }
+
+    rc = file->read_async(file, buf, bufsz, callback, context);
+    if (rc < 0) {
+        vlogE("File: Failed to submit read request (%d).", rc);
+        hive_set_error(rc);
+        return -1;
+    }
+
+    return 0;
+}
+
+int hive_file_write_async(HiveFile *file, const char *buf, size_t bufsz,
+                          HiveCompletionCallback *callback, void *context)
+{
+    int rc;
+
+    if (!file || !buf || !bufsz || !callback ||
+        (!HIVE_F_IS_SET(file->flags, HIVE_F_WRONLY) &&
+         !HIVE_F_IS_SET(file->flags, HIVE_F_RDWR))) {
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS));
+        return -1;
+    }
+
+    if (!file->write_async || !file->async) {
+        vlogE("File: file type does not support this method.");
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_NOT_SUPPORTED));
+        return -1;
+    }
+
+    if (hive_async_is_closed(file->async)) {
+        vlogE("File: client already closed.");
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_WRONG_STATE));
+        return -1;
+    }
+
+    rc = file->write_async(file, buf, bufsz, callback, context);
+    if (rc < 0) {
+        vlogE("File: Failed to submit write request (%d).", rc);
+        hive_set_error(rc);
+        return -1;
+    }
+
+    return 0;
+}
+
+int hive_file_commit_async(HiveFile *file,
+                           HiveCompletionCallback *callback, void *context)
+{
+    int rc;
+
+    if (!file || !callback ||
+        (!HIVE_F_IS_SET(file->flags, HIVE_F_WRONLY) &&
+         !HIVE_F_IS_SET(file->flags, HIVE_F_RDWR))) {
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS));
+        return -1;
+    }
+
+    if (!file->commit_async || !file->async) {
+        vlogE("File: file type does not support this method.");
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_NOT_SUPPORTED));
+        return -1;
+    }
+
+    if (hive_async_is_closed(file->async)) {
+        vlogE("File: client already closed.");
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_WRONG_STATE));
+        return -1;
+    }
+
+    rc = file->commit_async(file, callback, context);
+    if (rc < 0) {
+        vlogE("File: Failed to submit commit request (%d).", rc);
+        hive_set_error(rc);
+        return -1;
+    }
+
+    return 0;
+}
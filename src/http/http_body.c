@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2019 Elastos Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "http_body.h"
+
+#define HTTP_BODY_MIN_SIZE      512
+#define HTTP_BODY_CLASSES       8
+#define HTTP_BODY_CACHE_DEPTH   4
+
+typedef struct body_buffer {
+    struct body_buffer *next;
+    size_t sz;
+} body_buffer_t;
+
+typedef struct body_cache {
+    body_buffer_t *free[HTTP_BODY_CLASSES];
+    int count[HTTP_BODY_CLASSES];
+} body_cache_t;
+
+static pthread_key_t body_cache_key;
+static bool initialized = false;
+
+static void body_cache_destroy(void *ptr)
+{
+    body_cache_t *cache = (body_cache_t *)ptr;
+    body_buffer_t *buf;
+    int i;
+
+    for (i = 0; i < HTTP_BODY_CLASSES; i++) {
+        while ((buf = cache->free[i]) != NULL) {
+            cache->free[i] = buf->next;
+            free(buf);
+        }
+    }
+
+    free(cache);
+}
+
+static body_cache_t *body_cache_get(bool create)
+{
+    body_cache_t *cache;
+
+    cache = (body_cache_t *)pthread_getspecific(body_cache_key);
+    if (!cache && create) {
+        cache = (body_cache_t *)calloc(1, sizeof(body_cache_t));
+        if (cache && pthread_setspecific(body_cache_key, cache) != 0) {
+            free(cache);
+            cache = NULL;
+        }
+    }
+
+    return cache;
+}
+
+static int body_class_of(size_t sz)
+{
+    size_t class_sz = HTTP_BODY_MIN_SIZE;
+    int i;
+
+    for (i = 0; i < HTTP_BODY_CLASSES; i++, class_sz <<= 1) {
+        if (sz <= class_sz)
+            return i;
+    }
+
+    return -1;
+}
+
+/*
+ * Until the pool is initialized, and after it is cleaned up, buffers go
+ * straight to and from the heap.
+ */
+int http_body_pool_init(void)
+{
+    if (initialized)
+        return 0;
+
+    if (pthread_key_create(&body_cache_key, body_cache_destroy) != 0)
+        return -1;
+
+    initialized = true;
+    return 0;
+}
+
+void http_body_pool_cleanup(void)
+{
+    body_cache_t *cache;
+
+    if (!initialized)
+        return;
+
+    cache = body_cache_get(false);
+    if (cache) {
+        pthread_setspecific(body_cache_key, NULL);
+        body_cache_destroy(cache);
+    }
+
+    pthread_key_delete(body_cache_key);
+    initialized = false;
+}
+
+char *http_body_buffer_get(size_t sz)
+{
+    body_buffer_t *buf;
+    int cls;
+
+    cls = body_class_of(sz);
+    if (cls >= 0) {
+        body_cache_t *cache = initialized ? body_cache_get(false) : NULL;
+
+        if (cache && cache->free[cls]) {
+            buf = cache->free[cls];
+            cache->free[cls] = buf->next;
+            cache->count[cls]--;
+            buf->next = NULL;
+            return (char *)(buf + 1);
+        }
+
+        sz = (size_t)HTTP_BODY_MIN_SIZE << cls;
+    }
+
+    if (sz > SIZE_MAX - sizeof(body_buffer_t))
+        return NULL;
+
+    buf = (body_buffer_t *)malloc(sizeof(body_buffer_t) + sz);
+    if (!buf)
+        return NULL;
+
+    buf->next = NULL;
+    buf->sz = sz;
+    return (char *)(buf + 1);
+}
+
+void http_body_buffer_put(char *data)
+{
+    body_buffer_t *buf = (body_buffer_t *)data - 1;
+    int cls;
+
+    cls = body_class_of(buf->sz);
+    if (cls >= 0 && initialized) {
+        body_cache_t *cache = body_cache_get(true);
+
+        if (cache && cache->count[cls] < HTTP_BODY_CACHE_DEPTH) {
+            buf->next = cache->free[cls];
+            cache->free[cls] = buf;
+            cache->count[cls]++;
+            return;
+        }
+    }
+
+    free(buf);
+}
+
+size_t http_body_buffer_size(const char *data)
+{
+    return ((const body_buffer_t *)data - 1)->sz;
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2019 Elastos Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __HTTP_BODY_H__
+#define __HTTP_BODY_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+/*
+ * Response bodies live in buffers of power-of-two size classes (512 bytes
+ * up to 64K) that are cached per thread, so that steady-state requests take
+ * and give back a buffer without touching the heap. Larger bodies use plain
+ * heap buffers. A small header in front of the data records the capacity,
+ * which lets a body be handed back with only its pointer.
+ */
+int http_body_pool_init(void);
+
+void http_body_pool_cleanup(void);
+
+/*
+ * Returns a buffer of at least sz bytes: the size of its class, or exactly
+ * sz when no class is large enough. NULL when out of memory.
+ */
+char *http_body_buffer_get(size_t sz);
+
+void http_body_buffer_put(char *data);
+
+size_t http_body_buffer_size(const char *data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __HTTP_BODY_H__
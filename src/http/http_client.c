@@ -21,19 +21,30 @@
  */
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <assert.h>
 #include <pthread.h>
 #include <stdbool.h>
+#include <errno.h>
 
 #ifdef HAVE_MALLOC_H
 #include <malloc.h>
 #endif
 
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <fcntl.h>
+#endif
+
 #include <curl/curl.h>
 #include <crystal.h>
 
 #include "http_client.h"
+#include "http_body.h"
 
 static long curl_http_versions[] = {
     CURL_HTTP_VERSION_NONE,
@@ -48,12 +59,68 @@ typedef struct http_response_body {
     void *data;
 } http_response_body_t;
 
+/*
+ * An immutable header list shared by many clients, e.g. the authorization
+ * header of an access token.
+ */
+struct http_header_list {
+    struct curl_slist *hdr;
+};
+
 struct http_client {
     CURL *curl;
     CURLU *url;
     struct curl_slist *hdr;
+    struct curl_slist *hdr_tail;
+    http_header_list_t *shared_hdr;
     curl_mime *mime;
     http_response_body_t response_body;
+    http_client_complete_callback_t complete_cb;
+    void *complete_userdata;
+    http_client_t *prev;
+    http_client_t *next;
+};
+
+/*
+ * An engine drives many requests at once on top of one curl multi handle.
+ * Requests may be submitted from any thread; they are picked up and their
+ * completion callbacks are invoked by whichever thread runs
+ * http_engine_perform().
+ */
+struct http_engine {
+    CURLM *multi;
+    pthread_mutex_t lock;
+    http_client_t *pending;
+    http_client_t *pending_tail;
+    size_t pending_count;
+    http_client_t *active;
+    size_t running;
+#if !defined(_WIN32) && !defined(_WIN64)
+    int wakeup_fds[2];
+#endif
+};
+
+/*
+ * Closed clients are reset and parked in an idle pool instead of being
+ * destroyed, so that the next http_client_new() can reuse the easy handle
+ * together with its live (keep-alive) connections. All handles also share
+ * one DNS cache and TLS session cache, so that a fresh connection of any
+ * client skips the name lookup and resumes the TLS session. Connections
+ * themselves stay in the cache of their own handle: curl does not support
+ * sharing a connection cache between threads.
+ */
+#define HTTP_CLIENT_POOL_MAX_IDLE       16
+
+typedef struct http_client_pool {
+    pthread_mutex_t lock;
+    http_client_t *idle;
+    size_t idle_count;
+    CURLSH *share;
+    pthread_mutex_t share_locks[CURL_LOCK_DATA_LAST];
+} http_client_pool_t;
+
+static http_client_pool_t pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER
 };
 
 static bool initialized = false;
@@ -102,6 +169,72 @@ const char *curlu_strerror(int errcode)
     return NULL;
 }
 
+static void share_lock(CURL *handle, curl_lock_data data,
+                       curl_lock_access access, void *userptr)
+{
+    (void)handle;
+    (void)access;
+    (void)userptr;
+
+    pthread_mutex_lock(&pool.share_locks[data]);
+}
+
+static void share_unlock(CURL *handle, curl_lock_data data, void *userptr)
+{
+    (void)handle;
+    (void)userptr;
+
+    pthread_mutex_unlock(&pool.share_locks[data]);
+}
+
+static void pool_init(void)
+{
+    int i;
+
+    if (http_body_pool_init() < 0)
+        vlogW("HttpClient: response bodies will not be pooled.");
+
+    for (i = 0; i < CURL_LOCK_DATA_LAST; i++)
+        pthread_mutex_init(&pool.share_locks[i], NULL);
+
+    pool.share = curl_share_init();
+    if (!pool.share) {
+        vlogW("HttpClient: curl_share_init() failure, connections will "
+              "not be shared.");
+        return;
+    }
+
+    curl_share_setopt(pool.share, CURLSHOPT_LOCKFUNC, share_lock);
+    curl_share_setopt(pool.share, CURLSHOPT_UNLOCKFUNC, share_unlock);
+    curl_share_setopt(pool.share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(pool.share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+}
+
+static void pool_cleanup(void)
+{
+    http_client_t *client;
+    int i;
+
+    pthread_mutex_lock(&pool.lock);
+    while ((client = pool.idle) != NULL) {
+        pool.idle = client->next;
+        client->next = NULL;
+        deref(client);
+    }
+    pool.idle_count = 0;
+    pthread_mutex_unlock(&pool.lock);
+
+    http_body_pool_cleanup();
+
+    if (pool.share) {
+        curl_share_cleanup(pool.share);
+        pool.share = NULL;
+    }
+
+    for (i = 0; i < CURL_LOCK_DATA_LAST; i++)
+        pthread_mutex_destroy(&pool.share_locks[i]);
+}
+
 #if defined(_WIN32) || defined(_WIN64)
 BOOL APIENTRY DllMain(
     HMODULE hModule, DWORD  ul_reason_for_call, LPVOID lpReserved)
@@ -112,13 +245,16 @@ BOOL APIENTRY DllMain(
         rc = curl_global_init(CURL_GLOBAL_ALL);
         if (rc != CURLE_OK)
             vlogE("HttpClient: Initialize global curl error (%d)", rc);
-        else
+        else {
+            pool_init();
             initialized = true;
+        }
         return rc == CURLE_OK ? TRUE : FALSE;
     } else if (ul_reason_for_call == DLL_PROCESS_DETACH) {
         if (!initialized)
             return TRUE;
 
+        pool_cleanup();
         curl_global_cleanup();
         initialized = false;
         return TRUE;
@@ -138,8 +274,10 @@ static void initializer(int argc, char** argv, char** envp)
     rc = curl_global_init(CURL_GLOBAL_ALL);
     if (rc != CURLE_OK)
         vlogE("HttpClient: Initialize global curl error (%d)", rc);
-    else
+    else {
+        pool_init();
         initialized = true;
+    }
 }
 
 __attribute__((destructor))
@@ -148,6 +286,7 @@ static void finalizer()
     if (!initialized)
        return;
 
+    pool_cleanup();
     curl_global_cleanup();
     initialized = false;
 }
@@ -242,24 +381,86 @@ static size_t eat_output(char *ptr, size_t size,
     return size * nmemb;
 }
 
+/*
+ * Shared headers are chained behind the client's own ones only while a
+ * request is prepared, and must be unchained before the own list is
+ * modified or freed.
+ */
+static void unlink_shared_headers(http_client_t *client)
+{
+    if (client->hdr_tail)
+        client->hdr_tail->next = NULL;
+}
+
 static void http_client_destroy(void *obj)
 {
     http_client_t *client = (http_client_t *)obj;
 
     assert(client);
 
+    unlink_shared_headers(client);
+
     if (client->response_body.data)
-        free(client->response_body.data);
+        http_body_buffer_put(client->response_body.data);
     if (client->curl)
         curl_easy_cleanup(client->curl);
     if (client->url)
         curl_url_cleanup(client->url);
     if (client->hdr)
         curl_slist_free_all(client->hdr);
+    if (client->shared_hdr)
+        deref(client->shared_hdr);
     if (client->mime)
         curl_mime_free(client->mime);
 }
 
+static void http_client_set_defaults(http_client_t *client)
+{
+    curl_easy_setopt(client->curl, CURLOPT_DEBUGFUNCTION, trace_func);
+    curl_easy_setopt(client->curl, CURLOPT_VERBOSE, 1L);
+    curl_easy_setopt(client->curl, CURLOPT_WRITEFUNCTION, eat_output);
+    curl_easy_setopt(client->curl, CURLOPT_CURLU, client->url);
+    curl_easy_setopt(client->curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(client->curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    if (pool.share)
+        curl_easy_setopt(client->curl, CURLOPT_SHARE, pool.share);
+#if defined(_WIN32) || defined(_WIN64)
+    curl_easy_setopt(client->curl, CURLOPT_SSL_VERIFYPEER, 0);
+#endif
+}
+
+static http_client_t *pool_lease(void)
+{
+    http_client_t *client;
+
+    pthread_mutex_lock(&pool.lock);
+    client = pool.idle;
+    if (client) {
+        pool.idle = client->next;
+        pool.idle_count--;
+        client->next = NULL;
+    }
+    pthread_mutex_unlock(&pool.lock);
+
+    return client;
+}
+
+static bool pool_return(http_client_t *client)
+{
+    bool pooled = false;
+
+    pthread_mutex_lock(&pool.lock);
+    if (initialized && pool.idle_count < HTTP_CLIENT_POOL_MAX_IDLE) {
+        client->next = pool.idle;
+        pool.idle = client;
+        pool.idle_count++;
+        pooled = true;
+    }
+    pthread_mutex_unlock(&pool.lock);
+
+    return pooled;
+}
+
 http_client_t *http_client_new(void)
 {
     http_client_t *client;
@@ -271,9 +472,14 @@ http_client_t *http_client_new(void)
             vlogE("HttpClient: Initialize global curl error (%d)", rc);
             return NULL;
         }
+        pool_init();
         initialized = true;
     }
 
+    client = pool_lease();
+    if (client)
+        return client;
+
     client = (http_client_t *)rc_zalloc(sizeof(http_client_t), http_client_destroy);
     if (!client)
         return NULL;
@@ -292,21 +498,24 @@ http_client_t *http_client_new(void)
         return NULL;
     }
 
-    curl_easy_setopt(client->curl, CURLOPT_DEBUGFUNCTION, trace_func);
-    curl_easy_setopt(client->curl, CURLOPT_VERBOSE, 1L);
-    curl_easy_setopt(client->curl, CURLOPT_WRITEFUNCTION, eat_output);
-    curl_easy_setopt(client->curl, CURLOPT_CURLU, client->url);
-    curl_easy_setopt(client->curl, CURLOPT_NOSIGNAL, 1L);
-#if defined(_WIN32) || defined(_WIN64)
-    curl_easy_setopt(client->curl, CURLOPT_SSL_VERIFYPEER, 0);
-#endif
+    http_client_set_defaults(client);
 
     return client;
 }
 
 void http_client_close(http_client_t *client)
 {
-    if (client)
+    if (!client)
+        return;
+
+    /*
+     * Hand the client back to the idle pool. Its connections stay open
+     * in the connection cache of its handle, while its response buffer
+     * goes back to the buffer cache of this thread.
+     */
+    http_client_reset(client);
+
+    if (!pool_return(client))
         deref(client);
 }
 
@@ -317,9 +526,17 @@ void http_client_reset(http_client_t *client)
     curl_easy_reset(client->curl);
     curl_url_set(client->url, CURLUPART_URL, NULL, 0);
 
+    unlink_shared_headers(client);
+
     if (client->hdr) {
         curl_slist_free_all(client->hdr);
         client->hdr = NULL;
+        client->hdr_tail = NULL;
+    }
+
+    if (client->shared_hdr) {
+        deref(client->shared_hdr);
+        client->shared_hdr = NULL;
     }
 
     if (client->mime) {
@@ -327,16 +544,14 @@ void http_client_reset(http_client_t *client)
         client->mime = NULL;
     }
 
+    if (client->response_body.data) {
+        http_body_buffer_put(client->response_body.data);
+        client->response_body.data = NULL;
+        client->response_body.sz = 0;
+    }
     client->response_body.used = 0;
 
-    curl_easy_setopt(client->curl, CURLOPT_DEBUGFUNCTION, trace_func);
-    curl_easy_setopt(client->curl, CURLOPT_VERBOSE, 1L);
-    curl_easy_setopt(client->curl, CURLOPT_WRITEFUNCTION, eat_output);
-    curl_easy_setopt(client->curl, CURLOPT_CURLU, client->url);
-    curl_easy_setopt(client->curl, CURLOPT_NOSIGNAL, 1L);
-#if defined(_WIN32) || defined(_WIN64)
-    curl_easy_setopt(client->curl, CURLOPT_SSL_VERIFYPEER, 0);
-#endif
+    http_client_set_defaults(client);
 }
 
 int http_client_set_method(http_client_t *client, http_method_t method)
@@ -359,6 +574,18 @@ int http_client_set_method(http_client_t *client, http_method_t method)
     case HTTP_METHOD_PATCH:
         code = curl_easy_setopt(client->curl, CURLOPT_CUSTOMREQUEST, "PATCH");
         break;
+    case HTTP_METHOD_PROPFIND:
+        code = curl_easy_setopt(client->curl, CURLOPT_CUSTOMREQUEST, "PROPFIND");
+        break;
+    case HTTP_METHOD_MKCOL:
+        code = curl_easy_setopt(client->curl, CURLOPT_CUSTOMREQUEST, "MKCOL");
+        break;
+    case HTTP_METHOD_MOVE:
+        code = curl_easy_setopt(client->curl, CURLOPT_CUSTOMREQUEST, "MOVE");
+        break;
+    case HTTP_METHOD_COPY:
+        code = curl_easy_setopt(client->curl, CURLOPT_CUSTOMREQUEST, "COPY");
+        break;
     default:
         assert(0);
         break;
@@ -539,6 +766,8 @@ int http_client_set_header(http_client_t *client,
     header = alloca(strlen(name) + strlen(value) + 3);
     sprintf(header, "%s: %s", name, value);
 
+    unlink_shared_headers(client);
+
     hdr = curl_slist_append(client->hdr, header);
     if (!hdr) {
         vlogE("HttpClient: Set header from curl error");
@@ -546,6 +775,56 @@ int http_client_set_header(http_client_t *client,
     }
 
     client->hdr = hdr;
+    client->hdr_tail = client->hdr_tail ? client->hdr_tail->next : hdr;
+    return 0;
+}
+
+int http_client_set_header_list(http_client_t *client, http_header_list_t *list)
+{
+    assert(client);
+
+    if (client->shared_hdr)
+        deref(client->shared_hdr);
+
+    client->shared_hdr = list ? ref(list) : NULL;
+    return 0;
+}
+
+static void http_header_list_destroy(void *obj)
+{
+    http_header_list_t *list = (http_header_list_t *)obj;
+
+    if (list->hdr)
+        curl_slist_free_all(list->hdr);
+}
+
+http_header_list_t *http_header_list_new(void)
+{
+    return (http_header_list_t *)rc_zalloc(sizeof(http_header_list_t),
+                                           http_header_list_destroy);
+}
+
+int http_header_list_append(http_header_list_t *list,
+                            const char *name, const char *value)
+{
+    char *header;
+    struct curl_slist *hdr;
+
+    assert(list);
+    assert(name);
+    assert(value);
+    assert(*name);
+
+    header = alloca(strlen(name) + strlen(value) + 3);
+    sprintf(header, "%s: %s", name, value);
+
+    hdr = curl_slist_append(list->hdr, header);
+    if (!hdr) {
+        vlogE("HttpClient: Append header from curl error");
+        return CURLE_OUT_OF_MEMORY;
+    }
+
+    list->hdr = hdr;
     return 0;
 }
 
@@ -616,38 +895,56 @@ int http_client_set_response_body(http_client_t *client,
 static size_t http_response_body_write_callback(char *ptr, size_t size, size_t nmemb,
                                                 void *userdata)
 {
-    http_response_body_t *response = (http_response_body_t *)userdata;
+    http_client_t *client = (http_client_t *)userdata;
+    http_response_body_t *response = &client->response_body;
     size_t length = size * nmemb;
 
-    if (response->sz - response->used < length) {
+    // Keep one spare byte so that the body stays NUL-terminated.
+    if (response->sz - response->used <= length) {
         size_t new_sz;
-        size_t last_try;
-        void *new_data;
+        char *new_data;
 
-        if (response->sz + length < response->sz) {
+        new_sz = response->used + length + 1;
+        if (new_sz <= response->used) {
             response->used = 0;
             return 0;
         }
 
-        for (new_sz = response->sz ? response->sz << 1 : 512, last_try = response->sz;
-            new_sz > last_try && new_sz <= response->sz + length;
-            last_try = new_sz, new_sz <<= 1) ;
-
-        if (new_sz <= last_try)
-            new_sz = response->sz + length;
+        if (!response->used) {
+            curl_off_t content_length = -1;
+
+            /*
+             * The first chunk arrives after all headers, so the announced
+             * length sizes the buffer once for the whole body.
+             */
+            curl_easy_getinfo(client->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T,
+                              &content_length);
+            if (content_length > 0 &&
+                (uint64_t)content_length < (uint64_t)(SIZE_MAX - 1) &&
+                (size_t)content_length + 1 > new_sz)
+                new_sz = (size_t)content_length + 1;
+        } else if ((response->sz << 1) > new_sz) {
+            new_sz = response->sz << 1;
+        }
 
-        new_data = realloc(response->data, new_sz);
+        new_data = http_body_buffer_get(new_sz);
         if (!new_data) {
             response->used = 0;
             return 0;
         }
 
+        if (response->data) {
+            memcpy(new_data, response->data, response->used);
+            http_body_buffer_put(response->data);
+        }
+
         response->data = new_data;
-        response->sz = new_sz;
+        response->sz = http_body_buffer_size(new_data);
     }
 
     memcpy((char *)response->data + response->used, ptr, length);
     response->used += length;
+    ((char *)response->data)[response->used] = '\0';
 
     return length;
 }
@@ -657,8 +954,7 @@ int http_client_enable_response_body(http_client_t *client)
     curl_easy_setopt(client->curl, CURLOPT_WRITEFUNCTION,
                      http_response_body_write_callback);
 
-    curl_easy_setopt(client->curl, CURLOPT_WRITEDATA,
-                     &client->response_body);
+    curl_easy_setopt(client->curl, CURLOPT_WRITEDATA, client);
     return 0;
 }
 
@@ -672,7 +968,8 @@ char *http_client_move_response_body(http_client_t *client, size_t *len)
     char *resp;
 
     if (!client->response_body.used) {
-        *len = 0;
+        if (len)
+            *len = 0;
         return NULL;
     }
 
@@ -687,6 +984,12 @@ char *http_client_move_response_body(http_client_t *client, size_t *len)
     return resp;
 }
 
+void http_client_release_response_body(char *body)
+{
+    if (body)
+        http_body_buffer_put(body);
+}
+
 size_t http_client_get_response_body_length(http_client_t *client)
 {
     return client->response_body.used;
@@ -705,17 +1008,28 @@ int http_client_set_response_header(http_client_t *client,
     return 0;
 }
 
-int http_client_request(http_client_t *client)
+static void http_client_prepare(http_client_t *client)
 {
-    CURLcode code;
+    struct curl_slist *shared = client->shared_hdr ?
+                                client->shared_hdr->hdr : NULL;
 
-    assert(client);
-
-    if (client->hdr)
+    if (client->hdr) {
+        client->hdr_tail->next = shared;
         curl_easy_setopt(client->curl, CURLOPT_HTTPHEADER, client->hdr);
+    } else if (shared)
+        curl_easy_setopt(client->curl, CURLOPT_HTTPHEADER, shared);
 
     if (client->mime)
         curl_easy_setopt(client->curl, CURLOPT_MIMEPOST, client->mime);
+}
+
+int http_client_request(http_client_t *client)
+{
+    CURLcode code;
+
+    assert(client);
+
+    http_client_prepare(client);
 
     code = curl_easy_perform(client->curl);
     if (code != CURLE_OK) {
@@ -803,3 +1117,296 @@ int http_client_set_mime_instant(http_client_t *client, const char *name,
 
     return 0;
 }
+
+static void http_engine_destroy(void *obj)
+{
+    http_engine_t *engine = (http_engine_t *)obj;
+
+    assert(engine);
+
+    if (engine->multi)
+        curl_multi_cleanup(engine->multi);
+
+#if !defined(_WIN32) && !defined(_WIN64)
+    if (engine->wakeup_fds[0] >= 0)
+        close(engine->wakeup_fds[0]);
+    if (engine->wakeup_fds[1] >= 0)
+        close(engine->wakeup_fds[1]);
+#endif
+
+    pthread_mutex_destroy(&engine->lock);
+}
+
+http_engine_t *http_engine_new(void)
+{
+    http_engine_t *engine;
+
+    if (!initialized) {
+        vlogE("HttpClient: curl is not initialized.");
+        return NULL;
+    }
+
+    engine = (http_engine_t *)rc_zalloc(sizeof(http_engine_t), http_engine_destroy);
+    if (!engine)
+        return NULL;
+
+    pthread_mutex_init(&engine->lock, NULL);
+
+#if !defined(_WIN32) && !defined(_WIN64)
+    engine->wakeup_fds[0] = -1;
+    engine->wakeup_fds[1] = -1;
+
+    if (pipe(engine->wakeup_fds) < 0) {
+        vlogE("HttpClient: Create engine wakeup pipe error (%d).", errno);
+        engine->wakeup_fds[0] = -1;
+        engine->wakeup_fds[1] = -1;
+        deref(engine);
+        return NULL;
+    }
+
+    fcntl(engine->wakeup_fds[0], F_SETFL,
+          fcntl(engine->wakeup_fds[0], F_GETFL) | O_NONBLOCK);
+    fcntl(engine->wakeup_fds[1], F_SETFL,
+          fcntl(engine->wakeup_fds[1], F_GETFL) | O_NONBLOCK);
+#endif
+
+    engine->multi = curl_multi_init();
+    if (!engine->multi) {
+        vlogE("HttpClient: curl_multi_init() failure.");
+        deref(engine);
+        return NULL;
+    }
+
+    curl_multi_setopt(engine->multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+
+    return engine;
+}
+
+static void http_engine_attach(http_engine_t *engine, http_client_t *client)
+{
+    client->prev = NULL;
+    client->next = engine->active;
+    if (engine->active)
+        engine->active->prev = client;
+    engine->active = client;
+    engine->running++;
+}
+
+static void http_engine_detach(http_engine_t *engine, http_client_t *client)
+{
+    curl_multi_remove_handle(engine->multi, client->curl);
+
+    if (client->prev)
+        client->prev->next = client->next;
+    else
+        engine->active = client->next;
+    if (client->next)
+        client->next->prev = client->prev;
+
+    client->prev = NULL;
+    client->next = NULL;
+    engine->running--;
+}
+
+static void http_engine_complete(http_client_t *client, int rc)
+{
+    http_client_complete_callback_t cb = client->complete_cb;
+    void *userdata = client->complete_userdata;
+
+    client->complete_cb = NULL;
+    client->complete_userdata = NULL;
+
+    if (rc != CURLE_OK)
+        vlogE("HttpClient: Perform http request error (%d)", rc);
+
+    cb(client, rc, userdata);
+}
+
+void http_engine_close(http_engine_t *engine)
+{
+    http_client_t *client;
+
+    if (!engine)
+        return;
+
+    /*
+     * Abort whatever is still queued or in flight. Completion callbacks may
+     * submit follow-up requests, which are aborted in turn until the engine
+     * runs dry.
+     */
+    for (;;) {
+        pthread_mutex_lock(&engine->lock);
+        client = engine->pending;
+        engine->pending = NULL;
+        engine->pending_tail = NULL;
+        engine->pending_count = 0;
+        pthread_mutex_unlock(&engine->lock);
+
+        if (!client && !engine->active)
+            break;
+
+        while (client) {
+            http_client_t *next = client->next;
+            client->next = NULL;
+            http_engine_complete(client, CURLE_ABORTED_BY_CALLBACK);
+            client = next;
+        }
+
+        while ((client = engine->active) != NULL) {
+            http_engine_detach(engine, client);
+            http_engine_complete(client, CURLE_ABORTED_BY_CALLBACK);
+        }
+    }
+
+    deref(engine);
+}
+
+void http_engine_wakeup(http_engine_t *engine)
+{
+    assert(engine);
+
+#if !defined(_WIN32) && !defined(_WIN64)
+    {
+        char c = 0;
+        ssize_t rc;
+
+        rc = write(engine->wakeup_fds[1], &c, 1);
+        (void)rc;
+    }
+#endif
+}
+
+int http_client_submit(http_engine_t *engine, http_client_t *client,
+                       http_client_complete_callback_t cb, void *userdata)
+{
+    assert(engine);
+    assert(client);
+    assert(cb);
+
+    http_client_prepare(client);
+    curl_easy_setopt(client->curl, CURLOPT_PRIVATE, client);
+
+    client->complete_cb = cb;
+    client->complete_userdata = userdata;
+
+    pthread_mutex_lock(&engine->lock);
+    client->next = NULL;
+    if (engine->pending_tail)
+        engine->pending_tail->next = client;
+    else
+        engine->pending = client;
+    engine->pending_tail = client;
+    engine->pending_count++;
+    pthread_mutex_unlock(&engine->lock);
+
+    http_engine_wakeup(engine);
+    return 0;
+}
+
+static void http_engine_add_pending(http_engine_t *engine)
+{
+    http_client_t *client;
+
+    pthread_mutex_lock(&engine->lock);
+    client = engine->pending;
+    engine->pending = NULL;
+    engine->pending_tail = NULL;
+    engine->pending_count = 0;
+    pthread_mutex_unlock(&engine->lock);
+
+    while (client) {
+        http_client_t *next = client->next;
+        CURLMcode code;
+
+        client->next = NULL;
+        code = curl_multi_add_handle(engine->multi, client->curl);
+        if (code != CURLM_OK) {
+            vlogE("HttpClient: Add request to engine error (%d)", code);
+            http_engine_complete(client, CURLE_FAILED_INIT);
+        } else
+            http_engine_attach(engine, client);
+
+        client = next;
+    }
+}
+
+static void http_engine_dispatch(http_engine_t *engine)
+{
+    CURLMsg *msg;
+    int left;
+
+    while ((msg = curl_multi_info_read(engine->multi, &left)) != NULL) {
+        http_client_t *client = NULL;
+        CURLcode code;
+
+        if (msg->msg != CURLMSG_DONE)
+            continue;
+
+        code = msg->data.result;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&client);
+        assert(client);
+
+        http_engine_detach(engine, client);
+        http_engine_complete(client, code);
+    }
+}
+
+int http_engine_perform(http_engine_t *engine, int timeout_ms)
+{
+    CURLMcode code;
+    int still_running = 0;
+    int numfds = 0;
+    size_t pending;
+
+    assert(engine);
+
+    http_engine_add_pending(engine);
+
+    code = curl_multi_perform(engine->multi, &still_running);
+    if (code != CURLM_OK) {
+        vlogE("HttpClient: Perform engine requests error (%d)", code);
+        return -1;
+    }
+    http_engine_dispatch(engine);
+
+    pthread_mutex_lock(&engine->lock);
+    pending = engine->pending_count;
+    pthread_mutex_unlock(&engine->lock);
+
+    if (timeout_ms > 0 && !pending) {
+#if !defined(_WIN32) && !defined(_WIN64)
+        struct curl_waitfd wakeup;
+        char drain[64];
+
+        wakeup.fd = engine->wakeup_fds[0];
+        wakeup.events = CURL_WAIT_POLLIN;
+        wakeup.revents = 0;
+
+        code = curl_multi_wait(engine->multi, &wakeup, 1, timeout_ms, &numfds);
+        while (read(engine->wakeup_fds[0], drain, sizeof(drain)) > 0) ;
+#else
+        /* No wakeup channel here, so never sleep long while idle. */
+        code = curl_multi_wait(engine->multi, NULL, 0,
+                               engine->running ? timeout_ms :
+                               (timeout_ms < 10 ? timeout_ms : 10), &numfds);
+#endif
+        if (code != CURLM_OK) {
+            vlogE("HttpClient: Wait engine requests error (%d)", code);
+            return -1;
+        }
+
+        http_engine_add_pending(engine);
+        code = curl_multi_perform(engine->multi, &still_running);
+        if (code != CURLM_OK) {
+            vlogE("HttpClient: Perform engine requests error (%d)", code);
+            return -1;
+        }
+        http_engine_dispatch(engine);
+    }
+
+    pthread_mutex_lock(&engine->lock);
+    pending = engine->pending_count;
+    pthread_mutex_unlock(&engine->lock);
+
+    return (int)(engine->running + pending);
+}
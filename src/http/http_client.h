@@ -34,7 +34,11 @@ typedef enum {
     HTTP_METHOD_POST,
     HTTP_METHOD_PUT,
     HTTP_METHOD_DELETE,
-    HTTP_METHOD_PATCH
+    HTTP_METHOD_PATCH,
+    HTTP_METHOD_PROPFIND,
+    HTTP_METHOD_MKCOL,
+    HTTP_METHOD_MOVE,
+    HTTP_METHOD_COPY
 } http_method_t;
 
 typedef enum {
@@ -48,6 +52,14 @@ const char *curl_strerror(int errcode);
 
 const char *curlu_strerror(int errcode);
 
+/*
+ * Http header list, shared read-only by clients once built.
+ */
+typedef struct http_header_list http_header_list_t;
+
+http_header_list_t *http_header_list_new(void);
+int http_header_list_append(http_header_list_t *, const char *name, const char *value);
+
 /*
  * Http client instance.
  */
@@ -67,6 +79,7 @@ int http_client_set_url_escape(http_client_t *, const char *url);
 int http_client_set_path(http_client_t *, const char *path);
 int http_client_set_query(http_client_t *, const char *name, const char *value);
 int http_client_set_header(http_client_t *, const char *name, const char *value);
+int http_client_set_header_list(http_client_t *, http_header_list_t *list);
 int http_client_set_timeout(http_client_t *, int timeout /* seconds */);
 int http_client_set_version(http_client_t *, http_version_t version);
 
@@ -101,7 +114,12 @@ int http_client_set_response_body(http_client_t *client,
 int http_client_enable_response_body(http_client_t *);
 const char *http_client_get_response_body(http_client_t *);
 size_t http_client_get_response_body_length(http_client_t *);
+/*
+ * The moved body belongs to the caller, who hands it back with
+ * http_client_release_response_body() rather than free().
+ */
 char *http_client_move_response_body(http_client_t *, size_t *len);
+void http_client_release_response_body(char *body);
 int http_client_get_response_code(http_client_t *, long *response_code);
 int http_client_set_mime_instant(http_client_t *, const char *name,
                                  const char *filename, const char *type,
@@ -113,6 +131,36 @@ int http_client_set_mime_instant(http_client_t *, const char *name,
  */
 int http_client_request(http_client_t *client);
 
+/*
+ * Http client async request API.
+ *
+ * A submitted client is owned by the engine until its completion callback
+ * runs; rc is the same value http_client_request() would have returned.
+ * The callback may inspect the response, close the client or submit new
+ * requests to the same engine.
+ *
+ * Closing an engine aborts every request still queued or in flight,
+ * including those submitted by callbacks while it closes; each of them
+ * completes with CURLE_ABORTED_BY_CALLBACK.
+ */
+typedef struct http_engine http_engine_t;
+
+typedef void (*http_client_complete_callback_t)(http_client_t *client,
+    int rc, void *userdata);
+
+http_engine_t *http_engine_new(void);
+void http_engine_close(http_engine_t *engine);
+void http_engine_wakeup(http_engine_t *engine);
+
+/*
+ * Run the engine for at most timeout_ms, dispatching completions on the
+ * calling thread. Returns the number of requests still outstanding.
+ */
+int http_engine_perform(http_engine_t *engine, int timeout_ms);
+
+int http_client_submit(http_engine_t *engine, http_client_t *client,
+    http_client_complete_callback_t cb, void *userdata);
+
 /*
  * Escape/Unescape operation APIs.
  */
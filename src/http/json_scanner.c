@@ -0,0 +1,714 @@
+/*
+ * Copyright (c) 2019 Elastos Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <crystal.h>
+
+#include "ela_hive.h"
+#include "hive_error.h"
+#include "json_scanner.h"
+#include "http_client.h"
+
+#define MAX_DEPTH               64
+#define MAX_KEY_LEN             256
+#define MIN_VALUE_LEN           256
+#define MAX_VALUE_LEN           (1024 * 1024)
+
+typedef enum {
+    LEX_NONE,
+    LEX_STRING,
+    LEX_ESCAPE,
+    LEX_UNICODE,
+    LEX_LITERAL
+} lex_t;
+
+typedef enum {
+    EXPECT_VALUE,
+    EXPECT_FIRST_VALUE,
+    EXPECT_KEY,
+    EXPECT_FIRST_KEY,
+    EXPECT_COLON,
+    EXPECT_NEXT,
+    EXPECT_DONE
+} expect_t;
+
+/*
+ * Not a validating parser: the structure is checked all the way down, but
+ * scalars are only looked at where they are reported. Strings and
+ * literals are collected into the value buffer at the reported levels
+ * only, so large nested values cost nothing but the scan.
+ */
+struct json_scanner {
+    char *array_key;
+    json_scanner_callback_t *callback;
+    void *context;
+
+    lex_t lex;
+    expect_t expect;
+    bool in_key;
+    bool capture;
+    unsigned long unicode;
+    unsigned long surrogate;
+    int nhex;
+
+    char stack[MAX_DEPTH];
+    int level;
+    bool watching;
+
+    char key[MAX_KEY_LEN];
+    size_t key_len;
+    bool key_overflow;
+
+    char *value;
+    size_t value_len;
+    size_t value_sz;
+
+    bool stopped;
+    int rc;
+
+    // http
+    http_client_t *httpc;
+    long expected_status;
+    bool checked;
+    bool discard;
+    bool aborted;
+};
+
+json_scanner_t *json_scanner_new(const char *array_key,
+                                 json_scanner_callback_t *callback,
+                                 void *context)
+{
+    json_scanner_t *scanner;
+
+    assert(array_key);
+    assert(callback);
+
+    scanner = (json_scanner_t *)calloc(1, sizeof(json_scanner_t));
+    if (!scanner)
+        return NULL;
+
+    scanner->array_key = strdup(array_key);
+    scanner->value = (char *)malloc(MIN_VALUE_LEN);
+    if (!scanner->array_key || !scanner->value) {
+        json_scanner_delete(scanner);
+        return NULL;
+    }
+
+    scanner->value_sz = MIN_VALUE_LEN;
+    scanner->callback = callback;
+    scanner->context = context;
+
+    return scanner;
+}
+
+void json_scanner_delete(json_scanner_t *scanner)
+{
+    if (!scanner)
+        return;
+
+    free(scanner->array_key);
+    free(scanner->value);
+    free(scanner);
+}
+
+void json_scanner_reset(json_scanner_t *scanner)
+{
+    assert(scanner);
+
+    scanner->lex = LEX_NONE;
+    scanner->expect = EXPECT_VALUE;
+    scanner->level = 0;
+    scanner->watching = false;
+    scanner->key_len = 0;
+    scanner->value_len = 0;
+    scanner->stopped = false;
+    scanner->rc = 0;
+    scanner->checked = false;
+    scanner->discard = false;
+    scanner->aborted = false;
+}
+
+/*
+ * The depth members of the current container are reported at, or -1.
+ */
+static int reported_depth(json_scanner_t *scanner)
+{
+    if (scanner->level == 1)
+        return 0;
+
+    if (scanner->level == 3 && scanner->watching)
+        return 1;
+
+    return -1;
+}
+
+static const char *current_key(json_scanner_t *scanner)
+{
+    // A key this long can not be one of interest.
+    return scanner->key_overflow ? "" : scanner->key;
+}
+
+static int report(json_scanner_t *scanner, int depth, const char *key,
+                  json_scan_type_t type, const char *value)
+{
+    if (!scanner->callback(depth, key, type, value, scanner->context)) {
+        scanner->stopped = true;
+        return 1;
+    }
+
+    return 0;
+}
+
+static int append_value(json_scanner_t *scanner, char c)
+{
+    if (scanner->in_key) {
+        if (scanner->key_len + 1 >= sizeof(scanner->key))
+            scanner->key_overflow = true;
+        else
+            scanner->key[scanner->key_len++] = c;
+        return 0;
+    }
+
+    if (!scanner->capture)
+        return 0;
+
+    if (scanner->value_len + 1 >= scanner->value_sz) {
+        size_t sz = scanner->value_sz * 2;
+        char *p;
+
+        if (sz > MAX_VALUE_LEN) {
+            vlogE("JsonScanner: value too long.");
+            return HIVE_GENERAL_ERROR(HIVEERR_BUFFER_TOO_SMALL);
+        }
+
+        p = (char *)realloc(scanner->value, sz);
+        if (!p)
+            return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+        scanner->value = p;
+        scanner->value_sz = sz;
+    }
+
+    scanner->value[scanner->value_len++] = c;
+    return 0;
+}
+
+static int append_utf8(json_scanner_t *scanner, unsigned long cp)
+{
+    char out[4];
+    int n;
+    int i;
+    int rc;
+
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        n = 1;
+    } else if (cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        n = 2;
+    } else if (cp < 0x10000) {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        n = 3;
+    } else {
+        out[0] = (char)(0xF0 | (cp >> 18));
+        out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[3] = (char)(0x80 | (cp & 0x3F));
+        n = 4;
+    }
+
+    for (i = 0; i < n; i++) {
+        rc = append_value(scanner, out[i]);
+        if (rc < 0)
+            return rc;
+    }
+
+    return 0;
+}
+
+static int flush_surrogate(json_scanner_t *scanner)
+{
+    int rc = 0;
+
+    // A lone high surrogate is not a character.
+    if (scanner->surrogate) {
+        rc = append_utf8(scanner, 0xFFFD);
+        scanner->surrogate = 0;
+    }
+
+    return rc;
+}
+
+static int bad_format(void)
+{
+    vlogE("JsonScanner: malformed json document.");
+    return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+}
+
+static bool expecting_value(json_scanner_t *scanner)
+{
+    return scanner->expect == EXPECT_VALUE ||
+           scanner->expect == EXPECT_FIRST_VALUE;
+}
+
+static bool is_element(json_scanner_t *scanner)
+{
+    return scanner->level == 2 && scanner->watching;
+}
+
+static int value_done(json_scanner_t *scanner)
+{
+    scanner->expect = scanner->level ? EXPECT_NEXT : EXPECT_DONE;
+    return 0;
+}
+
+static int scalar_value(json_scanner_t *scanner, json_scan_type_t type)
+{
+    int depth = reported_depth(scanner);
+    int rc;
+
+    if (scanner->level == 0 || is_element(scanner))
+        return bad_format();
+
+    if (depth >= 0) {
+        scanner->value[scanner->value_len] = '\0';
+        rc = report(scanner, depth, current_key(scanner), type,
+                    type == JSON_SCAN_NULL ? NULL : scanner->value);
+        if (rc)
+            return rc;
+    }
+
+    return value_done(scanner);
+}
+
+static int open_container(json_scanner_t *scanner, char c)
+{
+    int depth = reported_depth(scanner);
+    bool watch = false;
+    int rc;
+
+    if (!expecting_value(scanner))
+        return bad_format();
+
+    // The root is an object, and so is every element of the watched array.
+    if ((scanner->level == 0 || is_element(scanner)) && c != '{')
+        return bad_format();
+
+    if (scanner->level == MAX_DEPTH) {
+        vlogE("JsonScanner: json document nested too deep.");
+        return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+    }
+
+    if (depth == 0 && c == '[' &&
+        !scanner->key_overflow && !strcmp(scanner->key, scanner->array_key))
+        watch = true;
+
+    if (depth >= 0) {
+        rc = report(scanner, depth, current_key(scanner),
+                    c == '{' ? JSON_SCAN_OBJECT : JSON_SCAN_ARRAY, NULL);
+        if (rc)
+            return rc;
+    }
+
+    if (watch)
+        scanner->watching = true;
+
+    scanner->stack[scanner->level++] = c;
+    scanner->expect = c == '{' ? EXPECT_FIRST_KEY : EXPECT_FIRST_VALUE;
+    return 0;
+}
+
+static int close_container(json_scanner_t *scanner, char c)
+{
+    char open = c == '}' ? '{' : '[';
+    int rc;
+
+    if (!scanner->level || scanner->stack[scanner->level - 1] != open)
+        return bad_format();
+
+    if (scanner->expect != EXPECT_NEXT &&
+        scanner->expect != (open == '{' ? EXPECT_FIRST_KEY : EXPECT_FIRST_VALUE))
+        return bad_format();
+
+    scanner->level--;
+
+    if (is_element(scanner)) {
+        rc = report(scanner, 1, NULL, JSON_SCAN_END, NULL);
+        if (rc)
+            return rc;
+    } else if (scanner->level == 1 && open == '[') {
+        scanner->watching = false;
+    }
+
+    return value_done(scanner);
+}
+
+static int start_string(json_scanner_t *scanner)
+{
+    if (scanner->expect == EXPECT_KEY || scanner->expect == EXPECT_FIRST_KEY) {
+        scanner->in_key = reported_depth(scanner) >= 0;
+        scanner->key_len = 0;
+        scanner->key_overflow = false;
+    } else if (expecting_value(scanner)) {
+        scanner->in_key = false;
+    } else {
+        return bad_format();
+    }
+
+    scanner->capture = reported_depth(scanner) >= 0;
+    scanner->value_len = 0;
+    scanner->surrogate = 0;
+    scanner->lex = LEX_STRING;
+    return 0;
+}
+
+static int end_string(json_scanner_t *scanner)
+{
+    int rc;
+
+    rc = flush_surrogate(scanner);
+    if (rc < 0)
+        return rc;
+
+    scanner->lex = LEX_NONE;
+
+    if (scanner->expect == EXPECT_KEY || scanner->expect == EXPECT_FIRST_KEY) {
+        scanner->key[scanner->key_len] = '\0';
+        scanner->in_key = false;
+        scanner->expect = EXPECT_COLON;
+        return 0;
+    }
+
+    return scalar_value(scanner, JSON_SCAN_STRING);
+}
+
+static int end_literal(json_scanner_t *scanner)
+{
+    static const struct {
+        const char *text;
+        json_scan_type_t type;
+    } literals[] = {
+        { "true",  JSON_SCAN_TRUE  },
+        { "false", JSON_SCAN_FALSE },
+        { "null",  JSON_SCAN_NULL  }
+    };
+    const char *text = scanner->value;
+    size_t i;
+
+    scanner->lex = LEX_NONE;
+    scanner->value[scanner->value_len] = '\0';
+
+    if (!scanner->capture)
+        return value_done(scanner);
+
+    for (i = 0; i < sizeof(literals) / sizeof(literals[0]); i++) {
+        if (!strcmp(text, literals[i].text))
+            return scalar_value(scanner, literals[i].type);
+    }
+
+    if (*text == '-' || (*text >= '0' && *text <= '9'))
+        return scalar_value(scanner, JSON_SCAN_NUMBER);
+
+    return bad_format();
+}
+
+static int start_literal(json_scanner_t *scanner, char c)
+{
+    if (!expecting_value(scanner) ||
+        scanner->level == 0 || is_element(scanner))
+        return bad_format();
+
+    scanner->in_key = false;
+    scanner->capture = reported_depth(scanner) >= 0;
+    scanner->value_len = 0;
+    scanner->lex = LEX_LITERAL;
+    return append_value(scanner, c);
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+static int scan_unicode(json_scanner_t *scanner, char c)
+{
+    int v = hex_value(c);
+    unsigned long cp;
+    int rc;
+
+    if (v < 0)
+        return bad_format();
+
+    scanner->unicode = (scanner->unicode << 4) | (unsigned long)v;
+    if (++scanner->nhex < 4)
+        return 0;
+
+    scanner->lex = LEX_STRING;
+    cp = scanner->unicode;
+
+    if (cp >= 0xD800 && cp <= 0xDBFF) {
+        rc = flush_surrogate(scanner);
+        scanner->surrogate = cp;
+        return rc;
+    }
+
+    if (cp >= 0xDC00 && cp <= 0xDFFF) {
+        if (!scanner->surrogate)
+            return append_utf8(scanner, 0xFFFD);
+
+        cp = 0x10000 + ((scanner->surrogate - 0xD800) << 10) + (cp - 0xDC00);
+        scanner->surrogate = 0;
+        return append_utf8(scanner, cp);
+    }
+
+    rc = flush_surrogate(scanner);
+    if (rc < 0)
+        return rc;
+
+    return append_utf8(scanner, cp);
+}
+
+static int scan_escape(json_scanner_t *scanner, char c)
+{
+    char out;
+    int rc;
+
+    scanner->lex = LEX_STRING;
+
+    switch (c) {
+    case '"':  out = '"';  break;
+    case '\\': out = '\\'; break;
+    case '/':  out = '/';  break;
+    case 'b':  out = '\b'; break;
+    case 'f':  out = '\f'; break;
+    case 'n':  out = '\n'; break;
+    case 'r':  out = '\r'; break;
+    case 't':  out = '\t'; break;
+    case 'u':
+        scanner->lex = LEX_UNICODE;
+        scanner->unicode = 0;
+        scanner->nhex = 0;
+        return 0;
+    default:
+        return bad_format();
+    }
+
+    rc = flush_surrogate(scanner);
+    if (rc < 0)
+        return rc;
+
+    return append_value(scanner, out);
+}
+
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static int scan_token(json_scanner_t *scanner, char c)
+{
+    if (is_space(c))
+        return 0;
+
+    if (scanner->expect == EXPECT_DONE)
+        return bad_format();
+
+    switch (c) {
+    case '{':
+    case '[':
+        return open_container(scanner, c);
+
+    case '}':
+    case ']':
+        return close_container(scanner, c);
+
+    case ':':
+        if (scanner->expect != EXPECT_COLON)
+            return bad_format();
+        scanner->expect = EXPECT_VALUE;
+        return 0;
+
+    case ',':
+        if (scanner->expect != EXPECT_NEXT)
+            return bad_format();
+        scanner->expect = scanner->stack[scanner->level - 1] == '{' ?
+                          EXPECT_KEY : EXPECT_VALUE;
+        return 0;
+
+    case '"':
+        return start_string(scanner);
+
+    default:
+        if (c == '-' || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z'))
+            return start_literal(scanner, c);
+        return bad_format();
+    }
+}
+
+int json_scanner_feed(json_scanner_t *scanner, const char *data, size_t len)
+{
+    size_t i;
+    int rc;
+
+    assert(scanner);
+    assert(data || !len);
+
+    if (scanner->rc < 0)
+        return scanner->rc;
+
+    if (scanner->stopped)
+        return 1;
+
+    for (i = 0; i < len; i++) {
+        char c = data[i];
+
+        switch (scanner->lex) {
+        case LEX_STRING:
+            if (c == '"') {
+                rc = end_string(scanner);
+            } else if (c == '\\') {
+                scanner->lex = LEX_ESCAPE;
+                rc = 0;
+            } else if ((unsigned char)c < 0x20) {
+                rc = bad_format();
+            } else {
+                rc = flush_surrogate(scanner);
+                if (rc == 0)
+                    rc = append_value(scanner, c);
+            }
+            break;
+
+        case LEX_ESCAPE:
+            rc = scan_escape(scanner, c);
+            break;
+
+        case LEX_UNICODE:
+            rc = scan_unicode(scanner, c);
+            break;
+
+        case LEX_LITERAL:
+            if (c == '-' || c == '+' || c == '.' ||
+                (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+                (c >= 'A' && c <= 'Z')) {
+                rc = append_value(scanner, c);
+                break;
+            }
+
+            // The delimiter ending a literal is a token on its own.
+            rc = end_literal(scanner);
+            if (rc == 0)
+                rc = scan_token(scanner, c);
+            break;
+
+        default:
+            rc = scan_token(scanner, c);
+            break;
+        }
+
+        if (rc < 0) {
+            scanner->rc = rc;
+            return rc;
+        }
+
+        if (rc > 0)
+            return 1;
+    }
+
+    return 0;
+}
+
+static size_t scanner_body_callback(char *buffer, size_t size,
+                                    size_t nitems, void *userdata)
+{
+    json_scanner_t *scanner = (json_scanner_t *)userdata;
+    size_t len = size * nitems;
+
+    if (!scanner->checked) {
+        long resp_code = 0;
+
+        http_client_get_response_code(scanner->httpc, &resp_code);
+        scanner->discard = resp_code != scanner->expected_status;
+        scanner->checked = true;
+    }
+
+    if (scanner->discard)
+        return len;
+
+    if (json_scanner_feed(scanner, buffer, len) != 0) {
+        scanner->aborted = true;
+        return 0;
+    }
+
+    return len;
+}
+
+int json_scanner_attach(json_scanner_t *scanner, http_client_t *httpc,
+                        long expected_status)
+{
+    assert(scanner);
+    assert(httpc);
+
+    scanner->httpc = httpc;
+    scanner->expected_status = expected_status;
+    scanner->checked = false;
+    scanner->discard = false;
+    scanner->aborted = false;
+
+    return http_client_set_response_body(httpc, scanner_body_callback,
+                                         scanner);
+}
+
+bool json_scanner_aborted(json_scanner_t *scanner)
+{
+    assert(scanner);
+
+    return scanner->aborted;
+}
+
+int json_scanner_finish(json_scanner_t *scanner)
+{
+    assert(scanner);
+
+    if (scanner->rc < 0)
+        return scanner->rc;
+
+    if (scanner->stopped)
+        return 1;
+
+    if (scanner->expect != EXPECT_DONE)
+        return bad_format();
+
+    return 0;
+}
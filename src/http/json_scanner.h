@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2019 Elastos Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __JSON_SCANNER_H__
+#define __JSON_SCANNER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "http_client.h"
+
+typedef enum {
+    JSON_SCAN_STRING,
+    JSON_SCAN_NUMBER,
+    JSON_SCAN_TRUE,
+    JSON_SCAN_FALSE,
+    JSON_SCAN_NULL,
+    JSON_SCAN_OBJECT,
+    JSON_SCAN_ARRAY,
+    JSON_SCAN_END
+} json_scan_type_t;
+
+/*
+ * Called for every member of the root object (depth 0) and for every
+ * member of the objects in the watched array (depth 1), in document
+ * order. Scalars come with their decoded text, valid for the duration of
+ * the call only; objects and arrays are announced by type, their content
+ * is skipped. Each element of the watched array ends with a
+ * JSON_SCAN_END event with no key. Return false to stop scanning.
+ */
+typedef bool json_scanner_callback_t(int depth, const char *key,
+                                     json_scan_type_t type, const char *value,
+                                     void *context);
+
+typedef struct json_scanner json_scanner_t;
+
+/*
+ * Incremental scanner of JSON documents shaped like the listings of the
+ * drives: an object holding an array of objects under array_key. Bytes
+ * are fed as they arrive, in chunks of any size, and nothing but the
+ * member being scanned is kept in memory.
+ */
+json_scanner_t *json_scanner_new(const char *array_key,
+                                 json_scanner_callback_t *callback,
+                                 void *context);
+
+void json_scanner_delete(json_scanner_t *scanner);
+
+/*
+ * Get ready for another document, such as the next page of a listing.
+ */
+void json_scanner_reset(json_scanner_t *scanner);
+
+/*
+ * Returns 0 to go on, 1 once the callback asked to stop, or a negative
+ * error when the document can not be scanned.
+ */
+int json_scanner_feed(json_scanner_t *scanner, const char *data, size_t len);
+
+/*
+ * Scan the response body of the request as it is received, provided the
+ * response carries the expected status; other bodies are discarded.
+ */
+int json_scanner_attach(json_scanner_t *scanner, http_client_t *httpc,
+                        long expected_status);
+
+/*
+ * Whether the scanner aborted the transfer, either because the callback
+ * asked to stop or the body is malformed. The request then fails with a
+ * write error which is not a transport failure.
+ */
+bool json_scanner_aborted(json_scanner_t *scanner);
+
+/*
+ * Returns 1 if the callback stopped the scanning, 0 once a complete
+ * document has been scanned, or a negative error otherwise.
+ */
+int json_scanner_finish(json_scanner_t *scanner);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __JSON_SCANNER_H__
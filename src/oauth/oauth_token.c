@@ -29,6 +29,7 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <pthread.h>
+#include <time.h>
 
 #ifdef HAVE_SYS_TIME_H
 #include <sys/time.h>
@@ -55,6 +56,23 @@
 
 #define ARGV(args, index) (((void **)(args))[index])
 
+/*
+ * Seconds to wait before the refresher retries a failed refresh.
+ */
+#define REFRESH_RETRY_INTERVAL  60
+
+typedef struct token_snapshot {
+    char *token_type;
+    char *access_token;
+    char *refresh_token;
+
+    /*
+     * Preformatted authorization header, shared by all requests
+     * made with this access token.
+     */
+    http_header_list_t *headers;
+} token_snapshot_t;
+
 struct oauth_token {
     /*
      * main url part to get authorize code.
@@ -73,12 +91,34 @@ struct oauth_token {
     char *redirect_url;
 
     /*
-     * tokens.
+     * tokens. The snapshot is swapped as a whole and never modified. The
+     * swap is guarded by snapshot_lock, which readers outside lock hold
+     * while taking a reference to the headers, since lock stays held for
+     * a whole refresh. The snapshot it replaced is kept until the next
+     * swap, long enough for any reader still holding it.
      */
-    char *token_type;
-    char *access_token;
-    char *refresh_token;
-    struct timeval expires_at;
+    pthread_mutex_t snapshot_lock;
+    token_snapshot_t *volatile snapshot;
+    token_snapshot_t *retired;
+    volatile time_t expires_at;
+
+    /*
+     * Refreshes are serialized by lock, and callers waiting for one in
+     * flight share its result through refresh_seq and refresh_rc.
+     */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    volatile unsigned int refresh_seq;
+    int refresh_rc;
+
+    /*
+     * Background refresher renewing the access token refresh_margin
+     * seconds before it expires.
+     */
+    pthread_t refresher;
+    bool refresher_running;
+    bool refresher_stopping;
+    unsigned int refresh_margin;
 
     /*
      * Token should be wroteback as long as they have been
@@ -88,6 +128,98 @@ struct oauth_token {
     void *user_data;
 };
 
+static void writeback_tokens(oauth_token_t *token);
+
+static token_snapshot_t *snapshot_new(const char *token_type,
+                                      const char *access_token,
+                                      const char *refresh_token)
+{
+    token_snapshot_t *snap;
+    size_t len;
+    char *p;
+
+    len = sizeof(token_snapshot_t) + strlen(token_type) + 1 +
+          strlen(access_token) + 1 + strlen(refresh_token) + 1;
+
+    snap = (token_snapshot_t *)calloc(1, len);
+    if (!snap)
+        return NULL;
+
+    p = (char *)(snap + 1);
+
+    snap->token_type = p;
+    strcpy(p, token_type);
+    p += strlen(p) + 1;
+
+    snap->access_token = p;
+    strcpy(p, access_token);
+    p += strlen(p) + 1;
+
+    snap->refresh_token = p;
+    strcpy(p, refresh_token);
+
+    len = strlen("Bearer ") + strlen(access_token) + 1;
+    p = (char *)malloc(len);
+    if (!p) {
+        free(snap);
+        return NULL;
+    }
+    snprintf(p, len, "Bearer %s", access_token);
+
+    snap->headers = http_header_list_new();
+    if (!snap->headers ||
+        http_header_list_append(snap->headers, "Authorization", p)) {
+        if (snap->headers)
+            deref(snap->headers);
+        free(p);
+        free(snap);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    free(p);
+    return snap;
+}
+
+static void snapshot_free(token_snapshot_t *snap)
+{
+    if (snap->headers)
+        deref(snap->headers);
+
+    free(snap);
+}
+
+/*
+ * Must be called with token->lock held.
+ */
+static void publish_snapshot(oauth_token_t *token, token_snapshot_t *snap,
+                             time_t expires_at)
+{
+    pthread_mutex_lock(&token->snapshot_lock);
+    if (token->retired)
+        snapshot_free(token->retired);
+    token->retired = token->snapshot;
+
+    // Make the snapshot content visible before the pointer.
+    __sync_synchronize();
+    token->snapshot = snap;
+    token->expires_at = expires_at;
+    pthread_mutex_unlock(&token->snapshot_lock);
+
+    // Let the refresher reschedule.
+    pthread_cond_signal(&token->cond);
+}
+
+/*
+ * Must be called with token->lock held.
+ */
+static void update_tokens(oauth_token_t *token, token_snapshot_t *snap,
+                          time_t expires_at)
+{
+    publish_snapshot(token, snap, expires_at);
+    writeback_tokens(token);
+}
+
 static void writeback_tokens(oauth_token_t *token)
 {
     cJSON *json;
@@ -102,13 +234,11 @@ static void writeback_tokens(oauth_token_t *token)
     }
 
     cJSON_AddStringToObject(json, "client_id", token->client_id);
-    if (token->token_type) {
-        assert(token->access_token);
-        assert(token->refresh_token);
-        cJSON_AddStringToObject(json, "token_type", token->token_type);
-        cJSON_AddStringToObject(json, "access_token", token->access_token);
-        cJSON_AddStringToObject(json, "refresh_token", token->refresh_token);
-        cJSON_AddNumberToObject(json, "expires_at", token->expires_at.tv_sec);
+    if (token->snapshot) {
+        cJSON_AddStringToObject(json, "token_type", token->snapshot->token_type);
+        cJSON_AddStringToObject(json, "access_token", token->snapshot->access_token);
+        cJSON_AddStringToObject(json, "refresh_token", token->snapshot->refresh_token);
+        cJSON_AddNumberToObject(json, "expires_at", token->expires_at);
     }
 
     rc = token->writeback_cb(json, token->user_data);
@@ -123,8 +253,20 @@ static void oauth_token_destrcutor(void *p)
     oauth_token_t *token = (oauth_token_t *)p;
     assert(token);
 
-    if (token->token_type)
-        free(token->token_type);
+    oauth_token_stop_refresher(token);
+
+    if (token->snapshot)
+        snapshot_free(token->snapshot);
+
+    if (token->retired)
+        snapshot_free(token->retired);
+
+    if (token->user_data)
+        deref(token->user_data);
+
+    pthread_cond_destroy(&token->cond);
+    pthread_mutex_destroy(&token->lock);
+    pthread_mutex_destroy(&token->snapshot_lock);
 }
 
 static int restore_access_token(const cJSON *json, oauth_token_t *token)
@@ -134,8 +276,6 @@ static int restore_access_token(const cJSON *json, oauth_token_t *token)
     cJSON *access_token;
     cJSON *refresh_token;
     cJSON *expires_at;
-    size_t mem_len = 0;
-    char *p;
 
     assert(token);
     assert(token->client_id);
@@ -165,25 +305,13 @@ static int restore_access_token(const cJSON *json, oauth_token_t *token)
         return 0;
     }
 
-    mem_len += strlen(token_type->valuestring) + 1;
-    mem_len += strlen(access_token->valuestring) + 1;
-    mem_len += strlen(refresh_token->valuestring) + 1;
-
-    token->expires_at.tv_sec = (long)expires_at->valuedouble;
-    p = (char *)calloc(1, mem_len);
-    if (!p)
+    token->snapshot = snapshot_new(token_type->valuestring,
+                                   access_token->valuestring,
+                                   refresh_token->valuestring);
+    if (!token->snapshot)
         return HIVE_SYS_ERROR(errno);
 
-    token->token_type = p;
-    strcpy(p, token_type->valuestring);
-    p += strlen(p) + 1;
-
-    token->access_token = p;
-    strcpy(p, access_token->valuestring);
-    p += strlen(p) + 1;
-
-    token->refresh_token = p;
-    strcpy(p, refresh_token->valuestring);
+    token->expires_at = (time_t)expires_at->valuedouble;
 
     vlogI("OauthToken: Successfully restore cached access token");
 
@@ -224,6 +352,10 @@ oauth_token_t *oauth_token_new(const oauth_options_t *opts, oauth_writeback_func
         return NULL;
     }
 
+    pthread_mutex_init(&token->lock, NULL);
+    pthread_cond_init(&token->cond, NULL);
+    pthread_mutex_init(&token->snapshot_lock, NULL);
+
     /*
      * set value for essential fields from options.
      */
@@ -250,7 +382,7 @@ oauth_token_t *oauth_token_new(const oauth_options_t *opts, oauth_writeback_func
 
 
     token->writeback_cb = cb;
-    token->user_data = user_data;
+    token->user_data = user_data ? ref(user_data) : NULL;
 
     /*
      * try restore access/refresh token from parsed json object.
@@ -271,14 +403,11 @@ int oauth_token_delete(oauth_token_t *token)
 
 int oauth_token_reset(oauth_token_t *token)
 {
-    assert(token->token_type);
+    assert(token->snapshot);
 
-    free(token->token_type);
-    token->token_type = NULL;
-    token->access_token = NULL;
-    token->refresh_token = NULL;
-
-    writeback_tokens(token);
+    pthread_mutex_lock(&token->lock);
+    update_tokens(token, NULL, 0);
+    pthread_mutex_unlock(&token->lock);
 
     return 0;
 }
@@ -473,28 +602,22 @@ static char *get_authorize_code(oauth_token_t *token,
     return (*code_buf ? code_buf : NULL);
 }
 
-static int decode_access_token(oauth_token_t *token, const char *json_str)
+static int decode_access_token(const char *json_str, token_snapshot_t **snap,
+                               time_t *expires_at)
 {
     cJSON *json;
     cJSON *item;
-    struct timeval now;
-    struct timeval interval;
-    char *token_type;
-    char *access_token;
-    char *refresh_token;
+    const char *token_type;
+    const char *access_token;
+    const char *refresh_token;
     int rc;
 
 #define IS_STRING_NODE(item)    (cJSON_IsString(item) && \
                                  (item)->valuestring && *(item)->valuestring)
 
-#define FREE(ptr)               do { \
-        if ((ptr)) \
-            free((ptr)); \
-        (ptr) = NULL;  \
-    } while(0)
-
-    assert(token);
     assert(json_str);
+    assert(snap);
+    assert(expires_at);
 
     json = cJSON_Parse(json_str);
     if (!json) {
@@ -509,20 +632,13 @@ static int decode_access_token(oauth_token_t *token, const char *json_str)
         rc = HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
         goto error_exit;
     }
-
-    token_type = strdup(item->valuestring);
-    if (!token_type) {
-        vlogE("OauthToken: Failed to duplicate token type.");
-        rc = HIVE_SYS_ERROR(errno);
-        goto error_exit;
-    }
+    token_type = item->valuestring;
 
     // Parse 'scope' item.
     item = cJSON_GetObjectItemCaseSensitive(json, "scope");
     if (!IS_STRING_NODE(item)) {
         vlogE("OauthToken: Json object named scope doesn't exist.");
         rc = HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
-        free(token_type);
         goto error_exit;
     }
 
@@ -531,58 +647,35 @@ static int decode_access_token(oauth_token_t *token, const char *json_str)
     if (!IS_STRING_NODE(item)) {
         vlogE("OauthToken: Json object named access_token doesn't exist.");
         rc = HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
-        free(token_type);
-        goto error_exit;
-    }
-
-    access_token = strdup(item->valuestring);
-    if (!access_token) {
-        vlogE("OauthToken: Failed to duplicate access token.");
-        rc = HIVE_SYS_ERROR(errno);
-        free(token_type);
         goto error_exit;
     }
+    access_token = item->valuestring;
 
     // Parse 'refresh_token' item
     item = cJSON_GetObjectItemCaseSensitive(json, "refresh_token");
     if (!IS_STRING_NODE(item)) {
         vlogE("OauthToken: Json object named refresh_token doesn't exist.");
         rc = HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
-        free(token_type);
-        free(access_token);
-        goto error_exit;
-    }
-
-    refresh_token = strdup(item->valuestring);
-    if (!refresh_token) {
-        vlogE("OauthToken: Failed to duplicate refresh token.");
-        rc = HIVE_SYS_ERROR(errno);
-        free(token_type);
-        free(access_token);
         goto error_exit;
     }
+    refresh_token = item->valuestring;
 
     // Parse 'expires_in' item.
     item = cJSON_GetObjectItemCaseSensitive(json, "expires_in");
     if (!cJSON_IsNumber(item) || item->valuedouble < 0) {
         vlogE("OauthToken: Json object named expires_in doesn't exist.");
         rc = HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
-        free(token_type);
-        free(access_token);
-        free(refresh_token);
         goto error_exit;
     }
 
-    FREE(token->token_type);
-
-    token->token_type    = token_type;
-    token->access_token  = access_token;
-    token->refresh_token = refresh_token;
+    *snap = snapshot_new(token_type, access_token, refresh_token);
+    if (!*snap) {
+        vlogE("OauthToken: Failed to create token snapshot.");
+        rc = HIVE_SYS_ERROR(errno);
+        goto error_exit;
+    }
 
-    gettimeofday(&now, NULL);
-    interval.tv_sec = (long)item->valuedouble;
-    interval.tv_usec = 0;
-    timeradd(&now, &interval, &token->expires_at);
+    *expires_at = time(NULL) + (time_t)item->valuedouble;
 
     cJSON_Delete(json);
     return 0;
@@ -601,6 +694,8 @@ static int redeem_access_token(oauth_token_t *token, char *code)
     char *client_id;
     char *redirect_uri;
     char *code_escaped;
+    token_snapshot_t *snap;
+    time_t expires_at;
     int rc;
 
     assert(token);
@@ -682,10 +777,16 @@ static int redeem_access_token(oauth_token_t *token, char *code)
         return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
     }
 
-    rc = decode_access_token(token, body);
-    free(body);
+    rc = decode_access_token(body, &snap, &expires_at);
+    http_client_release_response_body(body);
+    if (rc < 0)
+        return rc;
 
-    return rc;
+    pthread_mutex_lock(&token->lock);
+    update_tokens(token, snap, expires_at);
+    pthread_mutex_unlock(&token->lock);
+
+    return 0;
 
 error_exit:
     http_client_close(httpc);
@@ -702,7 +803,7 @@ int oauth_token_request(oauth_token_t *token,
     assert(token);
     assert(cb);
 
-    if (token->access_token) {
+    if (token->snapshot) {
         vlogI("OauthToken: Access token already exists.");
         return 0;
     }
@@ -720,11 +821,12 @@ int oauth_token_request(oauth_token_t *token,
 
     vlogI("OauthToken: Successfully redeem access token.");
 
-    writeback_tokens(token);
-
     return 0;
 }
 
+/*
+ * Must be called with token->lock held.
+ */
 static int refresh_access_token(oauth_token_t *token)
 {
     http_client_t *httpc;
@@ -734,8 +836,15 @@ static int refresh_access_token(oauth_token_t *token)
     char *client_id;
     char *redirect_uri;
     char *refresh_token;
+    token_snapshot_t *snap;
+    time_t expires_at;
     int rc;
 
+    if (!token->snapshot) {
+        vlogE("OauthToken: No refresh token to refresh access token.");
+        return HIVE_GENERAL_ERROR(HIVEERR_NOT_READY);
+    }
+
     httpc = http_client_new();
     if (!httpc) {
         vlogE("OauthToken: Failed to create http client instance.");
@@ -758,8 +867,8 @@ static int refresh_access_token(oauth_token_t *token)
         goto error_exit;
     }
 
-    refresh_token = http_client_escape(httpc, token->refresh_token,
-                                       strlen(token->refresh_token));
+    refresh_token = http_client_escape(httpc, token->snapshot->refresh_token,
+                                       strlen(token->snapshot->refresh_token));
     if (!refresh_token) {
         vlogE("OauthToken: Failed to escape refresh token.");
         rc = HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
@@ -813,12 +922,12 @@ static int refresh_access_token(oauth_token_t *token)
         return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
     }
 
-    rc = decode_access_token(token, body);
-    free(body);
+    rc = decode_access_token(body, &snap, &expires_at);
+    http_client_release_response_body(body);
     if (rc < 0)
         return rc;
 
-    writeback_tokens(token);
+    update_tokens(token, snap, expires_at);
 
     return 0;
 
@@ -827,41 +936,182 @@ error_exit:
     return rc;
 }
 
+/*
+ * Must be called with token->lock held. Threads that waited for the lock
+ * while this refresh was in flight pick up its result by refresh_seq.
+ */
+static int do_refresh(oauth_token_t *token)
+{
+    int rc;
+
+    rc = refresh_access_token(token);
+    if (rc < 0)
+        vlogE("OauthToken: Failed to refresh access token.");
+    else
+        vlogI("OauthToken: Successfully refreshed access token.");
+
+    token->refresh_rc = rc;
+    token->refresh_seq++;
+
+    return rc;
+}
+
+static void *refresher_entry(void *arg)
+{
+    oauth_token_t *token = (oauth_token_t *)arg;
+    struct timespec deadline;
+    time_t retry_at = 0;
+    time_t refresh_at;
+    time_t now;
+
+    pthread_mutex_lock(&token->lock);
+    while (!token->refresher_stopping) {
+        if (!token->snapshot) {
+            pthread_cond_wait(&token->cond, &token->lock);
+            continue;
+        }
+
+        now = time(NULL);
+        refresh_at = token->expires_at - (time_t)token->refresh_margin;
+        if (refresh_at < retry_at)
+            refresh_at = retry_at;
+
+        if (now < refresh_at) {
+            deadline.tv_sec = refresh_at;
+            deadline.tv_nsec = 0;
+            pthread_cond_timedwait(&token->cond, &token->lock, &deadline);
+            continue;
+        }
+
+        vlogD("OauthToken: Access token is about to expire, refresh it.");
+
+        if (do_refresh(token) < 0)
+            retry_at = now + REFRESH_RETRY_INTERVAL;
+        else
+            retry_at = 0;
+    }
+    pthread_mutex_unlock(&token->lock);
+
+    return NULL;
+}
+
+int oauth_token_start_refresher(oauth_token_t *token, unsigned int margin)
+{
+    int rc;
+
+    assert(token);
+
+    pthread_mutex_lock(&token->lock);
+    if (token->refresher_running) {
+        pthread_mutex_unlock(&token->lock);
+        return 0;
+    }
+
+    token->refresh_margin = margin;
+    token->refresher_stopping = false;
+
+    rc = pthread_create(&token->refresher, NULL, refresher_entry, token);
+    if (rc) {
+        pthread_mutex_unlock(&token->lock);
+        vlogE("OauthToken: Failed to start access token refresher.");
+        return HIVE_SYS_ERROR(rc);
+    }
+
+    token->refresher_running = true;
+    pthread_mutex_unlock(&token->lock);
+
+    return 0;
+}
+
+void oauth_token_stop_refresher(oauth_token_t *token)
+{
+    assert(token);
+
+    pthread_mutex_lock(&token->lock);
+    if (!token->refresher_running) {
+        pthread_mutex_unlock(&token->lock);
+        return;
+    }
+
+    token->refresher_stopping = true;
+    pthread_cond_signal(&token->cond);
+    pthread_mutex_unlock(&token->lock);
+
+    pthread_join(token->refresher, NULL);
+    token->refresher_running = false;
+}
+
 void oauth_token_set_expired(oauth_token_t *token)
 {
     assert(token);
-    memset(&token->expires_at, 0, sizeof(struct timeval));
+
+    token->expires_at = 0;
+    pthread_cond_signal(&token->cond);
 }
 
 bool oauth_token_is_expired(oauth_token_t *token)
 {
-    struct timeval now;
     assert(token);
 
-    gettimeofday(&now, NULL);
-    return timercmp(&now, &token->expires_at, >);
+    return time(NULL) > token->expires_at;
 }
 
 int oauth_token_check_expire(oauth_token_t *token)
 {
+    unsigned int seq;
     int rc;
 
     if (!oauth_token_is_expired(token))
         return 0;
 
-    vlogI("OauthToken: Access token expired.");
+    seq = token->refresh_seq;
 
-    rc = refresh_access_token(token);
-    if (rc < 0) {
-        vlogE("OauthToken: Failed to refresh access token.");
+    pthread_mutex_lock(&token->lock);
+    if (token->refresh_seq != seq) {
+        // Another thread just refreshed the token, share its result.
+        rc = token->refresh_rc;
+        pthread_mutex_unlock(&token->lock);
         return rc;
     }
 
-    vlogI("OauthToken: Successfully refreshed access token.");
-    return 0;
+    if (!oauth_token_is_expired(token)) {
+        pthread_mutex_unlock(&token->lock);
+        return 0;
+    }
+
+    vlogI("OauthToken: Access token expired.");
+
+    rc = do_refresh(token);
+    pthread_mutex_unlock(&token->lock);
+
+    return rc;
 }
 
 char *get_bearer_token(oauth_token_t *token)
 {
-    return token->access_token;
+    token_snapshot_t *snap = token->snapshot;
+
+    return snap ? snap->access_token : NULL;
+}
+
+http_header_list_t *get_auth_headers(oauth_token_t *token)
+{
+    http_header_list_t *headers = NULL;
+
+    pthread_mutex_lock(&token->snapshot_lock);
+    if (token->snapshot)
+        headers = ref(token->snapshot->headers);
+    pthread_mutex_unlock(&token->snapshot_lock);
+
+    return headers;
+}
+
+void set_auth_headers(http_client_t *httpc, oauth_token_t *token)
+{
+    http_header_list_t *headers;
+
+    headers = get_auth_headers(token);
+    http_client_set_header_list(httpc, headers);
+    if (headers)
+        deref(headers);
 }
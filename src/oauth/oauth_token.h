@@ -25,6 +25,8 @@
 
 typedef struct oauth_token oauth_token_t;
 typedef struct cJSON cJSON;
+typedef struct http_header_list http_header_list_t;
+typedef struct http_client http_client_t;
 
 typedef struct oauth_options {
     const char *authorize_url;
@@ -43,7 +45,9 @@ typedef struct oauth_options {
 typedef int oauth_writeback_func_t(const cJSON *json, void *user_data);
 
 /*
- * Create an oauth token instance.
+ * Create an oauth token instance. user_data must be a reference-counted
+ * object; the token holds a reference to it, since drives and files may
+ * keep the token alive after its owner is closed.
  */
 oauth_token_t *oauth_token_new(const oauth_options_t *opts, oauth_writeback_func_t *cb,
                                void *user_data);
@@ -69,6 +73,17 @@ typedef int oauth_request_func_t(const char *reqeust_url, void *user_data);
 int oauth_token_request(oauth_token_t *token, oauth_request_func_t *cb,
                         void *user_data);
 
+/*
+ * Start a background thread renewing the access token margin seconds
+ * before it expires.
+ */
+int oauth_token_start_refresher(oauth_token_t *token, unsigned int margin);
+
+/*
+ * Stop the background refresher if running.
+ */
+void oauth_token_stop_refresher(oauth_token_t *token);
+
 /*
  * Make the access token expired.
  */
@@ -85,4 +100,15 @@ int oauth_token_check_expire(oauth_token_t *token);
  */
 char *get_bearer_token(oauth_token_t *token);
 
+/*
+ * Get a reference to the preformatted authorization header of the current
+ * access token, to be released with deref() by the caller.
+ */
+http_header_list_t *get_auth_headers(oauth_token_t *token);
+
+/*
+ * Set the authorization header of the current access token on a request.
+ */
+void set_auth_headers(http_client_t *httpc, oauth_token_t *token);
+
 #endif // __OAUTH_TOKEN_H__
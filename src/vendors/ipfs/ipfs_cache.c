@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2019 Elastos Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <crystal.h>
+
+#include "ipfs_cache.h"
+#include "hashmap.h"
+
+typedef struct cache_block cache_block_t;
+
+struct cache_block {
+    cache_block_t *prev;
+    cache_block_t *next;
+    size_t keylen;
+    size_t len;
+    char key[160];
+    char data[0];
+};
+
+struct ipfs_cache {
+    pthread_mutex_t lock;
+    hashmap_t *blocks;
+    cache_block_t *head;    // most recently used.
+    cache_block_t *tail;
+    size_t capacity;
+    size_t used;
+};
+
+static size_t make_key(char *key, size_t len, const char *hash, uint64_t block)
+{
+    int rc;
+
+    rc = snprintf(key, len, "%s/%llu", hash, (unsigned long long)block);
+    if (rc < 0 || rc >= len)
+        return 0;
+
+    return (size_t)rc;
+}
+
+static void unlink_block(ipfs_cache_t *cache, cache_block_t *blk)
+{
+    if (blk->prev)
+        blk->prev->next = blk->next;
+    else
+        cache->head = blk->next;
+
+    if (blk->next)
+        blk->next->prev = blk->prev;
+    else
+        cache->tail = blk->prev;
+
+    blk->prev = blk->next = NULL;
+}
+
+static void push_front(ipfs_cache_t *cache, cache_block_t *blk)
+{
+    blk->prev = NULL;
+    blk->next = cache->head;
+
+    if (cache->head)
+        cache->head->prev = blk;
+    else
+        cache->tail = blk;
+
+    cache->head = blk;
+}
+
+static void drop_block(ipfs_cache_t *cache, cache_block_t *blk)
+{
+    unlink_block(cache, blk);
+    hashmap_remove(cache->blocks, blk->key, blk->keylen);
+    cache->used -= blk->len;
+    free(blk);
+}
+
+ssize_t ipfs_cache_get(ipfs_cache_t *cache, const char *hash, uint64_t block,
+                       size_t offset, char *buf, size_t len)
+{
+    cache_block_t *blk;
+    char key[160];
+    size_t keylen;
+    ssize_t nrd = -1;
+
+    keylen = make_key(key, sizeof(key), hash, block);
+    if (!keylen)
+        return -1;
+
+    pthread_mutex_lock(&cache->lock);
+    blk = (cache_block_t *)hashmap_get(cache->blocks, key, keylen);
+    if (blk) {
+        nrd = offset < blk->len ? blk->len - offset : 0;
+        if (nrd > len)
+            nrd = len;
+
+        memcpy(buf, blk->data + offset, nrd);
+
+        unlink_block(cache, blk);
+        push_front(cache, blk);
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    return nrd;
+}
+
+void ipfs_cache_put(ipfs_cache_t *cache, const char *hash, uint64_t block,
+                    const char *data, size_t len)
+{
+    cache_block_t *blk;
+    void *old = NULL;
+    int rc;
+
+    if (len > cache->capacity)
+        return;
+
+    blk = malloc(sizeof(*blk) + len);
+    if (!blk)
+        return;
+
+    blk->keylen = make_key(blk->key, sizeof(blk->key), hash, block);
+    if (!blk->keylen) {
+        free(blk);
+        return;
+    }
+
+    blk->len = len;
+    memcpy(blk->data, data, len);
+
+    pthread_mutex_lock(&cache->lock);
+
+    rc = hashmap_put(cache->blocks, blk->key, blk->keylen, blk, &old);
+    if (rc < 0) {
+        pthread_mutex_unlock(&cache->lock);
+        free(blk);
+        return;
+    }
+
+    if (old) {
+        cache_block_t *prev = (cache_block_t *)old;
+
+        unlink_block(cache, prev);
+        cache->used -= prev->len;
+        free(prev);
+    }
+
+    push_front(cache, blk);
+    cache->used += len;
+
+    while (cache->used > cache->capacity && cache->tail != blk)
+        drop_block(cache, cache->tail);
+
+    pthread_mutex_unlock(&cache->lock);
+}
+
+size_t ipfs_cache_get_capacity(ipfs_cache_t *cache)
+{
+    return cache->capacity;
+}
+
+static void ipfs_cache_destructor(void *obj)
+{
+    ipfs_cache_t *cache = (ipfs_cache_t *)obj;
+    cache_block_t *blk;
+
+    while ((blk = cache->head) != NULL) {
+        cache->head = blk->next;
+        free(blk);
+    }
+
+    if (cache->blocks)
+        hashmap_free(cache->blocks);
+
+    pthread_mutex_destroy(&cache->lock);
+}
+
+ipfs_cache_t *ipfs_cache_new(size_t capacity)
+{
+    ipfs_cache_t *cache;
+
+    cache = rc_zalloc(sizeof(ipfs_cache_t), ipfs_cache_destructor);
+    if (!cache)
+        return NULL;
+
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->capacity = capacity;
+
+    cache->blocks = hashmap_new(capacity / IPFS_CACHE_BLOCK_SIZE + 1);
+    if (!cache->blocks) {
+        deref(cache);
+        return NULL;
+    }
+
+    return cache;
+}
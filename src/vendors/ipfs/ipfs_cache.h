@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2019 Elastos Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __IPFS_CACHE_H__
+#define __IPFS_CACHE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define IPFS_CACHE_BLOCK_SIZE   (64 * 1024)
+
+typedef struct ipfs_cache ipfs_cache_t;
+
+/*
+ * In-memory LRU cache of file content blocks shared by all files of a
+ * client. Blocks are keyed by the content hash of the file they belong to
+ * and their index, so a file modification never hits stale blocks. Blocks
+ * shorter than IPFS_CACHE_BLOCK_SIZE mark the end of file.
+ */
+ipfs_cache_t *ipfs_cache_new(size_t capacity);
+size_t ipfs_cache_get_capacity(ipfs_cache_t *cache);
+
+/*
+ * Copies up to len bytes starting at offset within the cached block, and
+ * returns the number of bytes copied, or -1 if the block is not cached.
+ */
+ssize_t ipfs_cache_get(ipfs_cache_t *cache, const char *hash, uint64_t block,
+                       size_t offset, char *buf, size_t len);
+
+void ipfs_cache_put(ipfs_cache_t *cache, const char *hash, uint64_t block,
+                    const char *data, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __IPFS_CACHE_H__
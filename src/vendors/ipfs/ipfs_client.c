@@ -70,7 +70,6 @@
 typedef struct IPFSClient {
     HiveClient base;
     ipfs_rpc_t *rpc;
-    char token_cookie[MAXPATHLEN + 1];
 } IPFSClient;
 
 static int ipfs_client_login(HiveClient *base,
@@ -185,8 +184,13 @@ static int ipfs_client_drive_open(HiveClient *base, HiveDrive **drive)
 
 static int ipfs_client_close(HiveClient *base)
 {
+    IPFSClient *client = (IPFSClient *)base;
+
     assert(base);
 
+    if (client->rpc && ipfs_rpc_flush(client->rpc) < 0)
+        vlogW("IpfsClient: failed to publish pending mutations.");
+
     deref(base);
     return 0;
 }
@@ -195,8 +199,11 @@ static void ipfs_client_destructor(void *p)
 {
     IPFSClient *client = (IPFSClient *)p;
 
-    if (client->rpc)
+    if (client->rpc) {
+        // Drives and files may keep the rpc alive, but its owner is gone.
+        ipfs_rpc_stop_workers(client->rpc);
         ipfs_rpc_close(client->rpc);
+    }
 }
 
 static inline bool is_valid_ip(const char *ip)
@@ -261,7 +268,7 @@ static cJSON *load_ipfs_token_cookie(const char *path)
 
 static int writeback_token(const cJSON *json, void *user_data)
 {
-    IPFSClient *client = (IPFSClient *)user_data;
+    const char *token_cookie = (const char *)user_data;
     char *json_str;
     int json_str_len;
     int fd;
@@ -274,7 +281,7 @@ static int writeback_token(const cJSON *json, void *user_data)
         return -1;
     }
 
-    fd = open(client->token_cookie, O_WRONLY | O_TRUNC | O_CREAT, S_IRUSR | S_IWUSR);
+    fd = open(token_cookie, O_WRONLY | O_TRUNC | O_CREAT, S_IRUSR | S_IWUSR);
     if (fd < 0) {
         vlogE("IpfsClient: failed to open cookie file (%d).", errno);
         free(json_str);
@@ -302,6 +309,7 @@ HiveClient *ipfs_client_new(const HiveOptions *options)
     ipfs_rpc_options_t *token_options;
     size_t token_options_sz;
     char token_cookie[MAXPATHLEN + 1];
+    char *token_cookie_copy;
     cJSON *token_cookie_json = NULL;
     char path_tmp[PATH_MAX];
     IPFSClient *client;
@@ -322,6 +330,23 @@ HiveClient *ipfs_client_new(const HiveOptions *options)
     if (opts->uid)
         strcpy(token_options->uid, opts->uid);
 
+    // check publish policy configuration
+    if (opts->publish_policy < IPFSPublishPolicy_Immediate ||
+        opts->publish_policy > IPFSPublishPolicy_Manual)
+        return NULL;
+
+    token_options->publish_policy = opts->publish_policy;
+    token_options->publish_interval = opts->publish_interval ?
+                                      opts->publish_interval : 1000;
+    token_options->write_buffer_size = opts->write_buffer_size;
+    token_options->read_cache_size = opts->read_cache_size;
+    token_options->download_parallelism = opts->download_parallelism ?
+                                          opts->download_parallelism : 4;
+    token_options->download_range_size = opts->download_range_size ?
+                                         opts->download_range_size : 1024 * 1024;
+    token_options->health_check_interval = opts->health_check_interval;
+    token_options->sync_cache_ttl = opts->sync_cache_ttl;
+
     // check bootstraps configuration
     if (!opts->rpc_node_count)
         return NULL;
@@ -409,15 +434,26 @@ HiveClient *ipfs_client_new(const HiveOptions *options)
         return NULL;
     }
 
-    strcpy(client->token_cookie, token_cookie);
-
     client->base.login       = &ipfs_client_login;
     client->base.logout      = &ipfs_client_logout;
     client->base.get_info    = &ipfs_client_get_info;
     client->base.get_drive   = &ipfs_client_drive_open;
     client->base.close       = &ipfs_client_close;
 
-    client->rpc = ipfs_rpc_new(token_options, &writeback_token, client);
+    // The rpc may outlive the client, so it keeps its own cookie path.
+    token_cookie_copy = rc_zalloc(strlen(token_cookie) + 1, NULL);
+    if (!token_cookie_copy) {
+        if (token_options->store)
+            cJSON_Delete(token_options->store);
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY));
+        deref(client);
+        return NULL;
+    }
+    strcpy(token_cookie_copy, token_cookie);
+
+    client->rpc = ipfs_rpc_new(token_options, &writeback_token,
+                               token_cookie_copy);
+    deref(token_cookie_copy);
     if (token_options->store)
         cJSON_Delete(token_options->store);
     if (!client->rpc) {
@@ -23,6 +23,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stddef.h>
+#include <string.h>
+#include <limits.h>
 #include <assert.h>
 
 #include <crystal.h>
@@ -34,9 +36,11 @@
 #include "ipfs_constants.h"
 #include "ipfs_utils.h"
 #include "http_client.h"
+#include "json_scanner.h"
 #include "hive_error.h"
 #include "hive_client.h"
 #include "http_status.h"
+#include "hive_async.h"
 
 typedef struct IPFSDrive {
     HiveDrive base;
@@ -61,6 +65,63 @@ static int ipfs_drive_get_info(HiveDrive *base, HiveDriveInfo *info)
     return 0;
 }
 
+static int parse_file_stat_response(const char *response, HiveFileInfo *info)
+{
+    cJSON *json;
+    cJSON *item;
+    int rc;
+
+    assert(response);
+    assert(info);
+
+    json = cJSON_Parse(response);
+    if (!json) {
+        vlogE("IpfsDrive: invalid json format from response.");
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+    }
+
+    item = cJSON_GetObjectItem(json, "Hash");
+    if (!item ||
+        !cJSON_IsString(item) ||
+        !item->valuestring ||
+        !*item->valuestring ||
+        strlen(item->valuestring) >= sizeof(info->fileid)) {
+        cJSON_Delete(json);
+        vlogE("IpfsDrive: missing Hash json object from response.");
+        return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+    }
+
+    rc = snprintf(info->fileid, sizeof(info->fileid),
+                  "/ipfs/%s", item->valuestring);
+    if (rc < 0 || rc >= sizeof(info->fileid)) {
+        vlogE("IpfsDrive: file id field of file info too small.");
+        cJSON_Delete(json);
+        return HIVE_GENERAL_ERROR(HIVEERR_BUFFER_TOO_SMALL);
+    }
+
+    item = cJSON_GetObjectItem(json, "Type");
+    if (!item || !cJSON_IsString(item) || !item->valuestring || !*item->valuestring ||
+        (strcmp(item->valuestring, "file") && strcmp(item->valuestring, "directory"))) {
+        vlogE("IpfsDrive: missing Type json object from response.");
+        cJSON_Delete(json);
+        return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+    }
+
+    strcpy(info->type, item->valuestring);
+
+    item = cJSON_GetObjectItem(json, "Size");
+    if (!item || !cJSON_IsNumber(item)) {
+        vlogE("IpfsDrive: missing Size json object from response.");
+        cJSON_Delete(json);
+        return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+    }
+
+    info->size = (size_t)item->valuedouble;
+    cJSON_Delete(json);
+
+    return 0;
+}
+
 static int ipfs_drive_stat_file(HiveDrive *base, const char *path,
                                 HiveFileInfo *info)
 {
@@ -68,8 +129,6 @@ static int ipfs_drive_stat_file(HiveDrive *base, const char *path,
     char buf[MAX_URL_LEN] = {0};
     http_client_t *httpc;
     long resp_code = 0;
-    cJSON *json;
-    cJSON *item;
     char *p;
     int rc;
 
@@ -83,9 +142,9 @@ static int ipfs_drive_stat_file(HiveDrive *base, const char *path,
         return rc;
     }
 
-    sprintf(buf, "http://%s:%u/api/v0/files/stat",
-            ipfs_rpc_get_current_node_ip(drive->rpc),
-            (unsigned)ipfs_rpc_get_current_node_port(drive->rpc));
+    rc = ipfs_rpc_get_node_url(drive->rpc, "files/stat", buf, sizeof(buf));
+    if (rc < 0)
+        return rc;
 
     httpc = http_client_new();
     if (!httpc) {
@@ -133,110 +192,116 @@ static int ipfs_drive_stat_file(HiveDrive *base, const char *path,
         return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
     }
 
-    json = cJSON_Parse(p);
-    free(p);
+    rc = parse_file_stat_response(p, info);
+    http_client_release_response_body(p);
 
-    if (!json) {
-        vlogE("IpfsDrive: invalid json format from response.");
-        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
-    }
+    return rc;
 
-    item = cJSON_GetObjectItem(json, "Hash");
-    if (!item ||
-        !cJSON_IsString(item) ||
-        !item->valuestring ||
-        !*item->valuestring ||
-        strlen(item->valuestring) >= sizeof(info->fileid)) {
-        cJSON_Delete(json);
-        vlogE("IpfsDrive: missing Hash json object from response.");
-        return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
-    }
+error_exit:
+    http_client_close(httpc);
+    return rc;
+}
 
-    rc = snprintf(info->fileid, sizeof(info->fileid),
-                  "/ipfs/%s", item->valuestring);
-    if (rc < 0 || rc >= sizeof(info->fileid)) {
-        vlogE("IpfsDrive: file id field of file info too small.");
-        cJSON_Delete(json);
-        return HIVE_GENERAL_ERROR(HIVEERR_BUFFER_TOO_SMALL);
-    }
+/*
+ * Entries of a files/ls listing, as they are scanned out of the response.
+ * Synchronous listings hand each one to the iterate callback right away,
+ * asynchronous ones keep just the names until the result is delivered.
+ */
+typedef struct list_context {
+    HiveFilesIterateCallback *callback;
+    void *context;
+    cJSON *entries;
+    char name[PATH_MAX];
+    bool has_name;
+    bool has_entries;
+    int rc;
+} list_context_t;
 
-    item = cJSON_GetObjectItem(json, "Type");
-    if (!item || !cJSON_IsString(item) || !item->valuestring || !*item->valuestring ||
-        (strcmp(item->valuestring, "file") && strcmp(item->valuestring, "directory"))) {
-        vlogE("IpfsDrive: missing Type json object from response.");
-        cJSON_Delete(json);
-        return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
-    }
+static bool list_context_fail(list_context_t *ctx, const char *what)
+{
+    vlogE("IpfsDrive: %s.", what);
+    ctx->rc = HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+    return false;
+}
 
-    strcpy(info->type, item->valuestring);
+static bool on_list_entry(int depth, const char *key, json_scan_type_t type,
+                          const char *value, void *context)
+{
+    list_context_t *ctx = (list_context_t *)context;
+    KeyValue properties[1];
+    cJSON *name;
 
-    item = cJSON_GetObjectItem(json, "Size");
-    if (!item || !cJSON_IsNumber(item)) {
-        vlogE("IpfsDrive: missing Size json object from response.");
-        cJSON_Delete(json);
-        return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+    if (depth == 0) {
+        if (strcmp(key, "Entries"))
+            return true;
+
+        if (type != JSON_SCAN_ARRAY && type != JSON_SCAN_NULL)
+            return list_context_fail(ctx, "missing Entries json ojbect");
+
+        ctx->has_entries = true;
+        return true;
     }
 
-    info->size = (size_t)item->valuedouble;
-    cJSON_Delete(json);
+    if (type != JSON_SCAN_END) {
+        if (strcmp(key, "Name"))
+            return true;
 
-    return 0;
+        if (type != JSON_SCAN_STRING || !*value ||
+            strlen(value) >= sizeof(ctx->name))
+            return list_context_fail(ctx, "bad Name of Entries element");
 
-error_exit:
-    http_client_close(httpc);
-    return rc;
-}
+        strcpy(ctx->name, value);
+        ctx->has_name = true;
+        return true;
+    }
 
-static cJSON *parse_list_files_response(const char *response)
-{
-    cJSON *json;
-    cJSON *entries;
-    cJSON *entry;
+    if (!ctx->has_name)
+        return list_context_fail(ctx, "element of Entries array misses Name object");
 
-    assert(response);
+    ctx->has_name = false;
 
-    json = cJSON_Parse(response);
-    if (!json) {
-        vlogE("IpfsDrive: invalid json format.");
-        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY));
-        return NULL;
-    }
+    if (ctx->entries) {
+        name = cJSON_CreateString(ctx->name);
+        if (!name) {
+            ctx->rc = HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+            return false;
+        }
 
-    entries = cJSON_GetObjectItemCaseSensitive(json, "Entries");
-    if (!entries || (!cJSON_IsArray(entries) && !cJSON_IsNull(entries))) {
-        vlogE("IpfsDrive: missing Entries json ojbect.");
-        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT));
-        cJSON_Delete(json);
-        return NULL;
+        cJSON_AddItemToArray(ctx->entries, name);
+        return true;
     }
 
-    if (cJSON_IsNull(entries)) {
-        hive_set_error(HIVEOK);
-        cJSON_Delete(json);
-        return NULL;
-    }
+    properties[0].key   = "name";
+    properties[0].value = ctx->name;
 
-    cJSON_ArrayForEach(entry, entries) {
-        cJSON *name;
+    return ctx->callback(properties, sizeof(properties) / sizeof(properties[0]),
+                         ctx->context);
+}
 
-        if (!cJSON_IsObject(entry)) {
-            vlogE("IpfsDrive: element of Entries array is not json object type.");
-            hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT));
-            cJSON_Delete(json);
-            return NULL;
-        }
+/*
+ * Returns 1 if the application stopped the listing, 0 once all entries
+ * are through, or a negative error.
+ */
+static int finish_list(list_context_t *ctx, json_scanner_t *scanner)
+{
+    int rc;
 
-        name = cJSON_GetObjectItemCaseSensitive(entry, "Name");
-        if (!name || !cJSON_IsString(name) || !name->valuestring ||
-            !*name->valuestring) {
-            vlogE("IpfsDrive: element of Entries array misses Name object.");
-            hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT));
-            cJSON_Delete(json);
-            return NULL;
-        }
+    if (ctx->rc < 0)
+        return ctx->rc;
+
+    rc = json_scanner_finish(scanner);
+    if (rc) {
+        if (rc < 0)
+            vlogE("IpfsDrive: invalid json format.");
+        return rc;
     }
 
-    return json;
+    if (!ctx->has_entries) {
+        vlogE("IpfsDrive: missing Entries json ojbect.");
+        return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+    }
+
+    return 0;
 }
 
 static void notify_file_entries(cJSON *entries,
@@ -247,22 +312,17 @@ static void notify_file_entries(cJSON *entries,
 
     assert(callback);
 
-    if (cJSON_IsArray(entries)) {
-        cJSON_ArrayForEach(entry, entries) {
-            cJSON *name;
-            KeyValue properties[1];
-            bool resume;
-
-            name = cJSON_GetObjectItemCaseSensitive(entry, "Name");
+    cJSON_ArrayForEach(entry, entries) {
+        KeyValue properties[1];
+        bool resume;
 
-            properties[0].key   = "name";
-            properties[0].value = name->valuestring;
+        properties[0].key   = "name";
+        properties[0].value = entry->valuestring;
 
-            resume = callback(properties, sizeof(properties) / sizeof(properties[0]),
-                              context);
-            if (!resume)
-                return;
-        }
+        resume = callback(properties, sizeof(properties) / sizeof(properties[0]),
+                          context);
+        if (!resume)
+            return;
     }
     callback(NULL, 0, context);
 }
@@ -273,9 +333,9 @@ static int ipfs_drive_list_files(HiveDrive *base, const char *path,
     IPFSDrive *drive = (IPFSDrive *)base;
     char url[MAX_URL_LEN] = {0};
     http_client_t *httpc;
+    json_scanner_t *scanner;
+    list_context_t ctx;
     long resp_code;
-    cJSON *response;
-    char *p;
     int rc;
 
     rc = ipfs_rpc_check_reachable(drive->rpc);
@@ -284,13 +344,24 @@ static int ipfs_drive_list_files(HiveDrive *base, const char *path,
         return rc;
     }
 
-    sprintf(url, "http://%s:%u/api/v0/files/ls",
-            ipfs_rpc_get_current_node_ip(drive->rpc),
-            (unsigned)ipfs_rpc_get_current_node_port(drive->rpc));
+    rc = ipfs_rpc_get_node_url(drive->rpc, "files/ls", url, sizeof(url));
+    if (rc < 0)
+        return rc;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.callback = callback;
+    ctx.context = context;
+
+    scanner = json_scanner_new("Entries", on_list_entry, &ctx);
+    if (!scanner) {
+        vlogE("IpfsDrive: failed to create json scanner.");
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+    }
 
     httpc = http_client_new();
     if (!httpc) {
         vlogE("IpfsDrive: failed to create http client instance.");
+        json_scanner_delete(scanner);
         return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
     }
 
@@ -299,9 +370,13 @@ static int ipfs_drive_list_files(HiveDrive *base, const char *path,
     http_client_set_query(httpc, "path", path);
     http_client_set_method(httpc, HTTP_METHOD_POST);
     http_client_set_request_body_instant(httpc, NULL, 0);
-    http_client_enable_response_body(httpc);
+    // Entries reach the callback as the body streams in.
+    json_scanner_attach(scanner, httpc, HttpStatus_OK);
 
     rc = http_client_request(httpc);
+    if (rc && json_scanner_aborted(scanner))
+        rc = 0;
+
     if (rc) {
         rc = HIVE_CURL_ERROR(rc);
         if (RC_NODE_UNREACHABLE(rc)) {
@@ -326,28 +401,22 @@ static int ipfs_drive_list_files(HiveDrive *base, const char *path,
         goto error_exit;
     }
 
-    p = http_client_move_response_body(httpc, NULL);
     http_client_close(httpc);
 
-    if (!p) {
-        vlogE("IpfsDrive: failed to get response body.");
-        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
-    }
-
-    response = parse_list_files_response(p);
-    free(p);
-    if (!response && hive_get_error() != HIVEOK) {
+    rc = finish_list(&ctx, scanner);
+    json_scanner_delete(scanner);
+    if (rc < 0) {
         vlogE("IpfsDrive: failed to parse response body.");
-        return hive_get_error();
+        return rc;
     }
 
-    notify_file_entries(cJSON_GetObjectItemCaseSensitive(response, "Entries"),
-                        callback, context);
-    cJSON_Delete(response);
+    if (rc == 0)
+        callback(NULL, 0, context);
     return 0;
 
 error_exit:
     http_client_close(httpc);
+    json_scanner_delete(scanner);
     return rc;
 }
 
@@ -365,9 +434,9 @@ static int ipfs_drive_make_dir(HiveDrive *base, const char *path)
         return rc;
     }
 
-    sprintf(url, "http://%s:%u/api/v0/files/mkdir",
-            ipfs_rpc_get_current_node_ip(drive->rpc),
-            (unsigned)ipfs_rpc_get_current_node_port(drive->rpc));
+    rc = ipfs_rpc_get_node_url(drive->rpc, "files/mkdir", url, sizeof(url));
+    if (rc < 0)
+        return rc;
 
     httpc = http_client_new();
     if (!httpc) {
@@ -406,14 +475,9 @@ static int ipfs_drive_make_dir(HiveDrive *base, const char *path)
         return HIVE_HTTP_STATUS_ERROR(resp_code);
     }
 
-    rc = publish_root_hash(drive->rpc, url, sizeof(url));
+    rc = ipfs_rpc_publish(drive->rpc, true);
     if (rc < 0) {
-        if (RC_NODE_UNREACHABLE(rc)) {
-            vlogE("IpfsDrive: current node is not reachable.");
-            rc = HIVE_GENERAL_ERROR(HIVEERR_TRY_AGAIN);
-            ipfs_rpc_mark_node_unreachable(drive->rpc);
-        } else
-            vlogE("IpfsDrive: failed to publish root hash.");
+        vlogE("IpfsDrive: failed to publish root hash.");
         return rc;
     }
 
@@ -438,9 +502,9 @@ static int ipfs_drive_move_file(HiveDrive *base, const char *old, const char *ne
         return rc;
     }
 
-    sprintf(url, "http://%s:%u/api/v0/files/mv",
-            ipfs_rpc_get_current_node_ip(drive->rpc),
-            (unsigned)ipfs_rpc_get_current_node_port(drive->rpc));
+    rc = ipfs_rpc_get_node_url(drive->rpc, "files/mv", url, sizeof(url));
+    if (rc < 0)
+        return rc;
 
     httpc = http_client_new();
     if (!httpc) {
@@ -479,14 +543,9 @@ static int ipfs_drive_move_file(HiveDrive *base, const char *old, const char *ne
         return HIVE_HTTP_STATUS_ERROR(resp_code);
     }
 
-    rc = publish_root_hash(drive->rpc, url, sizeof(url));
+    rc = ipfs_rpc_publish(drive->rpc, true);
     if (rc < 0) {
-        if (RC_NODE_UNREACHABLE(rc)) {
-            vlogE("IpfsDrive: current node is not reachable.");
-            rc = HIVE_GENERAL_ERROR(HIVEERR_TRY_AGAIN);
-            ipfs_rpc_mark_node_unreachable(drive->rpc);
-        } else
-            vlogE("IpfsDrive: failed to publish root hash.");
+        vlogE("IpfsDrive: failed to publish root hash.");
         return rc;
     }
 
@@ -518,9 +577,9 @@ static int ipfs_drive_copy_file(HiveDrive *base, const char *src_path, const cha
         return rc;
     }
 
-    sprintf(url, "http://%s:%u/api/v0/files/cp",
-            ipfs_rpc_get_current_node_ip(drive->rpc),
-            (unsigned)ipfs_rpc_get_current_node_port(drive->rpc));
+    rc = ipfs_rpc_get_node_url(drive->rpc, "files/cp", url, sizeof(url));
+    if (rc < 0)
+        return rc;
 
     httpc = http_client_new();
     if (!httpc) {
@@ -559,14 +618,9 @@ static int ipfs_drive_copy_file(HiveDrive *base, const char *src_path, const cha
         return HIVE_HTTP_STATUS_ERROR(resp_code);
     }
 
-    rc = publish_root_hash(drive->rpc, url, sizeof(url));
+    rc = ipfs_rpc_publish(drive->rpc, true);
     if (rc < 0) {
-        if (RC_NODE_UNREACHABLE(rc)) {
-            vlogE("IpfsDrive: current node is not reachable.");
-            rc = HIVE_GENERAL_ERROR(HIVEERR_TRY_AGAIN);
-            ipfs_rpc_mark_node_unreachable(drive->rpc);
-        } else
-            vlogE("IpfsDrive: failed to publish root hash.");
+        vlogE("IpfsDrive: failed to publish root hash.");
         return rc;
     }
 
@@ -591,9 +645,9 @@ static int ipfs_drive_delete_file(HiveDrive *base, const char *path)
         return rc;
     }
 
-    sprintf(url, "http://%s:%u/api/v0/files/rm",
-            ipfs_rpc_get_current_node_ip(drive->rpc),
-            (unsigned)ipfs_rpc_get_current_node_port(drive->rpc));
+    rc = ipfs_rpc_get_node_url(drive->rpc, "files/rm", url, sizeof(url));
+    if (rc < 0)
+        return rc;
 
     httpc = http_client_new();
     if (!httpc) {
@@ -632,15 +686,9 @@ static int ipfs_drive_delete_file(HiveDrive *base, const char *path)
         return HIVE_HTTP_STATUS_ERROR(resp_code);
     }
 
-    rc = publish_root_hash(drive->rpc, url, sizeof(url));
+    rc = ipfs_rpc_publish(drive->rpc, true);
     if (rc < 0) {
-        if (RC_NODE_UNREACHABLE(rc)) {
-            vlogE("IpfsDrive: current node is not reachable.");
-            rc = HIVE_GENERAL_ERROR(HIVEERR_TRY_AGAIN);
-            ipfs_rpc_mark_node_unreachable(drive->rpc);
-        } else
-            vlogE("IpfsDrive: failed to publish root hash.");
-
+        vlogE("IpfsDrive: failed to publish root hash.");
         return rc;
     }
 
@@ -651,6 +699,396 @@ error_exit:
     return rc;
 }
 
+typedef struct ipfs_drive_op {
+    hive_async_op_t base;
+    hive_async_t *async;
+    http_engine_t *engine;
+    ipfs_rpc_t *rpc;
+    HiveFileInfo *info;
+    HiveFilesIterateCallback *iterate;
+    json_scanner_t *scanner;
+    list_context_t list;
+    char dest[PATH_MAX];
+} ipfs_drive_op_t;
+
+static void ipfs_drive_op_destructor(void *obj)
+{
+    ipfs_drive_op_t *op = (ipfs_drive_op_t *)obj;
+
+    if (op->scanner)
+        json_scanner_delete(op->scanner);
+
+    if (op->list.entries)
+        cJSON_Delete(op->list.entries);
+
+    if (op->rpc)
+        ipfs_rpc_close(op->rpc);
+
+    if (op->async)
+        deref(op->async);
+}
+
+static ipfs_drive_op_t *ipfs_drive_op_new(IPFSDrive *drive,
+                                          HiveCompletionCallback *callback,
+                                          void *context, int *rc)
+{
+    ipfs_drive_op_t *op;
+    http_engine_t *engine;
+
+    *rc = ipfs_rpc_check_reachable(drive->rpc);
+    if (*rc < 0) {
+        vlogE("IpfsDrive: failed to check node's connectivity.");
+        return NULL;
+    }
+
+    engine = hive_async_get_engine(drive->base.async);
+    if (!engine) {
+        *rc = hive_get_error();
+        return NULL;
+    }
+
+    op = hive_async_op_new(sizeof(ipfs_drive_op_t), callback, context,
+                           ipfs_drive_op_destructor);
+    if (!op) {
+        *rc = HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+        return NULL;
+    }
+
+    op->async  = ref(drive->base.async);
+    op->engine = engine;
+    op->rpc    = ref(drive->rpc);
+
+    return op;
+}
+
+static void ipfs_drive_op_complete(ipfs_drive_op_t *op, int rc)
+{
+    hive_async_op_complete(op->async, &op->base, rc);
+}
+
+static void on_published(int rc, void *arg)
+{
+    ipfs_drive_op_complete((ipfs_drive_op_t *)arg, rc);
+}
+
+static void on_mutation_done(http_client_t *httpc, int rc, void *arg)
+{
+    ipfs_drive_op_t *op = (ipfs_drive_op_t *)arg;
+
+    rc = ipfs_check_response(op->rpc, httpc, rc);
+    http_client_close(httpc);
+
+    if (rc < 0) {
+        ipfs_drive_op_complete(op, rc);
+        return;
+    }
+
+    if (ipfs_rpc_defer_publish(op->rpc, true)) {
+        ipfs_drive_op_complete(op, 0);
+        return;
+    }
+
+    rc = publish_root_hash_async(op->rpc, op->engine, on_published, op);
+    if (rc < 0)
+        ipfs_drive_op_complete(op, rc);
+}
+
+static void on_stat_done(http_client_t *httpc, int rc, void *arg)
+{
+    ipfs_drive_op_t *op = (ipfs_drive_op_t *)arg;
+    char *p;
+
+    rc = ipfs_check_response(op->rpc, httpc, rc);
+    if (rc < 0) {
+        http_client_close(httpc);
+        ipfs_drive_op_complete(op, rc);
+        return;
+    }
+
+    p = http_client_move_response_body(httpc, NULL);
+    http_client_close(httpc);
+
+    if (!p) {
+        vlogE("IpfsDrive: failed to get response body.");
+        ipfs_drive_op_complete(op, HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY));
+        return;
+    }
+
+    rc = parse_file_stat_response(p, op->info);
+    http_client_release_response_body(p);
+
+    ipfs_drive_op_complete(op, rc);
+}
+
+static int ipfs_drive_stat_file_async(HiveDrive *base, const char *path,
+                                      HiveFileInfo *info,
+                                      HiveCompletionCallback *callback,
+                                      void *context)
+{
+    IPFSDrive *drive = (IPFSDrive *)base;
+    ipfs_drive_op_t *op;
+    http_client_t *httpc;
+    int rc;
+
+    op = ipfs_drive_op_new(drive, callback, context, &rc);
+    if (!op)
+        return rc;
+
+    httpc = ipfs_http_client_new(drive->rpc, "files/stat");
+    if (!httpc) {
+        deref(op);
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+    }
+
+    http_client_set_query(httpc, "path", path);
+    http_client_set_request_body_instant(httpc, NULL, 0);
+    http_client_enable_response_body(httpc);
+
+    op->info = info;
+    http_client_submit(op->engine, httpc, on_stat_done, op);
+    return 0;
+}
+
+static void deliver_file_entries(hive_async_op_t *base)
+{
+    ipfs_drive_op_t *op = (ipfs_drive_op_t *)base;
+
+    notify_file_entries(op->list.entries, op->iterate, op->base.context);
+}
+
+static void on_list_done(http_client_t *httpc, int rc, void *arg)
+{
+    ipfs_drive_op_t *op = (ipfs_drive_op_t *)arg;
+
+    if (rc && json_scanner_aborted(op->scanner))
+        rc = 0;
+
+    rc = ipfs_check_response(op->rpc, httpc, rc);
+    http_client_close(httpc);
+
+    if (rc < 0) {
+        ipfs_drive_op_complete(op, rc);
+        return;
+    }
+
+    rc = finish_list(&op->list, op->scanner);
+    if (rc < 0) {
+        vlogE("IpfsDrive: failed to parse response body.");
+        ipfs_drive_op_complete(op, rc);
+        return;
+    }
+
+    op->base.deliver = deliver_file_entries;
+    ipfs_drive_op_complete(op, 0);
+}
+
+static int ipfs_drive_list_files_async(HiveDrive *base, const char *path,
+                                       HiveFilesIterateCallback *iterate,
+                                       HiveCompletionCallback *callback,
+                                       void *context)
+{
+    IPFSDrive *drive = (IPFSDrive *)base;
+    ipfs_drive_op_t *op;
+    http_client_t *httpc;
+    int rc;
+
+    op = ipfs_drive_op_new(drive, callback, context, &rc);
+    if (!op)
+        return rc;
+
+    // Names are collected off the engine thread and handed out on delivery.
+    op->list.entries = cJSON_CreateArray();
+    op->scanner = json_scanner_new("Entries", on_list_entry, &op->list);
+    if (!op->list.entries || !op->scanner) {
+        deref(op);
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+    }
+
+    httpc = ipfs_http_client_new(drive->rpc, "files/ls");
+    if (!httpc) {
+        deref(op);
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+    }
+
+    http_client_set_query(httpc, "path", path);
+    http_client_set_request_body_instant(httpc, NULL, 0);
+    json_scanner_attach(op->scanner, httpc, HttpStatus_OK);
+
+    op->iterate = iterate;
+    http_client_submit(op->engine, httpc, on_list_done, op);
+    return 0;
+}
+
+static int ipfs_drive_make_dir_async(HiveDrive *base, const char *path,
+                                     HiveCompletionCallback *callback,
+                                     void *context)
+{
+    IPFSDrive *drive = (IPFSDrive *)base;
+    ipfs_drive_op_t *op;
+    http_client_t *httpc;
+    int rc;
+
+    op = ipfs_drive_op_new(drive, callback, context, &rc);
+    if (!op)
+        return rc;
+
+    httpc = ipfs_http_client_new(drive->rpc, "files/mkdir");
+    if (!httpc) {
+        deref(op);
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+    }
+
+    http_client_set_query(httpc, "path", path);
+    http_client_set_query(httpc, "parents", "true");
+    http_client_set_request_body_instant(httpc, NULL, 0);
+
+    http_client_submit(op->engine, httpc, on_mutation_done, op);
+    return 0;
+}
+
+static int ipfs_drive_move_file_async(HiveDrive *base, const char *old,
+                                      const char *new,
+                                      HiveCompletionCallback *callback,
+                                      void *context)
+{
+    IPFSDrive *drive = (IPFSDrive *)base;
+    ipfs_drive_op_t *op;
+    http_client_t *httpc;
+    int rc;
+
+    op = ipfs_drive_op_new(drive, callback, context, &rc);
+    if (!op)
+        return rc;
+
+    httpc = ipfs_http_client_new(drive->rpc, "files/mv");
+    if (!httpc) {
+        deref(op);
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+    }
+
+    http_client_set_query(httpc, "source", old);
+    http_client_set_query(httpc, "dest", new);
+    http_client_set_request_body_instant(httpc, NULL, 0);
+
+    http_client_submit(op->engine, httpc, on_mutation_done, op);
+    return 0;
+}
+
+static void on_copy_source_stat(http_client_t *httpc, int rc, void *arg)
+{
+    ipfs_drive_op_t *op = (ipfs_drive_op_t *)arg;
+    HiveFileInfo src_info;
+    char *p;
+
+    rc = ipfs_check_response(op->rpc, httpc, rc);
+    if (rc < 0) {
+        http_client_close(httpc);
+        ipfs_drive_op_complete(op, rc);
+        return;
+    }
+
+    p = http_client_move_response_body(httpc, NULL);
+    http_client_close(httpc);
+
+    if (!p) {
+        vlogE("IpfsDrive: failed to get response body.");
+        ipfs_drive_op_complete(op, HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY));
+        return;
+    }
+
+    rc = parse_file_stat_response(p, &src_info);
+    http_client_release_response_body(p);
+    if (rc < 0) {
+        ipfs_drive_op_complete(op, rc);
+        return;
+    }
+
+    httpc = ipfs_http_client_new(op->rpc, "files/cp");
+    if (!httpc) {
+        ipfs_drive_op_complete(op, HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY));
+        return;
+    }
+
+    http_client_set_query(httpc, "source", src_info.fileid);
+    http_client_set_query(httpc, "dest", op->dest);
+    http_client_set_request_body_instant(httpc, NULL, 0);
+
+    http_client_submit(op->engine, httpc, on_mutation_done, op);
+}
+
+static int ipfs_drive_copy_file_async(HiveDrive *base, const char *src_path,
+                                      const char *dest_path,
+                                      HiveCompletionCallback *callback,
+                                      void *context)
+{
+    IPFSDrive *drive = (IPFSDrive *)base;
+    ipfs_drive_op_t *op;
+    http_client_t *httpc;
+    int rc;
+
+    if (strlen(dest_path) >= sizeof(op->dest)) {
+        vlogE("IpfsDrive: destination path too long.");
+        return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
+    }
+
+    op = ipfs_drive_op_new(drive, callback, context, &rc);
+    if (!op)
+        return rc;
+
+    httpc = ipfs_http_client_new(drive->rpc, "files/stat");
+    if (!httpc) {
+        deref(op);
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+    }
+
+    http_client_set_query(httpc, "path", src_path);
+    http_client_set_request_body_instant(httpc, NULL, 0);
+    http_client_enable_response_body(httpc);
+
+    strcpy(op->dest, dest_path);
+    http_client_submit(op->engine, httpc, on_copy_source_stat, op);
+    return 0;
+}
+
+static int ipfs_drive_delete_file_async(HiveDrive *base, const char *path,
+                                        HiveCompletionCallback *callback,
+                                        void *context)
+{
+    IPFSDrive *drive = (IPFSDrive *)base;
+    ipfs_drive_op_t *op;
+    http_client_t *httpc;
+    int rc;
+
+    op = ipfs_drive_op_new(drive, callback, context, &rc);
+    if (!op)
+        return rc;
+
+    httpc = ipfs_http_client_new(drive->rpc, "files/rm");
+    if (!httpc) {
+        deref(op);
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+    }
+
+    http_client_set_query(httpc, "path", path);
+    http_client_set_query(httpc, "recursive", "true");
+    http_client_set_request_body_instant(httpc, NULL, 0);
+
+    http_client_submit(op->engine, httpc, on_mutation_done, op);
+    return 0;
+}
+
+static int ipfs_drive_flush(HiveDrive *base)
+{
+    IPFSDrive *drive = (IPFSDrive *)base;
+    int rc;
+
+    rc = ipfs_rpc_flush(drive->rpc);
+    if (rc < 0)
+        vlogE("IpfsDrive: failed to publish pending mutations.");
+
+    return rc;
+}
+
 static void ipfs_drive_close(HiveDrive *obj)
 {
     deref(obj);
@@ -698,8 +1136,16 @@ HiveDrive *ipfs_drive_open(ipfs_rpc_t *rpc)
     drive->base.copy_file   = &ipfs_drive_copy_file;
     drive->base.delete_file = &ipfs_drive_delete_file;
     drive->base.open_file   = &ipfs_drive_open_file;
+    drive->base.flush       = &ipfs_drive_flush;
     drive->base.close       = &ipfs_drive_close;
 
+    drive->base.stat_file_async   = &ipfs_drive_stat_file_async;
+    drive->base.list_files_async  = &ipfs_drive_list_files_async;
+    drive->base.make_dir_async    = &ipfs_drive_make_dir_async;
+    drive->base.move_file_async   = &ipfs_drive_move_file_async;
+    drive->base.copy_file_async   = &ipfs_drive_copy_file_async;
+    drive->base.delete_file_async = &ipfs_drive_delete_file_async;
+
     drive->rpc              = ref(rpc);
 
     return &drive->base;
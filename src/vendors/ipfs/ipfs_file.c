@@ -23,6 +23,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <limits.h>
+#include <string.h>
+
+#ifdef HAVE_SYS_PARAM_H
+#include <sys/param.h>
+#endif
 
 #include <crystal.h>
 
@@ -32,14 +38,43 @@
 #include "hive_client.h"
 #include "http_client.h"
 #include "http_status.h"
+#include "hive_async.h"
+
+#ifndef MIN
+#define MIN(a,b) ((a) <= (b) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a,b) ((a) >= (b) ? (a) : (b))
+#endif
+
+#define IPFS_READ_AHEAD_MAX     (1024 * 1024)
 
 typedef struct IPFSFile {
     HiveFile base;
     ipfs_rpc_t *rpc;
     size_t lpos;
+
+    // write-back buffer holding wbuf_len bytes to be written at wbuf_off.
+    char *wbuf;
+    size_t wbuf_size;
+    size_t wbuf_len;
+    size_t wbuf_off;
+
+    // content hash keying the cached blocks, and read-ahead state.
+    char hash[128];
+    unsigned long hash_generation;
+    size_t ra_window;
+    size_t ra_window_max;
+    size_t ra_next;
+
+    // private engine running parallel downloads on the reading thread.
+    http_engine_t *engine;
 } IPFSFile;
 
-static int get_file_stat(ipfs_rpc_t *rpc, const char *path, size_t *fsz)
+static int flush_write_buffer(IPFSFile *file);
+
+static int get_file_stat(ipfs_rpc_t *rpc, const char *path, size_t *fsz,
+                         char *hash, size_t hash_len)
 {
     char buf[MAX_URL_LEN] = {0};
     http_client_t *httpc;
@@ -59,9 +94,9 @@ static int get_file_stat(ipfs_rpc_t *rpc, const char *path, size_t *fsz)
         return rc;
     }
 
-    sprintf(buf, "http://%s:%u/api/v0/files/stat",
-            ipfs_rpc_get_current_node_ip(rpc),
-            (unsigned)ipfs_rpc_get_current_node_port(rpc));
+    rc = ipfs_rpc_get_node_url(rpc, "files/stat", buf, sizeof(buf));
+    if (rc < 0)
+        return rc;
 
     httpc = http_client_new();
     if (!httpc) {
@@ -110,7 +145,7 @@ static int get_file_stat(ipfs_rpc_t *rpc, const char *path, size_t *fsz)
     }
 
     json = cJSON_Parse(p);
-    free(p);
+    http_client_release_response_body(p);
 
     if (!json) {
         vlogE("IpfsFile: bad json format for response body.");
@@ -125,6 +160,19 @@ static int get_file_stat(ipfs_rpc_t *rpc, const char *path, size_t *fsz)
     }
 
     *fsz = (size_t)item->valuedouble;
+
+    if (hash) {
+        item = cJSON_GetObjectItem(json, "Hash");
+        if (!cJSON_IsString(item) || !item->valuestring ||
+            strlen(item->valuestring) >= hash_len) {
+            vlogE("IpfsFile: missing Hash json object in response body.");
+            cJSON_Delete(json);
+            return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+        }
+
+        strcpy(hash, item->valuestring);
+    }
+
     cJSON_Delete(json);
 
     return 0;
@@ -140,6 +188,10 @@ static ssize_t ipfs_file_lseek(HiveFile *base, ssize_t offset, Whence whence)
     int rc;
     size_t fsz;
 
+    rc = flush_write_buffer(file);
+    if (rc < 0)
+        return rc;
+
     switch (whence) {
     case HiveSeek_Cur:
         file->lpos = offset + file->lpos < 0 ? 0 : offset + file->lpos;
@@ -148,7 +200,7 @@ static ssize_t ipfs_file_lseek(HiveFile *base, ssize_t offset, Whence whence)
         file->lpos = offset > 0 ? offset : 0;
         return file->lpos;
     case HiveSeek_End:
-        rc = get_file_stat(file->rpc, file->base.path, &fsz);
+        rc = get_file_stat(file->rpc, file->base.path, &fsz, NULL, 0);
         if (rc < 0) {
             vlogE("IpfsFile: failed to get file status.");
             return rc;
@@ -180,9 +232,9 @@ static size_t read_response_body_cb(char *buffer,
     return total_sz;
 }
 
-static ssize_t ipfs_file_read(HiveFile *base, char *buffer, size_t bufsz)
+static ssize_t read_at(IPFSFile *file, size_t offset,
+                       char *buffer, size_t bufsz)
 {
-    IPFSFile *file = (IPFSFile *)base;
     char buf[MAX_URL_LEN] = {0};
     char header[128];
     http_client_t *httpc;
@@ -197,9 +249,9 @@ static ssize_t ipfs_file_read(HiveFile *base, char *buffer, size_t bufsz)
         return rc;
     }
 
-    sprintf(buf, "http://%s:%u/api/v0/files/read",
-            ipfs_rpc_get_current_node_ip(file->rpc),
-            (unsigned)ipfs_rpc_get_current_node_port(file->rpc));
+    rc = ipfs_rpc_get_node_url(file->rpc, "files/read", buf, sizeof(buf));
+    if (rc < 0)
+        return rc;
 
     httpc = http_client_new();
     if (!httpc) {
@@ -210,7 +262,7 @@ static ssize_t ipfs_file_read(HiveFile *base, char *buffer, size_t bufsz)
     http_client_set_url(httpc, buf);
     http_client_set_query(httpc, "uid", ipfs_rpc_get_uid(file->rpc));
     http_client_set_query(httpc, "path", file->base.path);
-    sprintf(header, "%zu", file->lpos);
+    sprintf(header, "%zu", offset);
     http_client_set_query(httpc, "offset", header);
     sprintf(header, "%zu", bufsz);
     http_client_set_query(httpc, "count", header);
@@ -242,7 +294,6 @@ static ssize_t ipfs_file_read(HiveFile *base, char *buffer, size_t bufsz)
         return HIVE_HTTP_STATUS_ERROR(resp_code);
     }
 
-    file->lpos += nrd;
     return nrd;
 
 error_exit:
@@ -250,9 +301,293 @@ error_exit:
     return rc;
 }
 
-static ssize_t ipfs_file_write(HiveFile *base, const char *buffer, size_t bufsz)
+static int refresh_file_hash(IPFSFile *file)
+{
+    unsigned long generation;
+    size_t fsz;
+    int rc;
+
+    generation = ipfs_rpc_get_generation(file->rpc);
+    if (file->hash[0] && file->hash_generation == generation)
+        return 0;
+
+    rc = get_file_stat(file->rpc, file->base.path, &fsz,
+                       file->hash, sizeof(file->hash));
+    if (rc < 0) {
+        file->hash[0] = '\0';
+        return rc;
+    }
+
+    file->hash_generation = generation;
+    return 0;
+}
+
+static ssize_t read_ahead(IPFSFile *file, size_t pos, char *buffer, size_t bufsz)
+{
+    ipfs_cache_t *cache = ipfs_rpc_get_cache(file->rpc);
+    size_t start = pos - pos % IPFS_CACHE_BLOCK_SIZE;
+    size_t window = file->ra_window;
+    size_t nbytes;
+    size_t off;
+    ssize_t nrd;
+    char *data;
+
+    if (window < pos - start + bufsz) {
+        window = pos - start + bufsz + IPFS_CACHE_BLOCK_SIZE - 1;
+        window -= window % IPFS_CACHE_BLOCK_SIZE;
+    }
+
+    data = malloc(window);
+    if (!data)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    nrd = read_at(file, start, data, window);
+    if (nrd < 0) {
+        free(data);
+        return nrd;
+    }
+
+    // A block shorter than the block size, even empty, marks the end of file.
+    for (off = 0; off < (size_t)nrd || (off == (size_t)nrd && off < window);
+         off += IPFS_CACHE_BLOCK_SIZE) {
+        nbytes = MIN((size_t)nrd - off, IPFS_CACHE_BLOCK_SIZE);
+        ipfs_cache_put(cache, file->hash, (start + off) / IPFS_CACHE_BLOCK_SIZE,
+                       data + off, nbytes);
+    }
+
+    nbytes = (size_t)nrd > pos - start ? MIN((size_t)nrd - (pos - start), bufsz) : 0;
+    memcpy(buffer, data + pos - start, nbytes);
+    free(data);
+
+    return nbytes;
+}
+
+static ssize_t cached_read(IPFSFile *file, char *buffer, size_t bufsz)
+{
+    ipfs_cache_t *cache = ipfs_rpc_get_cache(file->rpc);
+    size_t nrd = 0;
+    size_t pos;
+    size_t off;
+    ssize_t rc;
+
+    rc = refresh_file_hash(file);
+    if (rc < 0)
+        return rc;
+
+    // Grow the read-ahead window as long as the file is read sequentially.
+    if (file->lpos == file->ra_next && file->ra_window)
+        file->ra_window = MIN(file->ra_window * 2, file->ra_window_max);
+    else
+        file->ra_window = IPFS_CACHE_BLOCK_SIZE;
+
+    while (nrd < bufsz) {
+        pos = file->lpos + nrd;
+        off = pos % IPFS_CACHE_BLOCK_SIZE;
+
+        rc = ipfs_cache_get(cache, file->hash, pos / IPFS_CACHE_BLOCK_SIZE,
+                            off, buffer + nrd, bufsz - nrd);
+        if (rc < 0) {
+            rc = read_ahead(file, pos, buffer + nrd, bufsz - nrd);
+            if (rc < 0) {
+                if (nrd)
+                    break;
+                return rc;
+            }
+
+            nrd += rc;
+            break;
+        }
+
+        nrd += rc;
+        if (off + rc < IPFS_CACHE_BLOCK_SIZE)
+            break;
+    }
+
+    file->lpos += nrd;
+    file->ra_next = file->lpos;
+
+    return nrd;
+}
+
+typedef struct parallel_read {
+    ipfs_rpc_t *rpc;
+    unsigned int inflight;
+    int rc;
+} parallel_read_t;
+
+typedef struct range_read {
+    parallel_read_t *ctx;
+    char *buf;
+    size_t offset;
+    size_t len;
+    size_t nrd;
+} range_read_t;
+
+static size_t range_body_cb(char *buffer,
+                            size_t size, size_t nitems, void *userdata)
+{
+    range_read_t *range = (range_read_t *)userdata;
+    size_t total_sz = size * nitems;
+
+    if (range->nrd + total_sz > range->len)
+        return 0;
+
+    memcpy(range->buf + range->nrd, buffer, total_sz);
+    range->nrd += total_sz;
+
+    return total_sz;
+}
+
+static void on_range_done(http_client_t *httpc, int rc, void *arg)
+{
+    range_read_t *range = (range_read_t *)arg;
+    parallel_read_t *ctx = range->ctx;
+
+    rc = ipfs_check_response(ctx->rpc, httpc, rc);
+    http_client_close(httpc);
+
+    if (rc < 0 && !ctx->rc)
+        ctx->rc = rc;
+
+    ctx->inflight--;
+}
+
+static int submit_range(http_engine_t *engine, const char *path,
+                        range_read_t *range)
+{
+    char header[32];
+    http_client_t *httpc;
+
+    httpc = ipfs_http_client_new(range->ctx->rpc, "files/read");
+    if (!httpc)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    http_client_set_query(httpc, "path", path);
+    sprintf(header, "%zu", range->offset);
+    http_client_set_query(httpc, "offset", header);
+    sprintf(header, "%zu", range->len);
+    http_client_set_query(httpc, "count", header);
+    http_client_set_request_body_instant(httpc, NULL, 0);
+    http_client_set_response_body(httpc, range_body_cb, range);
+
+    return http_client_submit(engine, httpc, on_range_done, range);
+}
+
+static ssize_t parallel_read(IPFSFile *file, char *buffer, size_t bufsz)
+{
+    unsigned int parallelism = ipfs_rpc_get_download_parallelism(file->rpc);
+    size_t range_size = ipfs_rpc_get_download_range_size(file->rpc);
+    parallel_read_t ctx;
+    range_read_t *ranges;
+    size_t count;
+    size_t next;
+    size_t nrd;
+    size_t fsz;
+    size_t i;
+    int rc;
+
+    // Ranges past the end of file would fail, so clamp the read first.
+    rc = get_file_stat(file->rpc, file->base.path, &fsz, NULL, 0);
+    if (rc < 0)
+        return rc;
+
+    if (file->lpos >= fsz)
+        return 0;
+
+    bufsz = MIN(bufsz, fsz - file->lpos);
+    count = (bufsz + range_size - 1) / range_size;
+
+    if (!file->engine) {
+        file->engine = http_engine_new();
+        if (!file->engine)
+            return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+    }
+
+    ranges = calloc(count, sizeof(range_read_t));
+    if (!ranges)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    ctx.rpc = file->rpc;
+    ctx.inflight = 0;
+    ctx.rc = 0;
+
+    for (i = 0; i < count; i++) {
+        ranges[i].ctx    = &ctx;
+        ranges[i].buf    = buffer + i * range_size;
+        ranges[i].offset = file->lpos + i * range_size;
+        ranges[i].len    = MIN(range_size, bufsz - i * range_size);
+    }
+
+    next = 0;
+    do {
+        while (!ctx.rc && next < count && ctx.inflight < parallelism) {
+            rc = submit_range(file->engine, file->base.path, &ranges[next]);
+            if (rc < 0) {
+                ctx.rc = rc;
+                break;
+            }
+
+            ctx.inflight++;
+            next++;
+        }
+
+        if (ctx.inflight && http_engine_perform(file->engine, 100) < 0) {
+            // Closing the engine aborts and completes what is in flight.
+            http_engine_close(file->engine);
+            file->engine = NULL;
+            if (!ctx.rc)
+                ctx.rc = HIVE_GENERAL_ERROR(HIVEERR_TRY_AGAIN);
+            break;
+        }
+    } while (ctx.inflight || (!ctx.rc && next < count));
+
+    // Only the leading part up to the first short range is contiguous.
+    nrd = 0;
+    for (i = 0; i < count; i++) {
+        nrd += ranges[i].nrd;
+        if (ranges[i].nrd < ranges[i].len)
+            break;
+    }
+
+    free(ranges);
+
+    if (ctx.rc < 0) {
+        vlogE("IpfsFile: failed to download file ranges.");
+        return ctx.rc;
+    }
+
+    file->lpos += nrd;
+    return nrd;
+}
+
+static ssize_t ipfs_file_read(HiveFile *base, char *buffer, size_t bufsz)
 {
     IPFSFile *file = (IPFSFile *)base;
+    ssize_t rc;
+
+    rc = flush_write_buffer(file);
+    if (rc < 0)
+        return rc;
+
+    // Large reads gain nothing from the cache.
+    if (ipfs_rpc_get_cache(file->rpc) && bufsz < file->ra_window_max)
+        return cached_read(file, buffer, bufsz);
+
+    if (ipfs_rpc_get_download_parallelism(file->rpc) > 1 &&
+        bufsz >= 2 * ipfs_rpc_get_download_range_size(file->rpc))
+        return parallel_read(file, buffer, bufsz);
+
+    rc = read_at(file, file->lpos, buffer, bufsz);
+    if (rc < 0)
+        return rc;
+
+    file->lpos += rc;
+    return rc;
+}
+
+static ssize_t write_at(IPFSFile *file, size_t offset,
+                        const char *buffer, size_t bufsz)
+{
     char buf[MAX_URL_LEN] = {0};
     char header[128];
     http_client_t *httpc;
@@ -265,9 +600,9 @@ static ssize_t ipfs_file_write(HiveFile *base, const char *buffer, size_t bufsz)
         return rc;
     }
 
-    sprintf(buf, "http://%s:%u/api/v0/files/write",
-            ipfs_rpc_get_current_node_ip(file->rpc),
-            (unsigned)ipfs_rpc_get_current_node_port(file->rpc));
+    rc = ipfs_rpc_get_node_url(file->rpc, "files/write", buf, sizeof(buf));
+    if (rc < 0)
+        return rc;
 
     httpc = http_client_new();
     if (!httpc) {
@@ -278,7 +613,7 @@ static ssize_t ipfs_file_write(HiveFile *base, const char *buffer, size_t bufsz)
     http_client_set_url(httpc, buf);
     http_client_set_query(httpc, "uid", ipfs_rpc_get_uid(file->rpc));
     http_client_set_query(httpc, "path", file->base.path);
-    sprintf(header, "%zu", file->lpos);
+    sprintf(header, "%zu", offset);
     http_client_set_query(httpc, "offset", header);
     sprintf(header, "%zu", bufsz);
     http_client_set_query(httpc, "count", header);
@@ -313,31 +648,376 @@ static ssize_t ipfs_file_write(HiveFile *base, const char *buffer, size_t bufsz)
         return HIVE_HTTP_STATUS_ERROR(resp_code);
     }
 
-    rc = publish_root_hash(file->rpc, buf, sizeof(buf));
+    rc = ipfs_rpc_publish(file->rpc, false);
     if (rc < 0) {
-        if (RC_NODE_UNREACHABLE(rc)) {
-            vlogE("IpfsFile: current node is not reachable.");
-            rc = HIVE_GENERAL_ERROR(HIVEERR_TRY_AGAIN);
-            ipfs_rpc_mark_node_unreachable(file->rpc);
-        } else
-            vlogE("IpfsFile: failed to publish root hash.");
+        vlogE("IpfsFile: failed to publish root hash.");
         return rc;
     }
 
     HIVE_F_UNSET(file->base.flags, HIVE_F_CREAT | HIVE_F_TRUNC);
+    file->hash[0] = '\0';
+    return bufsz;
+
+error_exit:
+    http_client_close(httpc);
+    return rc;
+}
+
+static int flush_write_buffer(IPFSFile *file)
+{
+    ssize_t rc;
+
+    if (!file->wbuf_len)
+        return 0;
+
+    rc = write_at(file, file->wbuf_off, file->wbuf, file->wbuf_len);
+    if (rc < 0) {
+        vlogE("IpfsFile: failed to flush write-back buffer.");
+        return (int)rc;
+    }
+
+    file->wbuf_len = 0;
+    return 0;
+}
+
+static ssize_t ipfs_file_write(HiveFile *base, const char *buffer, size_t bufsz)
+{
+    IPFSFile *file = (IPFSFile *)base;
+    ssize_t rc;
+
+    // Only contiguous writes get merged into the pending buffer.
+    if (file->wbuf_len && file->wbuf_off + file->wbuf_len != file->lpos) {
+        rc = flush_write_buffer(file);
+        if (rc < 0)
+            return rc;
+    }
+
+    if (file->wbuf_len + bufsz > file->wbuf_size) {
+        rc = flush_write_buffer(file);
+        if (rc < 0)
+            return rc;
+    }
+
+    if (bufsz >= file->wbuf_size) {
+        rc = write_at(file, file->lpos, buffer, bufsz);
+        if (rc < 0)
+            return rc;
+
+        file->lpos += bufsz;
+        return bufsz;
+    }
 
+    if (!file->wbuf) {
+        file->wbuf = malloc(file->wbuf_size);
+        if (!file->wbuf) {
+            vlogE("IpfsFile: failed to allocate write-back buffer.");
+            return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+        }
+    }
+
+    if (!file->wbuf_len)
+        file->wbuf_off = file->lpos;
+
+    memcpy(file->wbuf + file->wbuf_len, buffer, bufsz);
+    file->wbuf_len += bufsz;
     file->lpos += bufsz;
+
     return bufsz;
+}
 
-error_exit:
+typedef struct ipfs_file_op {
+    hive_async_op_t base;
+    hive_async_t *async;
+    http_engine_t *engine;
+    IPFSFile *file;
+    char *buf;
+    size_t bufsz;
+    size_t nrd;
+} ipfs_file_op_t;
+
+static void ipfs_file_op_destructor(void *obj)
+{
+    ipfs_file_op_t *op = (ipfs_file_op_t *)obj;
+
+    if (op->file)
+        deref(op->file);
+
+    if (op->async)
+        deref(op->async);
+}
+
+static ipfs_file_op_t *ipfs_file_op_new(IPFSFile *file,
+                                        HiveCompletionCallback *callback,
+                                        void *context, int *rc)
+{
+    ipfs_file_op_t *op;
+    http_engine_t *engine;
+
+    *rc = ipfs_rpc_check_reachable(file->rpc);
+    if (*rc < 0) {
+        vlogE("IpfsFile: failed to check node connectivity.");
+        return NULL;
+    }
+
+    // Buffered data has to reach the node before any queued request.
+    *rc = flush_write_buffer(file);
+    if (*rc < 0)
+        return NULL;
+
+    engine = hive_async_get_engine(file->base.async);
+    if (!engine) {
+        *rc = hive_get_error();
+        return NULL;
+    }
+
+    op = hive_async_op_new(sizeof(ipfs_file_op_t), callback, context,
+                           ipfs_file_op_destructor);
+    if (!op) {
+        *rc = HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+        return NULL;
+    }
+
+    op->async  = ref(file->base.async);
+    op->engine = engine;
+    op->file   = ref(file);
+
+    return op;
+}
+
+static size_t read_async_body_cb(char *buffer,
+                                 size_t size, size_t nitems, void *userdata)
+{
+    ipfs_file_op_t *op = (ipfs_file_op_t *)userdata;
+    size_t total_sz = size * nitems;
+
+    if (op->nrd + total_sz > op->bufsz)
+        return 0;
+
+    memcpy(op->buf + op->nrd, buffer, total_sz);
+    op->nrd += total_sz;
+
+    return total_sz;
+}
+
+static void deliver_read(hive_async_op_t *base)
+{
+    ipfs_file_op_t *op = (ipfs_file_op_t *)base;
+
+    op->file->lpos += op->nrd;
+}
+
+static void on_read_done(http_client_t *httpc, int rc, void *arg)
+{
+    ipfs_file_op_t *op = (ipfs_file_op_t *)arg;
+
+    rc = ipfs_check_response(op->file->rpc, httpc, rc);
+    http_client_close(httpc);
+
+    if (rc == 0) {
+        op->base.deliver = deliver_read;
+        rc = (int)op->nrd;
+    }
+
+    hive_async_op_complete(op->async, &op->base, rc);
+}
+
+static int ipfs_file_read_async(HiveFile *base, char *buffer, size_t bufsz,
+                                HiveCompletionCallback *callback, void *context)
+{
+    IPFSFile *file = (IPFSFile *)base;
+    char header[128];
+    ipfs_file_op_t *op;
+    http_client_t *httpc;
+    int rc;
+
+    if (bufsz > INT_MAX)
+        bufsz = INT_MAX;
+
+    op = ipfs_file_op_new(file, callback, context, &rc);
+    if (!op)
+        return rc;
+
+    httpc = ipfs_http_client_new(file->rpc, "files/read");
+    if (!httpc) {
+        deref(op);
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+    }
+
+    op->buf   = buffer;
+    op->bufsz = bufsz;
+
+    http_client_set_query(httpc, "path", file->base.path);
+    sprintf(header, "%zu", file->lpos);
+    http_client_set_query(httpc, "offset", header);
+    sprintf(header, "%zu", bufsz);
+    http_client_set_query(httpc, "count", header);
+    http_client_set_request_body_instant(httpc, NULL, 0);
+    http_client_set_response_body(httpc, read_async_body_cb, op);
+
+    http_client_submit(op->engine, httpc, on_read_done, op);
+    return 0;
+}
+
+static void deliver_write(hive_async_op_t *base)
+{
+    ipfs_file_op_t *op = (ipfs_file_op_t *)base;
+
+    HIVE_F_UNSET(op->file->base.flags, HIVE_F_CREAT | HIVE_F_TRUNC);
+    op->file->lpos += op->bufsz;
+}
+
+static void on_write_published(int rc, void *arg)
+{
+    ipfs_file_op_t *op = (ipfs_file_op_t *)arg;
+
+    if (rc == 0) {
+        op->base.deliver = deliver_write;
+        rc = (int)op->bufsz;
+    }
+
+    hive_async_op_complete(op->async, &op->base, rc);
+}
+
+static void on_write_done(http_client_t *httpc, int rc, void *arg)
+{
+    ipfs_file_op_t *op = (ipfs_file_op_t *)arg;
+
+    rc = ipfs_check_response(op->file->rpc, httpc, rc);
     http_client_close(httpc);
+
+    if (rc < 0) {
+        hive_async_op_complete(op->async, &op->base, rc);
+        return;
+    }
+
+    if (ipfs_rpc_defer_publish(op->file->rpc, false)) {
+        on_write_published(0, op);
+        return;
+    }
+
+    rc = publish_root_hash_async(op->file->rpc, op->engine,
+                                 on_write_published, op);
+    if (rc < 0)
+        hive_async_op_complete(op->async, &op->base, rc);
+}
+
+static int ipfs_file_write_async(HiveFile *base, const char *buffer,
+                                 size_t bufsz, HiveCompletionCallback *callback,
+                                 void *context)
+{
+    IPFSFile *file = (IPFSFile *)base;
+    char header[128];
+    ipfs_file_op_t *op;
+    http_client_t *httpc;
+    int rc;
+
+    if (bufsz > INT_MAX)
+        bufsz = INT_MAX;
+
+    op = ipfs_file_op_new(file, callback, context, &rc);
+    if (!op)
+        return rc;
+
+    httpc = ipfs_http_client_new(file->rpc, "files/write");
+    if (!httpc) {
+        deref(op);
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+    }
+
+    op->bufsz = bufsz;
+
+    http_client_set_query(httpc, "path", file->base.path);
+    sprintf(header, "%zu", file->lpos);
+    http_client_set_query(httpc, "offset", header);
+    sprintf(header, "%zu", bufsz);
+    http_client_set_query(httpc, "count", header);
+    if (HIVE_F_IS_SET(file->base.flags, HIVE_F_CREAT))
+        http_client_set_query(httpc, "create", "true");
+    if (HIVE_F_IS_SET(file->base.flags, HIVE_F_TRUNC))
+        http_client_set_query(httpc, "truncate", "true");
+    http_client_set_mime_instant(httpc, "file", NULL, NULL, buffer, bufsz);
+
+    http_client_submit(op->engine, httpc, on_write_done, op);
+    return 0;
+}
+
+static void on_commit_published(int rc, void *arg)
+{
+    ipfs_file_op_t *op = (ipfs_file_op_t *)arg;
+
+    if (rc < 0)
+        ipfs_rpc_mark_dirty(op->file->rpc);
+
+    hive_async_op_complete(op->async, &op->base, rc);
+}
+
+static int ipfs_file_commit_async(HiveFile *base,
+                                  HiveCompletionCallback *callback,
+                                  void *context)
+{
+    IPFSFile *file = (IPFSFile *)base;
+    ipfs_file_op_t *op;
+    int rc;
+
+    op = ipfs_file_op_new(file, callback, context, &rc);
+    if (!op)
+        return rc;
+
+    if (!ipfs_rpc_take_commit(file->rpc)) {
+        hive_async_op_complete(op->async, &op->base, 0);
+        return 0;
+    }
+
+    rc = publish_root_hash_async(file->rpc, op->engine,
+                                 on_commit_published, op);
+    if (rc < 0) {
+        ipfs_rpc_mark_dirty(file->rpc);
+        deref(op);
+        return rc;
+    }
+
+    return 0;
+}
+
+static int ipfs_file_commit(HiveFile *base)
+{
+    IPFSFile *file = (IPFSFile *)base;
+    int rc;
+
+    rc = flush_write_buffer(file);
+    if (rc < 0)
+        return rc;
+
+    rc = ipfs_rpc_commit(file->rpc);
+    if (rc < 0)
+        vlogE("IpfsFile: failed to publish root hash.");
+
     return rc;
 }
 
+static int ipfs_file_discard(HiveFile *base)
+{
+    IPFSFile *file = (IPFSFile *)base;
+
+    if (file->wbuf_len) {
+        file->lpos = file->wbuf_off;
+        file->wbuf_len = 0;
+    }
+
+    return 0;
+}
+
 static int ipfs_file_close(HiveFile *base)
 {
+    int rc;
+
+    // The file goes away regardless, but a failed write-back must surface.
+    rc = ipfs_file_commit(base);
+    if (rc < 0)
+        vlogE("IpfsFile: buffered writes were not written back on close.");
+
     deref(base);
-    return 0;
+    return rc;
 }
 
 static void ipfs_file_destructor(void *obj)
@@ -346,6 +1026,12 @@ static void ipfs_file_destructor(void *obj)
 
     if (file->rpc)
         ipfs_rpc_close(file->rpc);
+
+    if (file->wbuf)
+        free(file->wbuf);
+
+    if (file->engine)
+        http_engine_close(file->engine);
 }
 
 int ipfs_file_open(ipfs_rpc_t *rpc, const char *path, int flags, HiveFile **file)
@@ -355,7 +1041,7 @@ int ipfs_file_open(ipfs_rpc_t *rpc, const char *path, int flags, HiveFile **file
     size_t fsz;
     bool file_exists;
 
-    rc = get_file_stat(rpc, path, &fsz);
+    rc = get_file_stat(rpc, path, &fsz, NULL, 0);
     if (rc < 0 && rc != HIVE_HTTP_STATUS_ERROR(HttpStatus_InternalServerError)) {
         vlogE("IpfsFile: failed to get file status.");
         return rc;
@@ -385,9 +1071,21 @@ int ipfs_file_open(ipfs_rpc_t *rpc, const char *path, int flags, HiveFile **file
     tmp->base.lseek   = ipfs_file_lseek;
     tmp->base.read    = ipfs_file_read;
     tmp->base.write   = ipfs_file_write;
+    tmp->base.commit  = ipfs_file_commit;
+    tmp->base.discard = ipfs_file_discard;
     tmp->base.close   = ipfs_file_close;
 
+    tmp->base.read_async   = ipfs_file_read_async;
+    tmp->base.write_async  = ipfs_file_write_async;
+    tmp->base.commit_async = ipfs_file_commit_async;
+
     tmp->rpc          = ref(rpc);
+    tmp->wbuf_size    = ipfs_rpc_get_write_buffer_size(rpc);
+    if (ipfs_rpc_get_cache(rpc)) {
+        tmp->ra_window_max = ipfs_cache_get_capacity(ipfs_rpc_get_cache(rpc)) / 4;
+        tmp->ra_window_max = MIN(tmp->ra_window_max, IPFS_READ_AHEAD_MAX);
+        tmp->ra_window_max = MAX(tmp->ra_window_max, IPFS_CACHE_BLOCK_SIZE);
+    }
     if (file_exists && HIVE_F_IS_SET(flags, HIVE_F_APPEND))
         tmp->lpos = fsz;
 
@@ -21,12 +21,19 @@
  */
 
 #include <stddef.h>
+#include <limits.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
 
 #ifdef HAVE_SYS_PARAM_H
 #include <sys/param.h>
 #endif
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
 
 #include <crystal.h>
 #include <cjson/cJSON.h>
@@ -40,12 +47,62 @@
 #include "http_client.h"
 #include "http_status.h"
 
+#define PROBE_GRACE_PERIOD      200     // ms
+#define PUBLISH_MAX_DELAY_RATIO 10      // times publish_interval
+
+typedef struct rpc_endpoint {
+    char ip[HIVE_MAX_IPV6_ADDRESS_LEN + 1];
+    uint16_t port;
+    double rtt;             // EWMA of the probe latency in ms.
+    unsigned int fails;     // consecutive failures.
+    bool healthy;
+} rpc_endpoint_t;
+
 struct ipfs_rpc {
     char uid[HIVE_MAX_IPFS_UID_LEN + 1];
     char current_node_ip[HIVE_MAX_IPV6_ADDRESS_LEN  + 1];
     uint16_t current_node_port;
+    int current_endpoint;
+    rpc_endpoint_t *endpoints;
+    size_t endpoints_count;
     ipfs_rpc_writeback_func_t *writeback_cb;
     void *user_data;
+
+    IPFSPublishPolicy publish_policy;
+    unsigned int publish_interval;
+    size_t write_buffer_size;
+    ipfs_cache_t *cache;
+    unsigned int download_parallelism;
+    size_t download_range_size;
+    unsigned long generation;   // bumped on every mutation or node switch.
+    pthread_mutex_t publish_lock;
+    pthread_mutex_t flush_lock;
+    pthread_cond_t publish_cond;
+    struct timespec publish_deadline;
+    struct timespec publish_max_deadline;
+    bool publish_pending;
+    bool publish_lost;
+    bool publisher_started;
+    bool publisher_stopping;
+    pthread_t publisher;
+
+    // endpoint scores, current node and standby are guarded by node_lock.
+    pthread_mutex_t node_lock;
+    int standby;
+    unsigned long standby_generation;
+    unsigned int health_check_interval;
+    pthread_mutex_t monitor_lock;
+    pthread_cond_t monitor_cond;
+    volatile bool monitor_stopping;
+    bool monitor_started;
+    pthread_t monitor;
+
+    // last synchronization result, guarded by node_lock.
+    unsigned int sync_cache_ttl;
+    char peer_id[128];
+    char root_hash[128];
+    time_t synced_at;
+
     size_t rpc_nodes_count;
     rpc_node_t rpc_nodes[0];
 };
@@ -175,77 +232,501 @@ error_exit:
 }
 
 int ipfs_rpc_get_uid_info(ipfs_rpc_t *rpc, char **result)
+{
+    char ip[HIVE_MAX_IPV6_ADDRESS_LEN + 1];
+    uint16_t port;
+
+    assert(rpc);
+
+    ipfs_rpc_get_current_node(rpc, ip, &port);
+    return _ipfs_token_get_uid_info(ip, port, rpc->uid, result);
+}
+
+int ipfs_rpc_get_node_uid_info(ipfs_rpc_t *rpc, const char *node_ip,
+                               uint16_t node_port, char **result)
 {
     assert(rpc);
 
-    return _ipfs_token_get_uid_info(rpc->current_node_ip,
-                                    rpc->current_node_port,
-                                    rpc->uid, result);
+    return _ipfs_token_get_uid_info(node_ip, node_port, rpc->uid, result);
+}
+
+static void deadline_after(struct timespec *ts, unsigned int msecs)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    ts->tv_sec  = now.tv_sec + msecs / 1000;
+    ts->tv_nsec = now.tv_usec * 1000 + (long)(msecs % 1000) * 1000000;
+    if (ts->tv_nsec >= 1000000000) {
+        ts->tv_sec  += 1;
+        ts->tv_nsec -= 1000000000;
+    }
+}
+
+static bool deadline_before(const struct timespec *a, const struct timespec *b)
+{
+    if (a->tv_sec != b->tv_sec)
+        return a->tv_sec < b->tv_sec;
+
+    return a->tv_nsec < b->tv_nsec;
+}
+
+static bool deadline_passed(const struct timespec *ts)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    if (now.tv_sec != ts->tv_sec)
+        return now.tv_sec > ts->tv_sec;
+
+    return now.tv_usec * 1000 >= ts->tv_nsec;
+}
+
+static long elapsed_ms(const struct timeval *start)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - start->tv_sec) * 1000 +
+           (now.tv_usec - start->tv_usec) / 1000;
+}
+
+static void bump_generation(ipfs_rpc_t *rpc)
+{
+    pthread_mutex_lock(&rpc->publish_lock);
+    rpc->generation++;
+    pthread_mutex_unlock(&rpc->publish_lock);
+}
+
+static void endpoint_succeeded(rpc_endpoint_t *ep, long rtt)
+{
+    if (rtt < 1)
+        rtt = 1;
+
+    ep->rtt = ep->rtt > 0 ? ep->rtt * 0.7 + rtt * 0.3 : (double)rtt;
+    ep->fails = 0;
+    ep->healthy = true;
+}
+
+static void endpoint_failed(rpc_endpoint_t *ep)
+{
+    ep->fails++;
+    ep->healthy = false;
+}
+
+// Called with node_lock held.
+static void use_endpoint(ipfs_rpc_t *rpc, int index)
+{
+    rpc_endpoint_t *ep = &rpc->endpoints[index];
+
+    strcpy(rpc->current_node_ip, ep->ip);
+    rpc->current_node_port = ep->port;
+    rpc->current_endpoint = index;
+
+    if (rpc->standby == index)
+        rpc->standby = -1;
+
+    vlogI("IpfsToken: node selected: %s (rtt %.0f ms).", ep->ip, ep->rtt);
 }
 
-static int select_bootstrap(rpc_node_t *rpc_nodes, size_t nodes_cnt,
-                            char *selected_ip, uint16_t *selected_port)
+typedef struct probe_sweep {
+    ipfs_rpc_t *rpc;
+    int winner;
+    struct timeval won_at;
+    unsigned int inflight;
+    bool closing;
+} probe_sweep_t;
+
+typedef struct probe {
+    probe_sweep_t *sweep;
+    int index;
+    struct timeval start;
+} probe_t;
+
+static void on_probe_done(http_client_t *httpc, int rc, void *arg)
 {
+    probe_t *probe = (probe_t *)arg;
+    probe_sweep_t *sweep = probe->sweep;
+    ipfs_rpc_t *rpc = sweep->rpc;
+    long resp_code = 0;
+
+    sweep->inflight--;
+
+    // Probes cut off by the end of the sweep tell nothing about the node.
+    if (sweep->closing) {
+        http_client_close(httpc);
+        return;
+    }
+
+    if (!rc)
+        rc = http_client_get_response_code(httpc, &resp_code);
+    http_client_close(httpc);
+
+    pthread_mutex_lock(&rpc->node_lock);
+    if (rc || resp_code != HttpStatus_OK)
+        endpoint_failed(&rpc->endpoints[probe->index]);
+    else
+        endpoint_succeeded(&rpc->endpoints[probe->index],
+                           elapsed_ms(&probe->start));
+    pthread_mutex_unlock(&rpc->node_lock);
+
+    if (!rc && resp_code == HttpStatus_OK && sweep->winner < 0) {
+        sweep->winner = probe->index;
+        gettimeofday(&sweep->won_at, NULL);
+    }
+}
+
+/*
+ * Probe all endpoints at once. The first one answering wins, the others
+ * get grace_ms to answer as well so their scores stay fresh. A negative
+ * grace_ms waits for every endpoint.
+ */
+static int probe_endpoints(ipfs_rpc_t *rpc, long grace_ms)
+{
+    char url[MAXPATHLEN + 1];
+    http_engine_t *engine;
+    http_client_t *httpc;
+    probe_sweep_t sweep;
+    probe_t *probes;
     size_t i;
-    size_t base;
     int rc;
 
-    srand((unsigned)time(NULL));
-    base = (size_t)rand() % nodes_cnt;
-    i = base;
-
-    do {
-        if (rpc_nodes[i].ipv4[0]) {
-            rc = test_reachable(rpc_nodes[i].ipv4, rpc_nodes[i].port);
-            if (!rc) {
-                strcpy(selected_ip, rpc_nodes[i].ipv4);
-                *selected_port = rpc_nodes[i].port;
-                vlogI("IpfsToken: node selected: %s.", selected_ip);
-                return 0;
-            }
+    engine = http_engine_new();
+    if (!engine)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    probes = calloc(rpc->endpoints_count, sizeof(probe_t));
+    if (!probes) {
+        http_engine_close(engine);
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+    }
+
+    memset(&sweep, 0, sizeof(sweep));
+    sweep.rpc = rpc;
+    sweep.winner = -1;
+
+    for (i = 0; i < rpc->endpoints_count; i++) {
+        rpc_endpoint_t *ep = &rpc->endpoints[i];
+
+        rc = snprintf(url, sizeof(url), "http://%s:%d/version", ep->ip, ep->port);
+        if (rc < 0 || rc >= sizeof(url))
+            continue;
+
+        httpc = http_client_new();
+        if (!httpc)
+            continue;
+
+        http_client_set_url(httpc, url);
+        http_client_set_method(httpc, HTTP_METHOD_POST);
+        http_client_set_request_body_instant(httpc, NULL, 0);
+        http_client_set_timeout(httpc, 5);
+
+        probes[i].sweep = &sweep;
+        probes[i].index = (int)i;
+        gettimeofday(&probes[i].start, NULL);
+
+        http_client_submit(engine, httpc, on_probe_done, &probes[i]);
+        sweep.inflight++;
+    }
+
+    while (sweep.inflight && !rpc->monitor_stopping) {
+        if (http_engine_perform(engine, 50) < 0)
+            break;
+
+        if (grace_ms >= 0 && sweep.winner >= 0 &&
+            elapsed_ms(&sweep.won_at) >= grace_ms)
+            break;
+    }
+
+    sweep.closing = true;
+    http_engine_close(engine);
+    free(probes);
+
+    if (sweep.winner < 0) {
+        vlogE("IpfsToken: No node configured is reachable.");
+        return HIVE_GENERAL_ERROR(HIVEERR_BAD_BOOTSTRAP_HOST);
+    }
+
+    return sweep.winner;
+}
+
+// Called with node_lock held.
+static int best_endpoint(ipfs_rpc_t *rpc, int excluded)
+{
+    int best = -1;
+    size_t i;
+
+    for (i = 0; i < rpc->endpoints_count; i++) {
+        rpc_endpoint_t *ep = &rpc->endpoints[i];
+
+        if ((int)i == excluded || !ep->healthy)
+            continue;
+
+        if (best < 0 || ep->rtt < rpc->endpoints[best].rtt)
+            best = (int)i;
+    }
+
+    return best;
+}
+
+static int select_node(ipfs_rpc_t *rpc)
+{
+    struct timeval start;
+    rpc_endpoint_t ep;
+    int index;
+    int rc;
+
+    // Fail over along the known scores before sweeping all nodes again.
+    for (;;) {
+        pthread_mutex_lock(&rpc->node_lock);
+        index = best_endpoint(rpc, -1);
+        if (index >= 0)
+            ep = rpc->endpoints[index];
+        pthread_mutex_unlock(&rpc->node_lock);
+
+        if (index < 0)
+            break;
+
+        gettimeofday(&start, NULL);
+        rc = test_reachable(ep.ip, ep.port);
+
+        pthread_mutex_lock(&rpc->node_lock);
+        if (!rc) {
+            endpoint_succeeded(&rpc->endpoints[index], elapsed_ms(&start));
+            use_endpoint(rpc, index);
+            pthread_mutex_unlock(&rpc->node_lock);
+            return 0;
+        }
+        endpoint_failed(&rpc->endpoints[index]);
+        pthread_mutex_unlock(&rpc->node_lock);
+    }
+
+    index = probe_endpoints(rpc, PROBE_GRACE_PERIOD);
+    if (index < 0)
+        return index;
+
+    pthread_mutex_lock(&rpc->node_lock);
+    use_endpoint(rpc, index);
+    pthread_mutex_unlock(&rpc->node_lock);
+
+    return 0;
+}
+
+static bool take_standby(ipfs_rpc_t *rpc)
+{
+    unsigned long generation = ipfs_rpc_get_generation(rpc);
+    bool taken = false;
+
+    pthread_mutex_lock(&rpc->node_lock);
+    if (rpc->standby >= 0 && rpc->endpoints[rpc->standby].healthy &&
+        rpc->standby_generation == generation) {
+        vlogI("IpfsToken: fail over to standby node.");
+        use_endpoint(rpc, rpc->standby);
+        taken = true;
+    }
+    pthread_mutex_unlock(&rpc->node_lock);
+
+    return taken;
+}
+
+static int build_endpoints(ipfs_rpc_t *rpc)
+{
+    size_t i;
+
+    rpc->endpoints = calloc(rpc->rpc_nodes_count * 2, sizeof(rpc_endpoint_t));
+    if (!rpc->endpoints)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    for (i = 0; i < rpc->rpc_nodes_count; i++) {
+        rpc_node_t *node = &rpc->rpc_nodes[i];
+
+        if (node->ipv4[0]) {
+            strcpy(rpc->endpoints[rpc->endpoints_count].ip, node->ipv4);
+            rpc->endpoints[rpc->endpoints_count++].port = node->port;
         }
 
-        if (rpc_nodes[i].ipv6[0]) {
-            rc = test_reachable(rpc_nodes[i].ipv6, rpc_nodes[i].port);
-            if (!rc) {
-                strcpy(selected_ip, rpc_nodes[i].ipv6);
-                *selected_port = rpc_nodes[i].port;
-                vlogI("IpfsToken: node selected: %s.", selected_ip);
-                return 0;
-            }
+        if (node->ipv6[0]) {
+            strcpy(rpc->endpoints[rpc->endpoints_count].ip, node->ipv6);
+            rpc->endpoints[rpc->endpoints_count++].port = node->port;
         }
+    }
+
+    rpc->current_endpoint = -1;
+    rpc->standby = -1;
+    return 0;
+}
+
+static int publish_now(ipfs_rpc_t *rpc);
+
+/*
+ * Mutations not published yet exist only on the node that took them, and
+ * would silently vanish with a switch to another node. Give that node one
+ * more chance to publish them; if it still fails, the loss is reported by
+ * the next flush. Returns true if the node is back.
+ */
+static bool publish_before_switch(ipfs_rpc_t *rpc)
+{
+    bool reachable = false;
+    bool pending;
+    int previous;
+
+    pthread_mutex_lock(&rpc->flush_lock);
 
-        i = (i + 1) % nodes_cnt;
-    } while (i != base);
+    pthread_mutex_lock(&rpc->publish_lock);
+    pending = rpc->publish_pending;
+    rpc->publish_pending = false;
+    pthread_mutex_unlock(&rpc->publish_lock);
 
-    vlogE("IpfsToken: No node configured is reachable.");
-    return HIVE_GENERAL_ERROR(HIVEERR_BAD_BOOTSTRAP_HOST);
+    if (!pending) {
+        pthread_mutex_unlock(&rpc->flush_lock);
+        return false;
+    }
+
+    pthread_mutex_lock(&rpc->node_lock);
+    previous = rpc->current_endpoint;
+    if (previous >= 0)
+        use_endpoint(rpc, previous);
+    pthread_mutex_unlock(&rpc->node_lock);
+
+    // publish_now() marks the node unreachable again if it does not answer.
+    if (previous >= 0 && publish_now(rpc) < 0) {
+        pthread_mutex_lock(&rpc->node_lock);
+        reachable = rpc->current_node_ip[0] != '\0';
+        pthread_mutex_unlock(&rpc->node_lock);
+
+        if (reachable)
+            ipfs_rpc_mark_dirty(rpc);
+    } else
+        reachable = previous >= 0;
+
+    if (!reachable) {
+        vlogE("IpfsToken: unpublished mutations are lost with the failed node.");
+
+        pthread_mutex_lock(&rpc->publish_lock);
+        rpc->publish_lost = true;
+        pthread_mutex_unlock(&rpc->publish_lock);
+    }
+
+    pthread_mutex_unlock(&rpc->flush_lock);
+    return reachable;
 }
 
 int ipfs_rpc_check_reachable(ipfs_rpc_t *rpc)
 {
+    char ip[HIVE_MAX_IPV6_ADDRESS_LEN + 1];
+    uint16_t port;
     int rc;
 
-    if (rpc->current_node_ip[0])
+    if (ipfs_rpc_get_current_node(rpc, ip, &port))
+        return 0;
+
+    if (publish_before_switch(rpc))
         return 0;
 
-    rc = select_bootstrap(rpc->rpc_nodes, rpc->rpc_nodes_count,
-                          rpc->current_node_ip, &rpc->current_node_port);
+    // The standby is synchronized already, switching to it is enough.
+    if (take_standby(rpc)) {
+        bump_generation(rpc);
+        return 0;
+    }
+
+    rc = select_node(rpc);
     if (rc < 0) {
         vlogE("IpfsToken: no node configured is reachable.");
         return rc;
     }
 
     rc = ipfs_synchronize(rpc);
-    if (rc < 0)
+    if (rc < 0) {
+        pthread_mutex_lock(&rpc->node_lock);
         rpc->current_node_ip[0] = '\0';
+        pthread_mutex_unlock(&rpc->node_lock);
+        return rc;
+    }
 
-    return rc;
+    bump_generation(rpc);
+    return 0;
 }
 
 void ipfs_rpc_mark_node_unreachable(ipfs_rpc_t *rpc)
 {
+    pthread_mutex_lock(&rpc->node_lock);
     rpc->current_node_ip[0] = '\0';
+    if (rpc->current_endpoint >= 0)
+        endpoint_failed(&rpc->endpoints[rpc->current_endpoint]);
+    pthread_mutex_unlock(&rpc->node_lock);
+
+    // Let the monitor line up a new standby right away.
+    if (rpc->monitor_started) {
+        pthread_mutex_lock(&rpc->monitor_lock);
+        pthread_cond_signal(&rpc->monitor_cond);
+        pthread_mutex_unlock(&rpc->monitor_lock);
+    }
+}
+
+/*
+ * Rescore all endpoints and keep the best one besides the current node
+ * synchronized as standby.
+ */
+static void check_health(ipfs_rpc_t *rpc)
+{
+    unsigned long generation;
+    rpc_endpoint_t ep;
+    int index;
+    int rc;
+
+    probe_endpoints(rpc, -1);
+    if (rpc->monitor_stopping)
+        return;
+
+    generation = ipfs_rpc_get_generation(rpc);
+
+    pthread_mutex_lock(&rpc->node_lock);
+    index = best_endpoint(rpc, rpc->current_endpoint);
+    if (index < 0 || (index == rpc->standby &&
+                      rpc->standby_generation == generation)) {
+        if (index < 0)
+            rpc->standby = -1;
+        pthread_mutex_unlock(&rpc->node_lock);
+        return;
+    }
+    ep = rpc->endpoints[index];
+    pthread_mutex_unlock(&rpc->node_lock);
+
+    rc = ipfs_synchronize_node(rpc, ep.ip, ep.port);
+
+    pthread_mutex_lock(&rpc->node_lock);
+    if (rc < 0) {
+        vlogW("IpfsToken: failed to synchronize standby node %s.", ep.ip);
+        endpoint_failed(&rpc->endpoints[index]);
+        if (rpc->standby == index)
+            rpc->standby = -1;
+    } else if (index != rpc->current_endpoint) {
+        rpc->standby = index;
+        rpc->standby_generation = generation;
+    }
+    pthread_mutex_unlock(&rpc->node_lock);
+}
+
+static void *monitor_routine(void *arg)
+{
+    ipfs_rpc_t *rpc = (ipfs_rpc_t *)arg;
+    struct timespec deadline;
+
+    pthread_mutex_lock(&rpc->monitor_lock);
+    while (!rpc->monitor_stopping) {
+        deadline_after(&deadline, rpc->health_check_interval * 1000);
+        pthread_cond_timedwait(&rpc->monitor_cond, &rpc->monitor_lock,
+                               &deadline);
+        if (rpc->monitor_stopping)
+            break;
+
+        pthread_mutex_unlock(&rpc->monitor_lock);
+        check_health(rpc);
+        pthread_mutex_lock(&rpc->monitor_lock);
+    }
+    pthread_mutex_unlock(&rpc->monitor_lock);
+
+    return NULL;
 }
 
 static int uid_new(const char *node_ip, uint16_t node_port, char *uid, size_t uid_len)
@@ -304,7 +785,7 @@ static int uid_new(const char *node_ip, uint16_t node_port, char *uid, size_t ui
     }
 
     json = cJSON_Parse(p);
-    free(p);
+    http_client_release_response_body(p);
     if (!json) {
         vlogE("IpfsToken: invalid json format for http response.");
         return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
@@ -336,14 +817,76 @@ const char *ipfs_rpc_get_uid(ipfs_rpc_t *rpc)
     return rpc->uid;
 }
 
-const char *ipfs_rpc_get_current_node_ip(ipfs_rpc_t *rpc)
+/*
+ * Copies the current node into ip, which must hold at least
+ * HIVE_MAX_IPV6_ADDRESS_LEN + 1 bytes, and returns false if no node is
+ * reachable. The node may switch at any time, so never keep a reference
+ * to it across the lock.
+ */
+bool ipfs_rpc_get_current_node(ipfs_rpc_t *rpc, char *ip, uint16_t *port)
+{
+    bool reachable;
+
+    pthread_mutex_lock(&rpc->node_lock);
+    strcpy(ip, rpc->current_node_ip);
+    *port = rpc->current_node_port;
+    reachable = ip[0] != '\0';
+    pthread_mutex_unlock(&rpc->node_lock);
+
+    return reachable;
+}
+
+int ipfs_rpc_get_node_url(ipfs_rpc_t *rpc, const char *api,
+                          char *buf, size_t bufsz)
+{
+    char ip[HIVE_MAX_IPV6_ADDRESS_LEN + 1];
+    uint16_t port;
+    int rc;
+
+    if (!ipfs_rpc_get_current_node(rpc, ip, &port)) {
+        vlogE("IpfsToken: current node is not reachable.");
+        return HIVE_GENERAL_ERROR(HIVEERR_TRY_AGAIN);
+    }
+
+    rc = snprintf(buf, bufsz, "http://%s:%u/api/v0/%s",
+                  ip, (unsigned)port, api);
+    if (rc < 0 || rc >= bufsz) {
+        vlogE("IpfsToken: URL too long.");
+        return HIVE_GENERAL_ERROR(HIVEERR_BUFFER_TOO_SMALL);
+    }
+
+    return 0;
+}
+
+size_t ipfs_rpc_get_write_buffer_size(ipfs_rpc_t *rpc)
 {
-    return rpc->current_node_ip;
+    return rpc->write_buffer_size;
 }
 
-uint16_t ipfs_rpc_get_current_node_port(ipfs_rpc_t *rpc)
+ipfs_cache_t *ipfs_rpc_get_cache(ipfs_rpc_t *rpc)
 {
-    return rpc->current_node_port;
+    return rpc->cache;
+}
+
+unsigned int ipfs_rpc_get_download_parallelism(ipfs_rpc_t *rpc)
+{
+    return rpc->download_parallelism;
+}
+
+size_t ipfs_rpc_get_download_range_size(ipfs_rpc_t *rpc)
+{
+    return rpc->download_range_size;
+}
+
+unsigned long ipfs_rpc_get_generation(ipfs_rpc_t *rpc)
+{
+    unsigned long generation;
+
+    pthread_mutex_lock(&rpc->publish_lock);
+    generation = rpc->generation;
+    pthread_mutex_unlock(&rpc->publish_lock);
+
+    return generation;
 }
 
 static int load_store(const cJSON *store, char *uid, size_t len)
@@ -363,6 +906,31 @@ static int load_store(const cJSON *store, char *uid, size_t len)
     return 0;
 }
 
+static void load_sync_cache(ipfs_rpc_t *rpc, const cJSON *store)
+{
+    cJSON *item;
+
+    item = cJSON_GetObjectItemCaseSensitive(store, "uid");
+    if (!cJSON_IsString(item) || !item->valuestring ||
+        strcmp(item->valuestring, rpc->uid))
+        return;
+
+    item = cJSON_GetObjectItemCaseSensitive(store, "peer_id");
+    if (cJSON_IsString(item) && item->valuestring &&
+        strlen(item->valuestring) < sizeof(rpc->peer_id))
+        strcpy(rpc->peer_id, item->valuestring);
+
+    item = cJSON_GetObjectItemCaseSensitive(store, "root_hash");
+    if (!cJSON_IsString(item) || !item->valuestring ||
+        strlen(item->valuestring) >= sizeof(rpc->root_hash))
+        return;
+
+    strcpy(rpc->root_hash, item->valuestring);
+
+    item = cJSON_GetObjectItemCaseSensitive(store, "timestamp");
+    rpc->synced_at = cJSON_IsNumber(item) ? (time_t)item->valuedouble : 0;
+}
+
 static int writeback_tokens(ipfs_rpc_t *rpc)
 {
     cJSON *json;
@@ -380,6 +948,16 @@ static int writeback_tokens(ipfs_rpc_t *rpc)
         return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
     }
 
+    if (rpc->root_hash[0] &&
+        ((rpc->peer_id[0] &&
+          !cJSON_AddStringToObject(json, "peer_id", rpc->peer_id)) ||
+         !cJSON_AddStringToObject(json, "root_hash", rpc->root_hash) ||
+         !cJSON_AddNumberToObject(json, "timestamp", (double)rpc->synced_at))) {
+        vlogE("IpfsToken: failed to add synchronization json objects.");
+        cJSON_Delete(json);
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+    }
+
     rc = rpc->writeback_cb(json, rpc->user_data);
     if (rc < 0)
         vlogE("IpfsToken: failed to write to file.");
@@ -387,6 +965,58 @@ static int writeback_tokens(ipfs_rpc_t *rpc)
     return rc;
 }
 
+void ipfs_rpc_set_root_hash(ipfs_rpc_t *rpc, const char *peer_id,
+                            const char *hash)
+{
+    if (!rpc->sync_cache_ttl || strlen(hash) >= sizeof(rpc->root_hash))
+        return;
+
+    pthread_mutex_lock(&rpc->node_lock);
+    if (peer_id && strlen(peer_id) < sizeof(rpc->peer_id))
+        strcpy(rpc->peer_id, peer_id);
+    strcpy(rpc->root_hash, hash);
+    rpc->synced_at = time(NULL);
+
+    writeback_tokens(rpc);
+    pthread_mutex_unlock(&rpc->node_lock);
+}
+
+bool ipfs_rpc_get_cached_root_hash(ipfs_rpc_t *rpc, char *hash, size_t len)
+{
+    bool fresh = false;
+    time_t now = time(NULL);
+
+    if (!rpc->sync_cache_ttl)
+        return false;
+
+    pthread_mutex_lock(&rpc->node_lock);
+    if (rpc->root_hash[0] && strlen(rpc->root_hash) < len &&
+        now >= rpc->synced_at && now - rpc->synced_at < rpc->sync_cache_ttl) {
+        strcpy(hash, rpc->root_hash);
+        fresh = true;
+    }
+    pthread_mutex_unlock(&rpc->node_lock);
+
+    return fresh;
+}
+
+bool ipfs_rpc_get_cached_peer_id(ipfs_rpc_t *rpc, char *peer_id, size_t len)
+{
+    bool cached = false;
+
+    if (!rpc->sync_cache_ttl)
+        return false;
+
+    pthread_mutex_lock(&rpc->node_lock);
+    if (rpc->peer_id[0] && strlen(rpc->peer_id) < len) {
+        strcpy(peer_id, rpc->peer_id);
+        cached = true;
+    }
+    pthread_mutex_unlock(&rpc->node_lock);
+
+    return cached;
+}
+
 int ipfs_rpc_reset(ipfs_rpc_t *rpc)
 {
     (void)rpc;
@@ -398,6 +1028,277 @@ int ipfs_rpc_synchronize(ipfs_rpc_t *rpc)
     return ipfs_synchronize(rpc);
 }
 
+static void mark_pending(ipfs_rpc_t *rpc)
+{
+    bool was_pending = rpc->publish_pending;
+
+    rpc->publish_pending = true;
+    if (rpc->publish_policy == IPFSPublishPolicy_Debounce) {
+        // A steady stream of mutations must not hold the publish off forever.
+        if (!was_pending) {
+            unsigned int max_delay = rpc->publish_interval;
+
+            if (max_delay <= UINT_MAX / PUBLISH_MAX_DELAY_RATIO)
+                max_delay *= PUBLISH_MAX_DELAY_RATIO;
+            else
+                max_delay = UINT_MAX;
+            deadline_after(&rpc->publish_max_deadline, max_delay);
+        }
+
+        deadline_after(&rpc->publish_deadline, rpc->publish_interval);
+        if (deadline_before(&rpc->publish_max_deadline, &rpc->publish_deadline))
+            rpc->publish_deadline = rpc->publish_max_deadline;
+
+        if (!was_pending)
+            pthread_cond_signal(&rpc->publish_cond);
+    }
+}
+
+bool ipfs_rpc_defer_publish(ipfs_rpc_t *rpc, bool commit)
+{
+    bool deferred = true;
+
+    pthread_mutex_lock(&rpc->publish_lock);
+    rpc->generation++;
+
+    switch (rpc->publish_policy) {
+    case IPFSPublishPolicy_Immediate:
+        deferred = false;
+        break;
+
+    case IPFSPublishPolicy_OnCommit:
+        if (commit) {
+            // The publish about to happen covers earlier writes as well.
+            rpc->publish_pending = false;
+            deferred = false;
+        } else
+            mark_pending(rpc);
+        break;
+
+    default:
+        mark_pending(rpc);
+        break;
+    }
+    pthread_mutex_unlock(&rpc->publish_lock);
+
+    return deferred;
+}
+
+bool ipfs_rpc_take_commit(ipfs_rpc_t *rpc)
+{
+    bool pending = false;
+
+    pthread_mutex_lock(&rpc->publish_lock);
+    if (rpc->publish_policy == IPFSPublishPolicy_OnCommit) {
+        pending = rpc->publish_pending;
+        rpc->publish_pending = false;
+    }
+    pthread_mutex_unlock(&rpc->publish_lock);
+
+    return pending;
+}
+
+void ipfs_rpc_mark_dirty(ipfs_rpc_t *rpc)
+{
+    pthread_mutex_lock(&rpc->publish_lock);
+    mark_pending(rpc);
+    pthread_mutex_unlock(&rpc->publish_lock);
+}
+
+static int publish_now(ipfs_rpc_t *rpc)
+{
+    char ip[HIVE_MAX_IPV6_ADDRESS_LEN + 1];
+    char url[MAX_URL_LEN];
+    uint16_t port;
+    int rc;
+
+    if (!ipfs_rpc_get_current_node(rpc, ip, &port)) {
+        vlogE("IpfsToken: current node is not reachable.");
+        return HIVE_GENERAL_ERROR(HIVEERR_TRY_AGAIN);
+    }
+
+    rc = publish_root_hash(rpc, url, sizeof(url));
+    if (rc < 0) {
+        if (RC_NODE_UNREACHABLE(rc)) {
+            vlogE("IpfsToken: current node is not reachable.");
+            rc = HIVE_GENERAL_ERROR(HIVEERR_TRY_AGAIN);
+            ipfs_rpc_mark_node_unreachable(rpc);
+        } else
+            vlogE("IpfsToken: failed to publish root hash.");
+        return rc;
+    }
+
+    return 0;
+}
+
+int ipfs_rpc_publish(ipfs_rpc_t *rpc, bool commit)
+{
+    int rc;
+
+    if (ipfs_rpc_defer_publish(rpc, commit))
+        return 0;
+
+    pthread_mutex_lock(&rpc->flush_lock);
+    rc = publish_now(rpc);
+    pthread_mutex_unlock(&rpc->flush_lock);
+
+    return rc;
+}
+
+int ipfs_rpc_commit(ipfs_rpc_t *rpc)
+{
+    int rc;
+
+    if (!ipfs_rpc_take_commit(rpc))
+        return 0;
+
+    pthread_mutex_lock(&rpc->flush_lock);
+    rc = publish_now(rpc);
+    pthread_mutex_unlock(&rpc->flush_lock);
+
+    if (rc < 0)
+        ipfs_rpc_mark_dirty(rpc);
+
+    return rc;
+}
+
+static int flush_pending(ipfs_rpc_t *rpc)
+{
+    bool pending;
+    int rc = 0;
+
+    pthread_mutex_lock(&rpc->flush_lock);
+
+    pthread_mutex_lock(&rpc->publish_lock);
+    pending = rpc->publish_pending;
+    rpc->publish_pending = false;
+    pthread_mutex_unlock(&rpc->publish_lock);
+
+    if (pending) {
+        rc = publish_now(rpc);
+        if (rc < 0)
+            ipfs_rpc_mark_dirty(rpc);
+    }
+
+    pthread_mutex_unlock(&rpc->flush_lock);
+    return rc;
+}
+
+int ipfs_rpc_flush(ipfs_rpc_t *rpc)
+{
+    bool lost;
+    int rc;
+
+    rc = flush_pending(rpc);
+
+    pthread_mutex_lock(&rpc->publish_lock);
+    lost = rpc->publish_lost;
+    rpc->publish_lost = false;
+    pthread_mutex_unlock(&rpc->publish_lock);
+
+    if (lost) {
+        vlogE("IpfsToken: mutations were lost with a failed node before "
+              "being published.");
+        return HIVE_GENERAL_ERROR(HIVEERR_WRONG_STATE);
+    }
+
+    return rc;
+}
+
+static void *publisher_routine(void *arg)
+{
+    ipfs_rpc_t *rpc = (ipfs_rpc_t *)arg;
+    int rc;
+
+    pthread_mutex_lock(&rpc->publish_lock);
+    while (!rpc->publisher_stopping) {
+        if (!rpc->publish_pending) {
+            pthread_cond_wait(&rpc->publish_cond, &rpc->publish_lock);
+            continue;
+        }
+
+        // Every new mutation pushes the deadline further out.
+        rc = pthread_cond_timedwait(&rpc->publish_cond, &rpc->publish_lock,
+                                    &rpc->publish_deadline);
+        if (rc != ETIMEDOUT || rpc->publisher_stopping ||
+            !deadline_passed(&rpc->publish_deadline))
+            continue;
+
+        pthread_mutex_unlock(&rpc->publish_lock);
+        rc = flush_pending(rpc);
+        pthread_mutex_lock(&rpc->publish_lock);
+
+        if (rc < 0) {
+            vlogW("IpfsToken: deferred publish failed (%d), retry later.", rc);
+            deadline_after(&rpc->publish_deadline, rpc->publish_interval);
+        }
+    }
+    pthread_mutex_unlock(&rpc->publish_lock);
+
+    return NULL;
+}
+
+/*
+ * Should the last reference be dropped on a worker, that worker is
+ * detached rather than joined by itself.
+ */
+static void stop_thread(pthread_t thread)
+{
+    if (pthread_equal(thread, pthread_self()))
+        pthread_detach(thread);
+    else
+        pthread_join(thread, NULL);
+}
+
+static void stop_workers(ipfs_rpc_t *rpc)
+{
+    if (rpc->monitor_started) {
+        pthread_mutex_lock(&rpc->monitor_lock);
+        rpc->monitor_stopping = true;
+        pthread_cond_signal(&rpc->monitor_cond);
+        pthread_mutex_unlock(&rpc->monitor_lock);
+
+        stop_thread(rpc->monitor);
+        rpc->monitor_started = false;
+    }
+
+    if (rpc->publisher_started) {
+        pthread_mutex_lock(&rpc->publish_lock);
+        rpc->publisher_stopping = true;
+        pthread_cond_signal(&rpc->publish_cond);
+        pthread_mutex_unlock(&rpc->publish_lock);
+
+        stop_thread(rpc->publisher);
+        rpc->publisher_started = false;
+    }
+}
+
+static void ipfs_rpc_destructor(void *obj)
+{
+    ipfs_rpc_t *rpc = (ipfs_rpc_t *)obj;
+
+    stop_workers(rpc);
+
+    if (rpc->publish_pending && ipfs_rpc_flush(rpc) < 0)
+        vlogW("IpfsToken: pending mutations were not published.");
+
+    if (rpc->user_data)
+        deref(rpc->user_data);
+
+    if (rpc->cache)
+        deref(rpc->cache);
+
+    if (rpc->endpoints)
+        free(rpc->endpoints);
+
+    pthread_cond_destroy(&rpc->monitor_cond);
+    pthread_mutex_destroy(&rpc->monitor_lock);
+    pthread_mutex_destroy(&rpc->node_lock);
+    pthread_cond_destroy(&rpc->publish_cond);
+    pthread_mutex_destroy(&rpc->flush_lock);
+    pthread_mutex_destroy(&rpc->publish_lock);
+}
+
 ipfs_rpc_t *ipfs_rpc_new(ipfs_rpc_options_t *options,
                          ipfs_rpc_writeback_func_t cb,
                          void *user_data)
@@ -408,19 +1309,48 @@ ipfs_rpc_t *ipfs_rpc_new(ipfs_rpc_options_t *options,
     int rc;
 
     bootstraps_nbytes = sizeof(options->rpc_nodes[0]) * options->rpc_nodes_count;
-    tmp = rc_zalloc(sizeof(ipfs_rpc_t) + bootstraps_nbytes, NULL);
+    tmp = rc_zalloc(sizeof(ipfs_rpc_t) + bootstraps_nbytes, ipfs_rpc_destructor);
     if (!tmp) {
         hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY));
         return NULL;
     }
 
+    pthread_mutex_init(&tmp->publish_lock, NULL);
+    pthread_mutex_init(&tmp->flush_lock, NULL);
+    pthread_cond_init(&tmp->publish_cond, NULL);
+    pthread_mutex_init(&tmp->node_lock, NULL);
+    pthread_mutex_init(&tmp->monitor_lock, NULL);
+    pthread_cond_init(&tmp->monitor_cond, NULL);
+    tmp->health_check_interval = options->health_check_interval;
+    tmp->sync_cache_ttl = options->sync_cache_ttl;
+    tmp->publish_policy   = (IPFSPublishPolicy)options->publish_policy;
+    tmp->publish_interval = options->publish_interval;
+    tmp->write_buffer_size = options->write_buffer_size;
+    tmp->download_parallelism = options->download_parallelism;
+    tmp->download_range_size  = options->download_range_size;
+
+    if (options->read_cache_size) {
+        tmp->cache = ipfs_cache_new(options->read_cache_size);
+        if (!tmp->cache) {
+            hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY));
+            deref(tmp);
+            return NULL;
+        }
+    }
+
     memcpy(tmp->rpc_nodes, options->rpc_nodes, bootstraps_nbytes);
     tmp->rpc_nodes_count = options->rpc_nodes_count;
     tmp->writeback_cb    = cb;
-    tmp->user_data       = user_data;
+    tmp->user_data       = user_data ? ref(user_data) : NULL;
 
-    rc = select_bootstrap(options->rpc_nodes, options->rpc_nodes_count,
-                          tmp->current_node_ip, &tmp->current_node_port);
+    rc = build_endpoints(tmp);
+    if (rc < 0) {
+        hive_set_error(rc);
+        deref(tmp);
+        return NULL;
+    }
+
+    rc = select_node(tmp);
     if (rc < 0) {
         vlogE("IpfsToken: No configured node is reachable.");
         hive_set_error(rc);
@@ -483,11 +1413,43 @@ ipfs_rpc_t *ipfs_rpc_new(ipfs_rpc_options_t *options,
         vlogI("IpfsToken: Use uid created: %s.", tmp->uid);
     }
 
+    if (tmp->sync_cache_ttl && options->store)
+        load_sync_cache(tmp, options->store);
+
+    pthread_mutex_lock(&tmp->node_lock);
     writeback_tokens(tmp);
+    pthread_mutex_unlock(&tmp->node_lock);
+
+    if (tmp->publish_policy == IPFSPublishPolicy_Debounce) {
+        rc = pthread_create(&tmp->publisher, NULL, publisher_routine, tmp);
+        if (rc) {
+            vlogE("IpfsToken: failed to start deferred publisher.");
+            hive_set_error(HIVE_SYS_ERROR(rc));
+            deref(tmp);
+            return NULL;
+        }
+        tmp->publisher_started = true;
+    }
+
+    if (tmp->health_check_interval) {
+        rc = pthread_create(&tmp->monitor, NULL, monitor_routine, tmp);
+        if (rc) {
+            vlogE("IpfsToken: failed to start health monitor.");
+            hive_set_error(HIVE_SYS_ERROR(rc));
+            deref(tmp);
+            return NULL;
+        }
+        tmp->monitor_started = true;
+    }
 
     return tmp;
 }
 
+void ipfs_rpc_stop_workers(ipfs_rpc_t *rpc)
+{
+    stop_workers(rpc);
+}
+
 int ipfs_rpc_close(ipfs_rpc_t *rpc)
 {
     deref(rpc);
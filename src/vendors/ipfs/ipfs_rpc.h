@@ -27,10 +27,12 @@
 extern "C" {
 #endif
 
+#include <stdbool.h>
 #include <cjson/cJSON.h>
 
 #include "ela_hive.h"
 #include "ipfs_constants.h"
+#include "ipfs_cache.h"
 
 typedef struct ipfs_rpc ipfs_rpc_t;
 
@@ -43,25 +45,77 @@ typedef struct rpc_node {
 typedef struct ipfs_rpc_options {
     cJSON *store;
     char uid[HIVE_MAX_IPFS_UID_LEN + 1];
+    int publish_policy;
+    unsigned int publish_interval;
+    size_t write_buffer_size;
+    size_t read_cache_size;
+    unsigned int download_parallelism;
+    size_t download_range_size;
+    unsigned int health_check_interval;
+    unsigned int sync_cache_ttl;
     size_t rpc_nodes_count;
     rpc_node_t rpc_nodes[0];
 } ipfs_rpc_options_t;
 
 typedef int ipfs_rpc_writeback_func_t(const cJSON *json, void *user_data);
 
+/*
+ * user_data must be a reference-counted object, the rpc holds a reference
+ * to it until destroyed since drives and files may keep the rpc alive
+ * after its owner is closed. ipfs_rpc_close() just drops a reference.
+ *
+ * Only the owner calls ipfs_rpc_stop_workers(), once, when it is closed:
+ * it stops the health monitor and the deferred publisher, and later
+ * mutations are published on flush.
+ */
+
 ipfs_rpc_t *ipfs_rpc_new(ipfs_rpc_options_t *options,
                          ipfs_rpc_writeback_func_t cb,
                          void *user_data);
 int ipfs_rpc_close(ipfs_rpc_t *rpc);
+void ipfs_rpc_stop_workers(ipfs_rpc_t *rpc);
 int ipfs_rpc_synchronize(ipfs_rpc_t *rpc);
 int ipfs_rpc_reset(ipfs_rpc_t *rpc);
 int ipfs_rpc_get_uid_info(ipfs_rpc_t *rpc, char **result);
+int ipfs_rpc_get_node_uid_info(ipfs_rpc_t *rpc, const char *node_ip,
+                               uint16_t node_port, char **result);
 const char *ipfs_rpc_get_uid(ipfs_rpc_t *rpc);
-const char *ipfs_rpc_get_current_node_ip(ipfs_rpc_t *rpc);
-uint16_t ipfs_rpc_get_current_node_port(ipfs_rpc_t *rpc);
+bool ipfs_rpc_get_current_node(ipfs_rpc_t *rpc, char *ip, uint16_t *port);
+int ipfs_rpc_get_node_url(ipfs_rpc_t *rpc, const char *api,
+                          char *buf, size_t bufsz);
+size_t ipfs_rpc_get_write_buffer_size(ipfs_rpc_t *rpc);
+ipfs_cache_t *ipfs_rpc_get_cache(ipfs_rpc_t *rpc);
+unsigned int ipfs_rpc_get_download_parallelism(ipfs_rpc_t *rpc);
+size_t ipfs_rpc_get_download_range_size(ipfs_rpc_t *rpc);
+unsigned long ipfs_rpc_get_generation(ipfs_rpc_t *rpc);
 int ipfs_rpc_check_reachable(ipfs_rpc_t *rpc);
 void ipfs_rpc_mark_node_unreachable(ipfs_rpc_t *rpc);
 
+/*
+ * Synchronization results persisted in the store. The cached root hash is
+ * only returned while younger than the configured sync_cache_ttl.
+ */
+void ipfs_rpc_set_root_hash(ipfs_rpc_t *rpc, const char *peer_id,
+                            const char *hash);
+bool ipfs_rpc_get_cached_root_hash(ipfs_rpc_t *rpc, char *hash, size_t len);
+bool ipfs_rpc_get_cached_peer_id(ipfs_rpc_t *rpc, char *peer_id, size_t len);
+
+/*
+ * Root hash publishing under the configured IPFSPublishPolicy.
+ *
+ * ipfs_rpc_defer_publish() records a finished mutation (commit is true for
+ * drive mutations, false for file writes) and returns false when the caller
+ * has to publish right away. ipfs_rpc_take_commit() returns true when a
+ * file commit has to publish the pending mutations; ipfs_rpc_mark_dirty()
+ * restores the pending state after such a publish failed.
+ */
+bool ipfs_rpc_defer_publish(ipfs_rpc_t *rpc, bool commit);
+bool ipfs_rpc_take_commit(ipfs_rpc_t *rpc);
+void ipfs_rpc_mark_dirty(ipfs_rpc_t *rpc);
+int ipfs_rpc_publish(ipfs_rpc_t *rpc, bool commit);
+int ipfs_rpc_commit(ipfs_rpc_t *rpc);
+int ipfs_rpc_flush(ipfs_rpc_t *rpc);
+
 #ifdef __cplusplus
 }
 #endif
@@ -33,7 +33,8 @@
 #include "hive_error.h"
 #include "http_status.h"
 
-static int ipfs_resolve(ipfs_rpc_t *rpc, const char *peerid, char **result)
+static int ipfs_resolve(const char *node_ip, uint16_t node_port,
+                        const char *peerid, char **result)
 {
     char url[MAX_URL_LEN] = {0};
     http_client_t *httpc;
@@ -42,8 +43,7 @@ static int ipfs_resolve(ipfs_rpc_t *rpc, const char *peerid, char **result)
     int rc;
 
     rc = snprintf(url, sizeof(url), "http://%s:%u/api/v0/name/resolve",
-                  ipfs_rpc_get_current_node_ip(rpc),
-                  (unsigned)ipfs_rpc_get_current_node_port(rpc));
+                  node_ip, (unsigned)node_port);
     if (rc < 0 || rc >= sizeof(url)) {
         vlogE("IpfsUtils: URL too long.");
         return HIVE_GENERAL_ERROR(HIVEERR_BUFFER_TOO_SMALL);
@@ -96,7 +96,8 @@ error_exit:
     return rc;
 }
 
-static int ipfs_login(ipfs_rpc_t *rpc, const char *hash)
+static int ipfs_login(ipfs_rpc_t *rpc, const char *node_ip, uint16_t node_port,
+                      const char *hash)
 {
     char url[MAX_URL_LEN] = {0};
     http_client_t *httpc;
@@ -104,8 +105,7 @@ static int ipfs_login(ipfs_rpc_t *rpc, const char *hash)
     int rc;
 
     rc = snprintf(url, sizeof(url), "http://%s:%u/api/v0/uid/login",
-                  ipfs_rpc_get_current_node_ip(rpc),
-                  (unsigned)ipfs_rpc_get_current_node_port(rpc));
+                  node_ip, (unsigned)node_port);
     if (rc < 0 || rc >= sizeof(url)) {
         vlogE("IpfsUtils: URL too long.");
         return HIVE_GENERAL_ERROR(HIVEERR_BUFFER_TOO_SMALL);
@@ -152,62 +152,94 @@ error_exit:
 
 int ipfs_synchronize(ipfs_rpc_t *rpc)
 {
+    char ip[HIVE_MAX_IPV6_ADDRESS_LEN + 1];
+    uint16_t port;
+
+    assert(rpc);
+
+    if (!ipfs_rpc_get_current_node(rpc, ip, &port))
+        return HIVE_GENERAL_ERROR(HIVEERR_TRY_AGAIN);
+
+    return ipfs_synchronize_node(rpc, ip, port);
+}
+
+int ipfs_synchronize_node(ipfs_rpc_t *rpc, const char *node_ip,
+                          uint16_t node_port)
+{
+    char peer_id[128] = {0};
+    char cached[128];
     char *resp;
     cJSON *json = NULL;
-    cJSON *peer_id;
-    cJSON *hash;
+    cJSON *item;
     int rc;
 
     assert(rpc);
+    assert(node_ip);
 
-    rc = ipfs_rpc_get_uid_info(rpc, &resp);
-    if (rc < 0) {
-        vlogE("IpfsUtils: get uid info failure.");
-        return rc;
-    }
+    // A fresh cached root hash saves uid/info and name/resolve.
+    if (ipfs_rpc_get_cached_root_hash(rpc, cached, sizeof(cached))) {
+        rc = ipfs_login(rpc, node_ip, node_port, cached);
+        if (rc == 0)
+            return 0;
 
-    json = cJSON_Parse(resp);
-    free(resp);
-    if (!json) {
-        vlogE("IpfsUtils: bad json format for uid info response.");
-        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+        vlogW("IpfsUtils: failed to login with cached root hash, resolve it.");
     }
 
-    peer_id = cJSON_GetObjectItemCaseSensitive(json, "PeerID");
-    if (!cJSON_IsString(peer_id) || !peer_id->valuestring || !*peer_id->valuestring) {
-        vlogE("IpfsUtils: missing PeerID json object for uid info response.");
+    if (!ipfs_rpc_get_cached_peer_id(rpc, peer_id, sizeof(peer_id))) {
+        rc = ipfs_rpc_get_node_uid_info(rpc, node_ip, node_port, &resp);
+        if (rc < 0) {
+            vlogE("IpfsUtils: get uid info failure.");
+            return rc;
+        }
+
+        json = cJSON_Parse(resp);
+        http_client_release_response_body(resp);
+        if (!json) {
+            vlogE("IpfsUtils: bad json format for uid info response.");
+            return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+        }
+
+        item = cJSON_GetObjectItemCaseSensitive(json, "PeerID");
+        if (!is_string_item(item) || strlen(item->valuestring) >= sizeof(peer_id)) {
+            vlogE("IpfsUtils: missing PeerID json object for uid info response.");
+            cJSON_Delete(json);
+            return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+        }
+
+        strcpy(peer_id, item->valuestring);
         cJSON_Delete(json);
-        return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
     }
 
-    rc = ipfs_resolve(rpc, peer_id->valuestring, &resp);
-    cJSON_Delete(json);
+    rc = ipfs_resolve(node_ip, node_port, peer_id, &resp);
     if (rc < 0) {
         vlogE("IpfsUtils: failed to resolve uid hash.");
         return rc;
     }
 
     json = cJSON_Parse(resp);
-    free(resp);
+    http_client_release_response_body(resp);
     if (!json) {
         vlogE("IpfsUtils: bad json format for resolve response.");
         return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
     }
 
-    hash = cJSON_GetObjectItemCaseSensitive(json, "Path");
-    if (!cJSON_IsString(hash) || !hash->valuestring || !*hash->valuestring) {
+    item = cJSON_GetObjectItemCaseSensitive(json, "Path");
+    if (!is_string_item(item)) {
         vlogE("IpfsUtils: missing Path json object for resolve response.");
         cJSON_Delete(json);
         return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
     }
 
-    rc = ipfs_login(rpc, hash->valuestring);
-    cJSON_Delete(json);
+    rc = ipfs_login(rpc, node_ip, node_port, item->valuestring);
     if (rc < 0) {
         vlogE("IpfsUtils: failed to call login api.");
+        cJSON_Delete(json);
         return rc;
     }
 
+    ipfs_rpc_set_root_hash(rpc, peer_id, item->valuestring);
+    cJSON_Delete(json);
+
     return 0;
 }
 
@@ -229,9 +261,9 @@ static int get_last_root_hash(ipfs_rpc_t *rpc,
     assert(hash);
     assert(bufsz >= MAX_URL_LEN);
 
-    sprintf(buf, "http://%s:%u/api/v0/files/stat",
-            ipfs_rpc_get_current_node_ip(rpc),
-            (unsigned)ipfs_rpc_get_current_node_port(rpc));
+    rc = ipfs_rpc_get_node_url(rpc, "files/stat", buf, bufsz);
+    if (rc < 0)
+        return rc;
 
     httpc = http_client_new();
     if (!httpc) {
@@ -275,7 +307,7 @@ static int get_last_root_hash(ipfs_rpc_t *rpc,
     }
 
     json = cJSON_Parse(p);
-    free(p);
+    http_client_release_response_body(p);
 
     if (!json) {
         vlogE("IpfsUtils: bad json format for response body.");
@@ -321,9 +353,9 @@ static int pub_last_root_hash(ipfs_rpc_t *rpc,
     assert(hash);
     assert(bufsz >= MAX_URL_LEN);
 
-    sprintf(buf, "http://%s:%u/api/v0/name/publish",
-            ipfs_rpc_get_current_node_ip(rpc),
-            (unsigned)ipfs_rpc_get_current_node_port(rpc));
+    rc = ipfs_rpc_get_node_url(rpc, "name/publish", buf, bufsz);
+    if (rc < 0)
+        return rc;
 
     httpc = http_client_new();
     if (!httpc) {
@@ -380,5 +412,183 @@ int publish_root_hash(ipfs_rpc_t *rpc, char *buf, size_t length)
     }
 
     memset(buf, 0, length);
-    return pub_last_root_hash(rpc, buf, length, hash);
+    rc = pub_last_root_hash(rpc, buf, length, hash);
+    if (rc < 0)
+        return rc;
+
+    ipfs_rpc_set_root_hash(rpc, NULL, hash);
+    return 0;
+}
+
+http_client_t *ipfs_http_client_new(ipfs_rpc_t *rpc, const char *api)
+{
+    char url[MAX_URL_LEN] = {0};
+    http_client_t *httpc;
+    int rc;
+
+    assert(rpc);
+    assert(api);
+
+    rc = ipfs_rpc_get_node_url(rpc, api, url, sizeof(url));
+    if (rc < 0)
+        return NULL;
+
+    httpc = http_client_new();
+    if (!httpc) {
+        vlogE("IpfsUtils: failed to create http client instance.");
+        return NULL;
+    }
+
+    http_client_set_url(httpc, url);
+    http_client_set_query(httpc, "uid", ipfs_rpc_get_uid(rpc));
+    http_client_set_method(httpc, HTTP_METHOD_POST);
+
+    return httpc;
+}
+
+int ipfs_check_response(ipfs_rpc_t *rpc, http_client_t *httpc, int rc)
+{
+    long resp_code = 0;
+
+    if (rc) {
+        rc = HIVE_CURL_ERROR(rc);
+        if (RC_NODE_UNREACHABLE(rc)) {
+            vlogE("IpfsUtils: current node is not reachable.");
+            ipfs_rpc_mark_node_unreachable(rpc);
+            return HIVE_GENERAL_ERROR(HIVEERR_TRY_AGAIN);
+        }
+
+        vlogE("IpfsUtils: failed to perform http request.");
+        return rc;
+    }
+
+    rc = http_client_get_response_code(httpc, &resp_code);
+    if (rc) {
+        vlogE("IpfsUtils: failed to get http response code.");
+        return HIVE_CURL_ERROR(rc);
+    }
+
+    if (resp_code != HttpStatus_OK) {
+        vlogE("IpfsUtils: error from http response (%d).", resp_code);
+        return HIVE_HTTP_STATUS_ERROR(resp_code);
+    }
+
+    return 0;
+}
+
+typedef struct publish_ctx {
+    ipfs_rpc_t *rpc;
+    http_engine_t *engine;
+    ipfs_publish_callback_t *cb;
+    void *arg;
+    char hash[128];
+} publish_ctx_t;
+
+static void publish_ctx_done(publish_ctx_t *ctx, int rc)
+{
+    ctx->cb(rc, ctx->arg);
+    ipfs_rpc_close(ctx->rpc);
+    free(ctx);
+}
+
+static void on_root_hash_published(http_client_t *httpc, int rc, void *arg)
+{
+    publish_ctx_t *ctx = (publish_ctx_t *)arg;
+
+    rc = ipfs_check_response(ctx->rpc, httpc, rc);
+    http_client_close(httpc);
+
+    if (rc == 0)
+        ipfs_rpc_set_root_hash(ctx->rpc, NULL, ctx->hash);
+
+    publish_ctx_done(ctx, rc);
+}
+
+static void on_root_hash_got(http_client_t *httpc, int rc, void *arg)
+{
+    publish_ctx_t *ctx = (publish_ctx_t *)arg;
+    cJSON *json;
+    cJSON *item;
+    char *p;
+
+    rc = ipfs_check_response(ctx->rpc, httpc, rc);
+    if (rc < 0) {
+        http_client_close(httpc);
+        publish_ctx_done(ctx, rc);
+        return;
+    }
+
+    p = http_client_move_response_body(httpc, NULL);
+    http_client_close(httpc);
+
+    if (!p) {
+        vlogE("IpfsUtils: failed to get response body.");
+        publish_ctx_done(ctx, HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY));
+        return;
+    }
+
+    json = cJSON_Parse(p);
+    http_client_release_response_body(p);
+
+    if (!json) {
+        vlogE("IpfsUtils: bad json format for response body.");
+        publish_ctx_done(ctx, HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY));
+        return;
+    }
+
+    item = cJSON_GetObjectItem(json, "Hash");
+    if (!is_string_item(item) ||
+        strlen(item->valuestring) + strlen("/ipfs/") >= sizeof(ctx->hash)) {
+        cJSON_Delete(json);
+        vlogE("IpfsUtils: missing Hash json object for response body.");
+        publish_ctx_done(ctx, HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT));
+        return;
+    }
+
+    sprintf(ctx->hash, "/ipfs/%s", item->valuestring);
+    cJSON_Delete(json);
+
+    httpc = ipfs_http_client_new(ctx->rpc, "name/publish");
+    if (!httpc) {
+        publish_ctx_done(ctx, HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY));
+        return;
+    }
+
+    http_client_set_query(httpc, "path", ctx->hash);
+    http_client_set_request_body_instant(httpc, NULL, 0);
+
+    http_client_submit(ctx->engine, httpc, on_root_hash_published, ctx);
+}
+
+int publish_root_hash_async(ipfs_rpc_t *rpc, http_engine_t *engine,
+                            ipfs_publish_callback_t *cb, void *arg)
+{
+    publish_ctx_t *ctx;
+    http_client_t *httpc;
+
+    assert(rpc);
+    assert(engine);
+    assert(cb);
+
+    ctx = (publish_ctx_t *)calloc(1, sizeof(*ctx));
+    if (!ctx)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    httpc = ipfs_http_client_new(rpc, "files/stat");
+    if (!httpc) {
+        free(ctx);
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+    }
+
+    http_client_set_query(httpc, "path", "/");
+    http_client_set_request_body_instant(httpc, NULL, 0);
+    http_client_enable_response_body(httpc);
+
+    ctx->rpc    = ref(rpc);
+    ctx->engine = engine;
+    ctx->cb     = cb;
+    ctx->arg    = arg;
+
+    http_client_submit(engine, httpc, on_root_hash_got, ctx);
+    return 0;
 }
@@ -28,8 +28,11 @@ extern "C" {
 #endif
 
 #include "ipfs_rpc.h"
+#include "http_client.h"
 
 int ipfs_synchronize(ipfs_rpc_t *rpc);
+int ipfs_synchronize_node(ipfs_rpc_t *rpc, const char *node_ip,
+                          uint16_t node_port);
 int ipfs_publish(ipfs_rpc_t *rpc, const char *path);
 int ipfs_stat_file(ipfs_rpc_t *rpc, const char *file_path, HiveFileInfo *info);
 
@@ -40,6 +43,16 @@ static inline bool is_string_item(cJSON *item)
 
 int publish_root_hash(ipfs_rpc_t *rpc, char *buf, size_t length);
 
+/*
+ * Asynchronous helpers running on the engine thread.
+ */
+typedef void ipfs_publish_callback_t(int rc, void *arg);
+
+http_client_t *ipfs_http_client_new(ipfs_rpc_t *rpc, const char *api);
+int ipfs_check_response(ipfs_rpc_t *rpc, http_client_t *httpc, int rc);
+int publish_root_hash_async(ipfs_rpc_t *rpc, http_engine_t *engine,
+                            ipfs_publish_callback_t *cb, void *arg);
+
 #ifdef __cplusplus
 }
 #endif
@@ -20,16 +20,147 @@
  * SOFTWARE.
  */
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#include <limits.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include <crystal.h>
 
 #include "ela_hive.h"
+#include "native_client.h"
+#include "native_drive.h"
+#include "hive_error.h"
+#include "hive_client.h"
+#include "mkdirs.h"
 
+#if defined(_WIN32) || defined(_WIN64)
 HiveClient *native_client_new(const HiveOptions *options)
 {
     assert(options);
     (void)options;
 
-    // TODO;
+    vlogE("NativeClient: native drive is not supported on this platform.");
+    hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_NOT_SUPPORTED));
     return NULL;
 }
+#else
+typedef struct NativeClient {
+    HiveClient base;
+    char root[PATH_MAX];
+} NativeClient;
+
+static int native_client_login(HiveClient *base,
+                               HiveRequestAuthenticationCallback *cb,
+                               void *user_data)
+{
+    (void)base;
+    (void)cb;
+    (void)user_data;
+
+    // Nothing to authenticate against for the local file system.
+    return 0;
+}
+
+static int native_client_logout(HiveClient *base)
+{
+    (void)base;
+
+    return 0;
+}
+
+static int native_client_get_info(HiveClient *base, HiveClientInfo *result)
+{
+    int rc;
+
+    assert(base);
+    assert(result);
+
+    rc = snprintf(result->user_id, sizeof(result->user_id), "%u",
+                  (unsigned)getuid());
+    if (rc < 0 || rc >= sizeof(result->user_id)) {
+        vlogE("NativeClient: Failed to fill user id field of client info.");
+        return HIVE_GENERAL_ERROR(HIVEERR_BUFFER_TOO_SMALL);
+    }
+
+    result->display_name[0] = '\0';
+    result->email[0]        = '\0';
+    result->phone_number[0] = '\0';
+    result->region[0]       = '\0';
+
+    return 0;
+}
+
+static int native_client_drive_open(HiveClient *base, HiveDrive **drive)
+{
+    NativeClient *client = (NativeClient *)base;
+    HiveDrive *tmp;
+
+    assert(base);
+
+    tmp = native_drive_open(client->root);
+    if (!tmp) {
+        vlogE("NativeClient: Failed to open native drive.");
+        return hive_get_error();
+    }
+
+    *drive = tmp;
+
+    return 0;
+}
+
+static int native_client_close(HiveClient *base)
+{
+    assert(base);
+
+    deref(base);
+    return 0;
+}
+
+HiveClient *native_client_new(const HiveOptions *options)
+{
+    NativeClient *client;
+    char root[PATH_MAX];
+    int rc;
+
+    assert(options);
+    assert(options->persistent_location);
+
+    rc = snprintf(root, sizeof(root), "%s/.data/native",
+                  options->persistent_location);
+    if (rc < 0 || rc >= sizeof(root)) {
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_BUFFER_TOO_SMALL));
+        return NULL;
+    }
+
+    rc = mkdirs(root, S_IRWXU);
+    if (rc < 0 && errno != EEXIST) {
+        vlogE("NativeClient: failed to create directory (%d).", errno);
+        hive_set_error(HIVE_SYS_ERROR(errno));
+        return NULL;
+    }
+
+    client = (NativeClient *)rc_zalloc(sizeof(NativeClient), NULL);
+    if (!client) {
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY));
+        return NULL;
+    }
+
+    strcpy(client->root, root);
+
+    client->base.login       = &native_client_login;
+    client->base.logout      = &native_client_logout;
+    client->base.get_info    = &native_client_get_info;
+    client->base.get_drive   = &native_client_drive_open;
+    client->base.close       = &native_client_close;
+
+    return &client->base;
+}
+#endif
@@ -0,0 +1,924 @@
+/*
+ * Copyright (c) 2019 Elastos Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stddef.h>
+#include <limits.h>
+#include <errno.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include <crystal.h>
+
+#include "native_drive.h"
+#include "native_file.h"
+#include "native_utils.h"
+#include "native_uring.h"
+#include "hive_error.h"
+#include "hive_client.h"
+#include "hive_async.h"
+
+#define NATIVE_URING_ENTRIES    64
+
+/*
+ * struct statx comes with glibc 2.28 and is Linux only. Without it stats
+ * never go through the ring and are taken with fstatat() instead.
+ */
+#if defined(HAVE_LINUX_IO_URING_H) && defined(STATX_BASIC_STATS)
+#define NATIVE_HAVE_STATX 1
+#endif
+
+/*
+ * The drive owns an io_uring when the system provides one. Asynchronous
+ * stats, batched stats and the asynchronous I/O of its files go through
+ * it; everything else, and everything when there is no ring, uses the
+ * plain system calls.
+ */
+typedef struct NativeDrive {
+    HiveDrive base;
+    char root[PATH_MAX];
+    native_uring_t *ring;
+} NativeDrive;
+
+static int native_drive_get_info(HiveDrive *base, HiveDriveInfo *info)
+{
+    NativeDrive *drive = (NativeDrive *)base;
+    int rc;
+
+    assert(drive);
+    assert(info);
+
+    rc = snprintf(info->driveid, sizeof(info->driveid), "%s", drive->root);
+    if (rc < 0 || rc >= sizeof(info->driveid)) {
+        vlogE("NativeDrive: drive id too long.");
+        return HIVE_GENERAL_ERROR(HIVEERR_BUFFER_TOO_SMALL);
+    }
+
+    return 0;
+}
+
+static void fill_file_info(const struct stat *st, HiveFileInfo *info)
+{
+    snprintf(info->fileid, sizeof(info->fileid), "%llu",
+             (unsigned long long)st->st_ino);
+    strcpy(info->type, S_ISDIR(st->st_mode) ? "directory" : "file");
+    info->size = S_ISDIR(st->st_mode) ? 0 : (size_t)st->st_size;
+}
+
+#ifdef NATIVE_HAVE_STATX
+static void fill_file_info_statx(const struct statx *stx, HiveFileInfo *info)
+{
+    snprintf(info->fileid, sizeof(info->fileid), "%llu",
+             (unsigned long long)stx->stx_ino);
+    strcpy(info->type, S_ISDIR(stx->stx_mode) ? "directory" : "file");
+    info->size = S_ISDIR(stx->stx_mode) ? 0 : (size_t)stx->stx_size;
+}
+#endif
+
+static int stat_file(NativeDrive *drive, const char *path, HiveFileInfo *info)
+{
+    char abspath[PATH_MAX];
+    struct stat st;
+    int rc;
+
+    rc = native_resolve_path(drive->root, path, abspath, sizeof(abspath));
+    if (rc < 0)
+        return rc;
+
+    if (fstatat(AT_FDCWD, abspath, &st, 0) < 0) {
+        vlogE("NativeDrive: failed to call fstatat() (%d).", errno);
+        return HIVE_SYS_ERROR(errno);
+    }
+
+    fill_file_info(&st, info);
+    return 0;
+}
+
+static int native_drive_stat_file(HiveDrive *base, const char *path,
+                                  HiveFileInfo *info)
+{
+    NativeDrive *drive = (NativeDrive *)base;
+
+    return stat_file(drive, path, info);
+}
+
+static const char *get_entry_type(DIR *dir, struct dirent *entry)
+{
+#ifdef _DIRENT_HAVE_D_TYPE
+    if (entry->d_type != DT_UNKNOWN)
+        return entry->d_type == DT_DIR ? "directory" : "file";
+#endif
+    {
+        struct stat st;
+
+        if (fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0)
+            return "file";
+
+        return S_ISDIR(st.st_mode) ? "directory" : "file";
+    }
+}
+
+static bool is_skipped_entry(const char *name)
+{
+    return !strcmp(name, ".") || !strcmp(name, "..") ||
+           is_native_tmp_name(name);
+}
+
+static void notify_dir_entries(DIR *dir, HiveFilesIterateCallback *callback,
+                               void *context)
+{
+    struct dirent *entry;
+
+    while ((entry = readdir(dir)) != NULL) {
+        KeyValue properties[2];
+        bool resume;
+
+        if (is_skipped_entry(entry->d_name))
+            continue;
+
+        properties[0].key   = "name";
+        properties[0].value = entry->d_name;
+        properties[1].key   = "type";
+        properties[1].value = (char *)get_entry_type(dir, entry);
+
+        resume = callback(properties, sizeof(properties) / sizeof(properties[0]),
+                          context);
+        if (!resume)
+            return;
+    }
+
+    callback(NULL, 0, context);
+}
+
+static int open_dir(NativeDrive *drive, const char *path, DIR **dir)
+{
+    char abspath[PATH_MAX];
+    int rc;
+
+    rc = native_resolve_path(drive->root, path, abspath, sizeof(abspath));
+    if (rc < 0)
+        return rc;
+
+    *dir = opendir(abspath);
+    if (!*dir) {
+        vlogE("NativeDrive: failed to open directory (%d).", errno);
+        return HIVE_SYS_ERROR(errno);
+    }
+
+    return 0;
+}
+
+static int native_drive_list_files(HiveDrive *base, const char *path,
+                                   HiveFilesIterateCallback *callback,
+                                   void *context)
+{
+    NativeDrive *drive = (NativeDrive *)base;
+    DIR *dir;
+    int rc;
+
+    rc = open_dir(drive, path, &dir);
+    if (rc < 0)
+        return rc;
+
+    notify_dir_entries(dir, callback, context);
+    closedir(dir);
+
+    return 0;
+}
+
+static int make_dir(NativeDrive *drive, const char *path)
+{
+    char abspath[PATH_MAX];
+    int rc;
+
+    rc = native_resolve_path(drive->root, path, abspath, sizeof(abspath));
+    if (rc < 0)
+        return rc;
+
+    if (mkdir(abspath, S_IRWXU) < 0) {
+        vlogE("NativeDrive: failed to create directory (%d).", errno);
+        return HIVE_SYS_ERROR(errno);
+    }
+
+    return 0;
+}
+
+static int native_drive_make_dir(HiveDrive *base, const char *path)
+{
+    NativeDrive *drive = (NativeDrive *)base;
+
+    return make_dir(drive, path);
+}
+
+static int resolve_entry_path(NativeDrive *drive, const char *path,
+                              char *abspath, size_t len)
+{
+    int rc;
+
+    rc = native_resolve_path(drive->root, path, abspath, len);
+    if (rc < 0)
+        return rc;
+
+    // Never let the drive root itself be removed or moved.
+    if (!strcmp(abspath, drive->root)) {
+        vlogE("NativeDrive: root directory can not be changed.");
+        return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
+    }
+
+    return 0;
+}
+
+static int move_file(NativeDrive *drive, const char *from, const char *to)
+{
+    char src[PATH_MAX];
+    char dest[PATH_MAX];
+    int rc;
+
+    rc = resolve_entry_path(drive, from, src, sizeof(src));
+    if (rc < 0)
+        return rc;
+
+    rc = resolve_entry_path(drive, to, dest, sizeof(dest));
+    if (rc < 0)
+        return rc;
+
+    if (rename(src, dest) < 0) {
+        vlogE("NativeDrive: failed to rename file (%d).", errno);
+        return HIVE_SYS_ERROR(errno);
+    }
+
+    return 0;
+}
+
+static int native_drive_move_file(HiveDrive *base, const char *from,
+                                  const char *to)
+{
+    NativeDrive *drive = (NativeDrive *)base;
+
+    return move_file(drive, from, to);
+}
+
+static int copy_regular_file(const char *src, const char *dest)
+{
+    char tmp_path[PATH_MAX];
+    struct stat st;
+    int src_fd;
+    int fd;
+    int rc;
+
+    src_fd = open(src, O_RDONLY);
+    if (src_fd < 0) {
+        vlogE("NativeDrive: failed to open file (%d).", errno);
+        return HIVE_SYS_ERROR(errno);
+    }
+
+    fd = native_open_tmpfile(dest, tmp_path, sizeof(tmp_path));
+    if (fd < 0) {
+        close(src_fd);
+        return fd;
+    }
+
+    rc = native_clone_content(fd, src_fd);
+
+    // A new copy takes the mode of its source, as cp does.
+    if (rc == 0 && (fstat(src_fd, &st) < 0 ||
+                    fchmod(fd, st.st_mode & 07777) < 0)) {
+        vlogE("NativeDrive: failed to set mode of copy (%d).", errno);
+        rc = HIVE_SYS_ERROR(errno);
+    }
+
+    if (rc == 0)
+        rc = native_link_tmpfile(fd, tmp_path, dest);
+
+    if (rc < 0 && tmp_path[0])
+        unlink(tmp_path);
+
+    close(fd);
+    close(src_fd);
+    return rc;
+}
+
+static int copy_tree(const char *src, const char *dest)
+{
+    char src_child[PATH_MAX];
+    char dest_child[PATH_MAX];
+    struct dirent *entry;
+    struct stat st;
+    DIR *dir;
+    int rc = 0;
+
+    if (lstat(src, &st) < 0) {
+        vlogE("NativeDrive: failed to call lstat() (%d).", errno);
+        return HIVE_SYS_ERROR(errno);
+    }
+
+    if (S_ISREG(st.st_mode))
+        return copy_regular_file(src, dest);
+
+    if (!S_ISDIR(st.st_mode)) {
+        vlogW("NativeDrive: skipped copying special file %s.", src);
+        return 0;
+    }
+
+    if (mkdir(dest, S_IRWXU) < 0 && errno != EEXIST) {
+        vlogE("NativeDrive: failed to create directory (%d).", errno);
+        return HIVE_SYS_ERROR(errno);
+    }
+
+    dir = opendir(src);
+    if (!dir) {
+        vlogE("NativeDrive: failed to open directory (%d).", errno);
+        return HIVE_SYS_ERROR(errno);
+    }
+
+    while (rc == 0 && (entry = readdir(dir)) != NULL) {
+        if (is_skipped_entry(entry->d_name))
+            continue;
+
+        if (snprintf(src_child, sizeof(src_child), "%s/%s",
+                     src, entry->d_name) >= (int)sizeof(src_child) ||
+            snprintf(dest_child, sizeof(dest_child), "%s/%s",
+                     dest, entry->d_name) >= (int)sizeof(dest_child)) {
+            rc = HIVE_GENERAL_ERROR(HIVEERR_BUFFER_TOO_SMALL);
+            break;
+        }
+
+        rc = copy_tree(src_child, dest_child);
+    }
+
+    closedir(dir);
+    return rc;
+}
+
+static int copy_file(NativeDrive *drive, const char *from, const char *to)
+{
+    char src[PATH_MAX];
+    char dest[PATH_MAX];
+    size_t len;
+    int rc;
+
+    rc = resolve_entry_path(drive, from, src, sizeof(src));
+    if (rc < 0)
+        return rc;
+
+    rc = resolve_entry_path(drive, to, dest, sizeof(dest));
+    if (rc < 0)
+        return rc;
+
+    // Copying a directory into itself would never end.
+    len = strlen(src);
+    if (!strncmp(dest, src, len) && dest[len] == '/') {
+        vlogE("NativeDrive: can not copy a directory into itself.");
+        return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
+    }
+
+    return copy_tree(src, dest);
+}
+
+static int native_drive_copy_file(HiveDrive *base, const char *from,
+                                  const char *to)
+{
+    NativeDrive *drive = (NativeDrive *)base;
+
+    return copy_file(drive, from, to);
+}
+
+static int remove_tree(const char *path)
+{
+    char child[PATH_MAX];
+    struct dirent *entry;
+    struct stat st;
+    DIR *dir;
+    int rc = 0;
+
+    if (lstat(path, &st) < 0) {
+        vlogE("NativeDrive: failed to call lstat() (%d).", errno);
+        return HIVE_SYS_ERROR(errno);
+    }
+
+    if (!S_ISDIR(st.st_mode)) {
+        if (unlink(path) < 0) {
+            vlogE("NativeDrive: failed to remove file (%d).", errno);
+            return HIVE_SYS_ERROR(errno);
+        }
+        return 0;
+    }
+
+    dir = opendir(path);
+    if (!dir) {
+        vlogE("NativeDrive: failed to open directory (%d).", errno);
+        return HIVE_SYS_ERROR(errno);
+    }
+
+    while (rc == 0 && (entry = readdir(dir)) != NULL) {
+        if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+            continue;
+
+        if (snprintf(child, sizeof(child), "%s/%s",
+                     path, entry->d_name) >= (int)sizeof(child)) {
+            rc = HIVE_GENERAL_ERROR(HIVEERR_BUFFER_TOO_SMALL);
+            break;
+        }
+
+        rc = remove_tree(child);
+    }
+
+    closedir(dir);
+    if (rc < 0)
+        return rc;
+
+    if (rmdir(path) < 0) {
+        vlogE("NativeDrive: failed to remove directory (%d).", errno);
+        return HIVE_SYS_ERROR(errno);
+    }
+
+    return 0;
+}
+
+static int delete_file(NativeDrive *drive, const char *path)
+{
+    char abspath[PATH_MAX];
+    int rc;
+
+    rc = resolve_entry_path(drive, path, abspath, sizeof(abspath));
+    if (rc < 0)
+        return rc;
+
+    return remove_tree(abspath);
+}
+
+static int native_drive_delete_file(HiveDrive *base, const char *path)
+{
+    NativeDrive *drive = (NativeDrive *)base;
+
+    return delete_file(drive, path);
+}
+
+typedef struct batch_stat {
+    native_uring_req_t req;
+#ifdef NATIVE_HAVE_STATX
+    struct statx stx;
+#endif
+    char abspath[PATH_MAX];
+    HiveBatchRequest *request;
+    struct batch_wait *wait;
+} batch_stat_t;
+
+typedef struct batch_wait {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    size_t pending;
+} batch_wait_t;
+
+#ifdef NATIVE_HAVE_STATX
+static void batch_stat_complete(native_uring_req_t *req, int res)
+{
+    batch_stat_t *entry = (batch_stat_t *)req;
+    batch_wait_t *wait = entry->wait;
+
+    if (res < 0)
+        entry->request->result = HIVE_SYS_ERROR(-res);
+    else
+        fill_file_info_statx(&entry->stx, entry->request->info);
+
+    pthread_mutex_lock(&wait->lock);
+    if (--wait->pending == 0)
+        pthread_cond_signal(&wait->cond);
+    pthread_mutex_unlock(&wait->lock);
+}
+
+static int queue_batch_stat(NativeDrive *drive, batch_stat_t *entry,
+                            batch_wait_t *wait, HiveBatchRequest *request)
+{
+    int rc;
+
+    rc = native_resolve_path(drive->root, request->path, entry->abspath,
+                             sizeof(entry->abspath));
+    if (rc < 0)
+        return rc;
+
+    entry->req.complete = batch_stat_complete;
+    entry->request = request;
+    entry->wait = wait;
+
+    pthread_mutex_lock(&wait->lock);
+    wait->pending++;
+    pthread_mutex_unlock(&wait->lock);
+
+    rc = native_uring_queue_statx(drive->ring, entry->abspath, &entry->stx,
+                                  &entry->req);
+    if (rc < 0) {
+        entry->request = NULL;
+
+        pthread_mutex_lock(&wait->lock);
+        wait->pending--;
+        pthread_mutex_unlock(&wait->lock);
+    }
+
+    return rc;
+}
+#else
+static int queue_batch_stat(NativeDrive *drive, batch_stat_t *entry,
+                            batch_wait_t *wait, HiveBatchRequest *request)
+{
+    return HIVE_GENERAL_ERROR(HIVEERR_NOT_SUPPORTED);
+}
+#endif
+
+static int perform_request(NativeDrive *drive, HiveBatchRequest *request)
+{
+    switch (request->op) {
+    case HiveBatchOp_Stat:
+        return stat_file(drive, request->path, request->info);
+    case HiveBatchOp_Mkdir:
+        return make_dir(drive, request->path);
+    case HiveBatchOp_Move:
+        return move_file(drive, request->path, request->target);
+    case HiveBatchOp_Copy:
+        return copy_file(drive, request->path, request->target);
+    case HiveBatchOp_Delete:
+        return delete_file(drive, request->path);
+    default:
+        return HIVE_GENERAL_ERROR(HIVEERR_NOT_SUPPORTED);
+    }
+}
+
+/*
+ * All stats of the batch enter the kernel in one submission. The other
+ * operations are carried out meanwhile on this thread, then the stats
+ * are waited for.
+ */
+static int native_drive_batch(HiveDrive *base, HiveBatchRequest *requests,
+                              size_t count)
+{
+    NativeDrive *drive = (NativeDrive *)base;
+    batch_stat_t *stats;
+    batch_wait_t wait;
+    size_t i;
+
+    stats = (batch_stat_t *)calloc(count, sizeof(batch_stat_t));
+    if (!stats)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    pthread_mutex_init(&wait.lock, NULL);
+    pthread_cond_init(&wait.cond, NULL);
+    wait.pending = 0;
+
+    for (i = 0; i < count; i++) {
+        if (requests[i].op != HiveBatchOp_Stat)
+            continue;
+
+        // Stats not taken by a full ring are left to the loop below.
+        if (queue_batch_stat(drive, &stats[i], &wait, &requests[i]) ==
+                HIVE_GENERAL_ERROR(HIVEERR_TRY_AGAIN))
+            break;
+    }
+
+    if (native_uring_submit(drive->ring) < 0)
+        vlogW("NativeDrive: batched stats failed to submit.");
+
+    for (i = 0; i < count; i++) {
+        if (!stats[i].request)
+            requests[i].result = perform_request(drive, &requests[i]);
+    }
+
+    pthread_mutex_lock(&wait.lock);
+    while (wait.pending > 0)
+        pthread_cond_wait(&wait.cond, &wait.lock);
+    pthread_mutex_unlock(&wait.lock);
+
+    pthread_cond_destroy(&wait.cond);
+    pthread_mutex_destroy(&wait.lock);
+    free(stats);
+
+    return 0;
+}
+
+typedef struct native_drive_op {
+    hive_async_op_t base;
+    NativeDrive *drive;
+
+    // stat
+    HiveFileInfo info;
+    HiveFileInfo *result;
+
+    // io_uring stat
+    native_uring_req_t req;
+    hive_async_t *async;
+#ifdef NATIVE_HAVE_STATX
+    struct statx stx;
+#endif
+    char abspath[PATH_MAX];
+
+    // list
+    DIR *dir;
+    HiveFilesIterateCallback *iterate;
+} native_drive_op_t;
+
+static void native_drive_op_destructor(void *obj)
+{
+    native_drive_op_t *op = (native_drive_op_t *)obj;
+
+    if (op->dir)
+        closedir(op->dir);
+
+    if (op->drive)
+        deref(op->drive);
+}
+
+static native_drive_op_t *native_drive_op_new(NativeDrive *drive,
+                                              HiveCompletionCallback *callback,
+                                              void *context)
+{
+    native_drive_op_t *op;
+
+    op = hive_async_op_new(sizeof(native_drive_op_t), callback, context,
+                           native_drive_op_destructor);
+    if (!op)
+        return NULL;
+
+    op->drive = ref(drive);
+    return op;
+}
+
+/*
+ * Local operations are carried out right away, they just complete through
+ * the queue. Results are handed over on the dispatching thread.
+ */
+static void deliver_file_info(hive_async_op_t *base)
+{
+    native_drive_op_t *op = (native_drive_op_t *)base;
+
+    *op->result = op->info;
+}
+
+#ifdef NATIVE_HAVE_STATX
+/*
+ * Runs on the reaper thread of the ring, see file_io_complete().
+ */
+static void stat_complete(native_uring_req_t *req, int res)
+{
+    native_drive_op_t *op = (native_drive_op_t *)((char *)req -
+                                    offsetof(native_drive_op_t, req));
+    hive_async_t *async = op->async;
+
+    if (res == 0)
+        fill_file_info_statx(&op->stx, &op->info);
+
+    hive_async_op_complete(async, &op->base,
+                           res < 0 ? HIVE_SYS_ERROR(-res) : 0);
+    deref(async);
+}
+
+static int submit_stat(NativeDrive *drive, native_drive_op_t *op,
+                       const char *path)
+{
+    int rc;
+
+    rc = native_resolve_path(drive->root, path, op->abspath,
+                             sizeof(op->abspath));
+    if (rc < 0)
+        return rc;
+
+    op->req.complete = stat_complete;
+    op->async = ref(drive->base.async);
+
+    rc = native_uring_queue_statx(drive->ring, op->abspath, &op->stx,
+                                  &op->req);
+    if (rc < 0) {
+        op->async = NULL;
+        deref(drive->base.async);
+        return rc;
+    }
+
+    if (native_uring_submit(drive->ring) < 0)
+        vlogW("NativeDrive: stat failed to submit.");
+
+    return 0;
+}
+#else
+static int submit_stat(NativeDrive *drive, native_drive_op_t *op,
+                       const char *path)
+{
+    return HIVE_GENERAL_ERROR(HIVEERR_NOT_SUPPORTED);
+}
+#endif
+
+static int native_drive_stat_file_async(HiveDrive *base, const char *path,
+                                        HiveFileInfo *info,
+                                        HiveCompletionCallback *callback,
+                                        void *context)
+{
+    NativeDrive *drive = (NativeDrive *)base;
+    native_drive_op_t *op;
+    int rc;
+
+    op = native_drive_op_new(drive, callback, context);
+    if (!op)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    op->result = info;
+    op->base.deliver = deliver_file_info;
+
+    if (drive->ring && submit_stat(drive, op, path) == 0)
+        return 0;
+
+    rc = stat_file(drive, path, &op->info);
+    hive_async_op_complete(base->async, &op->base, rc);
+    return 0;
+}
+
+static void deliver_dir_entries(hive_async_op_t *base)
+{
+    native_drive_op_t *op = (native_drive_op_t *)base;
+
+    notify_dir_entries(op->dir, op->iterate, op->base.context);
+}
+
+static int native_drive_list_files_async(HiveDrive *base, const char *path,
+                                         HiveFilesIterateCallback *iterate,
+                                         HiveCompletionCallback *callback,
+                                         void *context)
+{
+    NativeDrive *drive = (NativeDrive *)base;
+    native_drive_op_t *op;
+    int rc;
+
+    op = native_drive_op_new(drive, callback, context);
+    if (!op)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    op->iterate = iterate;
+    op->base.deliver = deliver_dir_entries;
+
+    rc = open_dir(drive, path, &op->dir);
+    hive_async_op_complete(base->async, &op->base, rc);
+    return 0;
+}
+
+static int native_drive_make_dir_async(HiveDrive *base, const char *path,
+                                       HiveCompletionCallback *callback,
+                                       void *context)
+{
+    NativeDrive *drive = (NativeDrive *)base;
+    native_drive_op_t *op;
+
+    op = native_drive_op_new(drive, callback, context);
+    if (!op)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    hive_async_op_complete(base->async, &op->base, make_dir(drive, path));
+    return 0;
+}
+
+static int native_drive_move_file_async(HiveDrive *base, const char *from,
+                                        const char *to,
+                                        HiveCompletionCallback *callback,
+                                        void *context)
+{
+    NativeDrive *drive = (NativeDrive *)base;
+    native_drive_op_t *op;
+
+    op = native_drive_op_new(drive, callback, context);
+    if (!op)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    hive_async_op_complete(base->async, &op->base, move_file(drive, from, to));
+    return 0;
+}
+
+static int native_drive_copy_file_async(HiveDrive *base, const char *from,
+                                        const char *to,
+                                        HiveCompletionCallback *callback,
+                                        void *context)
+{
+    NativeDrive *drive = (NativeDrive *)base;
+    native_drive_op_t *op;
+
+    op = native_drive_op_new(drive, callback, context);
+    if (!op)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    hive_async_op_complete(base->async, &op->base, copy_file(drive, from, to));
+    return 0;
+}
+
+static int native_drive_delete_file_async(HiveDrive *base, const char *path,
+                                          HiveCompletionCallback *callback,
+                                          void *context)
+{
+    NativeDrive *drive = (NativeDrive *)base;
+    native_drive_op_t *op;
+
+    op = native_drive_op_new(drive, callback, context);
+    if (!op)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    hive_async_op_complete(base->async, &op->base, delete_file(drive, path));
+    return 0;
+}
+
+static int native_drive_open_file(HiveDrive *base, const char *path, int flags,
+                                  HiveFile **file)
+{
+    NativeDrive *drive = (NativeDrive *)base;
+    int rc;
+
+    rc = native_file_open(drive->root, path, flags, drive->ring, file);
+    if (rc < 0) {
+        vlogE("NativeDrive: Failed to open file.");
+        return rc;
+    }
+
+    return 0;
+}
+
+static void native_drive_close(HiveDrive *base)
+{
+    deref(base);
+}
+
+static void native_drive_destructor(void *obj)
+{
+    NativeDrive *drive = (NativeDrive *)obj;
+
+    if (drive->ring)
+        native_uring_close(drive->ring);
+}
+
+HiveDrive *native_drive_open(const char *root)
+{
+    NativeDrive *drive;
+
+    assert(root);
+
+    if (strlen(root) >= sizeof(drive->root)) {
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_BUFFER_TOO_SMALL));
+        return NULL;
+    }
+
+    drive = (NativeDrive *)rc_zalloc(sizeof(NativeDrive),
+                                     native_drive_destructor);
+    if (!drive) {
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY));
+        return NULL;
+    }
+
+    strcpy(drive->root, root);
+    drive->ring = native_uring_new(NATIVE_URING_ENTRIES);
+
+    drive->base.get_info    = &native_drive_get_info;
+    drive->base.stat_file   = &native_drive_stat_file;
+    drive->base.list_files  = &native_drive_list_files;
+    drive->base.make_dir    = &native_drive_make_dir;
+    drive->base.move_file   = &native_drive_move_file;
+    drive->base.copy_file   = &native_drive_copy_file;
+    drive->base.delete_file = &native_drive_delete_file;
+    drive->base.open_file   = &native_drive_open_file;
+    drive->base.close       = &native_drive_close;
+
+    drive->base.stat_file_async   = &native_drive_stat_file_async;
+    drive->base.list_files_async  = &native_drive_list_files_async;
+    drive->base.make_dir_async    = &native_drive_make_dir_async;
+    drive->base.move_file_async   = &native_drive_move_file_async;
+    drive->base.copy_file_async   = &native_drive_copy_file_async;
+    drive->base.delete_file_async = &native_drive_delete_file_async;
+
+    // Without a ring the requests of a batch just run one by one.
+    if (drive->ring)
+        drive->base.batch = &native_drive_batch;
+
+    return &drive->base;
+}
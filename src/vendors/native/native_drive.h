@@ -20,16 +20,19 @@
  * SOFTWARE.
  */
 
-#include <stdlib.h>
-#include <assert.h>
+#ifndef __NATIVE_DRIVE_H__
+#define __NATIVE_DRIVE_H__
 
-#include "owncloud.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
 
-HiveClient *owncloud_client_new(const HiveOptions *options)
-{
-    assert(options);
-    (void)options;
+#include "ela_hive.h"
 
-    // TODO;
-    return NULL;
+HiveDrive *native_drive_open(const char *root);
+
+#ifdef __cplusplus
 }
+#endif
+
+#endif // __NATIVE_DRIVE_H__
@@ -0,0 +1,532 @@
+/*
+ * Copyright (c) 2019 Elastos Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stddef.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include <crystal.h>
+
+#include "native_file.h"
+#include "native_utils.h"
+#include "native_uring.h"
+#include "hive_error.h"
+#include "hive_client.h"
+#include "hive_async.h"
+
+/*
+ * Reads come straight from the committed file. The first write switches
+ * to a private working copy in the same directory (an O_TMPFILE where
+ * supported, sharing extents with the original where the file system can
+ * reflink), and a commit atomically links that copy over the target.
+ * Closing without a commit leaves the target untouched.
+ *
+ * When the drive has an io_uring, asynchronous reads and writes are
+ * handed to it instead of being carried out on the calling thread.
+ */
+typedef struct NativeFile {
+    HiveFile base;
+    char abspath[PATH_MAX];
+    char tmp_path[PATH_MAX];
+    int fd;
+    bool dirty;
+    size_t lpos;
+    native_uring_t *ring;
+} NativeFile;
+
+static int open_working_copy(NativeFile *file, bool keep_content)
+{
+    int fd;
+    int rc;
+
+    fd = native_open_tmpfile(file->abspath, file->tmp_path,
+                             sizeof(file->tmp_path));
+    if (fd < 0) {
+        vlogE("NativeFile: failed to create working copy.");
+        return fd;
+    }
+
+    if (keep_content && file->fd >= 0) {
+        rc = native_clone_content(fd, file->fd);
+        if (rc < 0) {
+            vlogE("NativeFile: failed to copy content to working copy.");
+            close(fd);
+            if (file->tmp_path[0]) {
+                unlink(file->tmp_path);
+                file->tmp_path[0] = '\0';
+            }
+            return rc;
+        }
+    }
+
+    if (file->fd >= 0)
+        close(file->fd);
+
+    file->fd = fd;
+    file->dirty = true;
+    return 0;
+}
+
+static int get_file_size(NativeFile *file, size_t *size)
+{
+    struct stat st;
+
+    if (file->fd < 0) {
+        *size = 0;
+        return 0;
+    }
+
+    if (fstat(file->fd, &st) < 0) {
+        vlogE("NativeFile: failed to call fstat() (%d).", errno);
+        return HIVE_SYS_ERROR(errno);
+    }
+
+    *size = (size_t)st.st_size;
+    return 0;
+}
+
+static ssize_t native_file_lseek(HiveFile *base, ssize_t offset, Whence whence)
+{
+    NativeFile *file = (NativeFile *)base;
+    size_t fsz;
+    int rc;
+
+    switch (whence) {
+    case HiveSeek_Cur:
+        file->lpos = offset + (ssize_t)file->lpos < 0 ? 0 : offset + file->lpos;
+        return file->lpos;
+    case HiveSeek_Set:
+        file->lpos = offset > 0 ? offset : 0;
+        return file->lpos;
+    case HiveSeek_End:
+        rc = get_file_size(file, &fsz);
+        if (rc < 0)
+            return rc;
+
+        file->lpos = offset + (ssize_t)fsz < 0 ? 0 : offset + fsz;
+        return file->lpos;
+    default:
+        assert(0);
+        vlogE("NativeFile: unrecognizable whence parameter.");
+        return HIVE_GENERAL_ERROR(HIVEERR_NOT_SUPPORTED);
+    }
+}
+
+static ssize_t native_file_read(HiveFile *base, char *buf, size_t bufsz)
+{
+    NativeFile *file = (NativeFile *)base;
+    ssize_t nrd;
+
+    if (file->fd < 0)
+        return 0;
+
+    do {
+        nrd = pread(file->fd, buf, bufsz, (off_t)file->lpos);
+    } while (nrd < 0 && errno == EINTR);
+
+    if (nrd < 0) {
+        vlogE("NativeFile: failed to read file (%d).", errno);
+        return HIVE_SYS_ERROR(errno);
+    }
+
+    file->lpos += nrd;
+    return nrd;
+}
+
+static int prepare_write(NativeFile *file)
+{
+    int rc;
+
+    if (!file->dirty) {
+        rc = open_working_copy(file, true);
+        if (rc < 0)
+            return rc;
+    }
+
+    if (HIVE_F_IS_SET(file->base.flags, HIVE_F_APPEND)) {
+        rc = get_file_size(file, &file->lpos);
+        if (rc < 0)
+            return rc;
+    }
+
+    return 0;
+}
+
+static ssize_t native_file_write(HiveFile *base, const char *buf, size_t bufsz)
+{
+    NativeFile *file = (NativeFile *)base;
+    size_t written = 0;
+    ssize_t nwr;
+    int rc;
+
+    rc = prepare_write(file);
+    if (rc < 0)
+        return rc;
+
+    while (written < bufsz) {
+        nwr = pwrite(file->fd, buf + written, bufsz - written,
+                     (off_t)(file->lpos + written));
+        if (nwr < 0 && errno == EINTR)
+            continue;
+
+        if (nwr < 0) {
+            vlogE("NativeFile: failed to write file (%d).", errno);
+            return HIVE_SYS_ERROR(errno);
+        }
+
+        written += nwr;
+    }
+
+    file->lpos += written;
+    return written;
+}
+
+static int native_file_commit(HiveFile *base)
+{
+    NativeFile *file = (NativeFile *)base;
+    int rc;
+
+    if (!file->dirty)
+        return 0;
+
+    rc = native_link_tmpfile(file->fd, file->tmp_path, file->abspath);
+    if (rc < 0) {
+        vlogE("NativeFile: failed to commit working copy.");
+        return rc;
+    }
+
+    // The working copy is the committed file now, copy again on next write.
+    file->dirty = false;
+    return 0;
+}
+
+static int native_file_discard(HiveFile *base)
+{
+    NativeFile *file = (NativeFile *)base;
+    int fd;
+
+    if (!file->dirty)
+        return 0;
+
+    fd = open(file->abspath, O_RDONLY);
+    if (fd < 0 && errno != ENOENT) {
+        vlogE("NativeFile: failed to reopen file (%d).", errno);
+        return HIVE_SYS_ERROR(errno);
+    }
+
+    close(file->fd);
+    if (file->tmp_path[0]) {
+        unlink(file->tmp_path);
+        file->tmp_path[0] = '\0';
+    }
+
+    file->fd = fd;
+    file->dirty = false;
+    file->lpos = 0;
+    return 0;
+}
+
+static int native_file_close(HiveFile *base)
+{
+    deref(base);
+    return 0;
+}
+
+static void native_file_destructor(void *obj)
+{
+    NativeFile *file = (NativeFile *)obj;
+
+    if (file->fd >= 0)
+        close(file->fd);
+
+    if (file->dirty && file->tmp_path[0])
+        unlink(file->tmp_path);
+
+    if (file->ring)
+        deref(file->ring);
+}
+
+typedef struct native_file_op {
+    hive_async_op_t base;
+    NativeFile *file;
+
+    // io_uring
+    native_uring_req_t req;
+    hive_async_t *async;
+    size_t offset;
+} native_file_op_t;
+
+static void native_file_op_destructor(void *obj)
+{
+    native_file_op_t *op = (native_file_op_t *)obj;
+
+    if (op->file)
+        deref(op->file);
+}
+
+static native_file_op_t *native_file_op_new(NativeFile *file,
+                                            HiveCompletionCallback *callback,
+                                            void *context)
+{
+    native_file_op_t *op;
+
+    op = hive_async_op_new(sizeof(native_file_op_t), callback, context,
+                           native_file_op_destructor);
+    if (!op)
+        return NULL;
+
+    op->file = ref(file);
+    return op;
+}
+
+/*
+ * Runs on the reaper thread of the ring. The queue is referenced for as
+ * long as the request is in flight, so closing the client meanwhile is
+ * safe.
+ */
+static void file_io_complete(native_uring_req_t *req, int res)
+{
+    native_file_op_t *op = (native_file_op_t *)((char *)req -
+                                    offsetof(native_file_op_t, req));
+    hive_async_t *async = op->async;
+
+    hive_async_op_complete(async, &op->base,
+                           res < 0 ? HIVE_SYS_ERROR(-res) : res);
+    deref(async);
+}
+
+static void deliver_file_io(hive_async_op_t *base)
+{
+    native_file_op_t *op = (native_file_op_t *)base;
+
+    op->file->lpos = op->offset + base->result;
+}
+
+static int submit_file_io(NativeFile *file, native_file_op_t *op, bool write,
+                          const char *buf, size_t bufsz)
+{
+    int rc;
+
+    op->req.complete = file_io_complete;
+    op->async = ref(file->base.async);
+    op->offset = file->lpos;
+    op->base.deliver = deliver_file_io;
+
+    if (write)
+        rc = native_uring_queue_write(file->ring, file->fd, buf, bufsz,
+                                      (off_t)op->offset, &op->req);
+    else
+        rc = native_uring_queue_read(file->ring, file->fd, (char *)buf, bufsz,
+                                     (off_t)op->offset, &op->req);
+    if (rc < 0) {
+        op->base.deliver = NULL;
+        op->async = NULL;
+        deref(file->base.async);
+        return rc;
+    }
+
+    // Once queued the request completes through the ring whatever happens.
+    if (native_uring_submit(file->ring) < 0)
+        vlogW("NativeFile: request failed to submit.");
+
+    return 0;
+}
+
+/*
+ * Without a ring, local I/O is carried out right away and the operations
+ * just complete through the queue. The ring is also bypassed while full.
+ */
+static int native_file_read_async(HiveFile *base, char *buf, size_t bufsz,
+                                  HiveCompletionCallback *callback,
+                                  void *context)
+{
+    NativeFile *file = (NativeFile *)base;
+    native_file_op_t *op;
+    ssize_t rc;
+
+    op = native_file_op_new(file, callback, context);
+    if (!op)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    if (bufsz > INT_MAX)
+        bufsz = INT_MAX;
+
+    if (file->ring && file->fd >= 0 &&
+        submit_file_io(file, op, false, buf, bufsz) == 0)
+        return 0;
+
+    rc = native_file_read(base, buf, bufsz);
+    hive_async_op_complete(base->async, &op->base, (int)rc);
+    return 0;
+}
+
+static int native_file_write_async(HiveFile *base, const char *buf,
+                                   size_t bufsz,
+                                   HiveCompletionCallback *callback,
+                                   void *context)
+{
+    NativeFile *file = (NativeFile *)base;
+    native_file_op_t *op;
+    ssize_t rc;
+
+    op = native_file_op_new(file, callback, context);
+    if (!op)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    if (bufsz > INT_MAX)
+        bufsz = INT_MAX;
+
+    if (file->ring) {
+        rc = prepare_write(file);
+        if (rc < 0) {
+            hive_async_op_complete(base->async, &op->base, (int)rc);
+            return 0;
+        }
+
+        if (submit_file_io(file, op, true, buf, bufsz) == 0)
+            return 0;
+    }
+
+    rc = native_file_write(base, buf, bufsz);
+    hive_async_op_complete(base->async, &op->base, (int)rc);
+    return 0;
+}
+
+static int native_file_commit_async(HiveFile *base,
+                                    HiveCompletionCallback *callback,
+                                    void *context)
+{
+    NativeFile *file = (NativeFile *)base;
+    native_file_op_t *op;
+    int rc;
+
+    op = native_file_op_new(file, callback, context);
+    if (!op)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    rc = native_file_commit(base);
+    hive_async_op_complete(base->async, &op->base, rc);
+    return 0;
+}
+
+int native_file_open(const char *root, const char *path, int flags,
+                     native_uring_t *ring, HiveFile **file)
+{
+    NativeFile *tmp;
+    struct stat st;
+    bool file_exists;
+    int rc;
+
+    assert(root);
+    assert(path);
+    assert(file);
+
+    tmp = (NativeFile *)rc_zalloc(sizeof(NativeFile), native_file_destructor);
+    if (!tmp)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    tmp->fd = -1;
+
+    rc = native_resolve_path(root, path, tmp->abspath, sizeof(tmp->abspath));
+    if (rc < 0) {
+        deref(tmp);
+        return rc;
+    }
+
+    rc = stat(tmp->abspath, &st);
+    if (rc < 0 && errno != ENOENT) {
+        vlogE("NativeFile: failed to call stat() (%d).", errno);
+        deref(tmp);
+        return HIVE_SYS_ERROR(errno);
+    }
+
+    file_exists = !rc ? true : false;
+
+    if (file_exists && S_ISDIR(st.st_mode)) {
+        vlogE("NativeFile: can not open a directory.");
+        deref(tmp);
+        return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
+    }
+
+    if (HIVE_F_IS_EQ(flags, HIVE_F_RDONLY)) {
+        if (!file_exists) {
+            vlogE("NativeFile: readonly but file does not exist.");
+            deref(tmp);
+            return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
+        }
+    } else if (HIVE_F_IS_SET(flags, HIVE_F_CREAT | HIVE_F_EXCL) && file_exists) {
+        vlogE("NativeFile: file exists while EXCL flag is set.");
+        deref(tmp);
+        return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
+    } else if (!HIVE_F_IS_SET(flags, HIVE_F_CREAT) && !file_exists) {
+        vlogE("NativeFile: CREAT flag is not set while file does not exist.");
+        deref(tmp);
+        return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
+    }
+
+    if (file_exists) {
+        tmp->fd = open(tmp->abspath, O_RDONLY);
+        if (tmp->fd < 0) {
+            vlogE("NativeFile: failed to open file (%d).", errno);
+            deref(tmp);
+            return HIVE_SYS_ERROR(errno);
+        }
+    }
+
+    // A new or truncated file starts from an empty working copy.
+    if (!file_exists || HIVE_F_IS_SET(flags, HIVE_F_TRUNC)) {
+        rc = open_working_copy(tmp, false);
+        if (rc < 0) {
+            deref(tmp);
+            return rc;
+        }
+    }
+
+    if (ring)
+        tmp->ring = ref(ring);
+
+    strcpy(tmp->base.path, path);
+    tmp->base.flags   = flags;
+    tmp->base.lseek   = native_file_lseek;
+    tmp->base.read    = native_file_read;
+    tmp->base.write   = native_file_write;
+    tmp->base.commit  = native_file_commit;
+    tmp->base.discard = native_file_discard;
+    tmp->base.close   = native_file_close;
+
+    tmp->base.read_async   = native_file_read_async;
+    tmp->base.write_async  = native_file_write_async;
+    tmp->base.commit_async = native_file_commit_async;
+
+    *file = &tmp->base;
+    return 0;
+}
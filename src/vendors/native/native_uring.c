@@ -0,0 +1,628 @@
+/*
+ * Copyright (c) 2019 Elastos Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_ALLOCA_H
+#include <alloca.h>
+#endif
+#ifdef HAVE_LINUX_IO_URING_H
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+#include <crystal.h>
+
+#include "ela_hive.h"
+#include "hive_error.h"
+#include "native_uring.h"
+
+#if defined(HAVE_LINUX_IO_URING_H) && defined(__NR_io_uring_setup)
+
+/*
+ * A bare io_uring driven through the raw system calls. Submitters fill
+ * SQEs under the lock and push them to the kernel in one io_uring_enter()
+ * per run; a detached reaper thread blocks for completions and drains
+ * every CQE available on each wakeup. The ring memory is shared with the
+ * kernel, so the ring indexes are accessed with acquire/release ordering.
+ */
+struct native_uring {
+    int fd;
+
+    pthread_mutex_t lock;
+    bool closing;
+    bool stopping;              // the reaper quits once nothing is in flight.
+    bool ext_arg;               // waits can time out.
+    unsigned int queued;
+    unsigned int inflight;
+
+    void *sq_ptr;
+    size_t sq_len;
+    void *cq_ptr;
+    size_t cq_len;
+    struct io_uring_sqe *sqes;
+    size_t sqes_len;
+
+    unsigned int sq_entries;
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+
+    unsigned int cq_entries;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_cqe *cqes;
+};
+
+#define load_acquire(p)         __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define store_release(p, v)     __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+static int io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned int to_submit,
+                          unsigned int min_complete, unsigned int flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                        flags, NULL, 0);
+}
+
+static int io_uring_register(int fd, unsigned int opcode, void *arg,
+                             unsigned int nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static bool probe_opcodes(int fd)
+{
+    static const int opcodes[] = {
+        IORING_OP_READ,
+        IORING_OP_WRITE,
+        IORING_OP_STATX
+    };
+    struct io_uring_probe *probe;
+    size_t i;
+    bool ok = true;
+
+    probe = calloc(1, sizeof(*probe) + 256 * sizeof(struct io_uring_probe_op));
+    if (!probe)
+        return false;
+
+    if (io_uring_register(fd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+        free(probe);
+        return false;
+    }
+
+    for (i = 0; i < sizeof(opcodes) / sizeof(opcodes[0]); i++) {
+        if (opcodes[i] > probe->last_op ||
+            !(probe->ops[opcodes[i]].flags & IO_URING_OP_SUPPORTED)) {
+            ok = false;
+            break;
+        }
+    }
+
+    free(probe);
+    return ok;
+}
+
+static int map_rings(native_uring_t *ring, const struct io_uring_params *p)
+{
+    ring->sq_len = p->sq_off.array + p->sq_entries * sizeof(unsigned int);
+    ring->cq_len = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+
+    if (p->features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_len > ring->sq_len)
+            ring->sq_len = ring->cq_len;
+        ring->cq_len = ring->sq_len;
+    }
+
+    ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) {
+        ring->sq_ptr = NULL;
+        return -1;
+    }
+
+    if (p->features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ptr = ring->sq_ptr;
+    } else {
+        ring->cq_ptr = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring->fd,
+                            IORING_OFF_CQ_RING);
+        if (ring->cq_ptr == MAP_FAILED) {
+            ring->cq_ptr = NULL;
+            return -1;
+        }
+    }
+
+    ring->sqes_len = p->sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        return -1;
+    }
+
+    ring->sq_entries = p->sq_entries;
+    ring->sq_head  = (unsigned int *)((char *)ring->sq_ptr + p->sq_off.head);
+    ring->sq_tail  = (unsigned int *)((char *)ring->sq_ptr + p->sq_off.tail);
+    ring->sq_mask  = (unsigned int *)((char *)ring->sq_ptr + p->sq_off.ring_mask);
+    ring->sq_array = (unsigned int *)((char *)ring->sq_ptr + p->sq_off.array);
+
+    ring->cq_entries = p->cq_entries;
+    ring->cq_head = (unsigned int *)((char *)ring->cq_ptr + p->cq_off.head);
+    ring->cq_tail = (unsigned int *)((char *)ring->cq_ptr + p->cq_off.tail);
+    ring->cq_mask = (unsigned int *)((char *)ring->cq_ptr + p->cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)((char *)ring->cq_ptr + p->cq_off.cqes);
+
+    return 0;
+}
+
+static void native_uring_destructor(void *obj)
+{
+    native_uring_t *ring = (native_uring_t *)obj;
+
+    if (ring->sqes)
+        munmap(ring->sqes, ring->sqes_len);
+
+    if (ring->cq_ptr && ring->cq_ptr != ring->sq_ptr)
+        munmap(ring->cq_ptr, ring->cq_len);
+
+    if (ring->sq_ptr)
+        munmap(ring->sq_ptr, ring->sq_len);
+
+    if (ring->fd >= 0)
+        close(ring->fd);
+
+    pthread_mutex_destroy(&ring->lock);
+}
+
+/*
+ * With a timeout the reaper notices a close that failed to queue the
+ * drain marker, otherwise it only wakes up on completions.
+ */
+static int wait_completions(native_uring_t *ring)
+{
+#if defined(IORING_ENTER_EXT_ARG)
+    if (ring->ext_arg) {
+        struct __kernel_timespec ts;
+        struct io_uring_getevents_arg arg;
+
+        memset(&ts, 0, sizeof(ts));
+        memset(&arg, 0, sizeof(arg));
+        ts.tv_sec = 1;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+
+        return (int)syscall(__NR_io_uring_enter, ring->fd, 0, 1,
+                            IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                            &arg, sizeof(arg));
+    }
+#endif
+
+    return io_uring_enter(ring->fd, 0, 1, IORING_ENTER_GETEVENTS);
+}
+
+static void *reaper_entry(void *arg)
+{
+    native_uring_t *ring = (native_uring_t *)arg;
+    bool stopped = false;
+
+    while (!stopped) {
+        unsigned int head;
+        unsigned int reaped = 0;
+
+        if (wait_completions(ring) < 0 && errno != ETIME &&
+            errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            vlogE("NativeUring: failed to wait for completions (%d).", errno);
+            break;
+        }
+
+        head = *ring->cq_head;
+        while (head != load_acquire(ring->cq_tail)) {
+            struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+            native_uring_req_t *req = (native_uring_req_t *)(uintptr_t)cqe->user_data;
+            int res = cqe->res;
+
+            store_release(ring->cq_head, ++head);
+            reaped++;
+
+            // The drain marker queued by native_uring_close() comes last.
+            if (!req)
+                stopped = true;
+            else
+                req->complete(req, res);
+        }
+
+        pthread_mutex_lock(&ring->lock);
+        ring->inflight -= reaped;
+        if (ring->stopping && !ring->inflight)
+            stopped = true;
+        pthread_mutex_unlock(&ring->lock);
+    }
+
+    deref(ring);
+    return NULL;
+}
+
+native_uring_t *native_uring_new(unsigned int entries)
+{
+    struct io_uring_params params;
+    native_uring_t *ring;
+    pthread_attr_t attr;
+    pthread_t thread;
+    int rc;
+
+    ring = (native_uring_t *)rc_zalloc(sizeof(native_uring_t),
+                                       native_uring_destructor);
+    if (!ring)
+        return NULL;
+
+    pthread_mutex_init(&ring->lock, NULL);
+
+    memset(&params, 0, sizeof(params));
+    ring->fd = io_uring_setup(entries, &params);
+    if (ring->fd < 0) {
+        vlogI("NativeUring: io_uring unavailable (%d), using plain I/O.", errno);
+        deref(ring);
+        return NULL;
+    }
+
+    if (!probe_opcodes(ring->fd)) {
+        vlogI("NativeUring: io_uring lacks required opcodes, using plain I/O.");
+        deref(ring);
+        return NULL;
+    }
+
+    if (map_rings(ring, &params) < 0) {
+        vlogE("NativeUring: failed to map io_uring (%d).", errno);
+        deref(ring);
+        return NULL;
+    }
+
+#if defined(IORING_FEAT_EXT_ARG)
+    ring->ext_arg = (params.features & IORING_FEAT_EXT_ARG) != 0;
+#endif
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    rc = pthread_create(&thread, &attr, reaper_entry, ref(ring));
+    pthread_attr_destroy(&attr);
+    if (rc != 0) {
+        vlogE("NativeUring: failed to start reaper thread (%d).", rc);
+        deref(ring);
+        deref(ring);
+        return NULL;
+    }
+
+    return ring;
+}
+
+/*
+ * Returns 0 or a negative errno.
+ */
+static int submit_queued(native_uring_t *ring)
+{
+    int rc;
+
+    while (ring->queued > 0) {
+        rc = io_uring_enter(ring->fd, ring->queued, 0, 0);
+        if (rc < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+
+            rc = errno;
+            vlogE("NativeUring: failed to submit requests (%d).", rc);
+            return -rc;
+        }
+
+        ring->queued -= rc;
+    }
+
+    return 0;
+}
+
+/*
+ * One CQ slot is held back for the drain marker of native_uring_close(),
+ * so completions can never overflow.
+ */
+static struct io_uring_sqe *get_sqe(native_uring_t *ring, bool reserved)
+{
+    struct io_uring_sqe *sqe;
+    unsigned int tail = *ring->sq_tail;
+    unsigned int index;
+
+    if (!reserved && ring->inflight + 1 >= ring->cq_entries)
+        return NULL;
+
+    if (tail - load_acquire(ring->sq_head) >= ring->sq_entries)
+        return NULL;
+
+    index = tail & *ring->sq_mask;
+    sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+
+    return sqe;
+}
+
+static void put_sqe(native_uring_t *ring, void *user_data)
+{
+    ring->sqes[*ring->sq_tail & *ring->sq_mask].user_data =
+            (__u64)(uintptr_t)user_data;
+
+    store_release(ring->sq_tail, *ring->sq_tail + 1);
+    ring->queued++;
+    ring->inflight++;
+}
+
+/*
+ * On success the lock is left held until end_request() publishes the
+ * filled SQE.
+ */
+static struct io_uring_sqe *begin_request(native_uring_t *ring,
+                                          native_uring_req_t *req)
+{
+    struct io_uring_sqe *sqe;
+
+    assert(ring);
+    assert(req && req->complete);
+
+    pthread_mutex_lock(&ring->lock);
+    sqe = ring->closing ? NULL : get_sqe(ring, false);
+    if (!sqe)
+        pthread_mutex_unlock(&ring->lock);
+
+    return sqe;
+}
+
+static void end_request(native_uring_t *ring, native_uring_req_t *req)
+{
+    put_sqe(ring, req);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+int native_uring_queue_read(native_uring_t *ring, int fd, void *buf,
+                            size_t len, off_t offset, native_uring_req_t *req)
+{
+    struct io_uring_sqe *sqe;
+
+    sqe = begin_request(ring, req);
+    if (!sqe)
+        return HIVE_GENERAL_ERROR(HIVEERR_TRY_AGAIN);
+
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd     = fd;
+    sqe->addr   = (__u64)(uintptr_t)buf;
+    sqe->len    = len > INT_MAX ? INT_MAX : (__u32)len;
+    sqe->off    = (__u64)offset;
+
+    end_request(ring, req);
+    return 0;
+}
+
+int native_uring_queue_write(native_uring_t *ring, int fd, const void *buf,
+                             size_t len, off_t offset, native_uring_req_t *req)
+{
+    struct io_uring_sqe *sqe;
+
+    sqe = begin_request(ring, req);
+    if (!sqe)
+        return HIVE_GENERAL_ERROR(HIVEERR_TRY_AGAIN);
+
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd     = fd;
+    sqe->addr   = (__u64)(uintptr_t)buf;
+    sqe->len    = len > INT_MAX ? INT_MAX : (__u32)len;
+    sqe->off    = (__u64)offset;
+
+    end_request(ring, req);
+    return 0;
+}
+
+int native_uring_queue_statx(native_uring_t *ring, const char *path,
+                             struct statx *stx, native_uring_req_t *req)
+{
+#ifdef STATX_BASIC_STATS
+    struct io_uring_sqe *sqe;
+
+    sqe = begin_request(ring, req);
+    if (!sqe)
+        return HIVE_GENERAL_ERROR(HIVEERR_TRY_AGAIN);
+
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd     = AT_FDCWD;
+    sqe->addr   = (__u64)(uintptr_t)path;
+    sqe->len    = STATX_BASIC_STATS;
+    sqe->addr2  = (__u64)(uintptr_t)stx;
+
+    end_request(ring, req);
+    return 0;
+#else
+    // The C library predates statx(), its structure is not known here.
+    return HIVE_GENERAL_ERROR(HIVEERR_NOT_SUPPORTED);
+#endif
+}
+
+/*
+ * Takes back the requests the kernel refused. Without SQPOLL the kernel
+ * only reads the SQ inside io_uring_enter(), so the tail can be rewound
+ * under the lock.
+ */
+static unsigned int retract_queued(native_uring_t *ring,
+                                   native_uring_req_t **reqs)
+{
+    unsigned int tail = *ring->sq_tail;
+    unsigned int count = ring->queued;
+    unsigned int i;
+
+    for (i = 0; i < count; i++) {
+        struct io_uring_sqe *sqe = &ring->sqes[(tail - count + i) &
+                                               *ring->sq_mask];
+        reqs[i] = (native_uring_req_t *)(uintptr_t)sqe->user_data;
+    }
+
+    store_release(ring->sq_tail, tail - count);
+    ring->queued = 0;
+    ring->inflight -= count;
+
+    return count;
+}
+
+/*
+ * When the kernel refuses the queued requests they are completed right
+ * here with the error, once the lock is released, so that nobody waits
+ * on them forever.
+ */
+int native_uring_submit(native_uring_t *ring)
+{
+    native_uring_req_t **reqs;
+    unsigned int count = 0;
+    unsigned int i;
+    int rc;
+
+    assert(ring);
+
+    reqs = (native_uring_req_t **)alloca(ring->sq_entries * sizeof(*reqs));
+
+    pthread_mutex_lock(&ring->lock);
+    rc = submit_queued(ring);
+    if (rc < 0)
+        count = retract_queued(ring, reqs);
+    pthread_mutex_unlock(&ring->lock);
+
+    for (i = 0; i < count; i++)
+        reqs[i]->complete(reqs[i], rc);
+
+    return rc < 0 ? HIVE_SYS_ERROR(-rc) : 0;
+}
+
+void native_uring_close(native_uring_t *ring)
+{
+    struct io_uring_sqe *sqe;
+    native_uring_req_t **reqs;
+    unsigned int count = 0;
+    unsigned int i;
+    int rc;
+
+    if (!ring)
+        return;
+
+    reqs = (native_uring_req_t **)alloca(ring->sq_entries * sizeof(*reqs));
+
+    pthread_mutex_lock(&ring->lock);
+    ring->closing = true;
+
+    rc = submit_queued(ring);
+    if (rc == 0) {
+        // The SQ is empty after the submit and a CQ slot is reserved.
+        sqe = get_sqe(ring, true);
+        assert(sqe);
+
+        sqe->opcode = IORING_OP_NOP;
+        sqe->flags  = IOSQE_IO_DRAIN;
+        put_sqe(ring, NULL);
+
+        rc = submit_queued(ring);
+    }
+
+    /*
+     * Without the drain marker the reaper is told to quit once the
+     * requests already in flight are reaped, and the refused ones are
+     * completed here just as native_uring_submit() does.
+     */
+    if (rc < 0) {
+        count = retract_queued(ring, reqs);
+        ring->stopping = true;
+    }
+    pthread_mutex_unlock(&ring->lock);
+
+    for (i = 0; i < count; i++) {
+        if (reqs[i])
+            reqs[i]->complete(reqs[i], rc);
+    }
+
+    if (rc < 0 && !ring->ext_arg)
+        vlogE("NativeUring: failed to stop reaper thread.");
+
+    deref(ring);
+}
+
+#else
+
+native_uring_t *native_uring_new(unsigned int entries)
+{
+    (void)entries;
+
+    return NULL;
+}
+
+void native_uring_close(native_uring_t *ring)
+{
+    (void)ring;
+}
+
+int native_uring_queue_read(native_uring_t *ring, int fd, void *buf,
+                            size_t len, off_t offset, native_uring_req_t *req)
+{
+    return HIVE_GENERAL_ERROR(HIVEERR_NOT_SUPPORTED);
+}
+
+int native_uring_queue_write(native_uring_t *ring, int fd, const void *buf,
+                             size_t len, off_t offset, native_uring_req_t *req)
+{
+    return HIVE_GENERAL_ERROR(HIVEERR_NOT_SUPPORTED);
+}
+
+int native_uring_queue_statx(native_uring_t *ring, const char *path,
+                             struct statx *stx, native_uring_req_t *req)
+{
+    return HIVE_GENERAL_ERROR(HIVEERR_NOT_SUPPORTED);
+}
+
+int native_uring_submit(native_uring_t *ring)
+{
+    return HIVE_GENERAL_ERROR(HIVEERR_NOT_SUPPORTED);
+}
+
+#endif
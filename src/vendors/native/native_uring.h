@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2019 Elastos Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __NATIVE_URING_H__
+#define __NATIVE_URING_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <sys/types.h>
+
+struct statx;
+
+typedef struct native_uring native_uring_t;
+typedef struct native_uring_req native_uring_req_t;
+
+/*
+ * One request in flight on the ring. Callers embed it in their own
+ * operation and get it back in complete(), which runs on the reaper
+ * thread with the result of the request: a byte count or 0 on success,
+ * a negative errno on failure.
+ */
+struct native_uring_req {
+    void (*complete)(native_uring_req_t *req, int res);
+};
+
+/*
+ * Create an io_uring instance with its reaper thread. NULL is returned
+ * when io_uring is not available on this system, in which case callers
+ * keep to the plain system calls.
+ */
+native_uring_t *native_uring_new(unsigned int entries);
+
+/*
+ * Stop accepting requests and let the reaper thread wind down once the
+ * requests in flight have completed. Drops the reference of the caller.
+ */
+void native_uring_close(native_uring_t *ring);
+
+/*
+ * Queue a request on the ring. Nothing reaches the kernel until
+ * native_uring_submit() is called, so a run of queued requests costs a
+ * single system call. A negative value means the ring is full or closed
+ * and the request must be carried out synchronously instead.
+ */
+int native_uring_queue_read(native_uring_t *ring, int fd, void *buf,
+                            size_t len, off_t offset, native_uring_req_t *req);
+
+int native_uring_queue_write(native_uring_t *ring, int fd, const void *buf,
+                             size_t len, off_t offset, native_uring_req_t *req);
+
+int native_uring_queue_statx(native_uring_t *ring, const char *path,
+                             struct statx *stx, native_uring_req_t *req);
+
+/*
+ * Push the queued requests to the kernel. Should the kernel refuse them,
+ * they are completed with the error before this returns, so every queued
+ * request completes exactly once.
+ */
+int native_uring_submit(native_uring_t *ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __NATIVE_URING_H__
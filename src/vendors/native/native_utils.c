@@ -0,0 +1,320 @@
+/*
+ * Copyright (c) 2019 Elastos Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_SYS_PARAM_H
+#include <sys/param.h>
+#endif
+#ifdef HAVE_LINUX_FS_H
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
+#include <crystal.h>
+
+#include "ela_hive.h"
+#include "hive_error.h"
+#include "native_utils.h"
+
+#define COPY_BUFFER_SIZE        (256 * 1024)
+#define LINK_MAX_ATTEMPTS       (16)
+
+static unsigned int tmp_sequence;
+
+int native_resolve_path(const char *root, const char *path,
+                        char *buf, size_t bufsz)
+{
+    const char *p;
+    size_t len;
+    int rc;
+
+    assert(root);
+    assert(path);
+    assert(buf);
+
+    if (path[0] != '/')
+        return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
+
+    for (p = path; p; p = strchr(p + 1, '/')) {
+        len = strcspn(p + 1, "/");
+        if ((len == 1 && p[1] == '.') || (len == 2 && !strncmp(p + 1, "..", 2))) {
+            vlogE("NativeUtils: path must not contain '.' or '..'.");
+            return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
+        }
+    }
+
+    // "/" maps onto root itself.
+    rc = snprintf(buf, bufsz, "%s%s", root, strcmp(path, "/") ? path : "");
+    if (rc < 0 || rc >= (int)bufsz) {
+        vlogE("NativeUtils: path too long.");
+        return HIVE_GENERAL_ERROR(HIVEERR_BUFFER_TOO_SMALL);
+    }
+
+    // Drop a trailing slash so that the last component names the entry.
+    len = strlen(buf);
+    while (len > strlen(root) + 1 && buf[len - 1] == '/')
+        buf[--len] = '\0';
+
+    return 0;
+}
+
+static int get_parent_dir(const char *target, char *dir, size_t len)
+{
+    const char *p;
+
+    p = strrchr(target, '/');
+    if (!p || (size_t)(p - target) >= len)
+        return HIVE_GENERAL_ERROR(HIVEERR_BUFFER_TOO_SMALL);
+
+    memcpy(dir, target, p - target);
+    dir[p - target] = '\0';
+    return 0;
+}
+
+int native_open_tmpfile(const char *target, char *tmp_path, size_t len)
+{
+    char dir[PATH_MAX];
+    int fd;
+    int rc;
+
+    assert(target);
+    assert(tmp_path);
+
+    rc = get_parent_dir(target, dir, sizeof(dir));
+    if (rc < 0)
+        return rc;
+
+    tmp_path[0] = '\0';
+
+#ifdef O_TMPFILE
+    fd = open(dir, O_TMPFILE | O_RDWR, S_IRUSR | S_IWUSR);
+    if (fd >= 0)
+        return fd;
+
+    if (errno != EOPNOTSUPP && errno != EISDIR && errno != EINVAL) {
+        vlogE("NativeUtils: failed to create temporary file (%d).", errno);
+        return HIVE_SYS_ERROR(errno);
+    }
+#endif
+
+    rc = snprintf(tmp_path, len, "%s/" NATIVE_TMP_PREFIX "XXXXXX", dir);
+    if (rc < 0 || rc >= (int)len) {
+        tmp_path[0] = '\0';
+        return HIVE_GENERAL_ERROR(HIVEERR_BUFFER_TOO_SMALL);
+    }
+
+    fd = mkstemp(tmp_path);
+    if (fd < 0) {
+        vlogE("NativeUtils: failed to create temporary file (%d).", errno);
+        tmp_path[0] = '\0';
+        return HIVE_SYS_ERROR(errno);
+    }
+
+    return fd;
+}
+
+static int sync_data(int fd)
+{
+#if defined(__APPLE__)
+    // fsync() stops at the drive cache there, and fdatasync() is missing.
+    if (fcntl(fd, F_FULLFSYNC) == 0)
+        return 0;
+
+    return fsync(fd);
+#else
+    return fdatasync(fd);
+#endif
+}
+
+// Make the new directory entry durable, not only the file content.
+static int sync_dir(const char *dir)
+{
+    int fd;
+    int rc;
+
+    fd = open(dir, O_RDONLY);
+    if (fd < 0) {
+        vlogE("NativeUtils: failed to open directory (%d).", errno);
+        return HIVE_SYS_ERROR(errno);
+    }
+
+    rc = fsync(fd);
+    if (rc < 0) {
+        vlogE("NativeUtils: failed to sync directory (%d).", errno);
+        rc = HIVE_SYS_ERROR(errno);
+    }
+
+    close(fd);
+    return rc;
+}
+
+int native_link_tmpfile(int fd, char *tmp_path, const char *target)
+{
+    char dir[PATH_MAX];
+    char name[PATH_MAX];
+    char proc_path[64];
+    struct stat st;
+    int rc;
+    int i;
+
+    assert(fd >= 0);
+    assert(tmp_path);
+    assert(target);
+
+    rc = get_parent_dir(target, dir, sizeof(dir));
+    if (rc < 0)
+        return rc;
+
+    // Working files are created private, the target keeps its own mode.
+    if (stat(target, &st) == 0 && fchmod(fd, st.st_mode & 07777) < 0) {
+        vlogE("NativeUtils: failed to set mode of working file (%d).", errno);
+        return HIVE_SYS_ERROR(errno);
+    }
+
+    if (sync_data(fd) < 0) {
+        vlogE("NativeUtils: failed to sync working file (%d).", errno);
+        return HIVE_SYS_ERROR(errno);
+    }
+
+    if (tmp_path[0]) {
+        if (rename(tmp_path, target) < 0) {
+            vlogE("NativeUtils: failed to rename working file (%d).", errno);
+            return HIVE_SYS_ERROR(errno);
+        }
+
+        tmp_path[0] = '\0';
+        return sync_dir(dir);
+    }
+
+    /*
+     * An anonymous file can only be linked to a name that does not exist
+     * yet, so link it beside the target first and rename it over.
+     */
+    sprintf(proc_path, "/proc/self/fd/%d", fd);
+
+    for (i = 0; i < LINK_MAX_ATTEMPTS; i++) {
+        rc = snprintf(name, sizeof(name), "%s/" NATIVE_TMP_PREFIX "%d-%u", dir,
+                      (int)getpid(), __sync_fetch_and_add(&tmp_sequence, 1));
+        if (rc < 0 || rc >= (int)sizeof(name))
+            return HIVE_GENERAL_ERROR(HIVEERR_BUFFER_TOO_SMALL);
+
+        rc = linkat(AT_FDCWD, proc_path, AT_FDCWD, name, AT_SYMLINK_FOLLOW);
+        if (rc == 0 || errno != EEXIST)
+            break;
+    }
+
+    if (rc < 0) {
+        vlogE("NativeUtils: failed to link working file (%d).", errno);
+        return HIVE_SYS_ERROR(errno);
+    }
+
+    if (rename(name, target) < 0) {
+        vlogE("NativeUtils: failed to rename working file (%d).", errno);
+        rc = HIVE_SYS_ERROR(errno);
+        unlink(name);
+        return rc;
+    }
+
+    return sync_dir(dir);
+}
+
+int native_clone_content(int dst_fd, int src_fd)
+{
+    struct stat st;
+    off_t off = 0;
+    char *buf;
+    ssize_t nrd;
+    ssize_t nwr = 0;
+
+#ifdef FICLONE
+    if (ioctl(dst_fd, FICLONE, src_fd) == 0)
+        return 0;
+#endif
+
+    if (fstat(src_fd, &st) < 0) {
+        vlogE("NativeUtils: failed to call fstat() (%d).", errno);
+        return HIVE_SYS_ERROR(errno);
+    }
+
+#ifdef HAVE_COPY_FILE_RANGE
+    while (off < st.st_size) {
+        loff_t off_in = off;
+        loff_t off_out = off;
+
+        nwr = copy_file_range(src_fd, &off_in, dst_fd, &off_out,
+                              (size_t)(st.st_size - off), 0);
+        if (nwr < 0 && errno == EINTR)
+            continue;
+
+        // Not supported between these files, copy the rest by hand.
+        if (nwr <= 0)
+            break;
+
+        off += nwr;
+    }
+
+    if (off >= st.st_size)
+        return 0;
+#endif
+
+    buf = (char *)malloc(COPY_BUFFER_SIZE);
+    if (!buf)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    for (;;) {
+        nrd = pread(src_fd, buf, COPY_BUFFER_SIZE, off);
+        if (nrd < 0 && errno == EINTR)
+            continue;
+        if (nrd <= 0)
+            break;
+
+        nwr = pwrite(dst_fd, buf, (size_t)nrd, off);
+        if (nwr != nrd)
+            break;
+
+        off += nrd;
+    }
+
+    free(buf);
+
+    if (nrd < 0 || (nrd > 0 && nwr != nrd)) {
+        vlogE("NativeUtils: failed to copy file content (%d).", errno);
+        return HIVE_SYS_ERROR(errno ? errno : EIO);
+    }
+
+    return 0;
+}
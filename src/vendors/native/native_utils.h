@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2019 Elastos Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __NATIVE_UTILS_H__
+#define __NATIVE_UTILS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+/*
+ * Prefix of the working copies kept next to their target files. Such
+ * entries are never listed.
+ */
+#define NATIVE_TMP_PREFIX       ".hive-"
+
+/*
+ * Map an absolute hive path onto the local file system under root. Paths
+ * with "." or ".." components are refused, so nothing outside root is
+ * reachable.
+ */
+int native_resolve_path(const char *root, const char *path,
+                        char *buf, size_t bufsz);
+
+/*
+ * Create an anonymous working file in the directory of target. When the
+ * file system has no O_TMPFILE support a hidden named file is created
+ * instead and its path is returned in tmp_path, otherwise tmp_path is
+ * set empty.
+ */
+int native_open_tmpfile(const char *target, char *tmp_path, size_t len);
+
+/*
+ * Atomically make the working file the new content of target, replacing
+ * whatever was there. The working file takes the mode of the replaced
+ * target, and both its content and the directory entry are synced before
+ * returning.
+ */
+int native_link_tmpfile(int fd, char *tmp_path, const char *target);
+
+/*
+ * Copy the whole content of src_fd into the empty dst_fd, sharing the
+ * extents with a reflink where the file system allows, and copying in
+ * the kernel otherwise.
+ */
+int native_clone_content(int dst_fd, int src_fd);
+
+static inline bool is_native_tmp_name(const char *name)
+{
+    return !strncmp(name, NATIVE_TMP_PREFIX, strlen(NATIVE_TMP_PREFIX));
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __NATIVE_UTILS_H__
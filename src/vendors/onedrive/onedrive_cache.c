@@ -0,0 +1,860 @@
+/*
+ * Copyright (c) 2019 Elastos Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <ctype.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <crystal.h>
+#include <cjson/cJSON.h>
+
+#include "hive_error.h"
+#include "http_client.h"
+#include "http_status.h"
+#include "hashmap.h"
+#include "onedrive_cache.h"
+#include "onedrive_constants.h"
+
+#define DELTA_SELECT_FIELDS \
+    "id,name,size,cTag,file,folder,root,deleted,parentReference"
+
+#define CACHE_INITIAL_CAPACITY  (1024)
+
+/*
+ * Upper bound for keeping a mutated path out of the index in case delta
+ * never reports it, such as deleting an item the index did not know.
+ */
+#define MUTATION_MAX_AGE        (300)
+
+typedef struct cache_item cache_item_t;
+
+struct cache_item {
+    cache_item_t *prev;         // all items of the index.
+    cache_item_t *next;
+    cache_item_t *sib_prev;     // children of the same parent.
+    cache_item_t *sib_next;
+    char *id;
+    char *parent_id;
+    char *name;
+    char *key;                  // parent id and lower-cased name.
+    size_t keylen;
+    char *ctag;
+    size_t size;
+    bool folder;
+};
+
+/*
+ * A path mutated locally. The delta API may not reflect the mutation
+ * right away, so the path is answered by the server until a round
+ * started after the mutation reports the item at that path.
+ */
+typedef struct mutation mutation_t;
+
+struct mutation {
+    mutation_t *next;
+    char *path;
+    unsigned int round;
+    time_t at;
+};
+
+struct onedrive_cache {
+    pthread_mutex_t lock;       // guards the index.
+    pthread_mutex_t sync_lock;  // one refresher at a time.
+    hashmap_t *by_id;
+    hashmap_t *by_name;
+    hashmap_t *children;        // parent id to its first child.
+    cache_item_t *head;
+    char *root_id;
+    char *delta_link;
+    unsigned int ttl;
+    time_t synced_at;
+    unsigned int round;         // delta rounds started.
+    unsigned int epoch;         // bumped when the index is reset.
+    mutation_t *mutations;
+};
+
+static char *make_name_key(const char *parent_id, const char *name,
+                           size_t namelen, size_t *keylen)
+{
+    size_t idlen = strlen(parent_id);
+    char *key;
+    size_t i;
+
+    key = (char *)malloc(idlen + namelen + 2);
+    if (!key)
+        return NULL;
+
+    memcpy(key, parent_id, idlen);
+    key[idlen] = '/';
+
+    // OneDrive names are case insensitive.
+    for (i = 0; i < namelen; i++)
+        key[idlen + 1 + i] = (char)tolower((unsigned char)name[i]);
+
+    key[idlen + 1 + namelen] = '\0';
+    *keylen = idlen + 1 + namelen;
+
+    return key;
+}
+
+static void free_item(cache_item_t *item)
+{
+    free(item->id);
+    free(item->parent_id);
+    free(item->name);
+    free(item->key);
+    free(item->ctag);
+    free(item);
+}
+
+static void free_mutations(mutation_t *mutation)
+{
+    mutation_t *next;
+
+    for (; mutation; mutation = next) {
+        next = mutation->next;
+        free(mutation->path);
+        free(mutation);
+    }
+}
+
+static void unlink_item(onedrive_cache_t *cache, cache_item_t *item)
+{
+    if (item->key) {
+        if (hashmap_get(cache->by_name, item->key, item->keylen) == item)
+            hashmap_remove(cache->by_name, item->key, item->keylen);
+
+        free(item->key);
+        item->key = NULL;
+    }
+
+    if (!item->parent_id)
+        return;
+
+    if (item->sib_prev)
+        item->sib_prev->sib_next = item->sib_next;
+    else if (item->sib_next)
+        hashmap_put(cache->children, item->parent_id, strlen(item->parent_id),
+                    item->sib_next, NULL);
+    else if (hashmap_get(cache->children, item->parent_id,
+                         strlen(item->parent_id)) == item)
+        hashmap_remove(cache->children, item->parent_id, strlen(item->parent_id));
+
+    if (item->sib_next)
+        item->sib_next->sib_prev = item->sib_prev;
+
+    item->sib_prev = item->sib_next = NULL;
+}
+
+static int link_item(onedrive_cache_t *cache, cache_item_t *item)
+{
+    cache_item_t *head;
+    size_t idlen;
+
+    if (!item->parent_id)
+        return 0;
+
+    item->key = make_name_key(item->parent_id, item->name, strlen(item->name),
+                              &item->keylen);
+    if (!item->key)
+        return -1;
+
+    if (hashmap_put(cache->by_name, item->key, item->keylen, item, NULL) < 0)
+        return -1;
+
+    idlen = strlen(item->parent_id);
+    head = (cache_item_t *)hashmap_get(cache->children, item->parent_id, idlen);
+    if (hashmap_put(cache->children, item->parent_id, idlen, item, NULL) < 0)
+        return -1;
+
+    item->sib_next = head;
+    if (head)
+        head->sib_prev = item;
+
+    return 0;
+}
+
+static void remove_item(onedrive_cache_t *cache, cache_item_t *item)
+{
+    cache_item_t *child;
+
+    // Descendants are not always reported when a folder gets deleted.
+    while ((child = (cache_item_t *)hashmap_get(cache->children, item->id,
+                                                strlen(item->id))) != NULL)
+        remove_item(cache, child);
+
+    unlink_item(cache, item);
+    hashmap_remove(cache->by_id, item->id, strlen(item->id));
+
+    if (item->prev)
+        item->prev->next = item->next;
+    else
+        cache->head = item->next;
+
+    if (item->next)
+        item->next->prev = item->prev;
+
+    free_item(item);
+}
+
+static int reset_index(onedrive_cache_t *cache)
+{
+    cache_item_t *item;
+
+    while ((item = cache->head) != NULL) {
+        cache->head = item->next;
+        free_item(item);
+    }
+
+    if (cache->by_id)
+        hashmap_free(cache->by_id);
+    if (cache->by_name)
+        hashmap_free(cache->by_name);
+    if (cache->children)
+        hashmap_free(cache->children);
+
+    free(cache->root_id);
+    free(cache->delta_link);
+    cache->root_id = NULL;
+    cache->delta_link = NULL;
+    cache->synced_at = 0;
+
+    cache->by_id    = hashmap_new(CACHE_INITIAL_CAPACITY);
+    cache->by_name  = hashmap_new(CACHE_INITIAL_CAPACITY);
+    cache->children = hashmap_new(CACHE_INITIAL_CAPACITY);
+    if (!cache->by_id || !cache->by_name || !cache->children)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    return 0;
+}
+
+static const char *get_string(cJSON *json, const char *name)
+{
+    cJSON *item;
+
+    item = cJSON_GetObjectItemCaseSensitive(json, name);
+    if (!item || !cJSON_IsString(item) || !item->valuestring ||
+        !*item->valuestring)
+        return NULL;
+
+    return item->valuestring;
+}
+
+static int replace_string(char **field, const char *value)
+{
+    char *tmp = NULL;
+
+    if (value) {
+        tmp = strdup(value);
+        if (!tmp)
+            return -1;
+    }
+
+    free(*field);
+    *field = tmp;
+    return 0;
+}
+
+static bool is_fresh(onedrive_cache_t *cache)
+{
+    return cache->root_id && cache->synced_at &&
+           time(NULL) - cache->synced_at < (time_t)cache->ttl;
+}
+
+static cache_item_t *resolve_path(onedrive_cache_t *cache, const char *path)
+{
+    cache_item_t *item;
+    const char *p = path;
+
+    item = (cache_item_t *)hashmap_get(cache->by_id, cache->root_id,
+                                       strlen(cache->root_id));
+
+    while (item && *p) {
+        const char *end;
+        size_t keylen;
+        char *key;
+
+        while (*p == '/')
+            p++;
+        if (!*p)
+            break;
+
+        end = strchr(p, '/');
+        if (!end)
+            end = p + strlen(p);
+
+        key = make_name_key(item->id, p, end - p, &keylen);
+        if (!key)
+            return NULL;
+
+        item = (cache_item_t *)hashmap_get(cache->by_name, key, keylen);
+        free(key);
+        p = end;
+    }
+
+    return item;
+}
+
+/*
+ * Drops the mutations of the paths the item is at, once a round started
+ * after them reports it. Called both before and after applying the item,
+ * so the old and the new location of a moved or deleted item are settled.
+ */
+static void settle_mutations(onedrive_cache_t *cache, cache_item_t *item)
+{
+    mutation_t **p = &cache->mutations;
+    mutation_t *mutation;
+
+    if (!cache->root_id)
+        return;
+
+    while ((mutation = *p) != NULL) {
+        if (mutation->round < cache->round &&
+            resolve_path(cache, mutation->path) == item) {
+            *p = mutation->next;
+            mutation->next = NULL;
+            free_mutations(mutation);
+        } else
+            p = &mutation->next;
+    }
+}
+
+static int apply_item(onedrive_cache_t *cache, cJSON *json)
+{
+    cache_item_t *item;
+    const char *id;
+    const char *name;
+    const char *parent_id = NULL;
+    cJSON *parent;
+    cJSON *size;
+    bool root;
+
+    id = get_string(json, "id");
+    if (!id) {
+        vlogE("OneDriveCache: missing id json object.");
+        return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+    }
+
+    item = (cache_item_t *)hashmap_get(cache->by_id, id, strlen(id));
+    if (item && cache->mutations)
+        settle_mutations(cache, item);
+
+    if (cJSON_GetObjectItemCaseSensitive(json, "deleted")) {
+        if (item)
+            remove_item(cache, item);
+        return 0;
+    }
+
+    name = get_string(json, "name");
+    if (!name) {
+        vlogE("OneDriveCache: missing name json object.");
+        return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+    }
+
+    root = cJSON_GetObjectItemCaseSensitive(json, "root") != NULL;
+    parent = cJSON_GetObjectItemCaseSensitive(json, "parentReference");
+    if (parent && !root)
+        parent_id = get_string(parent, "id");
+
+    if (!item) {
+        item = (cache_item_t *)calloc(1, sizeof(cache_item_t));
+        if (!item)
+            return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+        item->id = strdup(id);
+        if (!item->id ||
+            hashmap_put(cache->by_id, item->id, strlen(item->id), item, NULL) < 0) {
+            free_item(item);
+            return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+        }
+
+        item->next = cache->head;
+        if (cache->head)
+            cache->head->prev = item;
+        cache->head = item;
+    } else {
+        unlink_item(cache, item);
+    }
+
+    if (replace_string(&item->name, name) < 0 ||
+        replace_string(&item->parent_id, parent_id) < 0 ||
+        replace_string(&item->ctag, get_string(json, "cTag")) < 0)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    size = cJSON_GetObjectItemCaseSensitive(json, "size");
+    item->size = (size && cJSON_IsNumber(size)) ? (size_t)size->valuedouble : 0;
+    item->folder = root || cJSON_GetObjectItemCaseSensitive(json, "folder");
+
+    if (root && replace_string(&cache->root_id, id) < 0)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    if (link_item(cache, item) < 0)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    if (cache->mutations)
+        settle_mutations(cache, item);
+
+    return 0;
+}
+
+// OneDrive names are case insensitive.
+static bool same_prefix(const char *a, const char *b, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i]))
+            return false;
+    }
+
+    return true;
+}
+
+// Whether path is dir itself or lies below it.
+static bool path_within(const char *path, const char *dir)
+{
+    size_t len = strlen(dir);
+
+    if (!strcmp(dir, "/"))
+        return true;
+
+    return strlen(path) >= len && same_prefix(path, dir, len) &&
+           (path[len] == '\0' || path[len] == '/');
+}
+
+static bool is_parent(const char *dir, const char *path)
+{
+    const char *sep = strrchr(path, '/');
+    size_t len;
+
+    if (!sep)
+        return false;
+
+    len = sep == path ? 1 : (size_t)(sep - path);
+    return strlen(dir) == len && same_prefix(dir, path, len);
+}
+
+/*
+ * Whether a mutation not reported by delta yet may affect the answer
+ * for path, that is its item, one of its ancestors or, for listings, one
+ * of its children was mutated.
+ */
+static bool is_mutated(onedrive_cache_t *cache, const char *path,
+                       bool listing)
+{
+    mutation_t **p = &cache->mutations;
+    mutation_t *mutation;
+    time_t now = time(NULL);
+    bool mutated = false;
+
+    while ((mutation = *p) != NULL) {
+        if (now - mutation->at > MUTATION_MAX_AGE) {
+            *p = mutation->next;
+            mutation->next = NULL;
+            free_mutations(mutation);
+            continue;
+        }
+
+        if (path_within(path, mutation->path) ||
+            (listing && is_parent(path, mutation->path)))
+            mutated = true;
+
+        p = &mutation->next;
+    }
+
+    return mutated;
+}
+
+int onedrive_cache_stat(onedrive_cache_t *cache, const char *path,
+                        HiveFileInfo *info)
+{
+    cache_item_t *item;
+    int rc = 1;
+
+    assert(cache);
+    assert(path);
+    assert(info);
+
+    pthread_mutex_lock(&cache->lock);
+    if (is_fresh(cache) && !is_mutated(cache, path, false)) {
+        item = resolve_path(cache, path);
+        if (!item)
+            rc = HIVE_HTTP_STATUS_ERROR(HttpStatus_NotFound);
+        else if (item->ctag && strlen(item->ctag) < sizeof(info->fileid)) {
+            strcpy(info->fileid, item->ctag);
+            strcpy(info->type, item->folder ? "directory" : "file");
+            info->size = item->size;
+            rc = 0;
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    return rc;
+}
+
+int onedrive_cache_list(onedrive_cache_t *cache, const char *path,
+                        cJSON **array)
+{
+    cache_item_t *item;
+    cJSON *entries;
+    int rc = 1;
+
+    assert(cache);
+    assert(path);
+    assert(array);
+
+    pthread_mutex_lock(&cache->lock);
+    if (!is_fresh(cache) || is_mutated(cache, path, true))
+        goto unlock_exit;
+
+    item = resolve_path(cache, path);
+    if (!item) {
+        rc = HIVE_HTTP_STATUS_ERROR(HttpStatus_NotFound);
+        goto unlock_exit;
+    }
+
+    if (!item->folder)
+        goto unlock_exit;
+
+    entries = cJSON_CreateArray();
+    if (!entries) {
+        rc = HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+        goto unlock_exit;
+    }
+
+    item = (cache_item_t *)hashmap_get(cache->children, item->id, strlen(item->id));
+    for (; item; item = item->sib_next) {
+        cJSON *entry;
+
+        entry = cJSON_CreateObject();
+        if (!entry) {
+            cJSON_Delete(entries);
+            rc = HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+            goto unlock_exit;
+        }
+
+        cJSON_AddItemToArray(entries, entry);
+        if (!cJSON_AddStringToObject(entry, "name", item->name) ||
+            !cJSON_AddObjectToObject(entry, item->folder ? "folder" : "file")) {
+            cJSON_Delete(entries);
+            rc = HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+            goto unlock_exit;
+        }
+    }
+
+    *array = entries;
+    rc = 0;
+
+unlock_exit:
+    pthread_mutex_unlock(&cache->lock);
+    return rc;
+}
+
+void onedrive_cache_invalidate(onedrive_cache_t *cache, const char *path)
+{
+    mutation_t *mutation;
+
+    assert(cache);
+    assert(path);
+
+    pthread_mutex_lock(&cache->lock);
+    for (mutation = cache->mutations; mutation; mutation = mutation->next) {
+        if (strlen(mutation->path) == strlen(path) &&
+            same_prefix(mutation->path, path, strlen(path)))
+            break;
+    }
+
+    if (!mutation) {
+        mutation = (mutation_t *)calloc(1, sizeof(mutation_t));
+        if (mutation)
+            mutation->path = strdup(path);
+
+        if (!mutation || !mutation->path) {
+            // Without a record of the path, nothing can be trusted.
+            vlogW("OneDriveCache: failed to record mutation, dropping index.");
+            free(mutation);
+            reset_index(cache);
+            pthread_mutex_unlock(&cache->lock);
+            return;
+        }
+
+        mutation->next = cache->mutations;
+        cache->mutations = mutation;
+    }
+
+    mutation->round = cache->round;
+    mutation->at = time(NULL);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+static int apply_page(onedrive_cache_t *cache, cJSON *json, char **link,
+                      bool *done)
+{
+    cJSON *value;
+    cJSON *item;
+    const char *next;
+    int rc = 0;
+
+    value = cJSON_GetObjectItemCaseSensitive(json, "value");
+    if (!value || !cJSON_IsArray(value)) {
+        vlogE("OneDriveCache: missing value json object.");
+        return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+    }
+
+    next = get_string(json, "@odata.nextLink");
+    *done = !next;
+    if (!next)
+        next = get_string(json, "@odata.deltaLink");
+
+    if (!next) {
+        vlogE("OneDriveCache: missing @odata.deltaLink json object.");
+        return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+    }
+
+    if (replace_string(link, next) < 0)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    pthread_mutex_lock(&cache->lock);
+    cJSON_ArrayForEach(item, value) {
+        rc = apply_item(cache, item);
+        if (rc < 0)
+            break;
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    return rc;
+}
+
+static int fetch_delta(onedrive_cache_t *cache, oauth_token_t *token,
+                       char **link)
+{
+    http_client_t *httpc;
+    bool resynced = false;
+    bool done = false;
+    long resp_code = 0;
+    cJSON *json;
+    int rc;
+
+    httpc = http_client_new();
+    if (!httpc) {
+        vlogE("OneDriveCache: failed to create http client instance.");
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+    }
+
+    while (!done) {
+        http_client_reset(httpc);
+        if (*link)
+            http_client_set_url(httpc, *link);
+        else {
+            http_client_set_url(httpc, MY_DRIVE "/root/delta");
+            http_client_set_query(httpc, "$select", DELTA_SELECT_FIELDS);
+        }
+        http_client_set_method(httpc, HTTP_METHOD_GET);
+        set_auth_headers(httpc, token);
+        http_client_enable_response_body(httpc);
+
+        rc = http_client_request(httpc);
+        if (rc) {
+            vlogE("OneDriveCache: failed to perform http request.");
+            rc = HIVE_CURL_ERROR(rc);
+            break;
+        }
+
+        rc = http_client_get_response_code(httpc, &resp_code);
+        if (rc) {
+            vlogE("OneDriveCache: failed to get http response code.");
+            rc = HIVE_CURL_ERROR(rc);
+            break;
+        }
+
+        if (resp_code == HttpStatus_Unauthorized) {
+            vlogE("OneDriveCache: access token expired.");
+            oauth_token_set_expired(token);
+            rc = HIVE_GENERAL_ERROR(HIVEERR_TRY_AGAIN);
+            break;
+        }
+
+        // The deltaLink expired, so the index is rebuilt from scratch.
+        if (resp_code == HttpStatus_Gone && *link && !resynced) {
+            vlogI("OneDriveCache: delta token expired, resynchronizing.");
+            pthread_mutex_lock(&cache->lock);
+            rc = reset_index(cache);
+            pthread_mutex_unlock(&cache->lock);
+            if (rc < 0)
+                break;
+
+            replace_string(link, NULL);
+            resynced = true;
+            continue;
+        }
+
+        if (resp_code != HttpStatus_OK) {
+            vlogE("OneDriveCache: error from http response (%d).", resp_code);
+            rc = HIVE_HTTP_STATUS_ERROR(resp_code);
+            break;
+        }
+
+        if (!http_client_get_response_body(httpc)) {
+            vlogE("OneDriveCache: failed to get http response body.");
+            rc = HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+            break;
+        }
+
+        json = cJSON_Parse(http_client_get_response_body(httpc));
+        if (!json) {
+            vlogE("OneDriveCache: bad json format for http response.");
+            rc = HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+            break;
+        }
+
+        rc = apply_page(cache, json, link, &done);
+        cJSON_Delete(json);
+        if (rc < 0)
+            break;
+    }
+
+    http_client_close(httpc);
+    return rc;
+}
+
+int onedrive_cache_sync(onedrive_cache_t *cache, oauth_token_t *token)
+{
+    unsigned int epoch;
+    char *link = NULL;
+    int rc = 0;
+
+    assert(cache);
+    assert(token);
+
+    pthread_mutex_lock(&cache->sync_lock);
+
+    pthread_mutex_lock(&cache->lock);
+    if (is_fresh(cache)) {
+        pthread_mutex_unlock(&cache->lock);
+        pthread_mutex_unlock(&cache->sync_lock);
+        return 0;
+    }
+
+    // Rebuild the maps a failed reset left behind.
+    if (!cache->by_id || !cache->by_name || !cache->children)
+        rc = reset_index(cache);
+
+    epoch = cache->epoch;
+    cache->round++;
+    if (rc == 0 && cache->delta_link)
+        rc = replace_string(&link, cache->delta_link);
+    pthread_mutex_unlock(&cache->lock);
+
+    if (rc < 0) {
+        pthread_mutex_unlock(&cache->sync_lock);
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+    }
+
+    rc = fetch_delta(cache, token, &link);
+
+    pthread_mutex_lock(&cache->lock);
+    if (epoch != cache->epoch) {
+        // Reset while refreshing, the pages may belong to another account.
+        reset_index(cache);
+    } else if (rc == 0) {
+        free(cache->delta_link);
+        cache->delta_link = link;
+        link = NULL;
+        cache->synced_at = time(NULL);
+    } else if (rc == HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT) ||
+               rc == HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY)) {
+        // Part of a page may have been applied; start over next time.
+        reset_index(cache);
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    free(link);
+    pthread_mutex_unlock(&cache->sync_lock);
+
+    if (rc < 0)
+        vlogE("OneDriveCache: failed to synchronize metadata (%d).", rc);
+
+    return rc;
+}
+
+void onedrive_cache_reset(onedrive_cache_t *cache)
+{
+    assert(cache);
+
+    pthread_mutex_lock(&cache->lock);
+    if (reset_index(cache) < 0)
+        vlogW("OneDriveCache: failed to rebuild index, retrying on sync.");
+
+    free_mutations(cache->mutations);
+    cache->mutations = NULL;
+    cache->epoch++;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+static void onedrive_cache_destructor(void *obj)
+{
+    onedrive_cache_t *cache = (onedrive_cache_t *)obj;
+    cache_item_t *item;
+
+    while ((item = cache->head) != NULL) {
+        cache->head = item->next;
+        free_item(item);
+    }
+
+    if (cache->by_id)
+        hashmap_free(cache->by_id);
+    if (cache->by_name)
+        hashmap_free(cache->by_name);
+    if (cache->children)
+        hashmap_free(cache->children);
+
+    free(cache->root_id);
+    free(cache->delta_link);
+    free_mutations(cache->mutations);
+
+    pthread_mutex_destroy(&cache->sync_lock);
+    pthread_mutex_destroy(&cache->lock);
+}
+
+onedrive_cache_t *onedrive_cache_new(unsigned int ttl)
+{
+    onedrive_cache_t *cache;
+
+    cache = rc_zalloc(sizeof(onedrive_cache_t), onedrive_cache_destructor);
+    if (!cache)
+        return NULL;
+
+    pthread_mutex_init(&cache->lock, NULL);
+    pthread_mutex_init(&cache->sync_lock, NULL);
+    cache->ttl = ttl;
+
+    if (reset_index(cache) < 0) {
+        deref(cache);
+        return NULL;
+    }
+
+    return cache;
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2019 Elastos Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __ONEDRIVE_CACHE_H__
+#define __ONEDRIVE_CACHE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <cjson/cJSON.h>
+
+#include "ela_hive.h"
+#include "oauth_token.h"
+
+typedef struct onedrive_cache onedrive_cache_t;
+
+/*
+ * Metadata index of a whole OneDrive drive populated by the delta API.
+ * Items are indexed by id and by parent id plus lower-cased name, and
+ * the stored deltaLink brings the index up to date incrementally. The
+ * index is trusted for ttl seconds after each refresh, and local
+ * mutations only make the paths they touch fall back to the server.
+ */
+onedrive_cache_t *onedrive_cache_new(unsigned int ttl);
+
+/*
+ * Refreshes the index from the delta API unless it is still fresh. Only
+ * one caller refreshes at a time; the others wait for it.
+ */
+int onedrive_cache_sync(onedrive_cache_t *cache, oauth_token_t *token);
+
+/*
+ * Records a local mutation of path. The delta API may lag behind, so
+ * the path, its descendants and the listing of its parent are answered
+ * by the server until a refresh started afterwards reports the item at
+ * that path.
+ */
+void onedrive_cache_invalidate(onedrive_cache_t *cache, const char *path);
+
+/*
+ * Drops the whole index, the deltaLink and the mutation records, so
+ * nothing learned under the previous account is answered after logout.
+ */
+void onedrive_cache_reset(onedrive_cache_t *cache);
+
+/*
+ * Both return 0 if answered from the index, the error a request would
+ * have returned if the path is known to be missing, or 1 if the index
+ * is stale or lacks the data, in which case the caller should ask the
+ * server instead. The listing is returned as an array of driveItem
+ * alike objects carrying name and either file or folder.
+ */
+int onedrive_cache_stat(onedrive_cache_t *cache, const char *path,
+                        HiveFileInfo *info);
+int onedrive_cache_list(onedrive_cache_t *cache, const char *path,
+                        cJSON **array);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ONEDRIVE_CACHE_H__
@@ -53,6 +53,8 @@ typedef struct OneDriveClient {
     oauth_token_t *token;
     char keystore_path[PATH_MAX];
     char tmp_template[PATH_MAX];
+    onedrive_upload_options_t upload_opts;
+    onedrive_cache_t *cache;
 } OneDriveClient;
 
 static int onedrive_client_login(HiveClient *base,
@@ -88,6 +90,9 @@ static int onedrive_client_logout(HiveClient *base)
     assert(client->token);
 
     oauth_token_reset(client->token);
+    if (client->cache)
+        onedrive_cache_reset(client->cache);
+
     return 0;
 }
 
@@ -151,7 +156,7 @@ static int onedrive_client_get_info(HiveClient *base, HiveClientInfo *info)
 
     http_client_set_url(httpc, URL_API);
     http_client_set_method(httpc, HTTP_METHOD_GET);
-    http_client_set_header(httpc, "Authorization", get_bearer_token(client->token));
+    set_auth_headers(httpc, client->token);
     http_client_enable_response_body(httpc);
 
     rc = http_client_request(httpc);
@@ -190,7 +195,7 @@ static int onedrive_client_get_info(HiveClient *base, HiveClientInfo *info)
     }
 
     rc = onedrive_decode_client_info(p, info);
-    free(p);
+    http_client_release_response_body(p);
 
     return rc;
 
@@ -208,7 +213,8 @@ static int onedrive_client_drive_open(HiveClient *base, HiveDrive **drive)
     assert(client->token);
     assert(drive);
 
-    rc = onedrive_drive_open(client->token, "default", client->tmp_template, drive);
+    rc = onedrive_drive_open(client->token, "default", client->tmp_template,
+                             &client->upload_opts, client->cache, drive);
     if (rc < 0) {
         vlogE("OneDriveClient: Opening onedrive drive handle error");
         return rc;
@@ -273,7 +279,7 @@ static cJSON *load_keystore_in_json(const char *path)
 
 static int oauth_writeback(const cJSON *json, void *user_data)
 {
-    OneDriveClient *client = (OneDriveClient *)user_data;
+    const char *keystore_path = (const char *)user_data;
     char *json_str;
     int json_str_len;
     int fd;
@@ -285,7 +291,7 @@ static int oauth_writeback(const cJSON *json, void *user_data)
         return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
     }
 
-    fd = open(client->keystore_path, O_WRONLY | O_TRUNC | O_CREAT, S_IRUSR | S_IWUSR);
+    fd = open(keystore_path, O_WRONLY | O_TRUNC | O_CREAT, S_IRUSR | S_IWUSR);
     if (fd < 0) {
         vlogE("OneDriveClient: open cache failure (%d).", errno);
         free(json_str);
@@ -309,8 +315,14 @@ static void onedrive_client_destructor(void *obj)
 {
     OneDriveClient *client = (OneDriveClient *)obj;
 
-    if (client->token)
+    // Drives and files may keep the token alive, but not its refresher.
+    if (client->token) {
+        oauth_token_stop_refresher(client->token);
         oauth_token_delete(client->token);
+    }
+
+    if (client->cache)
+        deref(client->cache);
 }
 
 HiveClient *onedrive_client_new(const HiveOptions *options)
@@ -319,6 +331,7 @@ HiveClient *onedrive_client_new(const HiveOptions *options)
     oauth_options_t oauth_opts;
     OneDriveClient *client;
     cJSON *keystore = NULL;
+    char *keystore_path;
     char path_tmp[PATH_MAX];
     int rc;
 
@@ -374,6 +387,28 @@ HiveClient *onedrive_client_new(const HiveOptions *options)
         return NULL;
     }
 
+    client->upload_opts.fragment_size = opts->upload_fragment_size ?
+        opts->upload_fragment_size : UPLOAD_FRAGMENT_DEFAULT_SIZE;
+    client->upload_opts.fragment_size -=
+        client->upload_opts.fragment_size % UPLOAD_FRAGMENT_UNIT;
+    if (client->upload_opts.fragment_size < UPLOAD_FRAGMENT_UNIT)
+        client->upload_opts.fragment_size = UPLOAD_FRAGMENT_UNIT;
+    if (client->upload_opts.fragment_size > UPLOAD_FRAGMENT_MAX_SIZE)
+        client->upload_opts.fragment_size = UPLOAD_FRAGMENT_MAX_SIZE;
+
+    client->upload_opts.parallelism = opts->upload_parallelism ?
+        opts->upload_parallelism : UPLOAD_DEFAULT_PARALLELISM;
+
+    if (opts->metadata_cache_ttl) {
+        client->cache = onedrive_cache_new(opts->metadata_cache_ttl);
+        if (!client->cache) {
+            vlogE("OneDriveClient: failed to create metadata cache.");
+            hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY));
+            deref(client);
+            return NULL;
+        }
+    }
+
     if (!access(client->keystore_path, F_OK)) {
         keystore = load_keystore_in_json(client->keystore_path);
         if (!keystore) {
@@ -391,7 +426,20 @@ HiveClient *onedrive_client_new(const HiveOptions *options)
     oauth_opts.scope         = opts->scope;
     oauth_opts.redirect_url  = opts->redirect_url;
 
-    client->token = oauth_token_new(&oauth_opts, &oauth_writeback, client);
+    // The token may outlive the client, so it keeps its own keystore path.
+    keystore_path = rc_zalloc(strlen(client->keystore_path) + 1, NULL);
+    if (!keystore_path) {
+        if (keystore)
+            cJSON_Delete(keystore);
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY));
+        deref(client);
+        return NULL;
+    }
+    strcpy(keystore_path, client->keystore_path);
+
+    client->token = oauth_token_new(&oauth_opts, &oauth_writeback,
+                                    keystore_path);
+    deref(keystore_path);
     if (keystore)
         cJSON_Delete(keystore);
 
@@ -401,6 +449,15 @@ HiveClient *onedrive_client_new(const HiveOptions *options)
         return NULL;
     }
 
+    rc = oauth_token_start_refresher(client->token, opts->token_refresh_margin ?
+                                    opts->token_refresh_margin : TOKEN_REFRESH_DEFAULT_MARGIN);
+    if (rc < 0) {
+        vlogE("OneDriveClient: Failed to create onedrive client instance: failed to start token refresher.");
+        hive_set_error(rc);
+        deref(client);
+        return NULL;
+    }
+
     client->base.login       = onedrive_client_login;
     client->base.logout      = onedrive_client_logout;
     client->base.get_info    = onedrive_client_get_info;
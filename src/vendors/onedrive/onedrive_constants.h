@@ -31,8 +31,22 @@
 
 #define MAX_CTAG_LEN        (1024)
 
+#define ITEM_SELECT_FIELDS  "id,name,size,cTag,file,folder"
+#define LIST_PAGE_SIZE      "999"
+
+#define UPLOAD_FRAGMENT_UNIT            (320U * 1024)
+#define UPLOAD_FRAGMENT_DEFAULT_SIZE    (32 * UPLOAD_FRAGMENT_UNIT)
+#define UPLOAD_FRAGMENT_MAX_SIZE        (60U * 1024 * 1024)
+#define UPLOAD_DEFAULT_PARALLELISM      (4)
+
+#define TOKEN_REFRESH_DEFAULT_MARGIN    (300)
+
 #define MY_DRIVE    "https://graph.microsoft.com/v1.0/me/drive"
 
+#define URL_BATCH           "https://graph.microsoft.com/v1.0/$batch"
+#define BATCH_DRIVE         "/me/drive"
+#define BATCH_MAX_REQUESTS  (20)
+
 #define METHOD_AUTHORIZE "authorize"
 #define METHOD_TOKEN     "token"
 
@@ -25,6 +25,7 @@
 #include <string.h>
 #include <limits.h>
 #include <errno.h>
+#include <ctype.h>
 
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
@@ -41,6 +42,8 @@
 #include "onedrive_constants.h"
 #include "http_client.h"
 #include "http_status.h"
+#include "hive_async.h"
+#include "json_scanner.h"
 
 #define ARGV(args, index) (((void **)(args))[index])
 
@@ -48,6 +51,8 @@ typedef struct OneDriveDrive {
     HiveDrive base;
     oauth_token_t *token;
     char tmp_template[PATH_MAX];
+    onedrive_upload_options_t upload_opts;
+    onedrive_cache_t *cache;
 } OneDriveDrive;
 
 #define DECODE_INFO_FIELD(json, name, field) do { \
@@ -107,7 +112,7 @@ int onedrive_drive_get_info(HiveDrive *base, HiveDriveInfo *info)
 
     http_client_set_url(httpc, MY_DRIVE);
     http_client_set_method(httpc, HTTP_METHOD_GET);
-    http_client_set_header(httpc, "Authorization", get_bearer_token(drive->token));
+    set_auth_headers(httpc, drive->token);
     http_client_enable_response_body(httpc);
 
     rc = http_client_request(httpc);
@@ -146,7 +151,7 @@ int onedrive_drive_get_info(HiveDrive *base, HiveDriveInfo *info)
     }
 
     rc = onedrive_decode_drive_info(p, info);
-    free(p);
+    http_client_release_response_body(p);
 
     if (rc < 0)
         vlogE("OneDriveDrive: failed to decode drive info.");
@@ -158,30 +163,66 @@ error_exit:
     return rc;
 }
 
+/*
+ * Asks the server for just the driveItem fields Hive exposes instead of
+ * the full item with thumbnails, parentReference and audit facets. Page
+ * size of listings goes to the maximum as well; the @odata.nextLink of
+ * each page carries both options on.
+ */
 static
-int onedrive_decode_file_info(const char *info_str, HiveFileInfo *info)
+void set_item_projection(http_client_t *httpc, bool listing)
+{
+    http_client_set_query(httpc, "$select", ITEM_SELECT_FIELDS);
+    if (listing)
+        http_client_set_query(httpc, "$top", LIST_PAGE_SIZE);
+}
+
+static void invalidate_cache(OneDriveDrive *drive, const char *path)
+{
+    if (drive->cache)
+        onedrive_cache_invalidate(drive->cache, path);
+}
+
+/*
+ * Both answer from the metadata index when it is enabled, and return 1
+ * to fall back to a request if it is not, or could not be refreshed.
+ */
+static int stat_from_cache(OneDriveDrive *drive, const char *path,
+                           HiveFileInfo *info)
+{
+    if (!drive->cache || onedrive_cache_sync(drive->cache, drive->token) < 0)
+        return 1;
+
+    return onedrive_cache_stat(drive->cache, path, info);
+}
+
+static int list_from_cache(OneDriveDrive *drive, const char *path,
+                           cJSON **array)
+{
+    if (!drive->cache || onedrive_cache_sync(drive->cache, drive->token) < 0)
+        return 1;
+
+    return onedrive_cache_list(drive->cache, path, array);
+}
+
+static
+int decode_file_info(cJSON *json, HiveFileInfo *info)
 {
-    cJSON *json;
     cJSON *file;
     cJSON *dir;
     cJSON *size;
+    int rc;
 
-    assert(info_str);
-    assert(info);
-
-    json = cJSON_Parse(info_str);
-    if (!json) {
-        vlogE("OneDriveDrive: bad json format.");
-        return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+    rc = decode_info_field(json, "cTag", info->fileid, sizeof(info->fileid));
+    if (rc < 0) {
+        vlogE("OneDriveDrive: missing cTag json object.");
+        return rc;
     }
 
-    DECODE_INFO_FIELD(json, "cTag", info->fileid);
-
     file = cJSON_GetObjectItemCaseSensitive(json, "file");
     dir  = cJSON_GetObjectItemCaseSensitive(json, "folder");
     if ((file && dir) || (!file && !dir)) {
         vlogE("OneDriveDrive: problem with file or folder json object.");
-        cJSON_Delete(json);
         return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
     }
 
@@ -193,14 +234,32 @@ int onedrive_decode_file_info(const char *info_str, HiveFileInfo *info)
     size = cJSON_GetObjectItemCaseSensitive(json, "size");
     if (!size || !cJSON_IsNumber(size)) {
         vlogE("OneDriveDrive: missing size json object.");
-        cJSON_Delete(json);
         return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
     }
 
     info->size = (size_t)size->valuedouble;
+    return 0;
+}
+
+static
+int onedrive_decode_file_info(const char *info_str, HiveFileInfo *info)
+{
+    cJSON *json;
+    int rc;
+
+    assert(info_str);
+    assert(info);
+
+    json = cJSON_Parse(info_str);
+    if (!json) {
+        vlogE("OneDriveDrive: bad json format.");
+        return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+    }
 
+    rc = decode_file_info(json, info);
     cJSON_Delete(json);
-    return 0;
+
+    return rc;
 }
 
 static
@@ -230,6 +289,10 @@ int onedrive_drive_stat_file(HiveDrive *base, const char *path, HiveFileInfo *in
         return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
     }
 
+    rc = stat_from_cache(drive, path, info);
+    if (rc <= 0)
+        return rc;
+
     httpc = http_client_new();
     if (!httpc) {
         vlogE("OneDriveDrive: failed to create http client instance.");
@@ -242,8 +305,9 @@ int onedrive_drive_stat_file(HiveDrive *base, const char *path, HiveFileInfo *in
         sprintf(url, "%s/root:%s", MY_DRIVE, path);
 
     http_client_set_url(httpc, url);
+    set_item_projection(httpc, false);
     http_client_set_method(httpc, HTTP_METHOD_GET);
-    http_client_set_header(httpc, "Authorization", get_bearer_token(drive->token));
+    set_auth_headers(httpc, drive->token);
     http_client_enable_response_body(httpc);
 
     rc = http_client_request(httpc);
@@ -282,7 +346,7 @@ int onedrive_drive_stat_file(HiveDrive *base, const char *path, HiveFileInfo *in
     }
 
     rc = onedrive_decode_file_info(p, info);
-    free(p);
+    http_client_release_response_body(p);
 
     return rc;
 
@@ -291,51 +355,178 @@ error_exit:
     return rc;
 }
 
-static
-int merge_array(cJSON *sub, cJSON *array)
+/*
+ * Items of a children listing, as they are scanned out of each page.
+ * Synchronous listings hand every item to the iterate callback right
+ * away, asynchronous ones collect slim copies until the result is
+ * delivered.
+ */
+typedef struct list_context {
+    HiveFilesIterateCallback *callback;
+    void *context;
+    cJSON *array;
+    char name[PATH_MAX];
+    bool has_name;
+    bool has_file;
+    bool has_folder;
+    bool has_value;
+    char *next_link;
+    int rc;
+} list_context_t;
+
+static bool list_context_fail(list_context_t *ctx, const char *what)
 {
-    cJSON *item;
-    size_t sub_sz = cJSON_GetArraySize(sub);
-    size_t i;
+    vlogE("OneDriveDrive: %s.", what);
+    ctx->rc = HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+    return false;
+}
 
-    for (i = 0; i < sub_sz; ++i) {
-        cJSON *name;
-        cJSON *file;
-        cJSON *folder;
+static bool on_page_member(list_context_t *ctx, const char *key,
+                           json_scan_type_t type, const char *value)
+{
+    if (!strcmp(key, "value")) {
+        if (type != JSON_SCAN_ARRAY)
+            return list_context_fail(ctx, "missing value json object");
 
-        item = cJSON_GetArrayItem(sub, 0);
+        ctx->has_value = true;
+        return true;
+    }
 
-        name = cJSON_GetObjectItemCaseSensitive(item, "name");
-        if (!name || !cJSON_IsString(name) || !name->valuestring || !*name->valuestring) {
-            vlogE("OneDriveDrive: missing name json object.");
-            return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
-        }
+    if (!strcmp(key, "@odata.nextLink")) {
+        if (type != JSON_SCAN_STRING || !*value)
+            return list_context_fail(ctx, "bad format for @odata.nextLink json object");
 
-        file = cJSON_GetObjectItemCaseSensitive(item, "file");
-        folder = cJSON_GetObjectItemCaseSensitive(item, "folder");
-        if ((file && folder) || (!file && !folder)) {
-            vlogE("OneDriveDrive: bad json format for file and folder json object.");
-            return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+        free(ctx->next_link);
+        ctx->next_link = strdup(value);
+        if (!ctx->next_link) {
+            ctx->rc = HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+            return false;
         }
+    }
 
-        if (file && !cJSON_IsObject(file)) {
-            vlogE("OneDriveDrive: bad format for file json object.");
-            return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
-        }
+    return true;
+}
+
+static bool on_item_end(list_context_t *ctx)
+{
+    KeyValue properties[2];
+    bool is_file = ctx->has_file;
+    cJSON *item;
 
-        if (folder && !cJSON_IsObject(folder)) {
-            vlogE("OneDriveDrive: bad format for folder json object.");
-            return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+    if (!ctx->has_name)
+        return list_context_fail(ctx, "missing name json object");
+
+    if (ctx->has_file == ctx->has_folder)
+        return list_context_fail(ctx, "bad json format for file and folder json object");
+
+    ctx->has_name = false;
+    ctx->has_file = false;
+    ctx->has_folder = false;
+
+    if (ctx->array) {
+        item = cJSON_CreateObject();
+        if (!item || !cJSON_AddStringToObject(item, "name", ctx->name) ||
+            !cJSON_AddObjectToObject(item, is_file ? "file" : "folder")) {
+            cJSON_Delete(item);
+            ctx->rc = HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+            return false;
         }
 
-        cJSON_AddItemToArray(array, cJSON_DetachItemFromArray(sub, 0));
+        cJSON_AddItemToArray(ctx->array, item);
+        return true;
+    }
+
+    properties[0].key   = "name";
+    properties[0].value = ctx->name;
+
+    properties[1].key   = "type";
+    properties[1].value = is_file ? "file" : "directory";
+
+    return ctx->callback(properties, sizeof(properties) / sizeof(properties[0]),
+                         ctx->context);
+}
+
+static bool on_list_item(int depth, const char *key, json_scan_type_t type,
+                         const char *value, void *context)
+{
+    list_context_t *ctx = (list_context_t *)context;
+
+    if (depth == 0)
+        return on_page_member(ctx, key, type, value);
+
+    if (type == JSON_SCAN_END)
+        return on_item_end(ctx);
+
+    if (!strcmp(key, "name")) {
+        if (type != JSON_SCAN_STRING || !*value ||
+            strlen(value) >= sizeof(ctx->name))
+            return list_context_fail(ctx, "missing name json object");
+
+        strcpy(ctx->name, value);
+        ctx->has_name = true;
+    } else if (!strcmp(key, "file")) {
+        if (type != JSON_SCAN_OBJECT)
+            return list_context_fail(ctx, "bad format for file json object");
+
+        ctx->has_file = true;
+    } else if (!strcmp(key, "folder")) {
+        if (type != JSON_SCAN_OBJECT)
+            return list_context_fail(ctx, "bad format for folder json object");
+
+        ctx->has_folder = true;
+    }
+
+    return true;
+}
+
+/*
+ * Get ready for the next page of the listing on the request.
+ */
+static void list_context_reset(list_context_t *ctx, json_scanner_t *scanner,
+                               http_client_t *httpc)
+{
+    ctx->has_name = false;
+    ctx->has_file = false;
+    ctx->has_folder = false;
+    ctx->has_value = false;
+
+    json_scanner_reset(scanner);
+    json_scanner_attach(scanner, httpc, HttpStatus_OK);
+}
+
+/*
+ * Returns 1 if the application stopped the listing, 0 once the page is
+ * through, or a negative error.
+ */
+static int finish_page(list_context_t *ctx, json_scanner_t *scanner)
+{
+    int rc;
+
+    if (ctx->rc < 0)
+        return ctx->rc;
+
+    rc = json_scanner_finish(scanner);
+    if (rc) {
+        if (rc < 0)
+            vlogE("OneDriveDrive: bad json format for http response.");
+        return rc;
+    }
+
+    if (!ctx->has_value) {
+        vlogE("OneDriveDrive: missing value json object.");
+        return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
     }
 
     return 0;
 }
 
+/*
+ * Hands every entry of the array to the iterate callback. Returns false
+ * as soon as the callback asks to stop, without the terminating NULL
+ * call, so callers know not to fetch any further page.
+ */
 static
-void notify_user_files(cJSON *array, HiveFilesIterateCallback *callback,
+bool notify_user_files(cJSON *array, HiveFilesIterateCallback *callback,
                        void *context)
 {
     cJSON *item;
@@ -363,9 +554,10 @@ void notify_user_files(cJSON *array, HiveFilesIterateCallback *callback,
         resume = callback(properties, sizeof(properties) / sizeof(properties[0]),
                           context);
         if (!resume)
-            return;
+            return false;
     }
-    callback(NULL, 0, context);
+
+    return true;
 }
 
 static
@@ -375,10 +567,11 @@ int onedrive_drive_list_files(HiveDrive *base, const char *path,
     OneDriveDrive *drive = (OneDriveDrive *)base;
     http_client_t *httpc;
     char url[MAX_URL_LEN] = {0};
-    char *next_url = NULL;
+    char *next_link = NULL;
+    json_scanner_t *scanner;
+    list_context_t ctx;
     long resp_code;
     cJSON *array;
-    cJSON *json = NULL;
     int rc;
 
     assert(drive);
@@ -398,9 +591,31 @@ int onedrive_drive_list_files(HiveDrive *base, const char *path,
         return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
     }
 
+    rc = list_from_cache(drive, path, &array);
+    if (rc < 0)
+        return rc;
+
+    if (rc == 0) {
+        if (notify_user_files(array, callback, context))
+            callback(NULL, 0, context);
+        cJSON_Delete(array);
+        return 0;
+    }
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.callback = callback;
+    ctx.context = context;
+
+    scanner = json_scanner_new("value", on_list_item, &ctx);
+    if (!scanner) {
+        vlogE("OneDriveDrive: failed to create json scanner.");
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+    }
+
     httpc = http_client_new();
     if (!httpc) {
         vlogE("OneDriveDrive: failed to create http client instance.");
+        json_scanner_delete(scanner);
         return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
     }
 
@@ -409,28 +624,23 @@ int onedrive_drive_list_files(HiveDrive *base, const char *path,
     else
         sprintf(url, "%s/root:%s:/children", MY_DRIVE, path);
 
-    array = cJSON_CreateArray();
-    if (!array) {
-        vlogE("OneDriveDrive: failed to create json array instance.");
-        rc = HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
-        goto error_exit;
-    }
-
-    next_url = url;
-    while (next_url) {
-        char *p;
-        cJSON *sub_array;
-        cJSON *next_link;
-
+    for (;;) {
         http_client_reset(httpc);
-        http_client_set_url(httpc, next_url);
+        http_client_set_url(httpc, next_link ? next_link : url);
+        if (!next_link)
+            set_item_projection(httpc, true);
         http_client_set_method(httpc, HTTP_METHOD_GET);
-        http_client_set_header(httpc, "Authorization", get_bearer_token(drive->token));
-        http_client_enable_response_body(httpc);
+        set_auth_headers(httpc, drive->token);
+
+        // Items reach the callback as the page streams in.
+        list_context_reset(&ctx, scanner, httpc);
+
+        free(next_link);
+        next_link = NULL;
 
         rc = http_client_request(httpc);
-        if (json)
-            cJSON_Delete(json);
+        if (rc && json_scanner_aborted(scanner))
+            rc = 0;
 
         if (rc) {
             rc = HIVE_CURL_ERROR(rc);
@@ -458,69 +668,32 @@ int onedrive_drive_list_files(HiveDrive *base, const char *path,
             break;
         }
 
-        p = http_client_move_response_body(httpc, NULL);
-        if (!p) {
-            vlogE("OneDriveDrive: failed to get http response body.");
-            rc = HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
-            break;
-        }
-
-        json = cJSON_Parse(p);
-        free(p);
-        if (!json) {
-            vlogE("OneDriveDrive: bad json format for http response.");
-            rc = HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
-            break;
-        }
-
-        sub_array = cJSON_GetObjectItemCaseSensitive(json, "value");
-        if (!sub_array || !cJSON_IsArray(sub_array)) {
-            vlogE("OneDriveDrive: missing value json object.");
-            cJSON_Delete(json);
-            rc = HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+        // An early stop from the application saves the remaining pages.
+        rc = finish_page(&ctx, scanner);
+        if (rc) {
+            rc = rc > 0 ? 0 : rc;
             break;
         }
 
-        rc = merge_array(sub_array, array);
-        if (rc < 0) {
-            vlogE("OneDriveDrive: failed to merge array.");
-            cJSON_Delete(json);
-            break;
-        }
+        next_link = ctx.next_link;
+        ctx.next_link = NULL;
 
-        next_link = cJSON_GetObjectItemCaseSensitive(json, "@odata.nextLink");
-        if (next_link && (!cJSON_IsString(next_link) || !next_link->valuestring ||
-                          !*next_link->valuestring)) {
-            vlogE("OneDriveDrive: bad format for @odata.nextLink json object.");
-            cJSON_Delete(json);
-            rc = HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+        if (!next_link) {
+            callback(NULL, 0, context);
             break;
         }
-
-        if (next_link)
-            next_url = next_link->valuestring;
-        else {
-            next_url = NULL;
-            cJSON_Delete(json);
-            notify_user_files(array, callback, context);
-            rc = 0;
-        }
     }
 
-    cJSON_Delete(array);
-    http_client_close(httpc);
-    return rc;
-
-error_exit:
+    free(ctx.next_link);
     http_client_close(httpc);
+    json_scanner_delete(scanner);
     return rc;
 }
 
 static
-char *create_mkdir_request_body(const char *path)
+cJSON *create_mkdir_request_json(const char *path)
 {
     cJSON *body;
-    char *body_str;
     char *p;
 
     assert(path);
@@ -540,6 +713,19 @@ char *create_mkdir_request_body(const char *path)
         return NULL;
     }
 
+    return body;
+}
+
+static
+char *create_mkdir_request_body(const char *path)
+{
+    cJSON *body;
+    char *body_str;
+
+    body = create_mkdir_request_json(path);
+    if (!body)
+        return NULL;
+
     body_str = cJSON_PrintUnformatted(body);
     cJSON_Delete(body);
 
@@ -597,7 +783,7 @@ int onedrive_drive_mkdir(HiveDrive *base, const char *path)
     http_client_set_url(httpc, url);
     http_client_set_method(httpc, HTTP_METHOD_POST);
     http_client_set_header(httpc, "Content-Type", "application/json");
-    http_client_set_header(httpc, "Authorization", get_bearer_token(drive->token));
+    set_auth_headers(httpc, drive->token);
     http_client_set_request_body_instant(httpc, body, strlen(body));
 
     rc = http_client_request(httpc);
@@ -628,6 +814,7 @@ int onedrive_drive_mkdir(HiveDrive *base, const char *path)
         return HIVE_HTTP_STATUS_ERROR(resp_code);
     }
 
+    invalidate_cache(drive, path);
     return 0;
 
 error_exit:
@@ -635,14 +822,13 @@ error_exit:
     return rc;
 }
 
-static char *create_cp_mv_request_body(const char *path)
+static cJSON *create_cp_mv_request_json(const char *path)
 {
     char url[MAX_URL_LEN] = {0};
     char path_tmp[PATH_MAX];
     cJSON *body;
     cJSON *item;
     cJSON *parent_ref;
-    char *body_str;
 
     body = cJSON_CreateObject();
     if (!body) {
@@ -674,16 +860,28 @@ static char *create_cp_mv_request_body(const char *path)
         goto error_exit;
     }
 
-    body_str = cJSON_PrintUnformatted(body);
-    cJSON_Delete(body);
-
-    return body_str;
+    return body;
 
 error_exit:
     cJSON_Delete(body);
     return NULL;
 }
 
+static char *create_cp_mv_request_body(const char *path)
+{
+    cJSON *body;
+    char *body_str;
+
+    body = create_cp_mv_request_json(path);
+    if (!body)
+        return NULL;
+
+    body_str = cJSON_PrintUnformatted(body);
+    cJSON_Delete(body);
+
+    return body_str;
+}
+
 static
 int onedrive_drive_move_file(HiveDrive *base, const char *old, const char *new)
 {
@@ -731,7 +929,7 @@ int onedrive_drive_move_file(HiveDrive *base, const char *old, const char *new)
     http_client_set_url(httpc, url);
     http_client_set_method(httpc, HTTP_METHOD_PATCH);
     http_client_set_header(httpc, "Content-Type", "application/json");
-    http_client_set_header(httpc, "Authorization", get_bearer_token(drive->token));
+    set_auth_headers(httpc, drive->token);
     http_client_set_request_body_instant(httpc, body, strlen(body));
 
     rc = http_client_request(httpc);
@@ -762,6 +960,8 @@ int onedrive_drive_move_file(HiveDrive *base, const char *old, const char *new)
         return HIVE_HTTP_STATUS_ERROR(resp_code);
     }
 
+    invalidate_cache(drive, old);
+    invalidate_cache(drive, new);
     return 0;
 
 error_exit:
@@ -808,7 +1008,7 @@ int onedrive_drive_copy_file(HiveDrive *base, const char *src, const char *dest)
     http_client_set_url(httpc, url);
     http_client_set_method(httpc, HTTP_METHOD_POST);
     http_client_set_header(httpc, "Content-Type", "application/json");
-    http_client_set_header(httpc, "Authorization", get_bearer_token(drive->token));
+    set_auth_headers(httpc, drive->token);
     http_client_set_request_body_instant(httpc, body, strlen(body));
 
     rc = http_client_request(httpc);
@@ -840,6 +1040,7 @@ int onedrive_drive_copy_file(HiveDrive *base, const char *src, const char *dest)
     }
 
     // We will not wait for the completation of copy action.
+    invalidate_cache(drive, dest);
     return 0;
 
 error_exit:
@@ -881,7 +1082,7 @@ int onedrive_drive_delete_file(HiveDrive *base, const char *path)
     sprintf(url, "%s/root:%s:", MY_DRIVE, path);
     http_client_set_url(httpc, url);
     http_client_set_method(httpc, HTTP_METHOD_DELETE);
-    http_client_set_header(httpc, "Authorization", get_bearer_token(drive->token));
+    set_auth_headers(httpc, drive->token);
 
     rc = http_client_request(httpc);
     if (rc) {
@@ -909,6 +1110,7 @@ int onedrive_drive_delete_file(HiveDrive *base, const char *path)
         return HIVE_HTTP_STATUS_ERROR(resp_code);
     }
 
+    invalidate_cache(drive, path);
     return 0;
 
 error_exit:
@@ -916,67 +1118,979 @@ error_exit:
     return rc;
 }
 
-static int onedrive_drive_open_file(HiveDrive *base, const char *path,
-                                    int flags, HiveFile **file)
+/*
+ * Sub-request urls of $batch are taken as they are, so the path has to be
+ * escaped here instead of by libcurl.
+ */
+static int escape_path(const char *path, char *buf, size_t len)
 {
-    OneDriveDrive *drive = (OneDriveDrive *)base;
+    static const char hex[] = "0123456789ABCDEF";
+    const unsigned char *p;
+    size_t i = 0;
+
+    for (p = (const unsigned char *)path; *p; p++) {
+        if (isalnum(*p) || strchr("/-._~", *p)) {
+            if (i + 1 >= len)
+                return -1;
+            buf[i++] = (char)*p;
+        } else {
+            if (i + 3 >= len)
+                return -1;
+            buf[i++] = '%';
+            buf[i++] = hex[*p >> 4];
+            buf[i++] = hex[*p & 0x0F];
+        }
+    }
 
-    if (strlen(path) >= MAX_URL_PARAM_LEN) {
+    buf[i] = '\0';
+    return 0;
+}
+
+static
+cJSON *create_batch_request_item(const HiveBatchRequest *request, int id)
+{
+    char path[MAX_URL_LEN * 3];
+    char url[MAX_URL_LEN * 4];
+    char path_tmp[PATH_MAX];
+    char id_str[16];
+    const char *method;
+    cJSON *item;
+    cJSON *body = NULL;
+    cJSON *headers;
+
+    if (strlen(request->path) >= MAX_URL_PARAM_LEN ||
+        (request->target && strlen(request->target) >= MAX_URL_PARAM_LEN)) {
         vlogE("OneDriveDrive: path too long.");
-        return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
+        return NULL;
+    }
+
+    switch (request->op) {
+    case HiveBatchOp_Stat:
+        if (!strcmp(request->path, "/"))
+            sprintf(url, "%s/root", BATCH_DRIVE);
+        else {
+            escape_path(request->path, path, sizeof(path));
+            sprintf(url, "%s/root:%s", BATCH_DRIVE, path);
+        }
+        strcat(url, "?$select=" ITEM_SELECT_FIELDS);
+        method = "GET";
+        break;
+
+    case HiveBatchOp_Mkdir:
+        strcpy(path_tmp, request->path);
+        escape_path(dirname(path_tmp), path, sizeof(path));
+        if (!strcmp(path, "/"))
+            sprintf(url, "%s/root/children", BATCH_DRIVE);
+        else
+            sprintf(url, "%s/root:%s:/children", BATCH_DRIVE, path);
+        body = create_mkdir_request_json(request->path);
+        method = "POST";
+        break;
+
+    case HiveBatchOp_Move:
+        escape_path(request->path, path, sizeof(path));
+        sprintf(url, "%s/root:%s", BATCH_DRIVE, path);
+        body = create_cp_mv_request_json(request->target);
+        method = "PATCH";
+        break;
+
+    case HiveBatchOp_Copy:
+        escape_path(request->path, path, sizeof(path));
+        sprintf(url, "%s/root:%s:/copy", BATCH_DRIVE, path);
+        body = create_cp_mv_request_json(request->target);
+        method = "POST";
+        break;
+
+    case HiveBatchOp_Delete:
+    default:
+        escape_path(request->path, path, sizeof(path));
+        sprintf(url, "%s/root:%s:", BATCH_DRIVE, path);
+        method = "DELETE";
+        break;
+    }
+
+    if (request->op != HiveBatchOp_Stat && request->op != HiveBatchOp_Delete &&
+        !body)
+        return NULL;
+
+    item = cJSON_CreateObject();
+    if (!item) {
+        cJSON_Delete(body);
+        return NULL;
+    }
+
+    sprintf(id_str, "%d", id);
+    if (!cJSON_AddStringToObject(item, "id", id_str) ||
+        !cJSON_AddStringToObject(item, "method", method) ||
+        !cJSON_AddStringToObject(item, "url", url))
+        goto error_exit;
+
+    if (body) {
+        headers = cJSON_AddObjectToObject(item, "headers");
+        if (!headers ||
+            !cJSON_AddStringToObject(headers, "Content-Type", "application/json"))
+            goto error_exit;
+
+        cJSON_AddItemToObject(item, "body", body);
     }
 
-    return onedrive_file_open(drive->token, path, flags,
-                              drive->tmp_template, file);
+    return item;
+
+error_exit:
+    cJSON_Delete(body);
+    cJSON_Delete(item);
+    return NULL;
 }
 
-static void onedrive_drive_close(HiveDrive *base)
+static long batch_expected_status(HiveBatchOpType op)
 {
-    assert(base);
-
-    deref(base);
+    switch (op) {
+    case HiveBatchOp_Mkdir:
+        return HttpStatus_Created;
+    case HiveBatchOp_Copy:
+        return HttpStatus_Accepted;
+    case HiveBatchOp_Delete:
+        return HttpStatus_NoContent;
+    default:
+        return HttpStatus_OK;
+    }
 }
 
-static void onedrive_drive_destructor(void *obj)
+static void fail_batch(HiveBatchRequest *requests, size_t count, int rc)
 {
-    OneDriveDrive *drive = (OneDriveDrive *)obj;
+    size_t i;
 
-    if (drive->token)
-        oauth_token_delete(drive->token);
+    for (i = 0; i < count; i++) {
+        if (!requests[i].result)
+            requests[i].result = rc;
+    }
 }
 
-int onedrive_drive_open(oauth_token_t *token, const char *driveid,
-                        const char *tmp_template, HiveDrive **drive)
+static
+void decode_batch_response(OneDriveDrive *drive, cJSON *response,
+                           HiveBatchRequest *requests, size_t count)
 {
-    OneDriveDrive *tmp;
+    HiveBatchRequest *request;
+    cJSON *id;
+    cJSON *status;
+    cJSON *body;
+    char *end;
+    long index;
+    long code;
 
-    assert(token);
-    assert(driveid);
-    assert(drive);
+    id = cJSON_GetObjectItemCaseSensitive(response, "id");
+    status = cJSON_GetObjectItemCaseSensitive(response, "status");
+    if (!id || !cJSON_IsString(id) || !id->valuestring ||
+        !status || !cJSON_IsNumber(status)) {
+        vlogE("OneDriveDrive: bad json format for batch response.");
+        return;
+    }
 
-    /*
-     * If param @driveid equals "default", then use the default drive.
-     * otherwise, use the drive with specific driveid.
-     */
+    index = strtol(id->valuestring, &end, 10);
+    if (*end || index < 0 || (size_t)index >= count) {
+        vlogE("OneDriveDrive: unknown batch response id %s.", id->valuestring);
+        return;
+    }
 
-    tmp = (OneDriveDrive *)rc_zalloc(sizeof(OneDriveDrive), onedrive_drive_destructor);
-    if (!tmp)
-        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+    request = &requests[index];
+    code = (long)status->valuedouble;
 
-    // Add reference of token to drive.
-    tmp->token = ref(token);
+    if (code == HttpStatus_Unauthorized) {
+        vlogE("OneDriveDrive: access token expired.");
+        oauth_token_set_expired(drive->token);
+        request->result = HIVE_GENERAL_ERROR(HIVEERR_TRY_AGAIN);
+        return;
+    }
 
-    tmp->base.get_info    = onedrive_drive_get_info;
-    tmp->base.stat_file   = onedrive_drive_stat_file;
+    if (code != batch_expected_status(request->op)) {
+        vlogE("OneDriveDrive: error from batch response (%ld) for %s.",
+              code, request->path);
+        request->result = HIVE_HTTP_STATUS_ERROR(code);
+        return;
+    }
+
+    if (request->op == HiveBatchOp_Stat) {
+        body = cJSON_GetObjectItemCaseSensitive(response, "body");
+        if (!body || !cJSON_IsObject(body)) {
+            vlogE("OneDriveDrive: missing body json object.");
+            request->result = HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+            return;
+        }
+
+        request->result = decode_file_info(body, request->info);
+        return;
+    }
+
+    request->result = 0;
+}
+
+static
+int perform_batch(OneDriveDrive *drive, HiveBatchRequest *requests, size_t count)
+{
+    http_client_t *httpc;
+    cJSON *json;
+    cJSON *array;
+    cJSON *item;
+    char *body;
+    long resp_code = 0;
+    size_t submitted = 0;
+    size_t i;
+    int rc;
+
+    json = cJSON_CreateObject();
+    if (!json)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    array = cJSON_AddArrayToObject(json, "requests");
+    if (!array) {
+        cJSON_Delete(json);
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+    }
+
+    for (i = 0; i < count; i++) {
+        item = create_batch_request_item(&requests[i], (int)i);
+        if (!item) {
+            vlogE("OneDriveDrive: failed to create batch request for %s.",
+                  requests[i].path);
+            requests[i].result = HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
+            continue;
+        }
+
+        cJSON_AddItemToArray(array, item);
+        submitted++;
+    }
+
+    if (!submitted) {
+        cJSON_Delete(json);
+        return 0;
+    }
+
+    body = cJSON_PrintUnformatted(json);
+    cJSON_Delete(json);
+    if (!body)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    httpc = http_client_new();
+    if (!httpc) {
+        vlogE("OneDriveDrive: failed to create http client instance.");
+        free(body);
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+    }
+
+    http_client_set_url_escape(httpc, URL_BATCH);
+    http_client_set_method(httpc, HTTP_METHOD_POST);
+    http_client_set_header(httpc, "Content-Type", "application/json");
+    set_auth_headers(httpc, drive->token);
+    http_client_set_request_body_instant(httpc, body, strlen(body));
+    http_client_enable_response_body(httpc);
+
+    rc = http_client_request(httpc);
+    free(body);
+
+    if (rc) {
+        rc = HIVE_CURL_ERROR(rc);
+        vlogE("OneDriveDrive: failed to perform http request.");
+        goto error_exit;
+    }
+
+    rc = http_client_get_response_code(httpc, &resp_code);
+    if (rc) {
+        rc = HIVE_CURL_ERROR(rc);
+        vlogE("OneDriveDrive: failed to get http response code.");
+        goto error_exit;
+    }
+
+    if (resp_code == HttpStatus_Unauthorized) {
+        vlogE("OneDriveDrive: access token expired.");
+        oauth_token_set_expired(drive->token);
+        rc = HIVE_GENERAL_ERROR(HIVEERR_TRY_AGAIN);
+        goto error_exit;
+    }
+
+    if (resp_code != HttpStatus_OK) {
+        vlogE("OneDriveDrive: error from http response (%d).", resp_code);
+        rc = HIVE_HTTP_STATUS_ERROR(resp_code);
+        goto error_exit;
+    }
+
+    if (!http_client_get_response_body(httpc)) {
+        vlogE("OneDriveDrive: failed to get http response body.");
+        rc = HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+        goto error_exit;
+    }
+
+    json = cJSON_Parse(http_client_get_response_body(httpc));
+    http_client_close(httpc);
+
+    array = json ? cJSON_GetObjectItemCaseSensitive(json, "responses") : NULL;
+    if (!array || !cJSON_IsArray(array)) {
+        vlogE("OneDriveDrive: missing responses json object.");
+        cJSON_Delete(json);
+        fail_batch(requests, count, HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT));
+        return 0;
+    }
+
+    // Requests the server did not answer stay failed.
+    for (i = 0; i < count; i++) {
+        if (!requests[i].result)
+            requests[i].result = HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+    }
+
+    cJSON_ArrayForEach(item, array)
+        decode_batch_response(drive, item, requests, count);
+
+    cJSON_Delete(json);
+    return 0;
+
+error_exit:
+    http_client_close(httpc);
+    fail_batch(requests, count, rc);
+    return 0;
+}
+
+static
+int onedrive_drive_batch(HiveDrive *base, HiveBatchRequest *requests,
+                         size_t count)
+{
+    OneDriveDrive *drive = (OneDriveDrive *)base;
+    size_t i;
+    int rc;
+
+    assert(drive);
+    assert(drive->token);
+    assert(requests);
+
+    rc = oauth_token_check_expire(drive->token);
+    if (rc < 0) {
+        vlogE("OneDriveDrive: checking access token expired error.");
+        return rc;
+    }
+
+    // Graph takes at most BATCH_MAX_REQUESTS sub-requests per $batch post.
+    for (i = 0; i < count; i += BATCH_MAX_REQUESTS) {
+        size_t n = count - i;
+
+        if (n > BATCH_MAX_REQUESTS)
+            n = BATCH_MAX_REQUESTS;
+
+        rc = perform_batch(drive, requests + i, n);
+        if (rc < 0)
+            fail_batch(requests + i, n, rc);
+    }
+
+    for (i = 0; i < count; i++) {
+        if (requests[i].op == HiveBatchOp_Stat || requests[i].result)
+            continue;
+
+        invalidate_cache(drive, requests[i].path);
+        if (requests[i].op == HiveBatchOp_Move ||
+            requests[i].op == HiveBatchOp_Copy)
+            invalidate_cache(drive, requests[i].target);
+    }
+
+    return 0;
+}
+
+typedef struct onedrive_drive_op {
+    hive_async_op_t base;
+    hive_async_t *async;
+    http_engine_t *engine;
+    oauth_token_t *token;
+    onedrive_cache_t *cache;
+    long expected_status;
+    char *body;
+    HiveFileInfo *info;
+    HiveFilesIterateCallback *iterate;
+    cJSON *array;
+    json_scanner_t *scanner;
+    list_context_t list;
+    char *mutated[2];           // paths to invalidate on success.
+} onedrive_drive_op_t;
+
+static void onedrive_drive_op_destructor(void *obj)
+{
+    onedrive_drive_op_t *op = (onedrive_drive_op_t *)obj;
+
+    if (op->body)
+        free(op->body);
+
+    if (op->array)
+        cJSON_Delete(op->array);
+
+    if (op->scanner)
+        json_scanner_delete(op->scanner);
+
+    if (op->list.next_link)
+        free(op->list.next_link);
+
+    free(op->mutated[0]);
+    free(op->mutated[1]);
+
+    if (op->token)
+        oauth_token_delete(op->token);
+
+    if (op->cache)
+        deref(op->cache);
+
+    if (op->async)
+        deref(op->async);
+}
+
+static
+onedrive_drive_op_t *onedrive_drive_op_new(OneDriveDrive *drive,
+                                           HiveCompletionCallback *callback,
+                                           void *context, int *rc)
+{
+    onedrive_drive_op_t *op;
+    http_engine_t *engine;
+
+    *rc = oauth_token_check_expire(drive->token);
+    if (*rc < 0) {
+        vlogE("OneDriveDrive: checking access token expired error.");
+        return NULL;
+    }
+
+    engine = hive_async_get_engine(drive->base.async);
+    if (!engine) {
+        *rc = hive_get_error();
+        return NULL;
+    }
+
+    op = hive_async_op_new(sizeof(onedrive_drive_op_t), callback, context,
+                           onedrive_drive_op_destructor);
+    if (!op) {
+        *rc = HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+        return NULL;
+    }
+
+    op->async  = ref(drive->base.async);
+    op->engine = engine;
+    op->token  = ref(drive->token);
+    if (drive->cache)
+        op->cache = ref(drive->cache);
+
+    return op;
+}
+
+static
+http_client_t *onedrive_drive_op_request(onedrive_drive_op_t *op,
+                                         const char *url, http_method_t method)
+{
+    http_client_t *httpc;
+
+    httpc = http_client_new();
+    if (!httpc) {
+        vlogE("OneDriveDrive: failed to create http client instance.");
+        return NULL;
+    }
+
+    http_client_set_url(httpc, url);
+    http_client_set_method(httpc, method);
+    set_auth_headers(httpc, op->token);
+    if (op->body) {
+        http_client_set_header(httpc, "Content-Type", "application/json");
+        http_client_set_request_body_instant(httpc, op->body, strlen(op->body));
+    }
+
+    return httpc;
+}
+
+static
+int onedrive_drive_op_check(onedrive_drive_op_t *op, http_client_t *httpc, int rc)
+{
+    long resp_code = 0;
+
+    if (rc) {
+        vlogE("OneDriveDrive: failed to perform http request.");
+        return HIVE_CURL_ERROR(rc);
+    }
+
+    rc = http_client_get_response_code(httpc, &resp_code);
+    if (rc) {
+        vlogE("OneDriveDrive: failed to get http response code.");
+        return HIVE_CURL_ERROR(rc);
+    }
+
+    if (resp_code == HttpStatus_Unauthorized) {
+        vlogE("OneDriveDrive: access token expired.");
+        oauth_token_set_expired(op->token);
+        return HIVE_GENERAL_ERROR(HIVEERR_TRY_AGAIN);
+    }
+
+    if (resp_code != op->expected_status) {
+        vlogE("OneDriveDrive: error from http response (%d).", resp_code);
+        return HIVE_HTTP_STATUS_ERROR(resp_code);
+    }
+
+    return 0;
+}
+
+static void onedrive_drive_op_complete(onedrive_drive_op_t *op, int rc)
+{
+    hive_async_op_complete(op->async, &op->base, rc);
+}
+
+static void on_status_done(http_client_t *httpc, int rc, void *arg)
+{
+    onedrive_drive_op_t *op = (onedrive_drive_op_t *)arg;
+
+    rc = onedrive_drive_op_check(op, httpc, rc);
+    http_client_close(httpc);
+
+    if (rc == 0 && op->cache) {
+        if (op->mutated[0])
+            onedrive_cache_invalidate(op->cache, op->mutated[0]);
+        if (op->mutated[1])
+            onedrive_cache_invalidate(op->cache, op->mutated[1]);
+    }
+
+    onedrive_drive_op_complete(op, rc);
+}
+
+static int set_mutated_paths(onedrive_drive_op_t *op, const char *path,
+                             const char *target)
+{
+    if (!op->cache)
+        return 0;
+
+    op->mutated[0] = strdup(path);
+    if (target)
+        op->mutated[1] = strdup(target);
+
+    if (!op->mutated[0] || (target && !op->mutated[1])) {
+        vlogE("OneDriveDrive: failed to record mutated paths.");
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+    }
+
+    return 0;
+}
+
+static int onedrive_drive_op_submit(onedrive_drive_op_t *op, const char *url,
+                                    http_method_t method, long expected_status,
+                                    http_client_complete_callback_t cb)
+{
+    http_client_t *httpc;
+
+    op->expected_status = expected_status;
+
+    httpc = onedrive_drive_op_request(op, url, method);
+    if (!httpc) {
+        deref(op);
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+    }
+
+    if (method == HTTP_METHOD_GET) {
+        set_item_projection(httpc, op->iterate != NULL);
+        if (op->scanner)
+            list_context_reset(&op->list, op->scanner, httpc);
+        else
+            http_client_enable_response_body(httpc);
+    }
+
+    http_client_submit(op->engine, httpc, cb, op);
+    return 0;
+}
+
+static void on_stat_done(http_client_t *httpc, int rc, void *arg)
+{
+    onedrive_drive_op_t *op = (onedrive_drive_op_t *)arg;
+    char *p;
+
+    rc = onedrive_drive_op_check(op, httpc, rc);
+    if (rc < 0) {
+        http_client_close(httpc);
+        onedrive_drive_op_complete(op, rc);
+        return;
+    }
+
+    p = http_client_move_response_body(httpc, NULL);
+    http_client_close(httpc);
+
+    if (!p) {
+        vlogE("OneDriveDrive: failed to get response body.");
+        onedrive_drive_op_complete(op, HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY));
+        return;
+    }
+
+    rc = onedrive_decode_file_info(p, op->info);
+    http_client_release_response_body(p);
+
+    onedrive_drive_op_complete(op, rc);
+}
+
+static
+int onedrive_drive_stat_file_async(HiveDrive *base, const char *path,
+                                   HiveFileInfo *info,
+                                   HiveCompletionCallback *callback,
+                                   void *context)
+{
+    OneDriveDrive *drive = (OneDriveDrive *)base;
+    onedrive_drive_op_t *op;
+    char url[MAX_URL_LEN] = {0};
+    int rc;
+
+    if (strlen(path) >= MAX_URL_PARAM_LEN) {
+        vlogE("OneDriveDrive: path too long.");
+        return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
+    }
+
+    op = onedrive_drive_op_new(drive, callback, context, &rc);
+    if (!op)
+        return rc;
+
+    // Only a fresh index is used here, refreshing it would block.
+    if (op->cache) {
+        rc = onedrive_cache_stat(op->cache, path, info);
+        if (rc <= 0) {
+            onedrive_drive_op_complete(op, rc);
+            return 0;
+        }
+    }
+
+    if (!strcmp(path, "/"))
+        sprintf(url, "%s/root", MY_DRIVE);
+    else
+        sprintf(url, "%s/root:%s", MY_DRIVE, path);
+
+    op->info = info;
+    return onedrive_drive_op_submit(op, url, HTTP_METHOD_GET, HttpStatus_OK,
+                                    on_stat_done);
+}
+
+static void deliver_user_files(hive_async_op_t *base)
+{
+    onedrive_drive_op_t *op = (onedrive_drive_op_t *)base;
+
+    if (notify_user_files(op->array, op->iterate, op->base.context))
+        op->iterate(NULL, 0, op->base.context);
+}
+
+static void on_list_page_done(http_client_t *httpc, int rc, void *arg)
+{
+    onedrive_drive_op_t *op = (onedrive_drive_op_t *)arg;
+
+    if (rc && json_scanner_aborted(op->scanner))
+        rc = 0;
+
+    rc = onedrive_drive_op_check(op, httpc, rc);
+    http_client_close(httpc);
+
+    if (rc < 0) {
+        onedrive_drive_op_complete(op, rc);
+        return;
+    }
+
+    rc = finish_page(&op->list, op->scanner);
+    if (rc < 0) {
+        onedrive_drive_op_complete(op, rc);
+        return;
+    }
+
+    if (!op->list.next_link) {
+        op->base.deliver = deliver_user_files;
+        onedrive_drive_op_complete(op, 0);
+        return;
+    }
+
+    httpc = onedrive_drive_op_request(op, op->list.next_link, HTTP_METHOD_GET);
+    free(op->list.next_link);
+    op->list.next_link = NULL;
+    if (!httpc) {
+        onedrive_drive_op_complete(op, HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY));
+        return;
+    }
+
+    list_context_reset(&op->list, op->scanner, httpc);
+    http_client_submit(op->engine, httpc, on_list_page_done, op);
+}
+
+static
+int onedrive_drive_list_files_async(HiveDrive *base, const char *path,
+                                    HiveFilesIterateCallback *iterate,
+                                    HiveCompletionCallback *callback,
+                                    void *context)
+{
+    OneDriveDrive *drive = (OneDriveDrive *)base;
+    onedrive_drive_op_t *op;
+    char url[MAX_URL_LEN] = {0};
+    int rc;
+
+    if (strlen(path) >= MAX_URL_PARAM_LEN) {
+        vlogE("OneDriveDrive: path too long.");
+        return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
+    }
+
+    op = onedrive_drive_op_new(drive, callback, context, &rc);
+    if (!op)
+        return rc;
+
+    op->iterate = iterate;
+
+    if (op->cache) {
+        rc = onedrive_cache_list(op->cache, path, &op->array);
+        if (rc <= 0) {
+            if (rc == 0)
+                op->base.deliver = deliver_user_files;
+            onedrive_drive_op_complete(op, rc);
+            return 0;
+        }
+    }
+
+    // Items are collected off the engine thread and handed out on delivery.
+    op->array = cJSON_CreateArray();
+    op->scanner = json_scanner_new("value", on_list_item, &op->list);
+    if (!op->array || !op->scanner) {
+        vlogE("OneDriveDrive: failed to create listing state.");
+        deref(op);
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+    }
+
+    op->list.array = op->array;
+
+    if (!strcmp(path, "/"))
+        sprintf(url, "%s/root/children", MY_DRIVE);
+    else
+        sprintf(url, "%s/root:%s:/children", MY_DRIVE, path);
+
+    return onedrive_drive_op_submit(op, url, HTTP_METHOD_GET, HttpStatus_OK,
+                                    on_list_page_done);
+}
+
+static
+int onedrive_drive_mkdir_async(HiveDrive *base, const char *path,
+                               HiveCompletionCallback *callback, void *context)
+{
+    OneDriveDrive *drive = (OneDriveDrive *)base;
+    onedrive_drive_op_t *op;
+    char url[MAX_URL_LEN] = {0};
+    char path_tmp[PATH_MAX];
+    char *dir;
+    int rc;
+
+    if (strlen(path) >= MAX_URL_PARAM_LEN) {
+        vlogE("OneDriveDrive: path too long.");
+        return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
+    }
+
+    op = onedrive_drive_op_new(drive, callback, context, &rc);
+    if (!op)
+        return rc;
+
+    strcpy(path_tmp, path);
+    dir = dirname(path_tmp);
+    if (!strcmp(dir, "/"))
+        sprintf(url, "%s/root/children", MY_DRIVE);
+    else
+        sprintf(url, "%s/root:%s:/children", MY_DRIVE, dir);
+
+    op->body = create_mkdir_request_body(path);
+    if (!op->body) {
+        vlogE("OneDriveDrive: failed to create http request body.");
+        deref(op);
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+    }
+
+    rc = set_mutated_paths(op, path, NULL);
+    if (rc < 0) {
+        deref(op);
+        return rc;
+    }
+
+    return onedrive_drive_op_submit(op, url, HTTP_METHOD_POST,
+                                    HttpStatus_Created, on_status_done);
+}
+
+static
+int onedrive_drive_move_file_async(HiveDrive *base, const char *old,
+                                   const char *new,
+                                   HiveCompletionCallback *callback,
+                                   void *context)
+{
+    OneDriveDrive *drive = (OneDriveDrive *)base;
+    onedrive_drive_op_t *op;
+    char url[MAX_URL_LEN] = {0};
+    int rc;
+
+    if (strlen(old) >= MAX_URL_PARAM_LEN ||
+        strlen(new) >= MAX_URL_PARAM_LEN) {
+        vlogE("OneDriveDrive: failed to move file: path too long.");
+        return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
+    }
+
+    op = onedrive_drive_op_new(drive, callback, context, &rc);
+    if (!op)
+        return rc;
+
+    sprintf(url, "%s/root:%s", MY_DRIVE, old);
+
+    op->body = create_cp_mv_request_body(new);
+    if (!op->body) {
+        vlogE("OneDriveDrive: failed to create request body.");
+        deref(op);
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+    }
+
+    rc = set_mutated_paths(op, old, new);
+    if (rc < 0) {
+        deref(op);
+        return rc;
+    }
+
+    return onedrive_drive_op_submit(op, url, HTTP_METHOD_PATCH,
+                                    HttpStatus_OK, on_status_done);
+}
+
+static
+int onedrive_drive_copy_file_async(HiveDrive *base, const char *src,
+                                   const char *dest,
+                                   HiveCompletionCallback *callback,
+                                   void *context)
+{
+    OneDriveDrive *drive = (OneDriveDrive *)base;
+    onedrive_drive_op_t *op;
+    char url[MAX_URL_LEN] = {0};
+    int rc;
+
+    if (strlen(src) >= MAX_URL_PARAM_LEN ||
+        strlen(dest) >= MAX_URL_PARAM_LEN) {
+        vlogE("OneDriveDrive: path too long.");
+        return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
+    }
+
+    op = onedrive_drive_op_new(drive, callback, context, &rc);
+    if (!op)
+        return rc;
+
+    sprintf(url, "%s/root:%s:/copy", MY_DRIVE, src);
+
+    op->body = create_cp_mv_request_body(dest);
+    if (!op->body) {
+        vlogE("OneDriveDrive: failed to create http request body.");
+        deref(op);
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+    }
+
+    rc = set_mutated_paths(op, dest, NULL);
+    if (rc < 0) {
+        deref(op);
+        return rc;
+    }
+
+    // Same as the synchronous version, the completion of the copy action
+    // on server side is not waited for.
+    return onedrive_drive_op_submit(op, url, HTTP_METHOD_POST,
+                                    HttpStatus_Accepted, on_status_done);
+}
+
+static
+int onedrive_drive_delete_file_async(HiveDrive *base, const char *path,
+                                     HiveCompletionCallback *callback,
+                                     void *context)
+{
+    OneDriveDrive *drive = (OneDriveDrive *)base;
+    onedrive_drive_op_t *op;
+    char url[MAX_URL_LEN] = {0};
+    int rc;
+
+    if (strlen(path) >= MAX_URL_PARAM_LEN) {
+        vlogE("OneDriveDrive: path too long.");
+        return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
+    }
+
+    op = onedrive_drive_op_new(drive, callback, context, &rc);
+    if (!op)
+        return rc;
+
+    sprintf(url, "%s/root:%s:", MY_DRIVE, path);
+
+    rc = set_mutated_paths(op, path, NULL);
+    if (rc < 0) {
+        deref(op);
+        return rc;
+    }
+
+    return onedrive_drive_op_submit(op, url, HTTP_METHOD_DELETE,
+                                    HttpStatus_NoContent, on_status_done);
+}
+
+static int onedrive_drive_open_file(HiveDrive *base, const char *path,
+                                    int flags, HiveFile **file)
+{
+    OneDriveDrive *drive = (OneDriveDrive *)base;
+
+    if (strlen(path) >= MAX_URL_PARAM_LEN) {
+        vlogE("OneDriveDrive: path too long.");
+        return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
+    }
+
+    return onedrive_file_open(drive->token, path, flags, drive->tmp_template,
+                              &drive->upload_opts, drive->cache, file);
+}
+
+static void onedrive_drive_close(HiveDrive *base)
+{
+    assert(base);
+
+    deref(base);
+}
+
+static void onedrive_drive_destructor(void *obj)
+{
+    OneDriveDrive *drive = (OneDriveDrive *)obj;
+
+    if (drive->token)
+        oauth_token_delete(drive->token);
+
+    if (drive->cache)
+        deref(drive->cache);
+}
+
+int onedrive_drive_open(oauth_token_t *token, const char *driveid,
+                        const char *tmp_template,
+                        const onedrive_upload_options_t *upload_opts,
+                        onedrive_cache_t *cache, HiveDrive **drive)
+{
+    OneDriveDrive *tmp;
+
+    assert(token);
+    assert(driveid);
+    assert(upload_opts);
+    assert(drive);
+
+    /*
+     * If param @driveid equals "default", then use the default drive.
+     * otherwise, use the drive with specific driveid.
+     */
+
+    tmp = (OneDriveDrive *)rc_zalloc(sizeof(OneDriveDrive), onedrive_drive_destructor);
+    if (!tmp)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    // Add reference of token to drive.
+    tmp->token = ref(token);
+    if (cache)
+        tmp->cache = ref(cache);
+
+    tmp->base.get_info    = onedrive_drive_get_info;
+    tmp->base.stat_file   = onedrive_drive_stat_file;
     tmp->base.list_files  = onedrive_drive_list_files;
     tmp->base.make_dir    = onedrive_drive_mkdir;
     tmp->base.move_file   = onedrive_drive_move_file;
     tmp->base.copy_file   = onedrive_drive_copy_file;
     tmp->base.delete_file = onedrive_drive_delete_file;
     tmp->base.open_file   = onedrive_drive_open_file;
+    tmp->base.batch       = onedrive_drive_batch;
     tmp->base.close       = onedrive_drive_close;
 
+    tmp->base.stat_file_async   = onedrive_drive_stat_file_async;
+    tmp->base.list_files_async  = onedrive_drive_list_files_async;
+    tmp->base.make_dir_async    = onedrive_drive_mkdir_async;
+    tmp->base.move_file_async   = onedrive_drive_move_file_async;
+    tmp->base.copy_file_async   = onedrive_drive_copy_file_async;
+    tmp->base.delete_file_async = onedrive_drive_delete_file_async;
+
     sprintf(tmp->tmp_template, "%s", tmp_template);
+    tmp->upload_opts = *upload_opts;
 
     *drive = &tmp->base;
 
@@ -20,9 +20,11 @@
  * SOFTWARE.
  */
 
+#include <stdio.h>
 #include <errno.h>
 #include <limits.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <sys/stat.h>
 
 #ifdef HAVE_UNISTD_H
@@ -40,21 +42,70 @@
 #include "ela_hive.h"
 #include "hive_client.h"
 #include "oauth_token.h"
+#include "onedrive_misc.h"
 #include "onedrive_constants.h"
+#include "onedrive_upload.h"
 #include "http_client.h"
 #include "http_status.h"
+#include "hive_async.h"
+
+#define MIN(a,b) ((a) <= (b) ? (a) : (b))
+
+/*
+ * Read-only files are not downloaded at open. The temporary file is sized
+ * to the remote object and left sparse; reads fetch the touched blocks with
+ * HTTP Range requests and record them in a sorted, merged extent list.
+ */
+#define LAZY_READ_BLOCK_SIZE (1024U * 1024)
+
+// Properties decode_file_stat() requires, shared by sync and async stats.
+#define FILE_STAT_SELECT "cTag,size,file,@microsoft.graph.downloadUrl"
+
+typedef struct onedrive_extent {
+    size_t start;
+    size_t end;
+} onedrive_extent_t;
+
+typedef struct onedrive_extents {
+    onedrive_extent_t *items;
+    size_t count;
+    size_t capacity;
+} onedrive_extents_t;
+
+typedef struct file_stat {
+    char ctag[MAX_CTAG_LEN];
+    char dl_url[MAX_URL_LEN];
+    char hash[ONEDRIVE_QUICKXOR_HASH_LEN];
+    size_t size;
+} file_stat_t;
 
 typedef struct OneDriveFile {
     HiveFile base;
     oauth_token_t *token;
+    onedrive_cache_t *cache;
     bool dirty;
     int fd;
     char tmp_path[PATH_MAX];
     // upstream properties
     char ctag[MAX_CTAG_LEN];
     char dl_url[MAX_URL_LEN];
+    char hash[ONEDRIVE_QUICKXOR_HASH_LEN];
+    size_t size;
+    size_t upload_fragment_size;
+    unsigned int upload_parallelism;
+    // private engine running the fragment uploads of commit().
+    http_engine_t *engine;
+    // lazy read-only state: backing file is sparse, extents mark what is local
+    bool lazy;
+    onedrive_extents_t cached;
+    // local changes since open or the last commit
+    bool truncated;
+    onedrive_extents_t written;
 } OneDriveFile;
 
+static int extent_add(onedrive_extents_t *extents, size_t start, size_t end);
+static int ensure_range(OneDriveFile *file, size_t off, size_t len);
+
 static ssize_t onedrive_file_lseek(HiveFile *base, ssize_t offset, Whence whence)
 {
     OneDriveFile *file = (OneDriveFile *)base;
@@ -91,6 +142,22 @@ static ssize_t onedrive_file_read(HiveFile *base, char *buf, size_t bufsz)
     OneDriveFile *file = (OneDriveFile *)base;
     ssize_t rc;
 
+    if (file->lazy) {
+        off_t pos = lseek(file->fd, 0, SEEK_CUR);
+
+        if (pos < 0) {
+            vlogE("OneDriveFile: failed to call lseek() (%d).", errno);
+            return HIVE_SYS_ERROR(errno);
+        }
+
+        if ((size_t)pos < file->size) {
+            rc = ensure_range(file, (size_t)pos,
+                              MIN(bufsz, file->size - (size_t)pos));
+            if (rc < 0)
+                return rc;
+        }
+    }
+
     rc = read(file->fd, buf, (unsigned)bufsz);
     if (rc < 0) {
         vlogE("OneDriveFile: failed to call read().");
@@ -103,34 +170,41 @@ static ssize_t onedrive_file_read(HiveFile *base, char *buf, size_t bufsz)
 static ssize_t onedrive_file_write(HiveFile *base, const char *buf, size_t bufsz)
 {
     OneDriveFile *file = (OneDriveFile *)base;
+    off_t pos;
     ssize_t nwr;
 
+    pos = lseek(file->fd, 0, SEEK_CUR);
+    if (pos < 0) {
+        vlogE("OneDriveFile: failed to call lseek() (%d).", errno);
+        return HIVE_SYS_ERROR(errno);
+    }
+
     nwr = write(file->fd, buf, (unsigned)bufsz);
     if (nwr < 0) {
         vlogE("OneDriveFile: failed to read: failed to call write().");
         return HIVE_SYS_ERROR(errno);
     }
 
+    // Without the written extents, the content is treated as all changed.
+    if (extent_add(&file->written, (size_t)pos, (size_t)pos + nwr) < 0)
+        file->truncated = true;
+
     file->dirty = true;
     return nwr;
 }
 
-static int create_upload_session(OneDriveFile *file,
-                                 http_client_t *httpc,
-                                 char *upload_url, size_t upload_url_len)
+static int create_upload_session(OneDriveFile *file, http_client_t *httpc,
+                                 char **session)
 {
     char url[MAX_URL_LEN] = {0};
     long resp_code = 0;
     int rc;
-    char *p;
-    cJSON *session;
-    cJSON *upload_url_json;
 
     sprintf(url, "%s/root:%s:/createUploadSession", MY_DRIVE, file->base.path);
 
     http_client_set_url(httpc, url);
     http_client_set_method(httpc, HTTP_METHOD_POST);
-    http_client_set_header(httpc, "Authorization", get_bearer_token(file->token));
+    set_auth_headers(httpc, file->token);
     http_client_set_request_body_instant(httpc, NULL, 0);
     if (file->ctag[0])
         http_client_set_header(httpc, "if-match", file->ctag);
@@ -159,124 +233,95 @@ static int create_upload_session(OneDriveFile *file,
         return HIVE_HTTP_STATUS_ERROR(resp_code);
     }
 
-    p = http_client_move_response_body(httpc, NULL);
-    if (!p) {
+    *session = http_client_move_response_body(httpc, NULL);
+    if (!*session) {
         vlogE("OneDriveFile: failed to get http response body.");
         return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
     }
 
-    session = cJSON_Parse(p);
-    free(p);
+    return 0;
+}
 
-    if (!session) {
-        vlogE("OneDriveFile: failed to parse json object from response.");
-        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+static int get_session_status(http_client_t *httpc, const char *upload_url,
+                              char **status)
+{
+    long resp_code = 0;
+    int rc;
+
+    http_client_set_url(httpc, upload_url);
+    http_client_set_method(httpc, HTTP_METHOD_GET);
+    http_client_enable_response_body(httpc);
+
+    rc = http_client_request(httpc);
+    if (rc) {
+        vlogE("OneDriveFile: failed to perform http request.");
+        return HIVE_CURL_ERROR(rc);
     }
 
-    upload_url_json = cJSON_GetObjectItemCaseSensitive(session, "uploadUrl");
-    if (!upload_url_json || !cJSON_IsString(upload_url_json) ||
-        !upload_url_json->valuestring || !*upload_url_json->valuestring) {
-        vlogE("OneDriveFile: failed to create json object.");
-        cJSON_Delete(session);
-        return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+    rc = http_client_get_response_code(httpc, &resp_code);
+    if (rc) {
+        vlogE("OneDriveFile: failed to get http response code.");
+        return HIVE_CURL_ERROR(rc);
+    }
+
+    if (resp_code != HttpStatus_OK) {
+        vlogE("OneDriveFile: error from http response (%d).", resp_code);
+        return HIVE_HTTP_STATUS_ERROR(resp_code);
     }
 
-    rc = snprintf(upload_url, upload_url_len, "%s", upload_url_json->valuestring);
-    cJSON_Delete(session);
-    if (rc < 0 || rc >= upload_url_len) {
-        vlogE("OneDriveFile: upload URL too long.");
-        return HIVE_GENERAL_ERROR(HIVEERR_BUFFER_TOO_SMALL);
+    *status = http_client_move_response_body(httpc, NULL);
+    if (!*status) {
+        vlogE("OneDriveFile: failed to get http response body.");
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
     }
 
     return 0;
 }
 
-#define MIN(a,b) ((a) <= (b) ? (a) : (b))
-static size_t upload_to_session_request_body_cb(char *buffer,
-                                                size_t size, size_t nitems,
-                                                void *userdata)
+/*
+ * Upload journals live in the directory of the temporary files, which is
+ * under the persistent location of the client.
+ */
+static void get_journal_dir(OneDriveFile *file, char *dir, size_t len)
 {
-    size_t *ul_sz = (size_t *)(((void **)userdata)[0]);
-    size_t *uled_sz = (size_t *)(((void **)userdata)[1]);
-    int fd = *((int *)(((void **)userdata)[2]));
-    size_t sz2ul;
-    ssize_t nrd;
-
-    if (*ul_sz == *uled_sz)
-        return 0;
-
-    sz2ul = MIN(*ul_sz - *uled_sz, size * nitems);
-    nrd = read(fd, buffer, (unsigned)sz2ul);
-    if (nrd < 0) {
-        vlogE("OneDriveFile: failed to call read().");
-        return HTTP_CLIENT_REQBODY_ABORT;
-    }
+    char *p;
 
-    *uled_sz += nrd;
-    vlogI("OneDriveFile: Successfully read %d bytes from temporary file to be uploaded.", nrd);
-    return (size_t)nrd;
+    snprintf(dir, len, "%s", file->tmp_path);
+    p = strrchr(dir, '/');
+    if (p)
+        *p = '\0';
 }
 
-#define HTTP_PUT_MAX_CHUNK_SIZE (60U * 1024 * 1024)
-static int upload_to_session(OneDriveFile *file, http_client_t *httpc,
-                             const char *upload_url)
+static int prepare_upload(OneDriveFile *file, onedrive_uploader_t *up,
+                          http_engine_t *engine,
+                          onedrive_upload_complete_t *complete)
 {
-    long resp_code = 0;
-    size_t fsize = lseek(file->fd, 0, SEEK_END);
-    size_t ul_off;
-    size_t ul_sz;
-    int rc;
-
-    lseek(file->fd, 0, SEEK_SET);
-    ul_off = 0;
-    ul_sz = fsize % HTTP_PUT_MAX_CHUNK_SIZE;
-    while (ul_sz) {
-        char header[128];
-        size_t uled_sz = 0;
-        void *userdata[] = {&ul_sz, &uled_sz, &file->fd};
-
-        http_client_set_url(httpc, upload_url);
-        http_client_set_method(httpc, HTTP_METHOD_PUT);
-        sprintf(header, "%zu", ul_sz);
-        http_client_set_header(httpc, "Content-Length", header);
-        sprintf(header, "bytes %zu-%zu/%zu", ul_off, ul_off + ul_sz - 1, fsize);
-        http_client_set_header(httpc, "Content-Range", header);
-        http_client_set_header(httpc, "Transfer-Encoding", "");
-        http_client_set_header(httpc, "Expect", "");
-        http_client_set_request_body(httpc,
-                                     upload_to_session_request_body_cb,
-                                     userdata);
-
-        rc = http_client_request(httpc);
-        if (rc) {
-            vlogE("OneDriveFile: failed to perform http request.");
-            return HIVE_CURL_ERROR(rc);
-        }
+    char journal_dir[PATH_MAX];
+    struct stat st;
 
-        ul_off += ul_sz;
-        ul_sz = (fsize - ul_off) % HTTP_PUT_MAX_CHUNK_SIZE;
+    if (fstat(file->fd, &st) < 0) {
+        vlogE("OneDriveFile: failed to call fstat() (%d).", errno);
+        return HIVE_SYS_ERROR(errno);
+    }
 
-        rc = http_client_get_response_code(httpc, &resp_code);
-        if (rc) {
-            vlogE("OneDriveFile: failed to get http response code.");
-            return HIVE_CURL_ERROR(rc);
-        }
+    onedrive_uploader_init(up, file->fd, (size_t)st.st_size,
+                           file->upload_fragment_size, file->upload_parallelism,
+                           file->ctag[0] != '\0', engine, complete);
 
-        if ((ul_sz && resp_code != HttpStatus_Accepted) ||
-            (!ul_sz && ((!file->ctag[0] && resp_code != HttpStatus_Created) ||
-                        (file->ctag[0] && resp_code != HttpStatus_OK)))) {
-            vlogE("OneDriveFile: error from http response (%d).", resp_code);
-            return HIVE_HTTP_STATUS_ERROR(resp_code);
-        }
-    }
+    get_journal_dir(file, journal_dir, sizeof(journal_dir));
+    return onedrive_uploader_open_journal(up, journal_dir, file->base.path);
+}
 
-    return 0;
+static void on_sync_upload_complete(onedrive_uploader_t *up, int rc)
+{
+    up->rc = rc;
 }
 
 static int upload_file(OneDriveFile *file)
 {
+    onedrive_uploader_t up;
     http_client_t *httpc;
-    char upload_url[MAX_URL_LEN] = {0};
+    char *body = NULL;
     int rc;
 
     rc = oauth_token_check_expire(file->token);
@@ -285,25 +330,66 @@ static int upload_file(OneDriveFile *file)
         return rc;
     }
 
+    if (!file->engine) {
+        file->engine = http_engine_new();
+        if (!file->engine)
+            return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+    }
+
+    rc = prepare_upload(file, &up, file->engine, on_sync_upload_complete);
+    if (rc < 0)
+        return rc;
+
     httpc = http_client_new();
     if (!httpc) {
         vlogE("OneDriveFile: failed to create http client instance.");
         return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
     }
 
-    rc = create_upload_session(file, httpc, upload_url, sizeof(upload_url));
+    if (rc > 0) {
+        rc = get_session_status(httpc, up.upload_url, &body);
+        if (rc == 0) {
+            rc = onedrive_uploader_resume(&up, body);
+            http_client_release_response_body(body);
+        }
+
+        if (rc < 0) {
+            vlogW("OneDriveFile: can not resume upload session, starting over.");
+            onedrive_uploader_discard_journal(&up);
+            http_client_reset(httpc);
+        }
+    } else
+        rc = -1;
+
     if (rc < 0) {
-        vlogE("OneDriveFile: failed to create upload session.");
-        http_client_close(httpc);
-        return rc;
-    }
+        rc = create_upload_session(file, httpc, &body);
+        if (rc < 0) {
+            vlogE("OneDriveFile: failed to create upload session.");
+            http_client_close(httpc);
+            return rc;
+        }
 
-    vlogI("OneDriveFile: Susscessfully created an upload session.");
+        vlogI("OneDriveFile: Susscessfully created an upload session.");
 
-    http_client_reset(httpc);
+        rc = onedrive_uploader_start(&up, body);
+        http_client_release_response_body(body);
+    }
 
-    rc = upload_to_session(file, httpc, upload_url);
     http_client_close(httpc);
+
+    while (rc == 0 && !up.finished) {
+        if (http_engine_perform(file->engine, 100) < 0) {
+            // Closing the engine aborts and completes what is in flight.
+            http_engine_close(file->engine);
+            file->engine = NULL;
+            rc = HIVE_GENERAL_ERROR(HIVEERR_TRY_AGAIN);
+        }
+    }
+
+    if (rc == 0)
+        rc = up.rc;
+
+    onedrive_uploader_cleanup(&up);
     if (rc < 0) {
         vlogE("OneDriveFile: failed to upload to session.");
         return rc;
@@ -327,6 +413,9 @@ static void onedrive_file_destructor(void *obj)
 {
     OneDriveFile *file = (OneDriveFile *)obj;
 
+    if (file->engine)
+        http_engine_close(file->engine);
+
     if (file->fd >= 0)
         close(file->fd);
 
@@ -335,20 +424,82 @@ static void onedrive_file_destructor(void *obj)
 
     if (file->token)
         oauth_token_delete(file->token);
+
+    if (file->cache)
+        deref(file->cache);
+
+    if (file->cached.items)
+        free(file->cached.items);
+
+    if (file->written.items)
+        free(file->written.items);
+}
+
+static int decode_file_stat(const char *body, file_stat_t *st)
+{
+    cJSON *fstat;
+    cJSON *item;
+
+    fstat = cJSON_Parse(body);
+    if (!fstat) {
+        vlogE("OneDriveFile: bad json format for response.");
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+    }
+
+    if (!cJSON_GetObjectItemCaseSensitive(fstat, "file")) {
+        vlogE("OneDriveFile: missing file json object for response.");
+        cJSON_Delete(fstat);
+        return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+    }
+
+    item = cJSON_GetObjectItemCaseSensitive(fstat, "@microsoft.graph.downloadUrl");
+    if (!cJSON_IsString(item) || !item->valuestring || !*item->valuestring ||
+        strlen(item->valuestring) >= sizeof(st->dl_url)) {
+        vlogE("OneDriveFile: missing @microsoft.graph.downloadUrl json object for response.");
+        cJSON_Delete(fstat);
+        return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+    }
+    strcpy(st->dl_url, item->valuestring);
+
+    item = cJSON_GetObjectItemCaseSensitive(fstat, "cTag");
+    if (!cJSON_IsString(item) || !item->valuestring || !*item->valuestring ||
+        strlen(item->valuestring) >= sizeof(st->ctag)) {
+        vlogE("OneDriveFile: missing cTag json object for response.");
+        cJSON_Delete(fstat);
+        return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+    }
+    strcpy(st->ctag, item->valuestring);
+
+    item = cJSON_GetObjectItemCaseSensitive(fstat, "size");
+    if (!cJSON_IsNumber(item) || item->valuedouble < 0) {
+        vlogE("OneDriveFile: missing size json object for response.");
+        cJSON_Delete(fstat);
+        return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+    }
+    st->size = (size_t)item->valuedouble;
+
+    // Not every drive type reports a quickXorHash.
+    item = cJSON_GetObjectItemCaseSensitive(
+                cJSON_GetObjectItemCaseSensitive(
+                    cJSON_GetObjectItemCaseSensitive(fstat, "file"), "hashes"),
+                "quickXorHash");
+    if (cJSON_IsString(item) && item->valuestring &&
+        strlen(item->valuestring) < sizeof(st->hash))
+        strcpy(st->hash, item->valuestring);
+    else
+        st->hash[0] = '\0';
+
+    cJSON_Delete(fstat);
+    return 0;
 }
 
 static int get_file_stat(oauth_token_t *token, const char *path,
-                         char *ctag, size_t ctag_len,
-                         char *dl_url, size_t dl_url_len)
+                         file_stat_t *st)
 {
     http_client_t *httpc;
     char url[MAX_URL_LEN] = {0};
-    char *p;
     long resp_code = 0;
     int rc;
-    cJSON *fstat;
-    cJSON *download_url_json;
-    cJSON *ctag_json;
 
     assert(token);
     assert(path);
@@ -369,9 +520,9 @@ static int get_file_stat(oauth_token_t *token, const char *path,
     sprintf(url, "%s/root:%s", MY_DRIVE, path);
 
     http_client_set_url(httpc, url);
-    http_client_set_query(httpc, "select", "cTag,file,@microsoft.graph.downloadUrl");
+    http_client_set_query(httpc, "$select", FILE_STAT_SELECT);
     http_client_set_method(httpc, HTTP_METHOD_GET);
-    http_client_set_header(httpc, "Authorization", get_bearer_token(token));
+    set_auth_headers(httpc, token);
     http_client_enable_response_body(httpc);
 
     rc = http_client_request(httpc);
@@ -401,57 +552,27 @@ static int get_file_stat(oauth_token_t *token, const char *path,
         goto error_exit;
     }
 
-    p = http_client_move_response_body(httpc, NULL);
-    http_client_close(httpc);
-
-    if (!p) {
+    if (!http_client_get_response_body(httpc)) {
         vlogE("OneDriveFile: failed to get http response body.");
-        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
-    }
-
-    fstat = cJSON_Parse(p);
-    free(p);
-
-    if (!fstat) {
-        vlogE("OneDriveFile: bad json format for response.");
-        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
-    }
-
-    if (!cJSON_GetObjectItemCaseSensitive(fstat, "file")) {
-        vlogE("OneDriveFile: missing file json object for response.");
-        cJSON_Delete(fstat);
-        return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
-    }
-
-    download_url_json =
-    cJSON_GetObjectItemCaseSensitive(fstat, "@microsoft.graph.downloadUrl");
-    if (!download_url_json || !download_url_json->string ||
-        !*download_url_json->valuestring ||
-        strlen(download_url_json->valuestring) >= dl_url_len) {
-        vlogE("OneDriveFile: missing @microsoft.graph.downloadUrl json object for response.");
-        cJSON_Delete(fstat);
-        return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
-    }
-    strcpy(dl_url, download_url_json->valuestring);
-
-    ctag_json = cJSON_GetObjectItemCaseSensitive(fstat, "cTag");
-    if (!ctag_json || !ctag_json->string || !*ctag_json->valuestring ||
-        strlen(ctag_json->valuestring) >= ctag_len) {
-        vlogE("OneDriveFile: missing cTag json object for response.");
-        cJSON_Delete(fstat);
-        return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+        rc = HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+        goto error_exit;
     }
-    strcpy(ctag, ctag_json->valuestring);
 
-    cJSON_Delete(fstat);
-
-    return 0;
+    rc = decode_file_stat(http_client_get_response_body(httpc), st);
 
 error_exit:
     http_client_close(httpc);
     return rc;
 }
 
+static void set_remote_stat(OneDriveFile *file, const file_stat_t *st)
+{
+    strcpy(file->ctag, st->ctag);
+    strcpy(file->dl_url, st->dl_url);
+    strcpy(file->hash, st->hash);
+    file->size = st->size;
+}
+
 static size_t response_body_callback(char *buffer, size_t size,
                                      size_t nitems, void *userdata)
 {
@@ -513,121 +634,752 @@ error_exit:
     return rc;
 }
 
-static int onedrive_file_commit(HiveFile *base)
+static int extent_add(onedrive_extents_t *extents, size_t start, size_t end)
 {
-    OneDriveFile *file = (OneDriveFile *)base;
-    int rc = 0;
+    onedrive_extent_t *items = extents->items;
+    size_t i, j;
 
-    if (!file->dirty)
+    if (start >= end)
         return 0;
 
-    rc = upload_file(file);
-    if (rc < 0) {
-        vlogE("OneDriveFile: failed to commit temporary file.");
-        return rc;
+    // Skip extents ending before the new one, then absorb the overlapping ones.
+    for (i = 0; i < extents->count && items[i].end < start; i++);
+    for (j = i; j < extents->count && items[j].start <= end; j++) {
+        start = MIN(start, items[j].start);
+        end = items[j].end > end ? items[j].end : end;
     }
 
-    file->dirty = false;
+    if (i == j) {
+        if (extents->count == extents->capacity) {
+            size_t cap = extents->capacity ? extents->capacity * 2 : 8;
 
-    rc = get_file_stat(file->token, base->path,
-                       file->ctag, sizeof(file->ctag),
-                       file->dl_url, sizeof(file->dl_url));
-    if (rc < 0) {
-        vlogE("OneDriveFile: failed to get file status.");
-        return rc;
+            items = realloc(extents->items, cap * sizeof(onedrive_extent_t));
+            if (!items)
+                return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+            extents->items = items;
+            extents->capacity = cap;
+        }
+
+        memmove(items + i + 1, items + i,
+                (extents->count - i) * sizeof(onedrive_extent_t));
+        extents->count++;
+    } else if (j - i > 1) {
+        memmove(items + i + 1, items + j,
+                (extents->count - j) * sizeof(onedrive_extent_t));
+        extents->count -= j - i - 1;
     }
 
+    items[i].start = start;
+    items[i].end = end;
     return 0;
 }
 
-static int onedrive_file_discard(HiveFile *base)
+static bool extent_covered(onedrive_extents_t *extents, size_t start, size_t end)
 {
-    OneDriveFile *file = (OneDriveFile *)base;
-    int rc;
+    size_t i;
 
-    if (!file->dirty)
-        return 0;
-
-    ftruncate(file->fd, 0);
-    lseek(file->fd, 0, SEEK_SET);
-
-    if (!file->ctag[0])
-        return 0;
+    for (i = 0; i < extents->count; i++) {
+        if (extents->items[i].end < end)
+            continue;
+        return extents->items[i].start <= start;
+    }
 
-    rc = download_file(file->fd, file->dl_url);
-    file->dirty = false;
-    if (rc < 0)
-        return rc;
-    lseek(file->fd, 0, SEEK_SET);
+    return false;
+}
 
-    return 0;
+static void extents_clear(onedrive_extents_t *extents)
+{
+    extents->count = 0;
 }
 
-#if defined(_WIN32) || defined(_WIN64)
-static int mkstemp(char *template)
+typedef struct range_context {
+    http_client_t *httpc;
+    int fd;
+    bool started;
+    bool whole;
+    size_t received;
+} range_context_t;
+
+static size_t range_body_callback(char *buffer, size_t size,
+                                  size_t nitems, void *userdata)
 {
-    errno_t err;
+    range_context_t *ctx = (range_context_t *)userdata;
+    size_t total_sz = size * nitems;
+    long resp_code = 0;
+    ssize_t nwr;
 
-    err = _mktemp_s(template, strlen(template) + 1);
-    if (err) {
-        errno = err;
-        vlogE("OneDriveFile: failed to call _mktemp_s() (%d).", errno);
-        return -1;
+    if (!ctx->started) {
+        ctx->started = true;
+        http_client_get_response_code(ctx->httpc, &resp_code);
+        if (resp_code == HttpStatus_OK) {
+            // Server ignored the Range header and sends the whole object.
+            ctx->whole = true;
+            lseek(ctx->fd, 0, SEEK_SET);
+        } else if (resp_code != HttpStatus_PartialContent)
+            return total_sz;
     }
 
-    return open(template, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+    nwr = write(ctx->fd, buffer, (unsigned)total_sz);
+    if (nwr < 0) {
+        vlogE("OneDriveFile: calling write() failure.");
+        return 0;
+    }
+
+    ctx->received += (size_t)nwr;
+    return (size_t)nwr;
 }
-#endif
 
-int onedrive_file_open(oauth_token_t *token, const char *path,
-                       int flags, const char *tmp_template, HiveFile **file)
+static int download_range(OneDriveFile *file, size_t start, size_t end)
 {
-    OneDriveFile *tmp;
-    bool file_exists;
-    char download_url[MAX_URL_LEN];
-    char ctag[MAX_CTAG_LEN];
+    range_context_t ctx;
+    http_client_t *httpc;
+    char range[64];
+    long resp_code = 0;
     int rc;
 
-    rc = get_file_stat(token, path, ctag, sizeof(ctag),
-                       download_url, sizeof(download_url));
-    if (rc < 0 && rc != HIVE_HTTP_STATUS_ERROR(HttpStatus_NotFound)) {
-        vlogE("OneDriveFile: get file status failure.");
-        return rc;
+    httpc = http_client_new();
+    if (!httpc) {
+        vlogE("OneDriveFile: failed to create http client.");
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
     }
 
-    file_exists = !rc ? true : false;
-
-    if (HIVE_F_IS_EQ(flags, HIVE_F_RDONLY)) {
-        if (!file_exists) {
-            vlogE("OneDriveFile: set readonly flag while file does not exist.");
-            return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
-        }
-    } else if (HIVE_F_IS_SET(flags, HIVE_F_CREAT | HIVE_F_EXCL) && file_exists) {
-        vlogE("OneDriveFile: set EXCL flag while file exists.");
-        return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
-    } else if (!HIVE_F_IS_SET(flags, HIVE_F_CREAT) && !file_exists) {
-        vlogE("OneDriveFile: set no CREAT flag while file does not exist.");
-        return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
+    if (lseek(file->fd, (long)start, SEEK_SET) < 0) {
+        vlogE("OneDriveFile: failed to call lseek() (%d).", errno);
+        http_client_close(httpc);
+        return HIVE_SYS_ERROR(errno);
     }
 
-    tmp = rc_zalloc(sizeof(OneDriveFile), onedrive_file_destructor);
-    if (!tmp)
-        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.httpc = httpc;
+    ctx.fd = file->fd;
 
-    strcpy(tmp->base.path, path);
-    tmp->base.flags   = flags;
-    tmp->base.lseek   = onedrive_file_lseek;
+    sprintf(range, "bytes=%zu-%zu", start, end - 1);
+
+    http_client_set_url(httpc, file->dl_url);
+    http_client_set_method(httpc, HTTP_METHOD_GET);
+    http_client_set_header(httpc, "Range", range);
+    http_client_set_response_body(httpc, range_body_callback, &ctx);
+
+    rc = http_client_request(httpc);
+    if (rc) {
+        vlogE("OneDriveFile: failed to perform http request.");
+        http_client_close(httpc);
+        return HIVE_CURL_ERROR(rc);
+    }
+
+    rc = http_client_get_response_code(httpc, &resp_code);
+    http_client_close(httpc);
+    if (rc) {
+        vlogE("OneDriveFile: failed to get http response code.");
+        return HIVE_CURL_ERROR(rc);
+    }
+
+    if (resp_code != HttpStatus_PartialContent && resp_code != HttpStatus_OK) {
+        vlogE("OneDriveFile: error from http response (%d).", resp_code);
+        return HIVE_HTTP_STATUS_ERROR(resp_code);
+    }
+
+    vlogD("OneDriveFile: Successfully get %zu bytes from onedrive.", ctx.received);
+
+    if (ctx.whole)
+        return extent_add(&file->cached, 0, MIN(ctx.received, file->size));
+
+    return extent_add(&file->cached, start, MIN(start + ctx.received, end));
+}
+
+/*
+ * The pre-authenticated download URL is short-lived. When it has expired,
+ * fetch a fresh one, provided the content has not changed meanwhile.
+ */
+static int refresh_download_url(OneDriveFile *file)
+{
+    file_stat_t st;
+    int rc;
+
+    rc = get_file_stat(file->token, file->base.path, &st);
+    if (rc < 0)
+        return rc;
+
+    if (strcmp(st.ctag, file->ctag)) {
+        vlogE("OneDriveFile: file changed remotely since it was opened.");
+        return HIVE_HTTP_STATUS_ERROR(HttpStatus_PreconditionFailed);
+    }
+
+    strcpy(file->dl_url, st.dl_url);
+    return 0;
+}
+
+static int fetch_range(OneDriveFile *file, size_t start, size_t end)
+{
+    int rc;
+
+    rc = download_range(file, start, end);
+    if (rc == HIVE_HTTP_STATUS_ERROR(HttpStatus_Unauthorized) ||
+        rc == HIVE_HTTP_STATUS_ERROR(HttpStatus_Forbidden) ||
+        rc == HIVE_HTTP_STATUS_ERROR(HttpStatus_Gone)) {
+        rc = refresh_download_url(file);
+        if (rc == 0)
+            rc = download_range(file, start, end);
+    }
+
+    if (rc < 0)
+        vlogE("OneDriveFile: failed to download range from onedrive.");
+
+    return rc;
+}
+
+static int ensure_range(OneDriveFile *file, size_t off, size_t len)
+{
+    size_t start = off - off % LAZY_READ_BLOCK_SIZE;
+    size_t end = off + len;
+    size_t run;
+    int rc = 0;
+
+    if (extent_covered(&file->cached, off, off + len))
+        return 0;
+
+    if (end % LAZY_READ_BLOCK_SIZE)
+        end += LAZY_READ_BLOCK_SIZE - end % LAZY_READ_BLOCK_SIZE;
+    end = MIN(end, file->size);
+
+    // Fetch each run of missing blocks with a single range request.
+    while (start < end) {
+        if (extent_covered(&file->cached, start, MIN(start + LAZY_READ_BLOCK_SIZE, end))) {
+            start += LAZY_READ_BLOCK_SIZE;
+            continue;
+        }
+
+        for (run = start + LAZY_READ_BLOCK_SIZE; run < end; run += LAZY_READ_BLOCK_SIZE) {
+            if (extent_covered(&file->cached, run, MIN(run + LAZY_READ_BLOCK_SIZE, end)))
+                break;
+        }
+        run = MIN(run, end);
+
+        rc = fetch_range(file, start, run);
+        if (rc < 0)
+            break;
+
+        start = run;
+    }
+
+    if (lseek(file->fd, (long)off, SEEK_SET) < 0) {
+        vlogE("OneDriveFile: failed to call lseek() (%d).", errno);
+        return HIVE_SYS_ERROR(errno);
+    }
+
+    return rc;
+}
+
+/*
+ * Graph upload sessions always replace the whole item, so any change still
+ * uploads the whole file (appending just the tail is not possible). But a
+ * commit without writes, or with writes leaving the content identical to
+ * the remote item as told by its quickXorHash, is skipped.
+ */
+static bool content_unchanged(OneDriveFile *file)
+{
+    char hash[ONEDRIVE_QUICKXOR_HASH_LEN];
+    struct stat st;
+
+    if (!file->ctag[0])
+        return false;
+
+    if (!file->truncated && !file->written.count)
+        return true;
+
+    if (!file->hash[0] || fstat(file->fd, &st) < 0 ||
+        (size_t)st.st_size != file->size)
+        return false;
+
+    if (onedrive_quickxor_hash_file(file->fd, file->size, hash, sizeof(hash)) < 0)
+        return false;
+
+    return !strcmp(hash, file->hash);
+}
+
+static void mark_clean(OneDriveFile *file)
+{
+    file->dirty = false;
+    file->truncated = false;
+    extents_clear(&file->written);
+}
+
+static void mark_uploaded(OneDriveFile *file)
+{
+    mark_clean(file);
+
+    if (file->cache)
+        onedrive_cache_invalidate(file->cache, file->base.path);
+}
+
+static int onedrive_file_commit(HiveFile *base)
+{
+    OneDriveFile *file = (OneDriveFile *)base;
+    file_stat_t st;
+    int rc = 0;
+
+    if (!file->dirty)
+        return 0;
+
+    if (content_unchanged(file)) {
+        vlogI("OneDriveFile: content unchanged, skipped uploading.");
+        mark_clean(file);
+        return 0;
+    }
+
+    rc = upload_file(file);
+    if (rc < 0) {
+        vlogE("OneDriveFile: failed to commit temporary file.");
+        return rc;
+    }
+
+    mark_uploaded(file);
+
+    rc = get_file_stat(file->token, base->path, &st);
+    if (rc < 0) {
+        vlogE("OneDriveFile: failed to get file status.");
+        return rc;
+    }
+
+    set_remote_stat(file, &st);
+    return 0;
+}
+
+static int onedrive_file_discard(HiveFile *base)
+{
+    OneDriveFile *file = (OneDriveFile *)base;
+    size_t i;
+    int rc;
+
+    if (!file->dirty)
+        return 0;
+
+    if (!file->ctag[0] || file->truncated) {
+        ftruncate(file->fd, 0);
+        lseek(file->fd, 0, SEEK_SET);
+
+        if (!file->ctag[0])
+            return 0;
+
+        rc = download_file(file->fd, file->dl_url);
+        if (rc < 0)
+            return rc;
+    } else {
+        // Only the written extents differ from the remote content.
+        if (ftruncate(file->fd, (long)file->size) < 0) {
+            vlogE("OneDriveFile: failed to call ftruncate() (%d).", errno);
+            return HIVE_SYS_ERROR(errno);
+        }
+
+        for (i = 0; i < file->written.count; i++) {
+            onedrive_extent_t *ext = &file->written.items[i];
+
+            if (ext->start >= file->size)
+                break;
+
+            rc = fetch_range(file, ext->start, MIN(ext->end, file->size));
+            if (rc < 0)
+                return rc;
+        }
+    }
+
+    mark_clean(file);
+    lseek(file->fd, 0, SEEK_SET);
+
+    return 0;
+}
+
+typedef struct onedrive_file_op {
+    hive_async_op_t base;
+    hive_async_t *async;
+    http_engine_t *engine;
+    OneDriveFile *file;
+    onedrive_uploader_t up;
+} onedrive_file_op_t;
+
+static void onedrive_file_op_destructor(void *obj)
+{
+    onedrive_file_op_t *op = (onedrive_file_op_t *)obj;
+
+    onedrive_uploader_cleanup(&op->up);
+
+    if (op->file)
+        deref(op->file);
+
+    if (op->async)
+        deref(op->async);
+}
+
+static onedrive_file_op_t *onedrive_file_op_new(OneDriveFile *file,
+                                                HiveCompletionCallback *callback,
+                                                void *context)
+{
+    onedrive_file_op_t *op;
+
+    op = hive_async_op_new(sizeof(onedrive_file_op_t), callback, context,
+                           onedrive_file_op_destructor);
+    if (!op)
+        return NULL;
+
+    op->async = ref(file->base.async);
+    op->file  = ref(file);
+
+    return op;
+}
+
+/*
+ * Reading and writing only touch the local temporary file (a lazy read may
+ * first fetch the missing blocks), so they are carried out right away and
+ * just complete through the queue.
+ */
+static int onedrive_file_read_async(HiveFile *base, char *buf, size_t bufsz,
+                                    HiveCompletionCallback *callback,
+                                    void *context)
+{
+    OneDriveFile *file = (OneDriveFile *)base;
+    onedrive_file_op_t *op;
+    ssize_t rc;
+
+    op = onedrive_file_op_new(file, callback, context);
+    if (!op)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    if (bufsz > INT_MAX)
+        bufsz = INT_MAX;
+
+    rc = onedrive_file_read(base, buf, bufsz);
+    hive_async_op_complete(op->async, &op->base, (int)rc);
+    return 0;
+}
+
+static int onedrive_file_write_async(HiveFile *base, const char *buf,
+                                     size_t bufsz,
+                                     HiveCompletionCallback *callback,
+                                     void *context)
+{
+    OneDriveFile *file = (OneDriveFile *)base;
+    onedrive_file_op_t *op;
+    ssize_t rc;
+
+    op = onedrive_file_op_new(file, callback, context);
+    if (!op)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    if (bufsz > INT_MAX)
+        bufsz = INT_MAX;
+
+    rc = onedrive_file_write(base, buf, bufsz);
+    hive_async_op_complete(op->async, &op->base, (int)rc);
+    return 0;
+}
+
+static void onedrive_file_op_complete(onedrive_file_op_t *op, int rc)
+{
+    hive_async_op_complete(op->async, &op->base, rc);
+}
+
+static int onedrive_file_op_check(onedrive_file_op_t *op, http_client_t *httpc,
+                                  int rc, long *resp_code)
+{
+    if (rc) {
+        vlogE("OneDriveFile: failed to perform http request.");
+        return HIVE_CURL_ERROR(rc);
+    }
+
+    rc = http_client_get_response_code(httpc, resp_code);
+    if (rc) {
+        vlogE("OneDriveFile: failed to get http response code.");
+        return HIVE_CURL_ERROR(rc);
+    }
+
+    if (*resp_code == HttpStatus_Unauthorized) {
+        vlogE("OneDriveFile: access token expired.");
+        oauth_token_set_expired(op->file->token);
+        return HIVE_GENERAL_ERROR(HIVEERR_TRY_AGAIN);
+    }
+
+    return 0;
+}
+
+static void on_commit_stat_done(http_client_t *httpc, int rc, void *arg)
+{
+    onedrive_file_op_t *op = (onedrive_file_op_t *)arg;
+    long resp_code = 0;
+    file_stat_t st;
+
+    rc = onedrive_file_op_check(op, httpc, rc, &resp_code);
+    if (rc == 0 && resp_code != HttpStatus_OK) {
+        vlogE("OneDriveFile: error from http response (%d).", resp_code);
+        rc = HIVE_HTTP_STATUS_ERROR(resp_code);
+    }
+
+    if (rc == 0 && !http_client_get_response_body(httpc)) {
+        vlogE("OneDriveFile: failed to get http response body.");
+        rc = HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+    }
+
+    if (rc == 0)
+        rc = decode_file_stat(http_client_get_response_body(httpc), &st);
+    http_client_close(httpc);
+
+    if (rc == 0)
+        set_remote_stat(op->file, &st);
+
+    onedrive_file_op_complete(op, rc);
+}
+
+static void submit_commit_stat(onedrive_file_op_t *op)
+{
+    char url[MAX_URL_LEN] = {0};
+    http_client_t *httpc;
+
+    httpc = http_client_new();
+    if (!httpc) {
+        vlogE("OneDriveFile: failed to create http client instance.");
+        onedrive_file_op_complete(op, HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY));
+        return;
+    }
+
+    sprintf(url, "%s/root:%s", MY_DRIVE, op->file->base.path);
+
+    http_client_set_url(httpc, url);
+    http_client_set_query(httpc, "$select", FILE_STAT_SELECT);
+    http_client_set_method(httpc, HTTP_METHOD_GET);
+    set_auth_headers(httpc, op->file->token);
+    http_client_enable_response_body(httpc);
+
+    http_client_submit(op->engine, httpc, on_commit_stat_done, op);
+}
+
+static void on_async_upload_complete(onedrive_uploader_t *up, int rc)
+{
+    onedrive_file_op_t *op = (onedrive_file_op_t *)
+                             ((char *)up - offsetof(onedrive_file_op_t, up));
+
+    onedrive_uploader_cleanup(up);
+
+    if (rc < 0) {
+        onedrive_file_op_complete(op, rc);
+        return;
+    }
+
+    vlogI("OneDriveFile: Susscessfully uploaded temporary file to onedrive.");
+    mark_uploaded(op->file);
+    submit_commit_stat(op);
+}
+
+static void on_upload_session_created(http_client_t *httpc, int rc, void *arg)
+{
+    onedrive_file_op_t *op = (onedrive_file_op_t *)arg;
+    long resp_code = 0;
+
+    rc = onedrive_file_op_check(op, httpc, rc, &resp_code);
+    if (rc == 0 && resp_code != HttpStatus_OK) {
+        vlogE("OneDriveFile: error from http response (%d).", resp_code);
+        rc = HIVE_HTTP_STATUS_ERROR(resp_code);
+    }
+
+    if (rc == 0) {
+        vlogI("OneDriveFile: Susscessfully created an upload session.");
+        rc = onedrive_uploader_start(&op->up,
+                                     http_client_get_response_body(httpc));
+    }
+
+    http_client_close(httpc);
+
+    if (rc < 0)
+        onedrive_file_op_complete(op, rc);
+}
+
+static void submit_upload_session(onedrive_file_op_t *op)
+{
+    OneDriveFile *file = op->file;
+    char url[MAX_URL_LEN] = {0};
+    http_client_t *httpc;
+
+    httpc = http_client_new();
+    if (!httpc) {
+        vlogE("OneDriveFile: failed to create http client instance.");
+        onedrive_file_op_complete(op, HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY));
+        return;
+    }
+
+    sprintf(url, "%s/root:%s:/createUploadSession", MY_DRIVE, file->base.path);
+
+    http_client_set_url(httpc, url);
+    http_client_set_method(httpc, HTTP_METHOD_POST);
+    set_auth_headers(httpc, file->token);
+    http_client_set_request_body_instant(httpc, NULL, 0);
+    if (file->ctag[0])
+        http_client_set_header(httpc, "if-match", file->ctag);
+    http_client_enable_response_body(httpc);
+
+    http_client_submit(op->engine, httpc, on_upload_session_created, op);
+}
+
+static void on_session_status_done(http_client_t *httpc, int rc, void *arg)
+{
+    onedrive_file_op_t *op = (onedrive_file_op_t *)arg;
+    long resp_code = 0;
+
+    if (rc) {
+        vlogE("OneDriveFile: failed to perform http request.");
+        rc = HIVE_CURL_ERROR(rc);
+    } else {
+        rc = http_client_get_response_code(httpc, &resp_code);
+        if (rc == 0 && resp_code != HttpStatus_OK)
+            rc = HIVE_HTTP_STATUS_ERROR(resp_code);
+    }
+
+    if (rc == 0)
+        rc = onedrive_uploader_resume(&op->up,
+                                      http_client_get_response_body(httpc));
+
+    http_client_close(httpc);
+
+    if (rc < 0) {
+        vlogW("OneDriveFile: can not resume upload session, starting over.");
+        onedrive_uploader_discard_journal(&op->up);
+        submit_upload_session(op);
+    }
+}
+
+static int onedrive_file_commit_async(HiveFile *base,
+                                      HiveCompletionCallback *callback,
+                                      void *context)
+{
+    OneDriveFile *file = (OneDriveFile *)base;
+    onedrive_file_op_t *op;
+    http_client_t *httpc;
+    int rc;
+
+    op = onedrive_file_op_new(file, callback, context);
+    if (!op)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    if (!file->dirty) {
+        onedrive_file_op_complete(op, 0);
+        return 0;
+    }
+
+    if (content_unchanged(file)) {
+        vlogI("OneDriveFile: content unchanged, skipped uploading.");
+        mark_clean(file);
+        onedrive_file_op_complete(op, 0);
+        return 0;
+    }
+
+    rc = oauth_token_check_expire(file->token);
+    if (rc < 0) {
+        vlogE("OneDriveFile: checking access token expired error.");
+        deref(op);
+        return rc;
+    }
+
+    op->engine = hive_async_get_engine(op->async);
+    if (!op->engine) {
+        deref(op);
+        return hive_get_error();
+    }
+
+    rc = prepare_upload(file, &op->up, op->engine, on_async_upload_complete);
+    if (rc < 0) {
+        deref(op);
+        return rc;
+    }
+
+    if (rc == 0) {
+        submit_upload_session(op);
+        return 0;
+    }
+
+    httpc = http_client_new();
+    if (!httpc) {
+        vlogE("OneDriveFile: failed to create http client instance.");
+        deref(op);
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+    }
+
+    http_client_set_url(httpc, op->up.upload_url);
+    http_client_set_method(httpc, HTTP_METHOD_GET);
+    http_client_enable_response_body(httpc);
+
+    http_client_submit(op->engine, httpc, on_session_status_done, op);
+    return 0;
+}
+
+#if defined(_WIN32) || defined(_WIN64)
+static int mkstemp(char *template)
+{
+    errno_t err;
+
+    err = _mktemp_s(template, strlen(template) + 1);
+    if (err) {
+        errno = err;
+        vlogE("OneDriveFile: failed to call _mktemp_s() (%d).", errno);
+        return -1;
+    }
+
+    return open(template, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+}
+#endif
+
+int onedrive_file_open(oauth_token_t *token, const char *path,
+                       int flags, const char *tmp_template,
+                       const onedrive_upload_options_t *upload_opts,
+                       onedrive_cache_t *cache, HiveFile **file)
+{
+    OneDriveFile *tmp;
+    bool file_exists;
+    file_stat_t st;
+    int rc;
+
+    rc = get_file_stat(token, path, &st);
+    if (rc < 0 && rc != HIVE_HTTP_STATUS_ERROR(HttpStatus_NotFound)) {
+        vlogE("OneDriveFile: get file status failure.");
+        return rc;
+    }
+
+    file_exists = !rc ? true : false;
+
+    if (HIVE_F_IS_EQ(flags, HIVE_F_RDONLY)) {
+        if (!file_exists) {
+            vlogE("OneDriveFile: set readonly flag while file does not exist.");
+            return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
+        }
+    } else if (HIVE_F_IS_SET(flags, HIVE_F_CREAT | HIVE_F_EXCL) && file_exists) {
+        vlogE("OneDriveFile: set EXCL flag while file exists.");
+        return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
+    } else if (!HIVE_F_IS_SET(flags, HIVE_F_CREAT) && !file_exists) {
+        vlogE("OneDriveFile: set no CREAT flag while file does not exist.");
+        return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
+    }
+
+    tmp = rc_zalloc(sizeof(OneDriveFile), onedrive_file_destructor);
+    if (!tmp)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    strcpy(tmp->base.path, path);
+    tmp->base.flags   = flags;
+    tmp->base.lseek   = onedrive_file_lseek;
     tmp->base.read    = onedrive_file_read;
     tmp->base.write   = onedrive_file_write;
     tmp->base.commit  = onedrive_file_commit;
     tmp->base.discard = onedrive_file_discard;
     tmp->base.close   = onedrive_file_close;
 
+    tmp->base.read_async   = onedrive_file_read_async;
+    tmp->base.write_async  = onedrive_file_write_async;
+    tmp->base.commit_async = onedrive_file_commit_async;
+
     tmp->token        = ref(token);
-    if (file_exists) {
-        strcpy(tmp->ctag, ctag);
-        strcpy(tmp->dl_url, download_url);
-    }
+    if (cache)
+        tmp->cache    = ref(cache);
+    tmp->upload_fragment_size = upload_opts->fragment_size;
+    tmp->upload_parallelism   = upload_opts->parallelism;
+    if (file_exists)
+        set_remote_stat(tmp, &st);
 
     strcpy(tmp->tmp_path, tmp_template);
     tmp->fd = mkstemp(tmp->tmp_path);
@@ -637,16 +1389,28 @@ int onedrive_file_open(oauth_token_t *token, const char *path,
         return HIVE_SYS_ERROR(errno);
     }
 
-    if (file_exists && !HIVE_F_IS_SET(flags, HIVE_F_TRUNC)) {
-        rc = download_file(tmp->fd, download_url);
+    if (file_exists && HIVE_F_IS_EQ(flags, HIVE_F_RDONLY)) {
+        // Content is fetched on demand by read().
+        if (ftruncate(tmp->fd, (long)st.size) < 0) {
+            rc = HIVE_SYS_ERROR(errno);
+            vlogE("OneDriveFile: failed to call ftruncate() (%d).", errno);
+            unlink(tmp->tmp_path);
+            deref(tmp);
+            return rc;
+        }
+        tmp->lazy = true;
+    } else if (file_exists && !HIVE_F_IS_SET(flags, HIVE_F_TRUNC)) {
+        rc = download_file(tmp->fd, st.dl_url);
         if (rc < 0) {
             vlogE("OneDriveFile: failed to download from onedrive.");
             unlink(tmp->tmp_path);
             deref(tmp);
             return rc;
         }
-    } else
+    } else {
         tmp->dirty = true;
+        tmp->truncated = true;
+    }
 
     if (!HIVE_F_IS_SET(flags, HIVE_F_APPEND))
         lseek(tmp->fd, 0, SEEK_SET);
@@ -30,6 +30,7 @@ extern "C" {
 #include "ela_hive.h"
 #include "oauth_token.h"
 #include "hive_client.h"
+#include "onedrive_cache.h"
 
 static inline
 int decode_info_field(cJSON *json, const char *name, char *buf, size_t len)
@@ -53,11 +54,20 @@ int decode_info_field(cJSON *json, const char *name, char *buf, size_t len)
     return 0;
 }
 
+typedef struct onedrive_upload_options {
+    size_t fragment_size;
+    unsigned int parallelism;
+} onedrive_upload_options_t;
+
 int onedrive_drive_open(oauth_token_t *token, const char *driveid,
-                        const char *tmp_template, HiveDrive **);
+                        const char *tmp_template,
+                        const onedrive_upload_options_t *upload_opts,
+                        onedrive_cache_t *cache, HiveDrive **);
 
 int onedrive_file_open(oauth_token_t *token, const char *path,
-                       int flags, const char *tmp_template, HiveFile **file);
+                       int flags, const char *tmp_template,
+                       const onedrive_upload_options_t *upload_opts,
+                       onedrive_cache_t *cache, HiveFile **file);
 
 #ifdef __cplusplus
 }
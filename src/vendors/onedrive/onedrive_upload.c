@@ -0,0 +1,802 @@
+/*
+ * Copyright (c) 2019 Elastos Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#if defined(_WIN32) || defined(_WIN64)
+#include <io.h>
+#define timegm _mkgmtime
+#endif
+
+#include <crystal.h>
+#include <cjson/cJSON.h>
+
+#include "ela_hive.h"
+#include "hive_error.h"
+#include "http_status.h"
+#include "onedrive_upload.h"
+
+#define MIN(a,b) ((a) <= (b) ? (a) : (b))
+
+// Sessions about to expire are not worth resuming.
+#define JOURNAL_EXPIRY_MARGIN   (60)
+
+#define FNV_OFFSET_BASIS    UINT64_C(0xcbf29ce484222325)
+#define FNV_PRIME           UINT64_C(0x100000001b3)
+
+#if defined(_WIN32) || defined(_WIN64)
+/*
+ * All request body callbacks of one engine run on the thread performing
+ * it, so seeking and reading back to back can not interleave.
+ */
+static ssize_t pread(int fd, void *buf, size_t count, off_t offset)
+{
+    if (lseek(fd, (long)offset, SEEK_SET) < 0)
+        return -1;
+
+    return read(fd, buf, (unsigned)count);
+}
+#endif
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)data;
+
+    while (len--) {
+        hash ^= *p++;
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+static int checksum_file(int fd, size_t fsize, uint64_t *checksum)
+{
+    uint64_t hash = FNV_OFFSET_BASIS;
+    size_t off = 0;
+    ssize_t nrd;
+    char *buf;
+
+    buf = malloc(64 * 1024);
+    if (!buf)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    while (off < fsize) {
+        nrd = pread(fd, buf, MIN(fsize - off, 64 * 1024), (off_t)off);
+        if (nrd <= 0) {
+            vlogE("OneDriveUpload: failed to call pread() (%d).", errno);
+            free(buf);
+            return nrd < 0 ? HIVE_SYS_ERROR(errno) :
+                             HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
+        }
+
+        hash = fnv1a(hash, buf, (size_t)nrd);
+        off += (size_t)nrd;
+    }
+
+    free(buf);
+    *checksum = hash;
+    return 0;
+}
+
+/*
+ * quickXorHash: every byte is XORed into a 160-bit register at a position
+ * advancing 11 bits per byte (wrapping around), and the content length is
+ * XORed into the last 64 bits of the result.
+ */
+#define QUICKXOR_WIDTH  (160)
+#define QUICKXOR_SHIFT  (11)
+
+typedef struct quickxor {
+    uint64_t data[3];
+    size_t shift;
+    uint64_t length;
+} quickxor_t;
+
+static void quickxor_update(quickxor_t *qx, const unsigned char *buf, size_t len)
+{
+    size_t cell = qx->shift / 64;
+    size_t offset = qx->shift % 64;
+    size_t iterations = MIN(len, QUICKXOR_WIDTH);
+    size_t i, j;
+
+    for (i = 0; i < iterations; i++) {
+        bool last = cell == 2;
+        size_t bits = last ? QUICKXOR_WIDTH % 64 : 64;
+        unsigned char x = 0;
+
+        // Bytes QUICKXOR_WIDTH apart land on the same bits.
+        for (j = i; j < len; j += QUICKXOR_WIDTH)
+            x ^= buf[j];
+
+        qx->data[cell] ^= (uint64_t)x << offset;
+        if (offset > bits - 8)
+            qx->data[last ? 0 : cell + 1] ^= (uint64_t)x >> (bits - offset);
+
+        offset += QUICKXOR_SHIFT;
+        if (offset >= bits) {
+            cell = last ? 0 : cell + 1;
+            offset -= bits;
+        }
+    }
+
+    qx->shift = (qx->shift + QUICKXOR_SHIFT * (len % QUICKXOR_WIDTH)) % QUICKXOR_WIDTH;
+    qx->length += len;
+}
+
+static void quickxor_final(quickxor_t *qx, char *hash)
+{
+    static const char b64[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    unsigned char digest[21];
+    size_t i;
+
+    for (i = 0; i < 20; i++)
+        digest[i] = (unsigned char)(qx->data[i / 8] >> (8 * (i % 8)));
+
+    for (i = 0; i < 8; i++)
+        digest[12 + i] ^= (unsigned char)(qx->length >> (8 * i));
+
+    digest[20] = 0;
+    for (i = 0; i < 21; i += 3) {
+        uint32_t v = (uint32_t)digest[i] << 16 | (uint32_t)digest[i + 1] << 8 |
+                     (i + 2 < 21 ? digest[i + 2] : 0);
+
+        *hash++ = b64[(v >> 18) & 0x3f];
+        *hash++ = b64[(v >> 12) & 0x3f];
+        *hash++ = b64[(v >> 6) & 0x3f];
+        *hash++ = b64[v & 0x3f];
+    }
+
+    // 20 bytes encode to 27 characters and one padding.
+    hash[-1] = '=';
+    hash[0] = '\0';
+}
+
+int onedrive_quickxor_hash_file(int fd, size_t fsize, char *hash, size_t len)
+{
+    quickxor_t qx;
+    size_t off = 0;
+    ssize_t nrd;
+    char *buf;
+
+    if (len < ONEDRIVE_QUICKXOR_HASH_LEN)
+        return HIVE_GENERAL_ERROR(HIVEERR_BUFFER_TOO_SMALL);
+
+    buf = malloc(64 * 1024);
+    if (!buf)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    memset(&qx, 0, sizeof(qx));
+
+    while (off < fsize) {
+        nrd = pread(fd, buf, MIN(fsize - off, 64 * 1024), (off_t)off);
+        if (nrd <= 0) {
+            vlogE("OneDriveUpload: failed to call pread() (%d).", errno);
+            free(buf);
+            return nrd < 0 ? HIVE_SYS_ERROR(errno) :
+                             HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
+        }
+
+        quickxor_update(&qx, (unsigned char *)buf, (size_t)nrd);
+        off += (size_t)nrd;
+    }
+
+    free(buf);
+    quickxor_final(&qx, hash);
+    return 0;
+}
+
+static time_t parse_expiration(const char *iso)
+{
+    struct tm tm;
+
+    memset(&tm, 0, sizeof(tm));
+    if (sscanf(iso, "%d-%d-%dT%d:%d:%d", &tm.tm_year, &tm.tm_mon,
+               &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6)
+        return 0;
+
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    return timegm(&tm);
+}
+
+/*
+ * Parse the nextExpectedRanges array of an upload session, each entry of
+ * which is either "start-end" (inclusive) or "start-" up to the end.
+ */
+static int parse_expected_ranges(const cJSON *json, size_t fsize,
+                                 onedrive_upload_range_t **ranges,
+                                 size_t *count)
+{
+    onedrive_upload_range_t *tmp;
+    cJSON *item;
+    size_t n = 0;
+    int size;
+
+    if (!json || !cJSON_IsArray(json))
+        return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+
+    size = cJSON_GetArraySize(json);
+    tmp = calloc(size ? size : 1, sizeof(onedrive_upload_range_t));
+    if (!tmp)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    cJSON_ArrayForEach(item, json) {
+        unsigned long long start;
+        unsigned long long end;
+        char *p;
+
+        if (!cJSON_IsString(item) || !item->valuestring)
+            goto bad_format;
+
+        start = strtoull(item->valuestring, &p, 10);
+        if (p == item->valuestring || *p++ != '-')
+            goto bad_format;
+
+        end = *p ? strtoull(p, &p, 10) + 1 : fsize;
+        if (*p || start >= end || end > fsize)
+            goto bad_format;
+
+        tmp[n].start = (size_t)start;
+        tmp[n].end   = (size_t)end;
+        n++;
+    }
+
+    *ranges = tmp;
+    *count  = n;
+    return 0;
+
+bad_format:
+    vlogE("OneDriveUpload: bad nextExpectedRanges in upload session.");
+    free(tmp);
+    return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+}
+
+static void save_journal(onedrive_uploader_t *up, const cJSON *ranges)
+{
+    char checksum[32];
+    cJSON *journal;
+    char *json_str;
+    size_t len;
+    int fd;
+    int rc;
+
+    if (!up->journal[0])
+        return;
+
+    journal = cJSON_CreateObject();
+    if (!journal)
+        return;
+
+    sprintf(checksum, "%016" PRIx64, up->checksum);
+
+    if (!cJSON_AddStringToObject(journal, "path", up->path) ||
+        !cJSON_AddStringToObject(journal, "uploadUrl", up->upload_url) ||
+        !cJSON_AddNumberToObject(journal, "expiration", (double)up->expiry) ||
+        !cJSON_AddNumberToObject(journal, "size", (double)up->fsize) ||
+        !cJSON_AddStringToObject(journal, "checksum", checksum)) {
+        cJSON_Delete(journal);
+        return;
+    }
+
+    if (ranges)
+        cJSON_AddItemToObject(journal, "nextExpectedRanges",
+                              cJSON_Duplicate(ranges, true));
+
+    json_str = cJSON_PrintUnformatted(journal);
+    cJSON_Delete(journal);
+    if (!json_str)
+        return;
+
+    fd = open(up->journal, O_WRONLY | O_TRUNC | O_CREAT, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        vlogW("OneDriveUpload: failed to open journal (%d).", errno);
+        free(json_str);
+        return;
+    }
+
+    len = strlen(json_str);
+    rc = (int)write(fd, json_str, (unsigned)len);
+    close(fd);
+    free(json_str);
+
+    if (rc != (int)len) {
+        vlogW("OneDriveUpload: failed to write journal.");
+        unlink(up->journal);
+    }
+}
+
+static cJSON *load_journal(const char *path)
+{
+    struct stat st;
+    cJSON *json;
+    char *buf;
+    ssize_t nrd;
+    int fd;
+
+    if (stat(path, &st) < 0 || !st.st_size || st.st_size > 64 * 1024)
+        return NULL;
+
+    buf = calloc(1, (size_t)st.st_size + 1);
+    if (!buf)
+        return NULL;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        free(buf);
+        return NULL;
+    }
+
+    nrd = read(fd, buf, (unsigned)st.st_size);
+    close(fd);
+
+    json = nrd == st.st_size ? cJSON_Parse(buf) : NULL;
+    free(buf);
+    return json;
+}
+
+void onedrive_uploader_init(onedrive_uploader_t *up, int fd, size_t fsize,
+                            size_t fragment_size, unsigned int parallelism,
+                            bool replace, http_engine_t *engine,
+                            onedrive_upload_complete_t *complete)
+{
+    memset(up, 0, sizeof(*up));
+
+    up->fd            = fd;
+    up->fsize         = fsize;
+    up->fragment_size = fragment_size;
+    up->parallelism   = parallelism;
+    up->replace       = replace;
+    up->engine        = engine;
+    up->complete      = complete;
+}
+
+void onedrive_uploader_cleanup(onedrive_uploader_t *up)
+{
+    if (up->frags) {
+        free(up->frags);
+        up->frags = NULL;
+    }
+}
+
+int onedrive_uploader_open_journal(onedrive_uploader_t *up,
+                                   const char *journal_dir, const char *path)
+{
+    char checksum[32];
+    cJSON *journal;
+    cJSON *item;
+    int rc;
+
+    if (strlen(path) >= sizeof(up->path))
+        return 0;
+
+    rc = snprintf(up->journal, sizeof(up->journal), "%s/upload-%016" PRIx64 ".json",
+                  journal_dir, fnv1a(FNV_OFFSET_BASIS, path, strlen(path)));
+    if (rc < 0 || rc >= (int)sizeof(up->journal)) {
+        up->journal[0] = '\0';
+        return 0;
+    }
+
+    strcpy(up->path, path);
+
+    rc = checksum_file(up->fd, up->fsize, &up->checksum);
+    if (rc < 0)
+        return rc;
+
+    journal = load_journal(up->journal);
+    if (!journal)
+        return 0;
+
+    sprintf(checksum, "%016" PRIx64, up->checksum);
+
+    item = cJSON_GetObjectItemCaseSensitive(journal, "path");
+    if (!cJSON_IsString(item) || strcmp(item->valuestring, path))
+        goto stale;
+
+    item = cJSON_GetObjectItemCaseSensitive(journal, "size");
+    if (!cJSON_IsNumber(item) || (size_t)item->valuedouble != up->fsize)
+        goto stale;
+
+    item = cJSON_GetObjectItemCaseSensitive(journal, "checksum");
+    if (!cJSON_IsString(item) || strcmp(item->valuestring, checksum))
+        goto stale;
+
+    item = cJSON_GetObjectItemCaseSensitive(journal, "expiration");
+    if (!cJSON_IsNumber(item) ||
+        (time_t)item->valuedouble < time(NULL) + JOURNAL_EXPIRY_MARGIN)
+        goto stale;
+    up->expiry = (time_t)item->valuedouble;
+
+    item = cJSON_GetObjectItemCaseSensitive(journal, "uploadUrl");
+    if (!cJSON_IsString(item) || !*item->valuestring ||
+        strlen(item->valuestring) >= sizeof(up->upload_url))
+        goto stale;
+    strcpy(up->upload_url, item->valuestring);
+
+    cJSON_Delete(journal);
+    vlogI("OneDriveUpload: found upload session to resume for %s.", path);
+    return 1;
+
+stale:
+    cJSON_Delete(journal);
+    unlink(up->journal);
+    return 0;
+}
+
+void onedrive_uploader_discard_journal(onedrive_uploader_t *up)
+{
+    if (up->journal[0])
+        unlink(up->journal);
+
+    up->upload_url[0] = '\0';
+}
+
+static void uploader_pump(onedrive_uploader_t *up);
+
+static int uploader_plan(onedrive_uploader_t *up,
+                         const onedrive_upload_range_t *ranges, size_t nranges)
+{
+    size_t fragsz = up->fragment_size;
+    onedrive_upload_fragment_t *frags;
+    size_t count = 0;
+    size_t off;
+    size_t i;
+
+    for (i = 0; i < nranges; i++)
+        count += (ranges[i].end - ranges[i].start + fragsz - 1) / fragsz;
+
+    frags = calloc(count ? count : 1, sizeof(onedrive_upload_fragment_t));
+    if (!frags)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    count = 0;
+    for (i = 0; i < nranges; i++) {
+        for (off = ranges[i].start; off < ranges[i].end; off += fragsz) {
+            frags[count].up     = up;
+            frags[count].offset = off;
+            frags[count].len    = MIN(fragsz, ranges[i].end - off);
+            count++;
+        }
+    }
+
+    if (up->frags)
+        free(up->frags);
+
+    up->frags = frags;
+    up->count = count;
+    up->next  = 0;
+    return 0;
+}
+
+static void uploader_fail(onedrive_uploader_t *up, int rc)
+{
+    if (!up->rc)
+        up->rc = rc;
+}
+
+static void uploader_finish(onedrive_uploader_t *up, int rc)
+{
+    if (rc == 0 && up->journal[0])
+        unlink(up->journal);
+
+    up->finished = true;
+    up->complete(up, rc);
+}
+
+/*
+ * Decodes the nextExpectedRanges of a session status or fragment response
+ * body, and records them in the journal.
+ */
+static int decode_expected_ranges(onedrive_uploader_t *up, const char *body,
+                                  onedrive_upload_range_t **ranges,
+                                  size_t *count)
+{
+    cJSON *json;
+    cJSON *item;
+    int rc;
+
+    json = body ? cJSON_Parse(body) : NULL;
+    if (!json) {
+        vlogE("OneDriveUpload: failed to parse upload session status.");
+        return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+    }
+
+    item = cJSON_GetObjectItemCaseSensitive(json, "nextExpectedRanges");
+    rc = parse_expected_ranges(item, up->fsize, ranges, count);
+    if (rc == 0)
+        save_journal(up, item);
+
+    cJSON_Delete(json);
+    return rc;
+}
+
+static size_t fragment_body_cb(char *buffer, size_t size, size_t nitems,
+                               void *userdata)
+{
+    onedrive_upload_fragment_t *frag = (onedrive_upload_fragment_t *)userdata;
+    size_t sz2ul;
+    ssize_t nrd;
+
+    if (frag->sent == frag->len)
+        return 0;
+
+    sz2ul = MIN(frag->len - frag->sent, size * nitems);
+    nrd = pread(frag->up->fd, buffer, sz2ul, (off_t)(frag->offset + frag->sent));
+    if (nrd <= 0) {
+        vlogE("OneDriveUpload: failed to call pread().");
+        return HTTP_CLIENT_REQBODY_ABORT;
+    }
+
+    frag->sent += nrd;
+    return (size_t)nrd;
+}
+
+static void on_fragment_done(http_client_t *httpc, int rc, void *arg)
+{
+    onedrive_upload_fragment_t *frag = (onedrive_upload_fragment_t *)arg;
+    onedrive_uploader_t *up = frag->up;
+    onedrive_upload_range_t *ranges;
+    long resp_code = 0;
+    size_t count;
+    bool last;
+
+    up->inflight--;
+
+    if (rc) {
+        vlogE("OneDriveUpload: failed to perform http request.");
+        uploader_fail(up, HIVE_CURL_ERROR(rc));
+        goto pump;
+    }
+
+    rc = http_client_get_response_code(httpc, &resp_code);
+    if (rc) {
+        vlogE("OneDriveUpload: failed to get http response code.");
+        uploader_fail(up, HIVE_CURL_ERROR(rc));
+        goto pump;
+    }
+
+    last = frag == &up->frags[up->count - 1];
+
+    if ((resp_code == HttpStatus_Conflict ||
+         resp_code == HttpStatus_RangeNotSatisfiable) && up->parallelism > 1) {
+        vlogW("OneDriveUpload: fragment rejected (%d), falling back to "
+              "sequential upload.", resp_code);
+        up->conflict = true;
+    } else if ((!last && resp_code != HttpStatus_Accepted) ||
+               (last && ((!up->replace && resp_code != HttpStatus_Created) ||
+                         (up->replace && resp_code != HttpStatus_OK)))) {
+        vlogE("OneDriveUpload: error from http response (%d).", resp_code);
+        uploader_fail(up, HIVE_HTTP_STATUS_ERROR(resp_code));
+    } else if (!last && decode_expected_ranges(up,
+                    http_client_get_response_body(httpc), &ranges, &count) == 0)
+        free(ranges);
+
+pump:
+    http_client_close(httpc);
+    uploader_pump(up);
+}
+
+static void submit_fragment(onedrive_uploader_t *up,
+                            onedrive_upload_fragment_t *frag)
+{
+    http_client_t *httpc;
+    char header[128];
+
+    httpc = http_client_new();
+    if (!httpc) {
+        vlogE("OneDriveUpload: failed to create http client instance.");
+        uploader_fail(up, HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY));
+        return;
+    }
+
+    frag->sent = 0;
+
+    http_client_set_url(httpc, up->upload_url);
+    http_client_set_method(httpc, HTTP_METHOD_PUT);
+    sprintf(header, "%zu", frag->len);
+    http_client_set_header(httpc, "Content-Length", header);
+    sprintf(header, "bytes %zu-%zu/%zu", frag->offset,
+            frag->offset + frag->len - 1, up->fsize);
+    http_client_set_header(httpc, "Content-Range", header);
+    http_client_set_header(httpc, "Transfer-Encoding", "");
+    http_client_set_header(httpc, "Expect", "");
+    http_client_set_request_body(httpc, fragment_body_cb, frag);
+    http_client_enable_response_body(httpc);
+
+    up->inflight++;
+    http_client_submit(up->engine, httpc, on_fragment_done, frag);
+}
+
+static void on_session_status(http_client_t *httpc, int rc, void *arg)
+{
+    onedrive_uploader_t *up = (onedrive_uploader_t *)arg;
+    onedrive_upload_range_t *ranges;
+    long resp_code = 0;
+    size_t count;
+
+    up->inflight--;
+
+    if (rc) {
+        vlogE("OneDriveUpload: failed to perform http request.");
+        rc = HIVE_CURL_ERROR(rc);
+    } else {
+        rc = http_client_get_response_code(httpc, &resp_code);
+        if (rc) {
+            vlogE("OneDriveUpload: failed to get http response code.");
+            rc = HIVE_CURL_ERROR(rc);
+        } else if (resp_code != HttpStatus_OK) {
+            vlogE("OneDriveUpload: error from http response (%d).", resp_code);
+            rc = HIVE_HTTP_STATUS_ERROR(resp_code);
+        }
+    }
+
+    if (rc == 0)
+        rc = decode_expected_ranges(up, http_client_get_response_body(httpc),
+                                    &ranges, &count);
+    http_client_close(httpc);
+
+    if (rc < 0) {
+        uploader_fail(up, rc);
+        uploader_pump(up);
+        return;
+    }
+
+    rc = uploader_plan(up, ranges, count);
+    free(ranges);
+    if (rc < 0)
+        uploader_fail(up, rc);
+
+    up->conflict = false;
+    up->parallelism = 1;
+    uploader_pump(up);
+}
+
+static void submit_session_status(onedrive_uploader_t *up)
+{
+    http_client_t *httpc;
+
+    httpc = http_client_new();
+    if (!httpc) {
+        vlogE("OneDriveUpload: failed to create http client instance.");
+        uploader_fail(up, HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY));
+        return;
+    }
+
+    http_client_set_url(httpc, up->upload_url);
+    http_client_set_method(httpc, HTTP_METHOD_GET);
+    http_client_enable_response_body(httpc);
+
+    up->inflight++;
+    http_client_submit(up->engine, httpc, on_session_status, up);
+}
+
+static void uploader_pump(onedrive_uploader_t *up)
+{
+    if (up->finished)
+        return;
+
+    if (up->rc < 0 || up->conflict) {
+        if (up->inflight)
+            return;
+
+        if (up->rc < 0) {
+            uploader_finish(up, up->rc);
+            return;
+        }
+
+        submit_session_status(up);
+        if (up->rc < 0)
+            uploader_finish(up, up->rc);
+        return;
+    }
+
+    // All but the last fragment go out concurrently.
+    while (up->next + 1 < up->count && up->inflight < up->parallelism) {
+        submit_fragment(up, &up->frags[up->next++]);
+        if (up->rc < 0)
+            break;
+    }
+
+    if (up->rc == 0 && up->next + 1 == up->count && !up->inflight)
+        submit_fragment(up, &up->frags[up->next++]);
+
+    if (up->rc < 0 && !up->inflight)
+        uploader_finish(up, up->rc);
+    else if (up->next == up->count && !up->inflight)
+        uploader_finish(up, 0);
+}
+
+int onedrive_uploader_start(onedrive_uploader_t *up, const char *session)
+{
+    onedrive_upload_range_t range = { 0, up->fsize };
+    cJSON *json;
+    cJSON *item;
+    int rc;
+
+    json = session ? cJSON_Parse(session) : NULL;
+    if (!json) {
+        vlogE("OneDriveUpload: failed to parse json object from response.");
+        return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+    }
+
+    item = cJSON_GetObjectItemCaseSensitive(json, "uploadUrl");
+    if (!cJSON_IsString(item) || !item->valuestring || !*item->valuestring ||
+        strlen(item->valuestring) >= sizeof(up->upload_url)) {
+        vlogE("OneDriveUpload: missing uploadUrl json object.");
+        cJSON_Delete(json);
+        return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+    }
+    strcpy(up->upload_url, item->valuestring);
+
+    item = cJSON_GetObjectItemCaseSensitive(json, "expirationDateTime");
+    up->expiry = cJSON_IsString(item) && item->valuestring ?
+                 parse_expiration(item->valuestring) : 0;
+
+    cJSON_Delete(json);
+
+    if (up->expiry)
+        save_journal(up, NULL);
+
+    rc = uploader_plan(up, &range, 1);
+    if (rc < 0)
+        return rc;
+
+    uploader_pump(up);
+    return 0;
+}
+
+int onedrive_uploader_resume(onedrive_uploader_t *up, const char *status)
+{
+    onedrive_upload_range_t *ranges;
+    size_t count;
+    int rc;
+
+    rc = decode_expected_ranges(up, status, &ranges, &count);
+    if (rc < 0)
+        return rc;
+
+    // Nothing expected means the session can not be completed any more.
+    if (!count) {
+        free(ranges);
+        return HIVE_GENERAL_ERROR(HIVEERR_BAD_JSON_FORMAT);
+    }
+
+    rc = uploader_plan(up, ranges, count);
+    free(ranges);
+    if (rc < 0)
+        return rc;
+
+    vlogI("OneDriveUpload: resuming upload session of %s.", up->path);
+
+    uploader_pump(up);
+    return 0;
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2019 Elastos Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __ONEDRIVE_UPLOAD_H__
+#define __ONEDRIVE_UPLOAD_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <time.h>
+
+#include "http_client.h"
+#include "onedrive_constants.h"
+
+/*
+ * Uploader of a local file to a OneDrive upload session.
+ *
+ * Fragments are PUT concurrently on an http engine, and the fragment
+ * completing the file is only sent after all others have been acknowledged.
+ * If the server rejects out of order fragments (409 or 416), the uploader
+ * asks the session for its nextExpectedRanges and sends what is missing one
+ * fragment at a time.
+ *
+ * The session is recorded in a journal file together with the size and a
+ * checksum of the content, and the ranges still expected by the server.
+ * A later commit of the same content to the same path, even from another
+ * process, resumes the session instead of starting over. The journal is
+ * removed once the upload completes.
+ */
+typedef struct onedrive_upload_range {
+    size_t start;
+    size_t end;
+} onedrive_upload_range_t;
+
+typedef struct onedrive_uploader onedrive_uploader_t;
+
+typedef struct onedrive_upload_fragment {
+    onedrive_uploader_t *up;
+    size_t offset;
+    size_t len;
+    size_t sent;
+} onedrive_upload_fragment_t;
+
+typedef void onedrive_upload_complete_t(onedrive_uploader_t *up, int rc);
+
+struct onedrive_uploader {
+    int fd;
+    http_engine_t *engine;
+    size_t fsize;
+    size_t fragment_size;
+    unsigned int parallelism;
+    // the item exists already, so completing replaces it.
+    bool replace;
+    onedrive_upload_complete_t *complete;
+
+    char upload_url[MAX_URL_LEN];
+    time_t expiry;
+    char path[MAX_URL_LEN];
+    char journal[PATH_MAX];
+    uint64_t checksum;
+
+    onedrive_upload_fragment_t *frags;
+    size_t count;
+    size_t next;
+    unsigned int inflight;
+    bool conflict;
+    bool finished;
+    int rc;
+};
+
+void onedrive_uploader_init(onedrive_uploader_t *up, int fd, size_t fsize,
+                            size_t fragment_size, unsigned int parallelism,
+                            bool replace, http_engine_t *engine,
+                            onedrive_upload_complete_t *complete);
+
+void onedrive_uploader_cleanup(onedrive_uploader_t *up);
+
+/*
+ * Checksums the content and looks for the journal of an unexpired session
+ * uploading the same content to path. Returns 1 and sets upload_url if
+ * one is found, 0 if not, or a negative error code.
+ */
+int onedrive_uploader_open_journal(onedrive_uploader_t *up,
+                                   const char *journal_dir, const char *path);
+
+void onedrive_uploader_discard_journal(onedrive_uploader_t *up);
+
+/*
+ * Takes the upload session from the createUploadSession response, records
+ * it in the journal and uploads the whole file.
+ */
+int onedrive_uploader_start(onedrive_uploader_t *up, const char *session);
+
+/*
+ * Uploads what the journaled session still expects according to its
+ * status response. On failure the caller should discard the journal and
+ * create a new session.
+ */
+int onedrive_uploader_resume(onedrive_uploader_t *up, const char *status);
+
+/*
+ * Computes the quickXorHash OneDrive reports for file content, encoded in
+ * base64 the same way as in the hashes facet of a driveItem.
+ */
+#define ONEDRIVE_QUICKXOR_HASH_LEN  (29)
+
+int onedrive_quickxor_hash_file(int fd, size_t fsize, char *hash, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ONEDRIVE_UPLOAD_H__
@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2019 Elastos Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <limits.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include <crystal.h>
+
+#include "ela_hive.h"
+#include "owncloud.h"
+#include "owncloud_drive.h"
+#include "owncloud_propfind.h"
+#include "owncloud_utils.h"
+#include "hive_error.h"
+#include "hive_client.h"
+#include "mkdirs.h"
+
+typedef struct OwnCloudClient {
+    HiveClient base;
+    owncloud_server_t *server;
+    char tmp_template[PATH_MAX];
+} OwnCloudClient;
+
+static bool login_entry_callback(const owncloud_entry_t *entry, void *context)
+{
+    (void)entry;
+    (void)context;
+
+    return false;
+}
+
+static int owncloud_client_login(HiveClient *base,
+                                 HiveRequestAuthenticationCallback *cb,
+                                 void *user_data)
+{
+    OwnCloudClient *client = (OwnCloudClient *)base;
+    int rc;
+
+    (void)cb;
+    (void)user_data;
+
+    assert(client);
+
+    // Basic credentials are sent with every request, just check them once.
+    rc = owncloud_propfind(client->server, "/", "0", login_entry_callback,
+                           NULL);
+    if (rc < 0) {
+        vlogE("OwnCloudClient: failed to authenticate with server.");
+        return rc;
+    }
+
+    return 0;
+}
+
+static int owncloud_client_logout(HiveClient *base)
+{
+    (void)base;
+
+    return 0;
+}
+
+static int owncloud_client_get_info(HiveClient *base, HiveClientInfo *result)
+{
+    OwnCloudClient *client = (OwnCloudClient *)base;
+    int rc;
+
+    assert(client);
+    assert(result);
+
+    rc = snprintf(result->user_id, sizeof(result->user_id), "%s",
+                  client->server->username);
+    if (rc < 0 || rc >= sizeof(result->user_id)) {
+        vlogE("OwnCloudClient: Failed to fill user id field of client info.");
+        return HIVE_GENERAL_ERROR(HIVEERR_BUFFER_TOO_SMALL);
+    }
+
+    result->display_name[0] = '\0';
+    result->email[0]        = '\0';
+    result->phone_number[0] = '\0';
+    result->region[0]       = '\0';
+
+    return 0;
+}
+
+static int owncloud_client_drive_open(HiveClient *base, HiveDrive **drive)
+{
+    OwnCloudClient *client = (OwnCloudClient *)base;
+    int rc;
+
+    assert(client);
+    assert(drive);
+
+    rc = owncloud_drive_open(client->server, client->tmp_template, drive);
+    if (rc < 0) {
+        vlogE("OwnCloudClient: Failed to open ownCloud drive.");
+        return rc;
+    }
+
+    return 0;
+}
+
+static int owncloud_client_close(HiveClient *base)
+{
+    assert(base);
+
+    deref(base);
+    return 0;
+}
+
+static void owncloud_client_destructor(void *obj)
+{
+    OwnCloudClient *client = (OwnCloudClient *)obj;
+
+    if (client->server)
+        deref(client->server);
+}
+
+HiveClient *owncloud_client_new(const HiveOptions *options)
+{
+    OwnCloudOptions *opts = (OwnCloudOptions *)options;
+    OwnCloudClient *client;
+    char path[PATH_MAX];
+    int rc;
+
+    assert(options);
+    assert(options->persistent_location);
+
+    if (!opts->url || !*opts->url || !opts->username || !opts->password) {
+        vlogE("OwnCloudClient: missing server url or credentials.");
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS));
+        return NULL;
+    }
+
+    rc = snprintf(path, sizeof(path), "%s/.data/owncloud",
+                  options->persistent_location);
+    if (rc < 0 || rc >= sizeof(path)) {
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_BUFFER_TOO_SMALL));
+        return NULL;
+    }
+
+    rc = mkdirs(path, S_IRWXU);
+    if (rc < 0 && errno != EEXIST) {
+        vlogE("OwnCloudClient: failed to create directory (%d).", errno);
+        hive_set_error(HIVE_SYS_ERROR(errno));
+        return NULL;
+    }
+
+    client = (OwnCloudClient *)rc_zalloc(sizeof(OwnCloudClient),
+                                         owncloud_client_destructor);
+    if (!client) {
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY));
+        return NULL;
+    }
+
+    rc = snprintf(client->tmp_template, sizeof(client->tmp_template),
+                  "%s/XXXXXX", path);
+    if (rc < 0 || rc >= sizeof(client->tmp_template)) {
+        vlogE("OwnCloudClient: template too long.");
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_BUFFER_TOO_SMALL));
+        deref(client);
+        return NULL;
+    }
+
+    client->server = owncloud_server_new(opts->url, opts->username,
+                                         opts->password);
+    if (!client->server) {
+        deref(client);
+        return NULL;
+    }
+
+    client->base.login       = &owncloud_client_login;
+    client->base.logout      = &owncloud_client_logout;
+    client->base.get_info    = &owncloud_client_get_info;
+    client->base.get_drive   = &owncloud_client_drive_open;
+    client->base.close       = &owncloud_client_close;
+
+    return &client->base;
+}
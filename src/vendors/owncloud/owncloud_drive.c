@@ -0,0 +1,344 @@
+/*
+ * Copyright (c) 2019 Elastos Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <limits.h>
+
+#include <crystal.h>
+
+#include "ela_hive.h"
+#include "owncloud_drive.h"
+#include "owncloud_file.h"
+#include "owncloud_propfind.h"
+#include "owncloud_utils.h"
+#include "http_client.h"
+#include "http_status.h"
+#include "hive_error.h"
+#include "hive_client.h"
+
+typedef struct OwnCloudDrive {
+    HiveDrive base;
+    owncloud_server_t *server;
+    char tmp_template[PATH_MAX];
+} OwnCloudDrive;
+
+static int owncloud_drive_get_info(HiveDrive *base, HiveDriveInfo *info)
+{
+    OwnCloudDrive *drive = (OwnCloudDrive *)base;
+    int rc;
+
+    assert(drive);
+    assert(info);
+
+    rc = snprintf(info->driveid, sizeof(info->driveid), "%s",
+                  drive->server->username);
+    if (rc < 0 || rc >= sizeof(info->driveid)) {
+        vlogE("OwnCloudDrive: drive id too long.");
+        return HIVE_GENERAL_ERROR(HIVEERR_BUFFER_TOO_SMALL);
+    }
+
+    return 0;
+}
+
+typedef struct propfind_context {
+    char self[PATH_MAX];
+    bool stopped;
+
+    // list
+    HiveFilesIterateCallback *callback;
+    void *context;
+
+    // stat
+    HiveFileInfo *info;
+    bool found;
+} propfind_context_t;
+
+static void trim_slashes(char *path)
+{
+    size_t len = strlen(path);
+
+    while (len > 0 && path[len - 1] == '/')
+        path[--len] = '\0';
+}
+
+static bool is_self(propfind_context_t *ctx, const char *href)
+{
+    char path[PATH_MAX];
+
+    snprintf(path, sizeof(path), "%s", href);
+    trim_slashes(path);
+
+    return !strcmp(path, ctx->self);
+}
+
+static bool stat_entry_callback(const owncloud_entry_t *entry, void *context)
+{
+    propfind_context_t *ctx = (propfind_context_t *)context;
+    HiveFileInfo *info = ctx->info;
+
+    snprintf(info->fileid, sizeof(info->fileid), "%s", entry->fileid);
+    strcpy(info->type, entry->is_dir ? "directory" : "file");
+    info->size = entry->is_dir ? 0 : entry->size;
+
+    ctx->found = true;
+    return false;
+}
+
+static int owncloud_drive_stat_file(HiveDrive *base, const char *path,
+                                    HiveFileInfo *info)
+{
+    OwnCloudDrive *drive = (OwnCloudDrive *)base;
+    propfind_context_t ctx;
+    int rc;
+
+    assert(drive);
+    assert(path);
+    assert(info);
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.info = info;
+
+    rc = owncloud_propfind(drive->server, path, "0", stat_entry_callback,
+                           &ctx);
+    if (rc < 0)
+        return rc;
+
+    if (!ctx.found) {
+        vlogE("OwnCloudDrive: no status of the file in response.");
+        return HIVE_HTTP_STATUS_ERROR(HttpStatus_NotFound);
+    }
+
+    return 0;
+}
+
+static bool list_entry_callback(const owncloud_entry_t *entry, void *context)
+{
+    propfind_context_t *ctx = (propfind_context_t *)context;
+    char path[PATH_MAX];
+    KeyValue properties[2];
+    char *name;
+
+    // A listing starts with the collection itself.
+    if (is_self(ctx, entry->href))
+        return true;
+
+    snprintf(path, sizeof(path), "%s", entry->href);
+    trim_slashes(path);
+
+    name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+
+    properties[0].key   = "name";
+    properties[0].value = name;
+    properties[1].key   = "type";
+    properties[1].value = entry->is_dir ? "directory" : "file";
+
+    if (!ctx->callback(properties,
+                       sizeof(properties) / sizeof(properties[0]),
+                       ctx->context)) {
+        ctx->stopped = true;
+        return false;
+    }
+
+    return true;
+}
+
+static int owncloud_drive_list_files(HiveDrive *base, const char *path,
+                                     HiveFilesIterateCallback *callback,
+                                     void *context)
+{
+    OwnCloudDrive *drive = (OwnCloudDrive *)base;
+    propfind_context_t ctx;
+    int rc;
+
+    assert(drive);
+    assert(path);
+    assert(callback);
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.callback = callback;
+    ctx.context = context;
+
+    rc = snprintf(ctx.self, sizeof(ctx.self), "%s%s",
+                  drive->server->root_path, path);
+    if (rc < 0 || rc >= sizeof(ctx.self))
+        return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
+    trim_slashes(ctx.self);
+
+    rc = owncloud_propfind(drive->server, path, "1", list_entry_callback,
+                           &ctx);
+    if (rc < 0)
+        return rc;
+
+    if (!ctx.stopped)
+        callback(NULL, 0, context);
+
+    return 0;
+}
+
+static int perform_request(OwnCloudDrive *drive, http_method_t method,
+                           const char *path, const char *dest,
+                           long expected, long alternative)
+{
+    char url[OWNCLOUD_MAX_URL_LEN];
+    http_client_t *httpc;
+    long resp_code = 0;
+    int rc;
+
+    httpc = owncloud_http_client_new(drive->server, method, path);
+    if (!httpc)
+        return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
+
+    if (dest) {
+        rc = owncloud_get_url(drive->server, dest, url, sizeof(url));
+        if (rc < 0) {
+            http_client_close(httpc);
+            return rc;
+        }
+
+        // Same as the other backends, moves and copies replace the target.
+        http_client_set_header(httpc, "Destination", url);
+        http_client_set_header(httpc, "Overwrite", "T");
+    }
+
+    rc = owncloud_http_perform(httpc, &resp_code);
+    http_client_close(httpc);
+    if (rc < 0)
+        return rc;
+
+    if (resp_code != expected && resp_code != alternative) {
+        vlogE("OwnCloudDrive: error from http response (%d).", resp_code);
+        return HIVE_HTTP_STATUS_ERROR(resp_code);
+    }
+
+    return 0;
+}
+
+static int owncloud_drive_mkdir(HiveDrive *base, const char *path)
+{
+    OwnCloudDrive *drive = (OwnCloudDrive *)base;
+
+    assert(drive);
+    assert(path);
+
+    return perform_request(drive, HTTP_METHOD_MKCOL, path, NULL,
+                           HttpStatus_Created, HttpStatus_Created);
+}
+
+static int owncloud_drive_move_file(HiveDrive *base, const char *from,
+                                    const char *to)
+{
+    OwnCloudDrive *drive = (OwnCloudDrive *)base;
+
+    assert(drive);
+    assert(from);
+    assert(to);
+
+    return perform_request(drive, HTTP_METHOD_MOVE, from, to,
+                           HttpStatus_Created, HttpStatus_NoContent);
+}
+
+static int owncloud_drive_copy_file(HiveDrive *base, const char *from,
+                                    const char *to)
+{
+    OwnCloudDrive *drive = (OwnCloudDrive *)base;
+
+    assert(drive);
+    assert(from);
+    assert(to);
+
+    return perform_request(drive, HTTP_METHOD_COPY, from, to,
+                           HttpStatus_Created, HttpStatus_NoContent);
+}
+
+static int owncloud_drive_delete_file(HiveDrive *base, const char *path)
+{
+    OwnCloudDrive *drive = (OwnCloudDrive *)base;
+
+    assert(drive);
+    assert(path);
+
+    return perform_request(drive, HTTP_METHOD_DELETE, path, NULL,
+                           HttpStatus_NoContent, HttpStatus_OK);
+}
+
+static int owncloud_drive_open_file(HiveDrive *base, const char *path,
+                                    int flags, HiveFile **file)
+{
+    OwnCloudDrive *drive = (OwnCloudDrive *)base;
+
+    return owncloud_file_open(drive->server, path, flags, drive->tmp_template,
+                              file);
+}
+
+static void owncloud_drive_close(HiveDrive *base)
+{
+    assert(base);
+
+    deref(base);
+}
+
+static void owncloud_drive_destructor(void *obj)
+{
+    OwnCloudDrive *drive = (OwnCloudDrive *)obj;
+
+    if (drive->server)
+        deref(drive->server);
+}
+
+int owncloud_drive_open(owncloud_server_t *server, const char *tmp_template,
+                        HiveDrive **drive)
+{
+    OwnCloudDrive *tmp;
+
+    assert(server);
+    assert(tmp_template);
+    assert(drive);
+
+    if (strlen(tmp_template) >= sizeof(tmp->tmp_template))
+        return HIVE_GENERAL_ERROR(HIVEERR_BUFFER_TOO_SMALL);
+
+    tmp = (OwnCloudDrive *)rc_zalloc(sizeof(OwnCloudDrive),
+                                     owncloud_drive_destructor);
+    if (!tmp)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    tmp->server = ref(server);
+    strcpy(tmp->tmp_template, tmp_template);
+
+    tmp->base.get_info    = &owncloud_drive_get_info;
+    tmp->base.stat_file   = &owncloud_drive_stat_file;
+    tmp->base.list_files  = &owncloud_drive_list_files;
+    tmp->base.make_dir    = &owncloud_drive_mkdir;
+    tmp->base.move_file   = &owncloud_drive_move_file;
+    tmp->base.copy_file   = &owncloud_drive_copy_file;
+    tmp->base.delete_file = &owncloud_drive_delete_file;
+    tmp->base.open_file   = &owncloud_drive_open_file;
+    tmp->base.close       = &owncloud_drive_close;
+
+    *drive = &tmp->base;
+
+    return 0;
+}
@@ -0,0 +1,583 @@
+/*
+ * Copyright (c) 2019 Elastos Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#if defined(_WIN32) || defined(_WIN64)
+#include <io.h>
+#endif
+
+#include <crystal.h>
+#include <curl/curl.h>
+
+#include "ela_hive.h"
+#include "owncloud_file.h"
+#include "owncloud_propfind.h"
+#include "owncloud_utils.h"
+#include "http_client.h"
+#include "http_status.h"
+#include "hive_error.h"
+#include "hive_client.h"
+
+/*
+ * Until the first write, reads are served by HTTP Range requests straight
+ * into the caller's buffer. The first write pulls the remote content into
+ * a private working copy, which every later read and write goes to, and
+ * a commit streams that copy back with a single PUT. Closing without a
+ * commit leaves the remote file untouched.
+ */
+typedef struct OwnCloudFile {
+    HiveFile base;
+    owncloud_server_t *server;
+    char tmp_template[PATH_MAX];
+    char tmp_path[PATH_MAX];
+    int fd;
+    bool dirty;
+    bool remote_exists;
+    size_t remote_size;
+    size_t lpos;
+} OwnCloudFile;
+
+#if defined(_WIN32) || defined(_WIN64)
+static int mkstemp(char *template)
+{
+    errno_t err;
+
+    err = _mktemp_s(template, strlen(template) + 1);
+    if (err) {
+        errno = err;
+        vlogE("OwnCloudFile: failed to call _mktemp_s() (%d).", errno);
+        return -1;
+    }
+
+    return open(template, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+}
+#endif
+
+static int get_local_size(OwnCloudFile *file, size_t *size)
+{
+    struct stat st;
+
+    if (fstat(file->fd, &st) < 0) {
+        vlogE("OwnCloudFile: failed to call fstat() (%d).", errno);
+        return HIVE_SYS_ERROR(errno);
+    }
+
+    *size = (size_t)st.st_size;
+    return 0;
+}
+
+static ssize_t owncloud_file_lseek(HiveFile *base, ssize_t offset,
+                                   Whence whence)
+{
+    OwnCloudFile *file = (OwnCloudFile *)base;
+    size_t fsz;
+    int rc;
+
+    switch (whence) {
+    case HiveSeek_Cur:
+        file->lpos = offset + (ssize_t)file->lpos < 0 ? 0 : offset + file->lpos;
+        return file->lpos;
+    case HiveSeek_Set:
+        file->lpos = offset > 0 ? offset : 0;
+        return file->lpos;
+    case HiveSeek_End:
+        if (file->fd >= 0) {
+            rc = get_local_size(file, &fsz);
+            if (rc < 0)
+                return rc;
+        } else {
+            fsz = file->remote_size;
+        }
+
+        file->lpos = offset + (ssize_t)fsz < 0 ? 0 : offset + fsz;
+        return file->lpos;
+    default:
+        assert(0);
+        vlogE("OwnCloudFile: unrecognizable whence parameter.");
+        return HIVE_GENERAL_ERROR(HIVEERR_NOT_SUPPORTED);
+    }
+}
+
+static ssize_t read_local(OwnCloudFile *file, char *buf, size_t bufsz)
+{
+    ssize_t nrd;
+
+    if (lseek(file->fd, (long)file->lpos, SEEK_SET) < 0) {
+        vlogE("OwnCloudFile: failed to call lseek() (%d).", errno);
+        return HIVE_SYS_ERROR(errno);
+    }
+
+    do {
+        nrd = read(file->fd, buf, bufsz);
+    } while (nrd < 0 && errno == EINTR);
+
+    if (nrd < 0) {
+        vlogE("OwnCloudFile: failed to read file (%d).", errno);
+        return HIVE_SYS_ERROR(errno);
+    }
+
+    return nrd;
+}
+
+typedef struct range_context {
+    http_client_t *httpc;
+    char *buf;
+    size_t bufsz;
+    size_t len;
+    size_t skip;
+    bool checked;
+    bool accepted;
+} range_context_t;
+
+static size_t range_body_callback(char *buffer, size_t size, size_t nitems,
+                                  void *userdata)
+{
+    range_context_t *ctx = (range_context_t *)userdata;
+    size_t len = size * nitems;
+    size_t skip;
+    size_t copy;
+
+    if (!ctx->checked) {
+        long resp_code = 0;
+
+        // A server ignoring the range sends the whole content instead.
+        http_client_get_response_code(ctx->httpc, &resp_code);
+        ctx->accepted = resp_code == HttpStatus_PartialContent ||
+                        resp_code == HttpStatus_OK;
+        if (resp_code != HttpStatus_OK)
+            ctx->skip = 0;
+        ctx->checked = true;
+    }
+
+    if (!ctx->accepted)
+        return len;
+
+    skip = ctx->skip < len ? ctx->skip : len;
+    ctx->skip -= skip;
+
+    copy = len - skip;
+    if (copy > ctx->bufsz - ctx->len)
+        copy = ctx->bufsz - ctx->len;
+
+    memcpy(ctx->buf + ctx->len, buffer + skip, copy);
+    ctx->len += copy;
+
+    // Stop the transfer once the buffer is full.
+    return ctx->len < ctx->bufsz ? len : 0;
+}
+
+static ssize_t read_remote(OwnCloudFile *file, char *buf, size_t bufsz)
+{
+    char range[64];
+    range_context_t ctx;
+    long resp_code = 0;
+    int rc;
+
+    if (!file->remote_exists || file->lpos >= file->remote_size || !bufsz)
+        return 0;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.buf = buf;
+    ctx.bufsz = bufsz;
+    ctx.skip = file->lpos;
+
+    ctx.httpc = owncloud_http_client_new(file->server, HTTP_METHOD_GET,
+                                         file->base.path);
+    if (!ctx.httpc)
+        return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
+
+    snprintf(range, sizeof(range), "bytes=%zu-%zu", file->lpos,
+             file->lpos + bufsz - 1);
+    http_client_set_header(ctx.httpc, "Range", range);
+    http_client_set_response_body(ctx.httpc, range_body_callback, &ctx);
+
+    rc = http_client_request(ctx.httpc);
+    if (rc == 0 || ctx.len == bufsz)
+        rc = http_client_get_response_code(ctx.httpc, &resp_code);
+
+    http_client_close(ctx.httpc);
+
+    if (rc) {
+        vlogE("OwnCloudFile: failed to perform http request.");
+        return HIVE_CURL_ERROR(rc);
+    }
+
+    if (resp_code == HttpStatus_RangeNotSatisfiable)
+        return 0;
+
+    if (resp_code != HttpStatus_PartialContent && resp_code != HttpStatus_OK) {
+        vlogE("OwnCloudFile: error from http response (%d).", resp_code);
+        return HIVE_HTTP_STATUS_ERROR(resp_code);
+    }
+
+    return ctx.len;
+}
+
+static ssize_t owncloud_file_read(HiveFile *base, char *buf, size_t bufsz)
+{
+    OwnCloudFile *file = (OwnCloudFile *)base;
+    ssize_t rc;
+
+    if (file->fd >= 0)
+        rc = read_local(file, buf, bufsz);
+    else
+        rc = read_remote(file, buf, bufsz);
+
+    if (rc > 0)
+        file->lpos += rc;
+
+    return rc;
+}
+
+static size_t download_body_callback(char *buffer, size_t size,
+                                     size_t nitems, void *userdata)
+{
+    int fd = *((int *)userdata);
+    size_t len = size * nitems;
+    size_t written = 0;
+    ssize_t nwr;
+
+    while (written < len) {
+        nwr = write(fd, buffer + written, len - written);
+        if (nwr < 0 && errno == EINTR)
+            continue;
+
+        if (nwr < 0) {
+            vlogE("OwnCloudFile: failed to write working copy (%d).", errno);
+            return 0;
+        }
+
+        written += nwr;
+    }
+
+    return len;
+}
+
+static int download_file(OwnCloudFile *file, int fd)
+{
+    http_client_t *httpc;
+    long resp_code = 0;
+    int rc;
+
+    httpc = owncloud_http_client_new(file->server, HTTP_METHOD_GET,
+                                     file->base.path);
+    if (!httpc)
+        return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
+
+    http_client_set_response_body(httpc, download_body_callback, &fd);
+
+    rc = owncloud_http_perform(httpc, &resp_code);
+    http_client_close(httpc);
+    if (rc < 0)
+        return rc;
+
+    if (resp_code != HttpStatus_OK) {
+        vlogE("OwnCloudFile: error from http response (%d).", resp_code);
+        return HIVE_HTTP_STATUS_ERROR(resp_code);
+    }
+
+    return 0;
+}
+
+static int open_working_copy(OwnCloudFile *file, bool keep_content)
+{
+    int fd;
+    int rc;
+
+    strcpy(file->tmp_path, file->tmp_template);
+    fd = mkstemp(file->tmp_path);
+    if (fd < 0) {
+        vlogE("OwnCloudFile: failed to call mkstemp() (%d).", errno);
+        return HIVE_SYS_ERROR(errno);
+    }
+
+    if (keep_content && file->remote_exists) {
+        rc = download_file(file, fd);
+        if (rc < 0) {
+            vlogE("OwnCloudFile: failed to download file.");
+            close(fd);
+            unlink(file->tmp_path);
+            return rc;
+        }
+    }
+
+    file->fd = fd;
+    file->dirty = true;
+    return 0;
+}
+
+static int prepare_write(OwnCloudFile *file)
+{
+    int rc;
+
+    if (file->fd < 0) {
+        rc = open_working_copy(file, true);
+        if (rc < 0)
+            return rc;
+    }
+
+    file->dirty = true;
+
+    if (HIVE_F_IS_SET(file->base.flags, HIVE_F_APPEND)) {
+        rc = get_local_size(file, &file->lpos);
+        if (rc < 0)
+            return rc;
+    }
+
+    return 0;
+}
+
+static ssize_t owncloud_file_write(HiveFile *base, const char *buf,
+                                   size_t bufsz)
+{
+    OwnCloudFile *file = (OwnCloudFile *)base;
+    size_t written = 0;
+    ssize_t nwr;
+    int rc;
+
+    rc = prepare_write(file);
+    if (rc < 0)
+        return rc;
+
+    if (lseek(file->fd, (long)file->lpos, SEEK_SET) < 0) {
+        vlogE("OwnCloudFile: failed to call lseek() (%d).", errno);
+        return HIVE_SYS_ERROR(errno);
+    }
+
+    while (written < bufsz) {
+        nwr = write(file->fd, buf + written, bufsz - written);
+        if (nwr < 0 && errno == EINTR)
+            continue;
+
+        if (nwr < 0) {
+            vlogE("OwnCloudFile: failed to write file (%d).", errno);
+            return HIVE_SYS_ERROR(errno);
+        }
+
+        written += nwr;
+    }
+
+    file->lpos += written;
+    return written;
+}
+
+static size_t upload_body_callback(char *buffer, size_t size, size_t nitems,
+                                   void *userdata)
+{
+    int fd = *((int *)userdata);
+    ssize_t nrd;
+
+    do {
+        nrd = read(fd, buffer, size * nitems);
+    } while (nrd < 0 && errno == EINTR);
+
+    if (nrd < 0) {
+        vlogE("OwnCloudFile: failed to read working copy (%d).", errno);
+        return CURL_READFUNC_ABORT;
+    }
+
+    return nrd;
+}
+
+static int owncloud_file_commit(HiveFile *base)
+{
+    OwnCloudFile *file = (OwnCloudFile *)base;
+    http_client_t *httpc;
+    long resp_code = 0;
+    size_t size;
+    int rc;
+
+    if (!file->dirty)
+        return 0;
+
+    rc = get_local_size(file, &size);
+    if (rc < 0)
+        return rc;
+
+    if (lseek(file->fd, 0, SEEK_SET) < 0) {
+        vlogE("OwnCloudFile: failed to call lseek() (%d).", errno);
+        return HIVE_SYS_ERROR(errno);
+    }
+
+    httpc = owncloud_http_client_new(file->server, HTTP_METHOD_PUT,
+                                     file->base.path);
+    if (!httpc)
+        return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
+
+    // The working copy is streamed as the body, never loaded in memory.
+    http_client_set_request_body(httpc, upload_body_callback, &file->fd);
+
+    rc = owncloud_http_perform(httpc, &resp_code);
+    http_client_close(httpc);
+    if (rc < 0)
+        return rc;
+
+    if (resp_code != HttpStatus_Created && resp_code != HttpStatus_NoContent &&
+        resp_code != HttpStatus_OK) {
+        vlogE("OwnCloudFile: error from http response (%d).", resp_code);
+        return HIVE_HTTP_STATUS_ERROR(resp_code);
+    }
+
+    // The working copy mirrors the remote file now and keeps serving reads.
+    file->dirty = false;
+    file->remote_exists = true;
+    file->remote_size = size;
+    return 0;
+}
+
+static int owncloud_file_discard(HiveFile *base)
+{
+    OwnCloudFile *file = (OwnCloudFile *)base;
+
+    if (!file->dirty)
+        return 0;
+
+    // Reads go back to the remote file.
+    close(file->fd);
+    unlink(file->tmp_path);
+    file->fd = -1;
+    file->dirty = false;
+    file->lpos = 0;
+    return 0;
+}
+
+static int owncloud_file_close(HiveFile *base)
+{
+    deref(base);
+    return 0;
+}
+
+static void owncloud_file_destructor(void *obj)
+{
+    OwnCloudFile *file = (OwnCloudFile *)obj;
+
+    if (file->fd >= 0) {
+        close(file->fd);
+        unlink(file->tmp_path);
+    }
+
+    if (file->server)
+        deref(file->server);
+}
+
+typedef struct file_stat {
+    bool found;
+    bool is_dir;
+    size_t size;
+} file_stat_t;
+
+static bool stat_entry_callback(const owncloud_entry_t *entry, void *context)
+{
+    file_stat_t *st = (file_stat_t *)context;
+
+    st->found = true;
+    st->is_dir = entry->is_dir;
+    st->size = entry->size;
+    return false;
+}
+
+int owncloud_file_open(owncloud_server_t *server, const char *path, int flags,
+                       const char *tmp_template, HiveFile **file)
+{
+    OwnCloudFile *tmp;
+    file_stat_t st;
+    bool file_exists;
+    int rc;
+
+    assert(server);
+    assert(path);
+    assert(tmp_template);
+    assert(file);
+
+    memset(&st, 0, sizeof(st));
+    rc = owncloud_propfind(server, path, "0", stat_entry_callback, &st);
+    if (rc < 0 && rc != HIVE_HTTP_STATUS_ERROR(HttpStatus_NotFound)) {
+        vlogE("OwnCloudFile: get file status failure.");
+        return rc;
+    }
+
+    file_exists = !rc && st.found ? true : false;
+
+    if (file_exists && st.is_dir) {
+        vlogE("OwnCloudFile: can not open a directory.");
+        return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
+    }
+
+    if (HIVE_F_IS_EQ(flags, HIVE_F_RDONLY)) {
+        if (!file_exists) {
+            vlogE("OwnCloudFile: readonly but file does not exist.");
+            return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
+        }
+    } else if (HIVE_F_IS_SET(flags, HIVE_F_CREAT | HIVE_F_EXCL) && file_exists) {
+        vlogE("OwnCloudFile: file exists while EXCL flag is set.");
+        return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
+    } else if (!HIVE_F_IS_SET(flags, HIVE_F_CREAT) && !file_exists) {
+        vlogE("OwnCloudFile: CREAT flag is not set while file does not exist.");
+        return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
+    }
+
+    if (strlen(tmp_template) >= sizeof(tmp->tmp_template))
+        return HIVE_GENERAL_ERROR(HIVEERR_BUFFER_TOO_SMALL);
+
+    tmp = (OwnCloudFile *)rc_zalloc(sizeof(OwnCloudFile),
+                                    owncloud_file_destructor);
+    if (!tmp)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    tmp->server = ref(server);
+    tmp->fd = -1;
+    tmp->remote_exists = file_exists;
+    tmp->remote_size = file_exists ? st.size : 0;
+    strcpy(tmp->tmp_template, tmp_template);
+
+    // A new or truncated file starts from an empty working copy.
+    if (!file_exists || HIVE_F_IS_SET(flags, HIVE_F_TRUNC)) {
+        rc = open_working_copy(tmp, false);
+        if (rc < 0) {
+            deref(tmp);
+            return rc;
+        }
+    }
+
+    strcpy(tmp->base.path, path);
+    tmp->base.flags   = flags;
+    tmp->base.lseek   = owncloud_file_lseek;
+    tmp->base.read    = owncloud_file_read;
+    tmp->base.write   = owncloud_file_write;
+    tmp->base.commit  = owncloud_file_commit;
+    tmp->base.discard = owncloud_file_discard;
+    tmp->base.close   = owncloud_file_close;
+
+    *file = &tmp->base;
+    return 0;
+}
@@ -0,0 +1,596 @@
+/*
+ * Copyright (c) 2019 Elastos Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+
+#include <crystal.h>
+
+#include "ela_hive.h"
+#include "hive_error.h"
+#include "owncloud_propfind.h"
+#include "owncloud_utils.h"
+#include "http_client.h"
+#include "http_status.h"
+
+#define MAX_TAG_LEN             256
+#define MAX_TEXT_LEN            4096
+
+const char owncloud_propfind_body[] =
+    "<?xml version=\"1.0\" encoding=\"utf-8\"?>"
+    "<d:propfind xmlns:d=\"DAV:\" xmlns:oc=\"http://owncloud.org/ns\">"
+    "<d:prop>"
+    "<d:resourcetype/>"
+    "<d:getcontentlength/>"
+    "<d:getetag/>"
+    "<oc:fileid/>"
+    "</d:prop>"
+    "</d:propfind>";
+
+typedef enum {
+    STATE_TEXT,
+    STATE_TAG,
+    STATE_MARKUP,
+    STATE_COMMENT,
+    STATE_CDATA,
+    STATE_PI
+} state_t;
+
+typedef enum {
+    FIELD_NONE,
+    FIELD_HREF,
+    FIELD_LENGTH,
+    FIELD_FILEID,
+    FIELD_ETAG
+} field_t;
+
+static const char *field_names[] = {
+    NULL,
+    "href",
+    "getcontentlength",
+    "fileid",
+    "getetag"
+};
+
+/*
+ * Only the handful of properties of a listing are of interest, so rather
+ * than building a document the scanner tracks element names as they go
+ * by and keeps the text of the current property only. Memory use does
+ * not depend on the size of the body.
+ */
+struct owncloud_propfind {
+    owncloud_entry_callback_t *callback;
+    void *context;
+
+    state_t state;
+    char quote;
+    int match;
+
+    char tag[MAX_TAG_LEN];
+    size_t tag_len;
+    char tag_last;
+
+    field_t field;
+    char text[MAX_TEXT_LEN];
+    size_t text_len;
+    bool overflow;
+
+    bool in_response;
+    char href[MAX_TEXT_LEN];
+    char fileid[128];
+    char etag[128];
+    bool is_dir;
+    size_t size;
+};
+
+owncloud_propfind_t *owncloud_propfind_new(owncloud_entry_callback_t *callback,
+                                           void *context)
+{
+    owncloud_propfind_t *parser;
+
+    assert(callback);
+
+    parser = (owncloud_propfind_t *)calloc(1, sizeof(owncloud_propfind_t));
+    if (!parser)
+        return NULL;
+
+    parser->callback = callback;
+    parser->context = context;
+    parser->state = STATE_TEXT;
+
+    return parser;
+}
+
+void owncloud_propfind_delete(owncloud_propfind_t *parser)
+{
+    free(parser);
+}
+
+static void put_utf8(char **out, unsigned long cp)
+{
+    char *p = *out;
+
+    if (cp < 0x80) {
+        *p++ = (char)cp;
+    } else if (cp < 0x800) {
+        *p++ = (char)(0xc0 | (cp >> 6));
+        *p++ = (char)(0x80 | (cp & 0x3f));
+    } else if (cp < 0x10000) {
+        *p++ = (char)(0xe0 | (cp >> 12));
+        *p++ = (char)(0x80 | ((cp >> 6) & 0x3f));
+        *p++ = (char)(0x80 | (cp & 0x3f));
+    } else {
+        *p++ = (char)(0xf0 | (cp >> 18));
+        *p++ = (char)(0x80 | ((cp >> 12) & 0x3f));
+        *p++ = (char)(0x80 | ((cp >> 6) & 0x3f));
+        *p++ = (char)(0x80 | (cp & 0x3f));
+    }
+
+    *out = p;
+}
+
+// Entities never grow when decoded, so this works in place.
+static void decode_entities(char *str)
+{
+    static const struct {
+        const char *name;
+        char c;
+    } entities[] = {
+        { "amp;",  '&'  },
+        { "lt;",   '<'  },
+        { "gt;",   '>'  },
+        { "quot;", '"'  },
+        { "apos;", '\'' }
+    };
+    char *out = str;
+    size_t i;
+
+    while (*str) {
+        if (*str != '&') {
+            *out++ = *str++;
+            continue;
+        }
+
+        if (str[1] == '#') {
+            char *end;
+            unsigned long cp;
+
+            if (str[2] == 'x')
+                cp = strtoul(str + 3, &end, 16);
+            else
+                cp = strtoul(str + 2, &end, 10);
+
+            if (*end == ';' && cp > 0 && cp <= 0x10ffff) {
+                put_utf8(&out, cp);
+                str = end + 1;
+                continue;
+            }
+        } else {
+            for (i = 0; i < sizeof(entities) / sizeof(entities[0]); i++) {
+                size_t len = strlen(entities[i].name);
+
+                if (!strncmp(str + 1, entities[i].name, len)) {
+                    *out++ = entities[i].c;
+                    str += len + 1;
+                    break;
+                }
+            }
+            if (i < sizeof(entities) / sizeof(entities[0]))
+                continue;
+        }
+
+        *out++ = *str++;
+    }
+
+    *out = '\0';
+}
+
+static void reset_entry(owncloud_propfind_t *parser)
+{
+    parser->href[0] = '\0';
+    parser->fileid[0] = '\0';
+    parser->etag[0] = '\0';
+    parser->is_dir = false;
+    parser->size = 0;
+}
+
+static int emit_entry(owncloud_propfind_t *parser)
+{
+    owncloud_entry_t entry;
+    char *href = parser->href;
+    char *p;
+
+    // Servers may answer with absolute URLs instead of absolute paths.
+    p = strstr(href, "://");
+    if (p) {
+        href = strchr(p + 3, '/');
+        if (!href) {
+            strcpy(parser->href, "/");
+            href = parser->href;
+        }
+    }
+
+    owncloud_unescape(href);
+
+    entry.href   = href;
+    entry.fileid = parser->fileid[0] ? parser->fileid : parser->etag;
+    entry.is_dir = parser->is_dir;
+    entry.size   = parser->size;
+
+    return parser->callback(&entry, parser->context) ? 0 : 1;
+}
+
+static int finish_field(owncloud_propfind_t *parser)
+{
+    field_t field = parser->field;
+    char *text = parser->text;
+
+    parser->field = FIELD_NONE;
+
+    if (parser->overflow) {
+        vlogE("OwnCloudPropfind: %s too long.", field_names[field]);
+        return HIVE_GENERAL_ERROR(HIVEERR_BUFFER_TOO_SMALL);
+    }
+
+    text[parser->text_len] = '\0';
+    decode_entities(text);
+
+    while (isspace((unsigned char)*text))
+        text++;
+
+    // Properties the server lacks come back empty in a 404 propstat,
+    // which must not wipe the values of the 200 one.
+    if (!*text)
+        return 0;
+
+    switch (field) {
+    case FIELD_HREF:
+        strcpy(parser->href, text);
+        break;
+    case FIELD_LENGTH:
+        parser->size = (size_t)strtoull(text, NULL, 10);
+        break;
+    case FIELD_FILEID:
+        snprintf(parser->fileid, sizeof(parser->fileid), "%s", text);
+        break;
+    case FIELD_ETAG:
+        snprintf(parser->etag, sizeof(parser->etag), "%s", text);
+        break;
+    default:
+        break;
+    }
+
+    return 0;
+}
+
+static void start_element(owncloud_propfind_t *parser, const char *name)
+{
+    field_t field;
+
+    if (!strcmp(name, "response")) {
+        parser->in_response = true;
+        reset_entry(parser);
+        return;
+    }
+
+    if (!parser->in_response)
+        return;
+
+    if (!strcmp(name, "collection")) {
+        parser->is_dir = true;
+        return;
+    }
+
+    for (field = FIELD_HREF; field <= FIELD_ETAG; field++) {
+        if (!strcmp(name, field_names[field])) {
+            parser->field = field;
+            parser->text_len = 0;
+            parser->overflow = false;
+            return;
+        }
+    }
+}
+
+static int end_element(owncloud_propfind_t *parser, const char *name)
+{
+    if (parser->field != FIELD_NONE &&
+        !strcmp(name, field_names[parser->field]))
+        return finish_field(parser);
+
+    if (!strcmp(name, "response") && parser->in_response) {
+        parser->in_response = false;
+        return emit_entry(parser);
+    }
+
+    return 0;
+}
+
+static int process_tag(owncloud_propfind_t *parser)
+{
+    char *name = parser->tag;
+    bool is_end = false;
+    bool empty;
+    char *p;
+    int rc;
+
+    parser->tag[parser->tag_len] = '\0';
+    empty = parser->tag_last == '/';
+
+    if (*name == '/') {
+        is_end = true;
+        name++;
+    }
+
+    for (p = name; *p && !isspace((unsigned char)*p) && *p != '/'; p++);
+    *p = '\0';
+
+    // Namespaces are not resolved, the local name is enough here.
+    p = strrchr(name, ':');
+    if (p)
+        name = p + 1;
+
+    if (is_end)
+        return end_element(parser, name);
+
+    start_element(parser, name);
+    if (empty) {
+        rc = end_element(parser, name);
+        if (rc != 0)
+            return rc;
+    }
+
+    return 0;
+}
+
+static void append_text(owncloud_propfind_t *parser, char c)
+{
+    if (parser->field == FIELD_NONE)
+        return;
+
+    if (parser->text_len + 1 >= sizeof(parser->text)) {
+        parser->overflow = true;
+        return;
+    }
+
+    parser->text[parser->text_len++] = c;
+}
+
+static void append_tag(owncloud_propfind_t *parser, char c)
+{
+    if (parser->tag_len + 1 < sizeof(parser->tag))
+        parser->tag[parser->tag_len++] = c;
+
+    parser->tag_last = c;
+}
+
+int owncloud_propfind_feed(owncloud_propfind_t *parser, const char *data,
+                           size_t len)
+{
+    size_t i;
+    int rc;
+
+    assert(parser);
+    assert(data || !len);
+
+    for (i = 0; i < len; i++) {
+        char c = data[i];
+
+        switch (parser->state) {
+        case STATE_TEXT:
+            if (c != '<') {
+                append_text(parser, c);
+                break;
+            }
+
+            parser->state = STATE_TAG;
+            parser->tag_len = 0;
+            parser->tag_last = '\0';
+            parser->quote = '\0';
+            parser->match = 0;
+            break;
+
+        case STATE_TAG:
+            if (parser->tag_len == 0 && (c == '!' || c == '?')) {
+                parser->state = c == '!' ? STATE_MARKUP : STATE_PI;
+                break;
+            }
+
+            if (parser->quote) {
+                if (c == parser->quote)
+                    parser->quote = '\0';
+                append_tag(parser, c);
+                break;
+            }
+
+            if (c == '"' || c == '\'') {
+                parser->quote = c;
+                append_tag(parser, c);
+                break;
+            }
+
+            if (c != '>') {
+                append_tag(parser, c);
+                break;
+            }
+
+            parser->state = STATE_TEXT;
+            rc = process_tag(parser);
+            if (rc != 0)
+                return rc;
+            break;
+
+        case STATE_MARKUP:
+            append_tag(parser, c);
+            if (parser->tag_len == 2 && !strncmp(parser->tag, "--", 2)) {
+                parser->state = STATE_COMMENT;
+            } else if (parser->tag_len == 7 &&
+                       !strncmp(parser->tag, "[CDATA[", 7)) {
+                parser->state = STATE_CDATA;
+            } else if (c == '>') {
+                // A declaration such as <!DOCTYPE ...>, nothing to take.
+                parser->state = STATE_TEXT;
+            }
+            break;
+
+        case STATE_COMMENT:
+            if (c == '-') {
+                parser->match++;
+            } else {
+                if (c == '>' && parser->match >= 2)
+                    parser->state = STATE_TEXT;
+                parser->match = 0;
+            }
+            break;
+
+        case STATE_CDATA:
+            if (c == '>' && parser->match >= 2) {
+                // Take back the "]]" appended as text.
+                if (parser->field != FIELD_NONE && !parser->overflow)
+                    parser->text_len -= 2;
+                parser->state = STATE_TEXT;
+                break;
+            }
+
+            parser->match = c == ']' ? parser->match + 1 : 0;
+            append_text(parser, c);
+            break;
+
+        case STATE_PI:
+            if (c == '>' && parser->match)
+                parser->state = STATE_TEXT;
+            parser->match = c == '?';
+            break;
+        }
+    }
+
+    return 0;
+}
+
+typedef struct propfind_request {
+    http_client_t *httpc;
+    owncloud_propfind_t *parser;
+    bool checked;
+    bool multistatus;
+    bool stopped;
+    int rc;
+} propfind_request_t;
+
+/*
+ * Entries are parsed straight out of the body as it streams in, a body
+ * which is not a multistatus is just drained.
+ */
+static size_t propfind_body_callback(char *buffer, size_t size,
+                                     size_t nitems, void *userdata)
+{
+    propfind_request_t *req = (propfind_request_t *)userdata;
+    size_t len = size * nitems;
+    int rc;
+
+    if (!req->checked) {
+        long resp_code = 0;
+
+        http_client_get_response_code(req->httpc, &resp_code);
+        req->multistatus = resp_code == HttpStatus_MultiStatus;
+        req->checked = true;
+    }
+
+    if (!req->multistatus)
+        return len;
+
+    rc = owncloud_propfind_feed(req->parser, buffer, len);
+    if (rc < 0) {
+        req->rc = rc;
+        return 0;
+    }
+
+    if (rc > 0) {
+        req->stopped = true;
+        return 0;
+    }
+
+    return len;
+}
+
+int owncloud_propfind(owncloud_server_t *server, const char *path,
+                      const char *depth, owncloud_entry_callback_t *callback,
+                      void *context)
+{
+    propfind_request_t req;
+    long resp_code = 0;
+    int rc;
+
+    assert(server);
+    assert(path);
+    assert(depth);
+    assert(callback);
+
+    memset(&req, 0, sizeof(req));
+
+    req.parser = owncloud_propfind_new(callback, context);
+    if (!req.parser)
+        return HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY);
+
+    req.httpc = owncloud_http_client_new(server, HTTP_METHOD_PROPFIND, path);
+    if (!req.httpc) {
+        owncloud_propfind_delete(req.parser);
+        return HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS);
+    }
+
+    http_client_set_header(req.httpc, "Depth", depth);
+    http_client_set_header(req.httpc, "Content-Type",
+                           "application/xml; charset=utf-8");
+    http_client_set_request_body_instant(req.httpc,
+                                         (void *)owncloud_propfind_body,
+                                         strlen(owncloud_propfind_body));
+    http_client_set_response_body(req.httpc, propfind_body_callback, &req);
+
+    rc = http_client_request(req.httpc);
+    if (rc == 0)
+        rc = http_client_get_response_code(req.httpc, &resp_code);
+
+    http_client_close(req.httpc);
+    owncloud_propfind_delete(req.parser);
+
+    // Stopping the listing aborts the transfer on purpose.
+    if (req.stopped)
+        return 0;
+
+    if (req.rc < 0) {
+        vlogE("OwnCloudPropfind: malformed multistatus response.");
+        return req.rc;
+    }
+
+    if (rc) {
+        vlogE("OwnCloudPropfind: failed to perform http request.");
+        return HIVE_CURL_ERROR(rc);
+    }
+
+    if (resp_code != HttpStatus_MultiStatus) {
+        vlogE("OwnCloudPropfind: error from http response (%d).", resp_code);
+        return HIVE_HTTP_STATUS_ERROR(resp_code);
+    }
+
+    return 0;
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2019 Elastos Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __OWNCLOUD_PROPFIND_H__
+#define __OWNCLOUD_PROPFIND_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "owncloud_utils.h"
+
+/*
+ * One <d:response> of a multistatus body. The href is unescaped and
+ * reduced to its path.
+ */
+typedef struct owncloud_entry {
+    const char *href;
+    const char *fileid;
+    bool is_dir;
+    size_t size;
+} owncloud_entry_t;
+
+typedef bool owncloud_entry_callback_t(const owncloud_entry_t *entry,
+                                       void *context);
+
+typedef struct owncloud_propfind owncloud_propfind_t;
+
+/*
+ * The request body asking for the properties the parser picks up.
+ */
+extern const char owncloud_propfind_body[];
+
+/*
+ * Incremental parser of PROPFIND multistatus responses. Bytes are fed as
+ * they arrive, in chunks of any size, and each entry is handed to the
+ * callback as soon as its closing tag is seen.
+ */
+owncloud_propfind_t *owncloud_propfind_new(owncloud_entry_callback_t *callback,
+                                           void *context);
+
+void owncloud_propfind_delete(owncloud_propfind_t *parser);
+
+/*
+ * Returns 0 to go on, 1 once the callback asked to stop, or a negative
+ * error when the body can not be parsed.
+ */
+int owncloud_propfind_feed(owncloud_propfind_t *parser, const char *data,
+                           size_t len);
+
+/*
+ * Issue a PROPFIND of the given depth on the hive path and stream the
+ * entries of the response to the callback. Returns 0 also when the
+ * callback stopped the listing midway.
+ */
+int owncloud_propfind(owncloud_server_t *server, const char *path,
+                      const char *depth, owncloud_entry_callback_t *callback,
+                      void *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __OWNCLOUD_PROPFIND_H__
@@ -0,0 +1,299 @@
+/*
+ * Copyright (c) 2019 Elastos Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+
+#include <crystal.h>
+
+#include "ela_hive.h"
+#include "hive_error.h"
+#include "owncloud_utils.h"
+
+static void base64_encode(const unsigned char *data, size_t len, char *out)
+{
+    static const char table[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t i;
+
+    for (i = 0; i + 2 < len; i += 3) {
+        *out++ = table[data[i] >> 2];
+        *out++ = table[((data[i] & 0x03) << 4) | (data[i + 1] >> 4)];
+        *out++ = table[((data[i + 1] & 0x0f) << 2) | (data[i + 2] >> 6)];
+        *out++ = table[data[i + 2] & 0x3f];
+    }
+
+    if (i < len) {
+        *out++ = table[data[i] >> 2];
+        if (i + 1 < len) {
+            *out++ = table[((data[i] & 0x03) << 4) | (data[i + 1] >> 4)];
+            *out++ = table[(data[i + 1] & 0x0f) << 2];
+        } else {
+            *out++ = table[(data[i] & 0x03) << 4];
+            *out++ = '=';
+        }
+        *out++ = '=';
+    }
+
+    *out = '\0';
+}
+
+static http_header_list_t *basic_auth_headers(const char *username,
+                                              const char *password)
+{
+    http_header_list_t *headers;
+    char *credentials;
+    char *value;
+    size_t len;
+    int rc;
+
+    len = strlen(username) + strlen(password) + 1;
+    credentials = (char *)malloc(len + 1);
+    value = (char *)malloc(strlen("Basic ") + (len + 2) / 3 * 4 + 1);
+    if (!credentials || !value) {
+        free(credentials);
+        free(value);
+        return NULL;
+    }
+
+    sprintf(credentials, "%s:%s", username, password);
+    strcpy(value, "Basic ");
+    base64_encode((unsigned char *)credentials, len, value + strlen("Basic "));
+
+    memset(credentials, 0, len);
+    free(credentials);
+
+    headers = http_header_list_new();
+    if (!headers) {
+        free(value);
+        return NULL;
+    }
+
+    rc = http_header_list_append(headers, "Authorization", value);
+    memset(value, 0, strlen(value));
+    free(value);
+    if (rc) {
+        deref(headers);
+        return NULL;
+    }
+
+    return headers;
+}
+
+static void owncloud_server_destructor(void *obj)
+{
+    owncloud_server_t *server = (owncloud_server_t *)obj;
+
+    if (server->auth_headers)
+        deref(server->auth_headers);
+}
+
+owncloud_server_t *owncloud_server_new(const char *url, const char *username,
+                                       const char *password)
+{
+    owncloud_server_t *server;
+    http_client_t *httpc;
+    char *path = NULL;
+    size_t len;
+    int rc;
+
+    assert(url);
+    assert(username);
+    assert(password);
+
+    if (strlen(url) >= sizeof(server->url) ||
+        strlen(username) >= sizeof(server->username)) {
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS));
+        return NULL;
+    }
+
+    server = (owncloud_server_t *)rc_zalloc(sizeof(owncloud_server_t),
+                                            owncloud_server_destructor);
+    if (!server) {
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY));
+        return NULL;
+    }
+
+    strcpy(server->url, url);
+    len = strlen(server->url);
+    while (len > 0 && server->url[len - 1] == '/')
+        server->url[--len] = '\0';
+
+    strcpy(server->username, username);
+
+    // Hrefs in responses are absolute paths, remember the root one.
+    httpc = http_client_new();
+    if (!httpc) {
+        deref(server);
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY));
+        return NULL;
+    }
+
+    rc = http_client_set_url_escape(httpc, server->url);
+    if (rc == 0)
+        rc = http_client_get_path(httpc, &path);
+    http_client_close(httpc);
+    if (rc) {
+        vlogE("OwnCloudUtils: invalid url %s.", url);
+        deref(server);
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS));
+        return NULL;
+    }
+
+    snprintf(server->root_path, sizeof(server->root_path), "%s", path);
+    http_client_memory_free(path);
+
+    len = strlen(server->root_path);
+    while (len > 0 && server->root_path[len - 1] == '/')
+        server->root_path[--len] = '\0';
+
+    server->auth_headers = basic_auth_headers(username, password);
+    if (!server->auth_headers) {
+        deref(server);
+        hive_set_error(HIVE_GENERAL_ERROR(HIVEERR_OUT_OF_MEMORY));
+        return NULL;
+    }
+
+    return server;
+}
+
+static bool is_unreserved(int c)
+{
+    return isalnum(c) || c == '-' || c == '.' || c == '_' || c == '~' ||
+           c == '/';
+}
+
+int owncloud_get_url(owncloud_server_t *server, const char *path,
+                     char *buf, size_t bufsz)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    size_t len;
+
+    assert(server);
+    assert(path);
+
+    len = strlen(server->url);
+    if (len >= bufsz)
+        return HIVE_GENERAL_ERROR(HIVEERR_BUFFER_TOO_SMALL);
+
+    memcpy(buf, server->url, len);
+
+    if (*path != '/') {
+        if (len + 1 >= bufsz)
+            return HIVE_GENERAL_ERROR(HIVEERR_BUFFER_TOO_SMALL);
+        buf[len++] = '/';
+    }
+
+    for (; *path; path++) {
+        unsigned char c = (unsigned char)*path;
+
+        if (is_unreserved(c)) {
+            if (len + 1 >= bufsz)
+                return HIVE_GENERAL_ERROR(HIVEERR_BUFFER_TOO_SMALL);
+            buf[len++] = (char)c;
+        } else {
+            if (len + 3 >= bufsz)
+                return HIVE_GENERAL_ERROR(HIVEERR_BUFFER_TOO_SMALL);
+            buf[len++] = '%';
+            buf[len++] = hex[c >> 4];
+            buf[len++] = hex[c & 0x0f];
+        }
+    }
+
+    buf[len] = '\0';
+    return 0;
+}
+
+http_client_t *owncloud_http_client_new(owncloud_server_t *server,
+                                        http_method_t method, const char *path)
+{
+    char url[OWNCLOUD_MAX_URL_LEN];
+    http_client_t *httpc;
+    int rc;
+
+    rc = owncloud_get_url(server, path, url, sizeof(url));
+    if (rc < 0) {
+        vlogE("OwnCloudUtils: path too long.");
+        return NULL;
+    }
+
+    httpc = http_client_new();
+    if (!httpc) {
+        vlogE("OwnCloudUtils: failed to create http client instance.");
+        return NULL;
+    }
+
+    http_client_set_url_escape(httpc, url);
+    http_client_set_method(httpc, method);
+    http_client_set_header_list(httpc, server->auth_headers);
+
+    return httpc;
+}
+
+int owncloud_http_perform(http_client_t *httpc, long *resp_code)
+{
+    int rc;
+
+    rc = http_client_request(httpc);
+    if (rc) {
+        vlogE("OwnCloudUtils: failed to perform http request.");
+        return HIVE_CURL_ERROR(rc);
+    }
+
+    rc = http_client_get_response_code(httpc, resp_code);
+    if (rc) {
+        vlogE("OwnCloudUtils: failed to get http response code.");
+        return HIVE_CURL_ERROR(rc);
+    }
+
+    return 0;
+}
+
+static int hex_value(int c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+void owncloud_unescape(char *str)
+{
+    char *out = str;
+
+    while (*str) {
+        if (str[0] == '%' && hex_value(str[1]) >= 0 && hex_value(str[2]) >= 0) {
+            *out++ = (char)(hex_value(str[1]) << 4 | hex_value(str[2]));
+            str += 3;
+        } else {
+            *out++ = *str++;
+        }
+    }
+
+    *out = '\0';
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2019 Elastos Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __OWNCLOUD_UTILS_H__
+#define __OWNCLOUD_UTILS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include "http_client.h"
+
+#define OWNCLOUD_MAX_URL_LEN        4096
+
+/*
+ * The WebDAV endpoint shared by a client and its drive and files. The
+ * Basic credentials are formatted once into a header list every request
+ * shares.
+ */
+typedef struct owncloud_server {
+    char url[OWNCLOUD_MAX_URL_LEN];
+    char root_path[OWNCLOUD_MAX_URL_LEN];
+    char username[256];
+    http_header_list_t *auth_headers;
+} owncloud_server_t;
+
+owncloud_server_t *owncloud_server_new(const char *url, const char *username,
+                                       const char *password);
+
+/*
+ * Compose the escaped URL of the hive path on the server.
+ */
+int owncloud_get_url(owncloud_server_t *server, const char *path,
+                     char *buf, size_t bufsz);
+
+/*
+ * Create a request of method on the hive path, carrying the credentials.
+ */
+http_client_t *owncloud_http_client_new(owncloud_server_t *server,
+                                        http_method_t method, const char *path);
+
+/*
+ * Perform the request and fetch its response code. The client is left
+ * open to the caller.
+ */
+int owncloud_http_perform(http_client_t *httpc, long *resp_code);
+
+/*
+ * Decode the %XX sequences of str in place.
+ */
+void owncloud_unescape(char *str);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __OWNCLOUD_UTILS_H__
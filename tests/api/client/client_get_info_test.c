@@ -80,3 +80,19 @@ int ipfs_client_get_info_test_suite_cleanup(void)
 
     return 0;
 }
+
+int native_client_get_info_test_suite_init(void)
+{
+    test_ctx.client = native_client_new();
+    if (!test_ctx.client)
+        return -1;
+
+    return 0;
+}
+
+int native_client_get_info_test_suite_cleanup(void)
+{
+    test_context_cleanup();
+
+    return 0;
+}
@@ -75,3 +75,17 @@ int ipfs_client_new_test_suite_cleanup(void)
 
     return 0;
 }
+
+int native_client_new_test_suite_init(void)
+{
+    test_ctx.ext = native_client_new;
+
+    return 0;
+}
+
+int native_client_new_test_suite_cleanup(void)
+{
+    test_context_cleanup();
+
+    return 0;
+}
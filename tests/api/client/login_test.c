@@ -126,3 +126,19 @@ int ipfs_login_test_suite_cleanup(void)
 
     return 0;
 }
+
+int native_login_test_suite_init(void)
+{
+    test_ctx.client = native_client_new();
+    if (!test_ctx.client)
+        return -1;
+
+    return 0;
+}
+
+int native_login_test_suite_cleanup(void)
+{
+    test_context_cleanup();
+
+    return 0;
+}
@@ -0,0 +1,306 @@
+/*
+ * Copyright (c) 2019 Elastos Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <limits.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <crystal.h>
+#endif
+
+#include <CUnit/Basic.h>
+#include <ela_hive.h>
+
+#include "config.h"
+#include "test_context.h"
+#include "test_helper.h"
+
+typedef struct {
+    int done;
+    int result;
+    int entries;
+} async_result;
+
+static char working_dir_name[PATH_MAX];
+
+static void completion_cb(int result, void *context)
+{
+    async_result *res = (async_result *)context;
+
+    res->done++;
+    res->result = result;
+}
+
+static bool count_entries_cb(const KeyValue *info, size_t size, void *context)
+{
+    async_result *res = (async_result *)context;
+
+    (void)size;
+
+    if (info)
+        res->entries++;
+
+    return true;
+}
+
+static int wait_for_completion(async_result *res)
+{
+    int i;
+
+    for (i = 0; i < 3000 && !res->done; i++) {
+        if (hive_client_process_completions(test_ctx.client) < 0)
+            return -1;
+
+        if (!res->done)
+            usleep(10000);
+    }
+
+    return res->done == 1 ? res->result : -1;
+}
+
+static void test_async_mkdir(void)
+{
+    async_result res = {0};
+    char dir_name[PATH_MAX];
+    int rc;
+
+    snprintf(dir_name, sizeof(dir_name), "%s/async", working_dir_name);
+
+    rc = hive_drive_mkdir_async(test_ctx.drive, dir_name, completion_cb, &res);
+    CU_ASSERT_FATAL(rc == 0);
+    // Callbacks never run inside the submitting call.
+    CU_ASSERT(res.done == 0);
+
+    rc = wait_for_completion(&res);
+    CU_ASSERT(rc == 0);
+}
+
+static void test_async_stat_file(void)
+{
+    async_result res = {0};
+    HiveFileInfo info;
+    char dir_name[PATH_MAX];
+    int rc;
+
+    snprintf(dir_name, sizeof(dir_name), "%s/async", working_dir_name);
+
+    rc = hive_drive_file_stat_async(test_ctx.drive, dir_name, &info,
+                                    completion_cb, &res);
+    CU_ASSERT_FATAL(rc == 0);
+
+    rc = wait_for_completion(&res);
+    CU_ASSERT(rc == 0);
+    CU_ASSERT(!strcmp(info.type, "directory"));
+}
+
+static void test_async_list_files(void)
+{
+    async_result res = {0};
+    int rc;
+
+    rc = hive_drive_list_files_async(test_ctx.drive, working_dir_name,
+                                     count_entries_cb, completion_cb, &res);
+    CU_ASSERT_FATAL(rc == 0);
+
+    rc = wait_for_completion(&res);
+    CU_ASSERT(rc == 0);
+    CU_ASSERT(res.entries == 1);
+}
+
+static void test_async_delete_file(void)
+{
+    async_result res = {0};
+    char dir_name[PATH_MAX];
+    int rc;
+
+    snprintf(dir_name, sizeof(dir_name), "%s/async", working_dir_name);
+
+    rc = hive_drive_delete_file_async(test_ctx.drive, dir_name,
+                                      completion_cb, &res);
+    CU_ASSERT_FATAL(rc == 0);
+
+    rc = wait_for_completion(&res);
+    CU_ASSERT(rc == 0);
+}
+
+static void test_async_stat_nonexist_file(void)
+{
+    async_result res = {0};
+    HiveFileInfo info;
+    int rc;
+
+    rc = hive_drive_file_stat_async(test_ctx.drive, get_random_file_name(),
+                                    &info, completion_cb, &res);
+    CU_ASSERT_FATAL(rc == 0);
+
+    rc = wait_for_completion(&res);
+    CU_ASSERT(rc < 0);
+}
+
+static void test_async_invalid_args(void)
+{
+    async_result res = {0};
+    int rc;
+
+    rc = hive_drive_mkdir_async(test_ctx.drive, "relative", completion_cb, &res);
+    CU_ASSERT(rc == -1);
+
+    rc = hive_drive_mkdir_async(test_ctx.drive, working_dir_name, NULL, NULL);
+    CU_ASSERT(rc == -1);
+
+    CU_ASSERT(hive_client_process_completions(test_ctx.client) == 0);
+    CU_ASSERT(res.done == 0);
+}
+
+static CU_TestInfo cases[] = {
+    { "test_async_mkdir"             , test_async_mkdir              },
+    { "test_async_stat_file"         , test_async_stat_file          },
+    { "test_async_list_files"        , test_async_list_files         },
+    { "test_async_delete_file"       , test_async_delete_file        },
+    { "test_async_stat_nonexist_file", test_async_stat_nonexist_file },
+    { "test_async_invalid_args"      , test_async_invalid_args       },
+    { NULL, NULL }
+};
+
+CU_TestInfo *async_ops_test_get_cases(void)
+{
+    return cases;
+}
+
+int onedrive_async_ops_test_suite_init(void)
+{
+    int rc;
+
+    test_ctx.client = onedrive_client_new();
+    if (!test_ctx.client)
+        return -1;
+
+    rc = hive_client_login(test_ctx.client, open_authorization_url, NULL);
+    if (rc < 0)
+        return -1;
+
+    test_ctx.drive = hive_drive_open(test_ctx.client);
+    if (!test_ctx.drive)
+        return -1;
+
+    strcpy(working_dir_name, get_random_file_name());
+
+    rc = hive_drive_mkdir(test_ctx.drive, working_dir_name);
+    if (rc < 0)
+        return -1;
+
+    return 0;
+}
+
+int onedrive_async_ops_test_suite_cleanup(void)
+{
+    int rc;
+
+    rc = hive_drive_delete_file(test_ctx.drive, working_dir_name);
+    if (rc < 0)
+        return -1;
+
+    test_context_cleanup();
+
+    return 0;
+}
+
+int ipfs_async_ops_test_suite_init(void)
+{
+    int rc;
+
+    test_ctx.client = ipfs_client_new();
+    if (!test_ctx.client)
+        return -1;
+
+    rc = hive_client_login(test_ctx.client, NULL, NULL);
+    if (rc < 0)
+        return -1;
+
+    test_ctx.drive = hive_drive_open(test_ctx.client);
+    if (!test_ctx.drive)
+        return -1;
+
+    strcpy(working_dir_name, get_random_file_name());
+
+    rc = hive_drive_mkdir(test_ctx.drive, working_dir_name);
+    if (rc < 0)
+        return -1;
+
+    return 0;
+}
+
+int ipfs_async_ops_test_suite_cleanup(void)
+{
+    int rc;
+
+    rc = hive_drive_delete_file(test_ctx.drive, working_dir_name);
+    if (rc < 0)
+        return -1;
+
+    test_context_cleanup();
+
+    return 0;
+}
+
+int native_async_ops_test_suite_init(void)
+{
+    int rc;
+
+    test_ctx.client = native_client_new();
+    if (!test_ctx.client)
+        return -1;
+
+    rc = hive_client_login(test_ctx.client, NULL, NULL);
+    if (rc < 0)
+        return -1;
+
+    test_ctx.drive = hive_drive_open(test_ctx.client);
+    if (!test_ctx.drive)
+        return -1;
+
+    strcpy(working_dir_name, get_random_file_name());
+
+    rc = hive_drive_mkdir(test_ctx.drive, working_dir_name);
+    if (rc < 0)
+        return -1;
+
+    return 0;
+}
+
+int native_async_ops_test_suite_cleanup(void)
+{
+    int rc;
+
+    rc = hive_drive_delete_file(test_ctx.drive, working_dir_name);
+    if (rc < 0)
+        return -1;
+
+    test_context_cleanup();
+
+    return 0;
+}
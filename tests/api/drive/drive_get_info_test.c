@@ -97,3 +97,55 @@ int ipfs_drive_get_info_test_suite_cleanup(void)
 
     return 0;
 }
+
+int native_drive_get_info_test_suite_init(void)
+{
+    int rc;
+
+    test_ctx.client = native_client_new();
+    if (!test_ctx.client)
+        return -1;
+
+    rc = hive_client_login(test_ctx.client, NULL, NULL);
+    if (rc < 0)
+        return -1;
+
+    test_ctx.drive = hive_drive_open(test_ctx.client);
+    if (!test_ctx.drive)
+        return -1;
+
+    return 0;
+}
+
+int native_drive_get_info_test_suite_cleanup(void)
+{
+    test_context_cleanup();
+
+    return 0;
+}
+
+int owncloud_drive_get_info_test_suite_init(void)
+{
+    int rc;
+
+    test_ctx.client = owncloud_client_new();
+    if (!test_ctx.client)
+        return -1;
+
+    rc = hive_client_login(test_ctx.client, NULL, NULL);
+    if (rc < 0)
+        return -1;
+
+    test_ctx.drive = hive_drive_open(test_ctx.client);
+    if (!test_ctx.drive)
+        return -1;
+
+    return 0;
+}
+
+int owncloud_drive_get_info_test_suite_cleanup(void)
+{
+    test_context_cleanup();
+
+    return 0;
+}
@@ -21,6 +21,7 @@
  */
 
 #include <limits.h>
+#include <string.h>
 
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
@@ -47,6 +48,14 @@ static dir_entry ipfs_dir_entries[] = {
     IPFS_DIR_ENTRY("test", "directory"),
     IPFS_DIR_ENTRY("test2", "directory")
 };
+static dir_entry native_dir_entries[] = {
+    ONEDRIVE_DIR_ENTRY("test", "directory"),
+    ONEDRIVE_DIR_ENTRY("test2", "directory")
+};
+static dir_entry owncloud_dir_entries[] = {
+    ONEDRIVE_DIR_ENTRY("test", "directory"),
+    ONEDRIVE_DIR_ENTRY("test2", "directory")
+};
 
 static bool list_nonexist_dir_cb(const KeyValue *info, size_t size, void *context)
 {
@@ -205,6 +214,116 @@ static void test_stat_file_nonexist(void)
     CU_ASSERT_FATAL(rc < 0);
 }
 
+static void test_flush(void)
+{
+    int rc;
+
+    rc = hive_drive_flush(test_ctx.drive);
+    CU_ASSERT_FATAL(rc == HIVEOK);
+}
+
+static void test_batch(void)
+{
+    int rc;
+    dir_entry *entries = (dir_entry *)test_ctx.ext;
+    char dir_name1[PATH_MAX];
+    char dir_name2[PATH_MAX];
+    HiveFileInfo info1;
+    HiveFileInfo info2;
+    HiveBatchRequest reqs[2];
+
+    snprintf(dir_name1, sizeof(dir_name1), "%s/test", working_dir_name);
+    snprintf(dir_name2, sizeof(dir_name2), "%s/test2", working_dir_name);
+
+    memset(reqs, 0, sizeof(reqs));
+    reqs[0].op   = HiveBatchOp_Mkdir;
+    reqs[0].path = dir_name1;
+    reqs[1].op   = HiveBatchOp_Mkdir;
+    reqs[1].path = dir_name2;
+
+    rc = hive_drive_batch(test_ctx.drive, reqs, 2);
+    CU_ASSERT_FATAL(rc == HIVEOK);
+
+    list_files_test_scheme(test_ctx.drive, working_dir_name, entries, 2);
+
+    reqs[0].op   = HiveBatchOp_Stat;
+    reqs[0].info = &info1;
+    reqs[1].op   = HiveBatchOp_Stat;
+    reqs[1].info = &info2;
+
+    rc = hive_drive_batch(test_ctx.drive, reqs, 2);
+    CU_ASSERT(rc == HIVEOK);
+    if (rc == HIVEOK) {
+        CU_ASSERT(!strcmp(info1.type, "directory"));
+        CU_ASSERT(!strcmp(info2.type, "directory"));
+    }
+
+    reqs[0].op = HiveBatchOp_Delete;
+    reqs[1].op = HiveBatchOp_Delete;
+
+    rc = hive_drive_batch(test_ctx.drive, reqs, 2);
+    CU_ASSERT(rc == HIVEOK);
+    CU_ASSERT(reqs[0].result == HIVEOK);
+    CU_ASSERT(reqs[1].result == HIVEOK);
+}
+
+static void test_batch_nonexist(void)
+{
+    int rc;
+    char dir_name[PATH_MAX];
+    HiveFileInfo info1;
+    HiveFileInfo info2;
+    HiveBatchRequest reqs[2];
+
+    snprintf(dir_name, sizeof(dir_name), "%s", get_random_file_name());
+
+    memset(reqs, 0, sizeof(reqs));
+    reqs[0].op   = HiveBatchOp_Stat;
+    reqs[0].path = dir_name;
+    reqs[0].info = &info1;
+    reqs[1].op   = HiveBatchOp_Stat;
+    reqs[1].path = working_dir_name;
+    reqs[1].info = &info2;
+
+    rc = hive_drive_batch(test_ctx.drive, reqs, 2);
+    CU_ASSERT_FATAL(rc < 0);
+    CU_ASSERT(reqs[0].result < 0);
+    CU_ASSERT(reqs[1].result == HIVEOK);
+}
+
+static void test_batch_invalid_paths(void)
+{
+    int rc;
+    size_t i;
+    char path[PATH_MAX];
+    HiveBatchRequest reqs[5];
+
+    snprintf(path, sizeof(path), "%s/test", working_dir_name);
+
+    memset(reqs, 0, sizeof(reqs));
+    reqs[0].op     = HiveBatchOp_Move;
+    reqs[0].path   = "/";
+    reqs[0].target = path;
+    reqs[1].op     = HiveBatchOp_Move;
+    reqs[1].path   = path;
+    reqs[1].target = path;
+    reqs[2].op     = HiveBatchOp_Copy;
+    reqs[2].path   = "/";
+    reqs[2].target = path;
+    reqs[3].op     = HiveBatchOp_Copy;
+    reqs[3].path   = path;
+    reqs[3].target = "/";
+    reqs[4].op     = HiveBatchOp_Copy;
+    reqs[4].path   = path;
+    reqs[4].target = path;
+
+    for (i = 0; i < sizeof(reqs) / sizeof(reqs[0]); i++) {
+        rc = hive_drive_batch(test_ctx.drive, &reqs[i], 1);
+        CU_ASSERT(rc < 0);
+        CU_ASSERT(hive_get_error() == HIVE_GENERAL_ERROR(HIVEERR_INVALID_ARGS));
+    }
+}
+
 static CU_TestInfo cases[] = {
     { "test_mkdir"             , test_mkdir              },
     { "test_mv_file"           , test_mv_file            },
@@ -214,6 +333,10 @@ static CU_TestInfo cases[] = {
     { "test_rm_file_nonexist"  , test_rm_file_nonexist   },
     { "test_stat_file"         , test_stat_file          },
     { "test_stat_file_nonexist", test_stat_file_nonexist },
+    { "test_batch"             , test_batch              },
+    { "test_batch_nonexist"    , test_batch_nonexist     },
+    { "test_batch_invalid_paths", test_batch_invalid_paths },
+    { "test_flush"             , test_flush              },
     { NULL, NULL }
 };
 
@@ -301,3 +424,83 @@ int ipfs_file_ops_test_suite_cleanup(void)
 
     return 0;
 }
+
+int native_file_ops_test_suite_init(void)
+{
+    int rc;
+
+    test_ctx.ext = native_dir_entries;
+
+    test_ctx.client = native_client_new();
+    if (!test_ctx.client)
+        return -1;
+
+    rc = hive_client_login(test_ctx.client, NULL, NULL);
+    if (rc < 0)
+        return -1;
+
+    test_ctx.drive = hive_drive_open(test_ctx.client);
+    if (!test_ctx.drive)
+        return -1;
+
+    strcpy(working_dir_name, get_random_file_name());
+
+    rc = hive_drive_mkdir(test_ctx.drive, working_dir_name);
+    if (rc < 0)
+        return -1;
+
+    return 0;
+}
+
+int native_file_ops_test_suite_cleanup(void)
+{
+    int rc;
+
+    rc = hive_drive_delete_file(test_ctx.drive, working_dir_name);
+    if (rc < 0)
+        return -1;
+
+    test_context_cleanup();
+
+    return 0;
+}
+
+int owncloud_file_ops_test_suite_init(void)
+{
+    int rc;
+
+    test_ctx.ext = owncloud_dir_entries;
+
+    test_ctx.client = owncloud_client_new();
+    if (!test_ctx.client)
+        return -1;
+
+    rc = hive_client_login(test_ctx.client, NULL, NULL);
+    if (rc < 0)
+        return -1;
+
+    test_ctx.drive = hive_drive_open(test_ctx.client);
+    if (!test_ctx.drive)
+        return -1;
+
+    strcpy(working_dir_name, get_random_file_name());
+
+    rc = hive_drive_mkdir(test_ctx.drive, working_dir_name);
+    if (rc < 0)
+        return -1;
+
+    return 0;
+}
+
+int owncloud_file_ops_test_suite_cleanup(void)
+{
+    int rc;
+
+    rc = hive_drive_delete_file(test_ctx.drive, working_dir_name);
+    if (rc < 0)
+        return -1;
+
+    test_context_cleanup();
+
+    return 0;
+}
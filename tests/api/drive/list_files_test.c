@@ -37,6 +37,8 @@ static char working_dir_name[PATH_MAX];
 
 static dir_entry onedrive_dir_entry = ONEDRIVE_DIR_ENTRY("test", "directory");
 static dir_entry ipfs_dir_entry = IPFS_DIR_ENTRY("test", "directory");
+static dir_entry native_dir_entry = ONEDRIVE_DIR_ENTRY("test", "directory");
+static dir_entry owncloud_dir_entry = ONEDRIVE_DIR_ENTRY("test", "directory");
 
 static bool list_nonexist_dir_cb(const KeyValue *info, size_t size, void *context)
 {
@@ -169,3 +171,83 @@ int ipfs_list_files_test_suite_cleanup(void)
 
     return 0;
 }
+
+int native_list_files_test_suite_init(void)
+{
+    int rc;
+
+    test_ctx.ext = &native_dir_entry;
+
+    test_ctx.client = native_client_new();
+    if (!test_ctx.client)
+        return -1;
+
+    rc = hive_client_login(test_ctx.client, NULL, NULL);
+    if (rc < 0)
+        return -1;
+
+    test_ctx.drive = hive_drive_open(test_ctx.client);
+    if (!test_ctx.drive)
+        return -1;
+
+    strcpy(working_dir_name, get_random_file_name());
+
+    rc = hive_drive_mkdir(test_ctx.drive, working_dir_name);
+    if (rc < 0)
+        return -1;
+
+    return 0;
+}
+
+int native_list_files_test_suite_cleanup(void)
+{
+    int rc;
+
+    rc = hive_drive_delete_file(test_ctx.drive, working_dir_name);
+    if (rc < 0)
+        return -1;
+
+    test_context_cleanup();
+
+    return 0;
+}
+
+int owncloud_list_files_test_suite_init(void)
+{
+    int rc;
+
+    test_ctx.ext = &owncloud_dir_entry;
+
+    test_ctx.client = owncloud_client_new();
+    if (!test_ctx.client)
+        return -1;
+
+    rc = hive_client_login(test_ctx.client, NULL, NULL);
+    if (rc < 0)
+        return -1;
+
+    test_ctx.drive = hive_drive_open(test_ctx.client);
+    if (!test_ctx.drive)
+        return -1;
+
+    strcpy(working_dir_name, get_random_file_name());
+
+    rc = hive_drive_mkdir(test_ctx.drive, working_dir_name);
+    if (rc < 0)
+        return -1;
+
+    return 0;
+}
+
+int owncloud_list_files_test_suite_cleanup(void)
+{
+    int rc;
+
+    rc = hive_drive_delete_file(test_ctx.drive, working_dir_name);
+    if (rc < 0)
+        return -1;
+
+    test_context_cleanup();
+
+    return 0;
+}
@@ -57,6 +57,18 @@ static extension ipfs_ext = {
     .test_file_commit = ipfs_test_file_commit
 };
 
+static extension native_ext = {
+    .entry = ONEDRIVE_DIR_ENTRY("test", "file"),
+    .write_callback = onedrive_file_write,
+    .test_file_commit = onedrive_test_file_commit
+};
+
+static extension owncloud_ext = {
+    .entry = ONEDRIVE_DIR_ENTRY("test", "file"),
+    .write_callback = onedrive_file_write,
+    .test_file_commit = onedrive_test_file_commit
+};
+
 static ssize_t onedrive_file_write(HiveFile *file, const char *buf, size_t bufsz)
 {
     ssize_t nwr;
@@ -556,22 +568,37 @@ static void ipfs_test_file_commit(void)
     int rc;
     char file_path[PATH_MAX];
     HiveFile *file;
+    ssize_t nbytes;
 
     snprintf(file_path, sizeof(file_path), "%s/test", working_dir_name);
 
     file = hive_file_open(test_ctx.drive, file_path, "w+");
     CU_ASSERT_PTR_NOT_NULL_FATAL(file);
 
+    nbytes = hive_file_write(file, "hello", 5);
+    if (nbytes != 5) {
+        CU_FAIL("hive_file_write() failed");
+        hive_file_close(file);
+        return;
+    }
+
     rc = hive_file_commit(file);
-    if (rc == 0) {
+    if (rc < 0) {
         CU_FAIL("hive_file_commit() failed");
         hive_file_close(file);
         return;
     }
 
+    nbytes = hive_file_write(file, "world", 5);
+    if (nbytes != 5) {
+        CU_FAIL("hive_file_write() failed");
+        hive_file_close(file);
+        return;
+    }
+
     rc = hive_file_discard(file);
     hive_file_close(file);
-    if (rc == 0) {
+    if (rc < 0) {
         CU_FAIL("hive_file_discard() failed");
         return;
     }
@@ -678,3 +705,82 @@ int ipfs_file_apis_test_suite_cleanup(void)
     return 0;
 }
 
+int native_file_apis_test_suite_init(void)
+{
+    int rc;
+
+    test_ctx.ext = &native_ext;
+
+    test_ctx.client = native_client_new();
+    if (!test_ctx.client)
+        return -1;
+
+    rc = hive_client_login(test_ctx.client, NULL, NULL);
+    if (rc < 0)
+        return -1;
+
+    test_ctx.drive = hive_drive_open(test_ctx.client);
+    if (!test_ctx.drive)
+        return -1;
+
+    strcpy(working_dir_name, get_random_file_name());
+
+    rc = hive_drive_mkdir(test_ctx.drive, working_dir_name);
+    if (rc < 0)
+        return -1;
+
+    return 0;
+}
+
+int native_file_apis_test_suite_cleanup(void)
+{
+    int rc;
+
+    rc = hive_drive_delete_file(test_ctx.drive, working_dir_name);
+    if (rc < 0)
+        return -1;
+
+    test_context_cleanup();
+
+    return 0;
+}
+
+int owncloud_file_apis_test_suite_init(void)
+{
+    int rc;
+
+    test_ctx.ext = &owncloud_ext;
+
+    test_ctx.client = owncloud_client_new();
+    if (!test_ctx.client)
+        return -1;
+
+    rc = hive_client_login(test_ctx.client, NULL, NULL);
+    if (rc < 0)
+        return -1;
+
+    test_ctx.drive = hive_drive_open(test_ctx.client);
+    if (!test_ctx.drive)
+        return -1;
+
+    strcpy(working_dir_name, get_random_file_name());
+
+    rc = hive_drive_mkdir(test_ctx.drive, working_dir_name);
+    if (rc < 0)
+        return -1;
+
+    return 0;
+}
+
+int owncloud_file_apis_test_suite_cleanup(void)
+{
+    int rc;
+
+    rc = hive_drive_delete_file(test_ctx.drive, working_dir_name);
+    if (rc < 0)
+        return -1;
+
+    test_context_cleanup();
+
+    return 0;
+}
@@ -23,9 +23,9 @@
 #ifndef __API_FILE_TEST_SUITES_H__
 #define __API_FILE_TEST_SUITES_H__
 
-DECL_TESTSUITE_PER_BACKEND(file_apis_test)
+DECL_TESTSUITE_PER_STORAGE_BACKEND(file_apis_test)
 
 #define DEFINE_FILE_TESTSUITES \
-    DEFINE_TESTSUITE_PER_BACKEND(file_apis_test)
+    DEFINE_TESTSUITE_PER_STORAGE_BACKEND(file_apis_test)
 
 #endif /* __API_FILE_TEST_SUITES_H__ */
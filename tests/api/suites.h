@@ -44,7 +44,17 @@ typedef struct TestSuite {
 
 #define DECL_TESTSUITE_PER_BACKEND(mod) \
     DECL_TESTSUITE(mod, onedrive) \
-    DECL_TESTSUITE(mod, ipfs)
+    DECL_TESTSUITE(mod, ipfs) \
+    DECL_TESTSUITE(mod, native)
+
+/*
+ * Drive and file suites also run against a WebDAV server, see the
+ * owncloud section of tests.conf. The ownCloud backend has no
+ * asynchronous operations, so the async suites stay per backend.
+ */
+#define DECL_TESTSUITE_PER_STORAGE_BACKEND(mod) \
+    DECL_TESTSUITE_PER_BACKEND(mod) \
+    DECL_TESTSUITE(mod, owncloud)
 
 #define DEFINE_TESTSUIT(mod, backend) \
     { \
@@ -59,7 +69,32 @@ typedef struct TestSuite {
 
 #define DEFINE_TESTSUITE_PER_BACKEND(mod) \
     DEFINE_TESTSUIT(mod, onedrive), \
-    DEFINE_TESTSUIT(mod, ipfs)
+    DEFINE_TESTSUIT(mod, ipfs), \
+    DEFINE_TESTSUIT(mod, native)
+
+#define DEFINE_TESTSUITE_PER_STORAGE_BACKEND(mod) \
+    DEFINE_TESTSUITE_PER_BACKEND(mod), \
+    DEFINE_TESTSUIT(mod, owncloud)
+
+/*
+ * Unit suites exercise internal modules directly, independent of any
+ * backend.
+ */
+#define DECL_UNIT_TESTSUITE(mod) \
+    int mod##_suite_init(void); \
+    int mod##_suite_cleanup(void); \
+    CU_TestInfo *mod##_get_cases(void);
+
+#define DEFINE_UNIT_TESTSUITE(mod) \
+    { \
+        .fileName = #mod".c", \
+        .strName  = #mod, \
+        .pCases   = mod##_get_cases, \
+        .pInit    = mod##_suite_init, \
+        .pClean   = mod##_suite_cleanup, \
+        .pSetUp   = NULL, \
+        .pTearDown= NULL \
+    }
 
 #define DEFINE_TESTSUITE_NULL \
     { \
@@ -75,11 +110,13 @@ typedef struct TestSuite {
 #include "client/suites.h"
 #include "drive/suites.h"
 #include "file/suites.h"
+#include "unit/suites.h"
 
 TestSuite suites[] = {
     DEFINE_CLIENT_TESTSUITES,
     DEFINE_DRIVE_TESTSUITES,
     DEFINE_FILE_TESTSUITES,
+    DEFINE_UNIT_TESTSUITES,
     DEFINE_TESTSUITE_NULL
 };
 
@@ -99,6 +99,15 @@ void config_deinit()
 
         free(global_config.ipfs_rpc_nodes);
     }
+
+    if (global_config.owncloud_url)
+        free(global_config.owncloud_url);
+
+    if (global_config.owncloud_username)
+        free(global_config.owncloud_username);
+
+    if (global_config.owncloud_password)
+        free(global_config.owncloud_password);
 }
 
 test_cfg_t *load_config(const char *config_file)
@@ -217,6 +226,19 @@ test_cfg_t *load_config(const char *config_file)
         global_config.ipfs_rpc_nodes[i] = node;
     }
 
+    // Optional, the ownCloud suites fail to initialize without it.
+    rc = config_lookup_string(&cfg, "owncloud.url", &stropt);
+    if (rc && *stropt)
+        global_config.owncloud_url = strdup(stropt);
+
+    rc = config_lookup_string(&cfg, "owncloud.username", &stropt);
+    if (rc && *stropt)
+        global_config.owncloud_username = strdup(stropt);
+
+    rc = config_lookup_string(&cfg, "owncloud.password", &stropt);
+    if (rc && *stropt)
+        global_config.owncloud_password = strdup(stropt);
+
     config_destroy(&cfg);
     return &global_config;
 }
@@ -35,6 +35,9 @@ typedef struct {
     int shuffle;
     int ipfs_rpc_nodes_sz;
     HiveRpcNode **ipfs_rpc_nodes;
+    char *owncloud_url;
+    char *owncloud_username;
+    char *owncloud_password;
 } test_cfg_t;
 
 extern test_cfg_t global_config;
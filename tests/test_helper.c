@@ -85,6 +85,32 @@ HiveClient *ipfs_client_new()
     return client;
 }
 
+HiveClient *native_client_new()
+{
+    HiveOptions options = {
+        .drive_type          = HiveDriveType_Native,
+        .persistent_location = global_config.data_dir
+    };
+
+    return hive_client_new(&options);
+}
+
+HiveClient *owncloud_client_new()
+{
+    OwnCloudOptions options = {
+        .base.drive_type          = HiveDriveType_ownCloud,
+        .base.persistent_location = global_config.data_dir,
+        .url                      = global_config.owncloud_url,
+        .username                 = global_config.owncloud_username,
+        .password                 = global_config.owncloud_password
+    };
+
+    if (!options.url)
+        return NULL;
+
+    return hive_client_new((HiveOptions *)&options);
+}
+
 int open_authorization_url(const char *url, void *context)
 {
 #if defined(_WIN32) || defined(_WIN64)
@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2019 Elastos Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <CUnit/Basic.h>
+
+#include "http_body.h"
+
+#define MIN_CLASS       512
+#define MAX_CLASS       (64 * 1024)
+#define CACHE_DEPTH     4
+
+static void test_size_class_selection(void)
+{
+    static const struct {
+        size_t request;
+        size_t expected;
+    } sizes[] = {
+        { 0,                MIN_CLASS     },
+        { 1,                MIN_CLASS     },
+        { MIN_CLASS,        MIN_CLASS     },
+        { MIN_CLASS + 1,    MIN_CLASS * 2 },
+        { 3000,             4096          },
+        { MAX_CLASS / 2 + 1, MAX_CLASS    },
+        { MAX_CLASS,        MAX_CLASS     }
+    };
+    size_t i;
+
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        char *buf = http_body_buffer_get(sizes[i].request);
+
+        CU_ASSERT_PTR_NOT_NULL_FATAL(buf);
+        CU_ASSERT_EQUAL(http_body_buffer_size(buf), sizes[i].expected);
+
+        // The whole capacity is usable.
+        memset(buf, 'x', http_body_buffer_size(buf));
+        http_body_buffer_put(buf);
+    }
+}
+
+static void test_reuse(void)
+{
+    char *buf1;
+    char *buf2;
+
+    buf1 = http_body_buffer_get(1000);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(buf1);
+    http_body_buffer_put(buf1);
+
+    // Any request of the same class takes the cached buffer back.
+    buf2 = http_body_buffer_get(600);
+    CU_ASSERT_TRUE(buf2 == buf1);
+    CU_ASSERT_EQUAL(http_body_buffer_size(buf2), 1024);
+    http_body_buffer_put(buf2);
+
+    // Other classes do not.
+    buf2 = http_body_buffer_get(2000);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(buf2);
+    CU_ASSERT_TRUE(buf2 != buf1);
+
+    buf1 = http_body_buffer_get(1024);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(buf1);
+
+    http_body_buffer_put(buf1);
+    http_body_buffer_put(buf2);
+}
+
+static void test_cache_depth(void)
+{
+    char *bufs[CACHE_DEPTH + 1];
+    char *buf;
+    int i;
+
+    for (i = 0; i <= CACHE_DEPTH; i++) {
+        bufs[i] = http_body_buffer_get(8192);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(bufs[i]);
+    }
+
+    // The last one does not fit in the cache and goes back to the heap.
+    for (i = 0; i <= CACHE_DEPTH; i++)
+        http_body_buffer_put(bufs[i]);
+
+    for (i = CACHE_DEPTH - 1; i >= 0; i--) {
+        buf = http_body_buffer_get(8192);
+        CU_ASSERT_TRUE(buf == bufs[i]);
+        bufs[i] = buf;
+    }
+
+    for (i = 0; i < CACHE_DEPTH; i++)
+        http_body_buffer_put(bufs[i]);
+}
+
+static void test_oversized_buffers(void)
+{
+    char *cached;
+    char *large;
+    char *buf;
+
+    large = http_body_buffer_get(MAX_CLASS + 1);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(large);
+
+    // Sized exactly, as no class is large enough.
+    CU_ASSERT_EQUAL(http_body_buffer_size(large), MAX_CLASS + 1);
+    memset(large, 'x', MAX_CLASS + 1);
+
+    cached = http_body_buffer_get(MAX_CLASS);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(cached);
+    http_body_buffer_put(cached);
+
+    // Freed rather than cached in the largest class.
+    http_body_buffer_put(large);
+    buf = http_body_buffer_get(MAX_CLASS);
+    CU_ASSERT_TRUE(buf == cached);
+    http_body_buffer_put(buf);
+
+    large = http_body_buffer_get(4 * MAX_CLASS);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(large);
+    CU_ASSERT_EQUAL(http_body_buffer_size(large), 4 * MAX_CLASS);
+    http_body_buffer_put(large);
+
+    CU_ASSERT_PTR_NULL(http_body_buffer_get(SIZE_MAX));
+}
+
+static CU_TestInfo cases[] = {
+    { "test_size_class_selection",  test_size_class_selection },
+    { "test_reuse",                 test_reuse                },
+    { "test_cache_depth",           test_cache_depth          },
+    { "test_oversized_buffers",     test_oversized_buffers    },
+    { NULL, NULL }
+};
+
+CU_TestInfo *http_body_test_get_cases(void)
+{
+    return cases;
+}
+
+int http_body_test_suite_init(void)
+{
+    return http_body_pool_init();
+}
+
+int http_body_test_suite_cleanup(void)
+{
+    return 0;
+}
@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2019 Elastos Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <CUnit/Basic.h>
+#include <crystal.h>
+
+#include "ipfs_cache.h"
+
+#define BLOCK_LEN       100
+#define CACHE_CAPACITY  (3 * BLOCK_LEN)
+
+static const char *hash1 = "QmXoypizjW3WknFiJnKLwHCnL72vedxjQkDDP1mXWo6uco";
+static const char *hash2 = "QmT78zSuBmuS4z925WZfrqQ1qHaJ56DQaTfyMUF7F8ff5o";
+
+static void put_block(ipfs_cache_t *cache, const char *hash, uint64_t block,
+                      char c)
+{
+    char buf[BLOCK_LEN];
+
+    memset(buf, c, sizeof(buf));
+    ipfs_cache_put(cache, hash, block, buf, sizeof(buf));
+}
+
+static bool has_block(ipfs_cache_t *cache, const char *hash, uint64_t block,
+                      char c)
+{
+    char buf[BLOCK_LEN];
+    size_t i;
+
+    if (ipfs_cache_get(cache, hash, block, 0, buf, sizeof(buf)) != BLOCK_LEN)
+        return false;
+
+    for (i = 0; i < sizeof(buf); i++) {
+        if (buf[i] != c)
+            return false;
+    }
+
+    return true;
+}
+
+static void test_get_miss_and_hit(void)
+{
+    ipfs_cache_t *cache;
+    char buf[BLOCK_LEN];
+
+    cache = ipfs_cache_new(CACHE_CAPACITY);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(cache);
+
+    CU_ASSERT_EQUAL(ipfs_cache_get(cache, hash1, 0, 0, buf, sizeof(buf)), -1);
+
+    put_block(cache, hash1, 0, 'a');
+    CU_ASSERT_TRUE(has_block(cache, hash1, 0, 'a'));
+    CU_ASSERT_EQUAL(ipfs_cache_get(cache, hash1, 1, 0, buf, sizeof(buf)), -1);
+
+    deref(cache);
+}
+
+static void test_get_with_offset(void)
+{
+    ipfs_cache_t *cache;
+    char buf[16];
+
+    cache = ipfs_cache_new(CACHE_CAPACITY);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(cache);
+
+    ipfs_cache_put(cache, hash1, 0, "0123456789", 10);
+
+    CU_ASSERT_EQUAL(ipfs_cache_get(cache, hash1, 0, 4, buf, 3), 3);
+    CU_ASSERT_NSTRING_EQUAL(buf, "456", 3);
+
+    // A short block ends the file, reads past its end get what is left.
+    CU_ASSERT_EQUAL(ipfs_cache_get(cache, hash1, 0, 7, buf, sizeof(buf)), 3);
+    CU_ASSERT_NSTRING_EQUAL(buf, "789", 3);
+    CU_ASSERT_EQUAL(ipfs_cache_get(cache, hash1, 0, 10, buf, sizeof(buf)), 0);
+
+    deref(cache);
+}
+
+static void test_lru_order(void)
+{
+    ipfs_cache_t *cache;
+
+    cache = ipfs_cache_new(CACHE_CAPACITY);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(cache);
+
+    put_block(cache, hash1, 0, 'a');
+    put_block(cache, hash1, 1, 'b');
+    put_block(cache, hash1, 2, 'c');
+
+    // Reading the oldest block leaves the second one least recently used.
+    CU_ASSERT_TRUE(has_block(cache, hash1, 0, 'a'));
+
+    put_block(cache, hash1, 3, 'd');
+    CU_ASSERT_FALSE(has_block(cache, hash1, 1, 'b'));
+    CU_ASSERT_TRUE(has_block(cache, hash1, 2, 'c'));
+    CU_ASSERT_TRUE(has_block(cache, hash1, 3, 'd'));
+    CU_ASSERT_TRUE(has_block(cache, hash1, 0, 'a'));
+
+    // The reads above left block 2 least recently used.
+    put_block(cache, hash1, 4, 'e');
+    CU_ASSERT_FALSE(has_block(cache, hash1, 2, 'c'));
+    CU_ASSERT_TRUE(has_block(cache, hash1, 3, 'd'));
+    CU_ASSERT_TRUE(has_block(cache, hash1, 0, 'a'));
+    CU_ASSERT_TRUE(has_block(cache, hash1, 4, 'e'));
+
+    deref(cache);
+}
+
+static void test_eviction_at_capacity(void)
+{
+    ipfs_cache_t *cache;
+    char big[CACHE_CAPACITY + 1];
+    uint64_t i;
+    int cached = 0;
+
+    cache = ipfs_cache_new(CACHE_CAPACITY);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(cache);
+    CU_ASSERT_EQUAL(ipfs_cache_get_capacity(cache), CACHE_CAPACITY);
+
+    for (i = 0; i < 10; i++)
+        put_block(cache, hash1, i, (char)('a' + i));
+
+    for (i = 0; i < 10; i++) {
+        if (has_block(cache, hash1, i, (char)('a' + i)))
+            cached++;
+    }
+
+    // Only the three most recent blocks fit.
+    CU_ASSERT_EQUAL(cached, 3);
+    CU_ASSERT_TRUE(has_block(cache, hash1, 7, 'h'));
+    CU_ASSERT_TRUE(has_block(cache, hash1, 8, 'i'));
+    CU_ASSERT_TRUE(has_block(cache, hash1, 9, 'j'));
+
+    // A block larger than the capacity is not cached and evicts nothing.
+    memset(big, 'z', sizeof(big));
+    ipfs_cache_put(cache, hash2, 0, big, sizeof(big));
+    CU_ASSERT_EQUAL(ipfs_cache_get(cache, hash2, 0, 0, big, sizeof(big)), -1);
+    CU_ASSERT_TRUE(has_block(cache, hash1, 9, 'j'));
+
+    // A block filling the whole capacity pushes out everything else.
+    ipfs_cache_put(cache, hash2, 0, big, CACHE_CAPACITY);
+    CU_ASSERT_EQUAL(ipfs_cache_get(cache, hash2, 0, 0, big, sizeof(big)),
+                    CACHE_CAPACITY);
+    CU_ASSERT_FALSE(has_block(cache, hash1, 7, 'h'));
+    CU_ASSERT_FALSE(has_block(cache, hash1, 8, 'i'));
+    CU_ASSERT_FALSE(has_block(cache, hash1, 9, 'j'));
+
+    deref(cache);
+}
+
+static void test_invalidation(void)
+{
+    ipfs_cache_t *cache;
+    char buf[BLOCK_LEN];
+    int i;
+
+    cache = ipfs_cache_new(CACHE_CAPACITY);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(cache);
+
+    put_block(cache, hash1, 0, 'a');
+    put_block(cache, hash1, 1, 'b');
+
+    // Putting a cached block again replaces it without growing the cache.
+    for (i = 0; i < 5; i++) {
+        put_block(cache, hash1, 0, (char)('p' + i));
+        CU_ASSERT_TRUE(has_block(cache, hash1, 0, (char)('p' + i)));
+    }
+    CU_ASSERT_TRUE(has_block(cache, hash1, 1, 'b'));
+
+    // A modified file has a new content hash and never hits stale blocks.
+    CU_ASSERT_EQUAL(ipfs_cache_get(cache, hash2, 0, 0, buf, sizeof(buf)), -1);
+    put_block(cache, hash2, 0, 'n');
+    CU_ASSERT_TRUE(has_block(cache, hash2, 0, 'n'));
+    CU_ASSERT_TRUE(has_block(cache, hash1, 0, 't'));
+    CU_ASSERT_TRUE(has_block(cache, hash1, 1, 'b'));
+
+    deref(cache);
+}
+
+static CU_TestInfo cases[] = {
+    { "test_get_miss_and_hit",      test_get_miss_and_hit     },
+    { "test_get_with_offset",       test_get_with_offset      },
+    { "test_lru_order",             test_lru_order            },
+    { "test_eviction_at_capacity",  test_eviction_at_capacity },
+    { "test_invalidation",          test_invalidation         },
+    { NULL, NULL }
+};
+
+CU_TestInfo *ipfs_cache_test_get_cases(void)
+{
+    return cases;
+}
+
+int ipfs_cache_test_suite_init(void)
+{
+    return 0;
+}
+
+int ipfs_cache_test_suite_cleanup(void)
+{
+    return 0;
+}
@@ -0,0 +1,260 @@
+/*
+ * Copyright (c) 2019 Elastos Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <CUnit/Basic.h>
+
+#include "json_scanner.h"
+
+#define EVENTS_LEN      2048
+
+/*
+ * Every event is recorded as "depth:key:type=value;" so that a scan can be
+ * checked against the expected events in one comparison.
+ */
+typedef struct {
+    char events[EVENTS_LEN];
+    int stop_after;
+    int count;
+} recorder;
+
+static const char *type_names[] = {
+    "string", "number", "true", "false", "null", "object", "array", "end"
+};
+
+static bool record_cb(int depth, const char *key, json_scan_type_t type,
+                      const char *value, void *context)
+{
+    recorder *rec = (recorder *)context;
+    size_t len = strlen(rec->events);
+
+    snprintf(rec->events + len, sizeof(rec->events) - len, "%d:%s:%s=%s;",
+             depth, key ? key : "", type_names[type], value ? value : "");
+
+    return ++rec->count != rec->stop_after;
+}
+
+/*
+ * Feed the document in chunks of chunk_len bytes, then finish the scan.
+ */
+static int scan(const char *doc, size_t chunk_len, recorder *rec)
+{
+    json_scanner_t *scanner;
+    size_t len = strlen(doc);
+    size_t off;
+    int rc = 0;
+
+    memset(rec->events, 0, sizeof(rec->events));
+    rec->count = 0;
+
+    scanner = json_scanner_new("value", record_cb, rec);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(scanner);
+
+    for (off = 0; off < len && rc == 0; off += chunk_len) {
+        size_t n = len - off < chunk_len ? len - off : chunk_len;
+        rc = json_scanner_feed(scanner, doc + off, n);
+    }
+
+    if (rc >= 0)
+        rc = json_scanner_finish(scanner);
+
+    json_scanner_delete(scanner);
+    return rc;
+}
+
+/*
+ * Every split of the document must give the same events as a single
+ * chunk, whatever token the chunk boundaries fall into.
+ */
+static void check_all_chunkings(const char *doc, const char *expected)
+{
+    recorder rec = { .stop_after = 0 };
+    size_t chunk_len;
+
+    for (chunk_len = 1; chunk_len <= strlen(doc); chunk_len++) {
+        CU_ASSERT_EQUAL(scan(doc, chunk_len, &rec), 0);
+        CU_ASSERT_STRING_EQUAL(rec.events, expected);
+    }
+}
+
+static void test_scan_listing(void)
+{
+    static const char *doc =
+        "{\"@odata.count\": 2, \"value\": ["
+        "{\"name\": \"a.txt\", \"size\": 12, \"deleted\": false},"
+        "{\"name\": \"docs\", \"folder\": {\"childCount\": 3}, \"size\": 0}"
+        "], \"@odata.nextLink\": null}";
+
+    check_all_chunkings(doc,
+        "0:@odata.count:number=2;"
+        "0:value:array=;"
+        "1:name:string=a.txt;1:size:number=12;1:deleted:false=false;1::end=;"
+        "1:name:string=docs;1:folder:object=;1:size:number=0;1::end=;"
+        "0:@odata.nextLink:null=;");
+}
+
+static void test_tokens_across_chunks(void)
+{
+    // Literals, numbers and keys end right where the chunks may split.
+    static const char *doc =
+        "{\"value\":[{\"longkeyname\":-1.5e+10,\"t\":true,\"n\":null}],"
+        "\"flag\":true}";
+
+    check_all_chunkings(doc,
+        "0:value:array=;"
+        "1:longkeyname:number=-1.5e+10;1:t:true=true;1:n:null=;1::end=;"
+        "0:flag:true=true;");
+}
+
+static void test_escapes(void)
+{
+    static const char *doc =
+        "{\"value\":[{\"name\":\"q\\\"b\\\\s\\/n\\nt\\tr\\r\","
+        "\"u\":\"\\u0041\\u00e9\\u20ac\",\"k\\u0065y\":\"x\"}]}";
+
+    check_all_chunkings(doc,
+        "0:value:array=;"
+        "1:name:string=q\"b\\s/n\nt\tr\r;"
+        "1:u:string=A\xc3\xa9\xe2\x82\xac;"
+        "1:key:string=x;1::end=;");
+}
+
+static void test_surrogate_pairs(void)
+{
+    static const char *doc =
+        "{\"value\":[{\"pair\":\"\\ud83d\\ude00\","
+        "\"lone\":\"\\ud83dx\",\"low\":\"\\ude00\"}]}";
+
+    // Unpaired surrogates decode to the replacement character.
+    check_all_chunkings(doc,
+        "0:value:array=;"
+        "1:pair:string=\xf0\x9f\x98\x80;"
+        "1:lone:string=\xef\xbf\xbdx;"
+        "1:low:string=\xef\xbf\xbd;1::end=;");
+}
+
+static void test_nested_containers(void)
+{
+    // Nested content is skipped, even when it looks like the listing.
+    static const char *doc =
+        "{\"meta\":{\"value\":[{\"name\":\"no\"}]},"
+        "\"value\":[{\"name\":\"a\",\"deep\":{\"value\":[[1,{\"x\":\"}]\"}],{}]},"
+        "\"list\":[\"[\",{\"name\":\"no\"}],\"size\":1},{}],"
+        "\"tail\":[1,2]}";
+
+    check_all_chunkings(doc,
+        "0:meta:object=;"
+        "0:value:array=;"
+        "1:name:string=a;1:deep:object=;1:list:array=;1:size:number=1;"
+        "1::end=;1::end=;"
+        "0:tail:array=;");
+}
+
+static void test_stop_scanning(void)
+{
+    static const char *doc =
+        "{\"value\":[{\"name\":\"a\"},{\"name\":\"b\"},{\"name\":\"c\"}]}";
+    recorder rec = { .stop_after = 4 };
+    size_t chunk_len;
+
+    for (chunk_len = 1; chunk_len <= strlen(doc); chunk_len++) {
+        CU_ASSERT_EQUAL(scan(doc, chunk_len, &rec), 1);
+        CU_ASSERT_STRING_EQUAL(rec.events,
+            "0:value:array=;1:name:string=a;1::end=;1:name:string=b;");
+    }
+}
+
+static void test_malformed_documents(void)
+{
+    static const char *docs[] = {
+        "[]",
+        "{\"value\":[1]}",
+        "{\"value\":[{\"name\":\"a\"}]",
+        "{\"name\":\"a\" \"size\":1}",
+        "{\"name\":\"a\\q\"}",
+        "{\"name\":\"\\u00zz\"}",
+        "{\"name\":\"a\"}}",
+        "{\"flag\":maybe}",
+        "{\"name\":\"a\"} {}",
+    };
+    recorder rec = { .stop_after = 0 };
+    size_t i;
+
+    for (i = 0; i < sizeof(docs) / sizeof(docs[0]); i++) {
+        CU_ASSERT_TRUE(scan(docs[i], 1, &rec) < 0);
+        CU_ASSERT_TRUE(scan(docs[i], strlen(docs[i]), &rec) < 0);
+    }
+}
+
+static void test_reset(void)
+{
+    static const char *page1 = "{\"value\":[{\"name\":\"a\"}],\"next\":\"p2\"}";
+    static const char *page2 = "{\"value\":[{\"name\":\"b\"}]}";
+    recorder rec = { .stop_after = 0 };
+    json_scanner_t *scanner;
+
+    scanner = json_scanner_new("value", record_cb, &rec);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(scanner);
+
+    CU_ASSERT_EQUAL(json_scanner_feed(scanner, page1, strlen(page1)), 0);
+    CU_ASSERT_EQUAL(json_scanner_finish(scanner), 0);
+
+    // The next page is a document of its own.
+    json_scanner_reset(scanner);
+    CU_ASSERT_EQUAL(json_scanner_feed(scanner, page2, strlen(page2)), 0);
+    CU_ASSERT_EQUAL(json_scanner_finish(scanner), 0);
+
+    CU_ASSERT_STRING_EQUAL(rec.events,
+        "0:value:array=;1:name:string=a;1::end=;0:next:string=p2;"
+        "0:value:array=;1:name:string=b;1::end=;");
+
+    json_scanner_delete(scanner);
+}
+
+static CU_TestInfo cases[] = {
+    { "test_scan_listing",          test_scan_listing         },
+    { "test_tokens_across_chunks",  test_tokens_across_chunks },
+    { "test_escapes",               test_escapes              },
+    { "test_surrogate_pairs",       test_surrogate_pairs      },
+    { "test_nested_containers",     test_nested_containers    },
+    { "test_stop_scanning",         test_stop_scanning        },
+    { "test_malformed_documents",   test_malformed_documents  },
+    { "test_reset",                 test_reset                },
+    { NULL, NULL }
+};
+
+CU_TestInfo *json_scanner_test_get_cases(void)
+{
+    return cases;
+}
+
+int json_scanner_test_suite_init(void)
+{
+    return 0;
+}
+
+int json_scanner_test_suite_cleanup(void)
+{
+    return 0;
+}
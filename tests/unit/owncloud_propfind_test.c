@@ -0,0 +1,272 @@
+/*
+ * Copyright (c) 2019 Elastos Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <CUnit/Basic.h>
+
+#include "owncloud_propfind.h"
+
+#define ENTRIES_LEN     2048
+
+/*
+ * Every entry is recorded as "href:fileid:d|f:size;" so that a parse can
+ * be checked against the expected entries in one comparison.
+ */
+typedef struct {
+    char entries[ENTRIES_LEN];
+    int stop_after;
+    int count;
+} recorder;
+
+static bool record_cb(const owncloud_entry_t *entry, void *context)
+{
+    recorder *rec = (recorder *)context;
+    size_t len = strlen(rec->entries);
+
+    snprintf(rec->entries + len, sizeof(rec->entries) - len, "%s:%s:%s:%zu;",
+             entry->href, entry->fileid, entry->is_dir ? "d" : "f",
+             entry->size);
+
+    return ++rec->count != rec->stop_after;
+}
+
+/*
+ * Feed the body in chunks of chunk_len bytes, stopping at the first
+ * nonzero result.
+ */
+static int parse(const char *body, size_t chunk_len, recorder *rec)
+{
+    owncloud_propfind_t *parser;
+    size_t len = strlen(body);
+    size_t off;
+    int rc = 0;
+
+    memset(rec->entries, 0, sizeof(rec->entries));
+    rec->count = 0;
+
+    parser = owncloud_propfind_new(record_cb, rec);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+
+    for (off = 0; off < len && rc == 0; off += chunk_len) {
+        size_t n = len - off < chunk_len ? len - off : chunk_len;
+        rc = owncloud_propfind_feed(parser, body + off, n);
+    }
+
+    owncloud_propfind_delete(parser);
+    return rc;
+}
+
+/*
+ * Every split of the body must give the same entries as a single chunk,
+ * whatever tag, entity or section the chunk boundaries fall into.
+ */
+static void check_all_chunkings(const char *body, const char *expected)
+{
+    recorder rec = { .stop_after = 0 };
+    size_t chunk_len;
+
+    for (chunk_len = 1; chunk_len <= strlen(body); chunk_len++) {
+        CU_ASSERT_EQUAL(parse(body, chunk_len, &rec), 0);
+        CU_ASSERT_STRING_EQUAL(rec.entries, expected);
+    }
+}
+
+#define MULTISTATUS(responses) \
+    "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n" \
+    "<d:multistatus xmlns:d=\"DAV:\" xmlns:oc=\"http://owncloud.org/ns\">" \
+    responses \
+    "</d:multistatus>"
+
+#define DIR_RESPONSE(href, fileid) \
+    "<d:response><d:href>" href "</d:href><d:propstat><d:prop>" \
+    "<d:resourcetype><d:collection/></d:resourcetype>" \
+    "<oc:fileid>" fileid "</oc:fileid>" \
+    "</d:prop><d:status>HTTP/1.1 200 OK</d:status></d:propstat>" \
+    "</d:response>"
+
+#define FILE_RESPONSE(href, fileid, size) \
+    "<d:response><d:href>" href "</d:href><d:propstat><d:prop>" \
+    "<d:resourcetype/><d:getcontentlength>" size "</d:getcontentlength>" \
+    "<oc:fileid>" fileid "</oc:fileid>" \
+    "</d:prop><d:status>HTTP/1.1 200 OK</d:status></d:propstat>" \
+    "</d:response>"
+
+static void test_parse_listing(void)
+{
+    static const char *body = MULTISTATUS(
+        DIR_RESPONSE("/remote.php/webdav/docs/", "00000010")
+        FILE_RESPONSE("/remote.php/webdav/docs/a.txt", "00000011", "12")
+        DIR_RESPONSE("/remote.php/webdav/docs/sub/", "00000012"));
+
+    check_all_chunkings(body,
+        "/remote.php/webdav/docs/:00000010:d:0;"
+        "/remote.php/webdav/docs/a.txt:00000011:f:12;"
+        "/remote.php/webdav/docs/sub/:00000012:d:0;");
+}
+
+static void test_markup_sections(void)
+{
+    // Markup inside comments and CDATA must not be taken for elements.
+    static const char *body = MULTISTATUS(
+        "<!-- <d:response><d:href>/no</d:href></d:response> -->"
+        "<!DOCTYPE multistatus>"
+        "<d:response>"
+        "<d:href><![CDATA[/remote.php/webdav/<a>]]b.txt]]></d:href>"
+        "<d:propstat><d:prop>"
+        "<d:resourcetype/>"
+        "<d:getcontentlength><!-- 99 -->7</d:getcontentlength>"
+        "<oc:fileid attr='>'>id1</oc:fileid>"
+        "<?pi <d:collection/> ?>"
+        "</d:prop><d:status>HTTP/1.1 200 OK</d:status></d:propstat>"
+        "</d:response>");
+
+    check_all_chunkings(body, "/remote.php/webdav/<a>]]b.txt:id1:f:7;");
+}
+
+static void test_entities(void)
+{
+    static const char *body = MULTISTATUS(
+        FILE_RESPONSE("/dav/a%20b&amp;c&lt;&gt;&quot;&apos;.txt",
+                      "&#65;&#x42;&#xe9;&#8364;", "1")
+        FILE_RESPONSE("/dav/&unknown;&#0;&#x110000;", "id", "2"));
+
+    // Unknown entities and invalid code points are kept verbatim.
+    check_all_chunkings(body,
+        "/dav/a b&c<>\"'.txt:AB\xc3\xa9\xe2\x82\xac:f:1;"
+        "/dav/&unknown;&#0;&#x110000;:id:f:2;");
+}
+
+static void test_missing_properties(void)
+{
+    // Properties the server can not provide come back in a 404 propstat,
+    // whose empty elements must not override the values found earlier.
+    static const char *body = MULTISTATUS(
+        "<d:response><d:href>/dav/a.txt</d:href>"
+        "<d:propstat><d:prop>"
+        "<d:resourcetype/><d:getcontentlength>5</d:getcontentlength>"
+        "<d:getetag>\"etag1\"</d:getetag>"
+        "</d:prop><d:status>HTTP/1.1 200 OK</d:status></d:propstat>"
+        "<d:propstat><d:prop>"
+        "<oc:fileid/><d:getcontentlength/>"
+        "</d:prop><d:status>HTTP/1.1 404 Not Found</d:status></d:propstat>"
+        "</d:response>"
+        "<d:response><d:href>/dav/dir/</d:href>"
+        "<d:propstat><d:prop>"
+        "<d:getcontentlength/>"
+        "</d:prop><d:status>HTTP/1.1 404 Not Found</d:status></d:propstat>"
+        "<d:propstat><d:prop>"
+        "<d:resourcetype><d:collection/></d:resourcetype>"
+        "<oc:fileid>id2</oc:fileid>"
+        "</d:prop><d:status>HTTP/1.1 200 OK</d:status></d:propstat>"
+        "</d:response>");
+
+    // The etag stands in for a missing fileid.
+    check_all_chunkings(body,
+        "/dav/a.txt:\"etag1\":f:5;"
+        "/dav/dir/:id2:d:0;");
+}
+
+static void test_entry_reset(void)
+{
+    // Nothing of an entry leaks into the next one.
+    static const char *body = MULTISTATUS(
+        DIR_RESPONSE("/dav/dir/", "id1")
+        "<d:response><d:href>/dav/b</d:href></d:response>");
+
+    check_all_chunkings(body, "/dav/dir/:id1:d:0;/dav/b::f:0;");
+}
+
+static void test_absolute_urls(void)
+{
+    static const char *body = MULTISTATUS(
+        DIR_RESPONSE("https://cloud.example.com/remote.php/webdav/", "id1")
+        FILE_RESPONSE("http://cloud.example.com:8080/remote.php/webdav/a%2Bb",
+                      "id2", "3")
+        FILE_RESPONSE("https://cloud.example.com", "id3", "4"));
+
+    check_all_chunkings(body,
+        "/remote.php/webdav/:id1:d:0;"
+        "/remote.php/webdav/a+b:id2:f:3;"
+        "/:id3:f:4;");
+}
+
+static void test_stop_parsing(void)
+{
+    static const char *body = MULTISTATUS(
+        FILE_RESPONSE("/dav/a", "id1", "1")
+        FILE_RESPONSE("/dav/b", "id2", "2")
+        FILE_RESPONSE("/dav/c", "id3", "3"));
+    recorder rec = { .stop_after = 2 };
+    size_t chunk_len;
+
+    for (chunk_len = 1; chunk_len <= strlen(body); chunk_len++) {
+        CU_ASSERT_EQUAL(parse(body, chunk_len, &rec), 1);
+        CU_ASSERT_STRING_EQUAL(rec.entries, "/dav/a:id1:f:1;/dav/b:id2:f:2;");
+    }
+}
+
+static void test_malformed_bodies(void)
+{
+    static char body[8192];
+    recorder rec = { .stop_after = 0 };
+    size_t len;
+
+    // A property too long to be held fails the parse.
+    len = sprintf(body, "%s", "<d:multistatus xmlns:d=\"DAV:\">"
+                  "<d:response><d:href>/dav/");
+    memset(body + len, 'a', 5000);
+    strcpy(body + len + 5000, "</d:href></d:response></d:multistatus>");
+
+    CU_ASSERT_TRUE(parse(body, 1, &rec) < 0);
+    CU_ASSERT_TRUE(parse(body, 1000, &rec) < 0);
+    CU_ASSERT_TRUE(parse(body, strlen(body), &rec) < 0);
+    CU_ASSERT_EQUAL(rec.count, 0);
+}
+
+static CU_TestInfo cases[] = {
+    { "test_parse_listing",       test_parse_listing      },
+    { "test_markup_sections",     test_markup_sections    },
+    { "test_entities",            test_entities           },
+    { "test_missing_properties",  test_missing_properties },
+    { "test_entry_reset",         test_entry_reset        },
+    { "test_absolute_urls",       test_absolute_urls      },
+    { "test_stop_parsing",        test_stop_parsing       },
+    { "test_malformed_bodies",    test_malformed_bodies   },
+    { NULL, NULL }
+};
+
+CU_TestInfo *owncloud_propfind_test_get_cases(void)
+{
+    return cases;
+}
+
+int owncloud_propfind_test_suite_init(void)
+{
+    return 0;
+}
+
+int owncloud_propfind_test_suite_cleanup(void)
+{
+    return 0;
+}